@@ -821,22 +821,9 @@ CM_STAT cmp_isbn_13 (
 	  return CM_STAT_KILL_RECORD;
 
 	/*===================================================================*/
-	/* First, allocate space for ISBN13...                               */
+	/* First, allocate space for ISBN13, good until the record is done...*/
 	/*===================================================================*/
-
-
-#ifdef DEBUG
-	if ((tsrc2 = (char *) marc_alloc(src_len+4, 100)) == NULL) {   // TAG:100
-	    cm_error(CM_ERROR, "Error allocating memory for ISBN13 processing. " "Record not processed...");
-	    return CM_STAT_KILL_RECORD;
-	}
-#else
-	if ((tsrc2 = (char *)malloc(src_len+4)) == NULL) {
-	  cm_error(CM_ERROR, "Error allocating memory for ISBN13 processing. "
-		   "Record not processed...");
-	  return CM_STAT_KILL_RECORD;
-	}
-#endif
+	tsrc2 = (char *) cmp_alloc(pp, src_len+4);
 
 	memset(tsrc2, '\0', src_len+4);
 
@@ -1903,20 +1890,9 @@ CM_STAT cmp_punc_245 (
       socc++) {
 
     /*=======================================================================*/
-    /* Allocate memory based on size of source string...                     */
+    /* Allocate memory based on size of source string, for this record...    */
     /*=======================================================================*/
-
-#ifdef DEBUG
-    if ((tmpp = (char *) marc_alloc(src_len+4, 101)) == NULL) {   // TAG:101
-        cm_error(CM_ERROR, "Error allocating memory for 245 processing. " "Record not processed");
-        return CM_STAT_KILL_RECORD;
-    }
-#else
-    if ((tmpp = (char *)malloc(src_len+4)) == NULL) {
-      cm_error(CM_ERROR, "Error allocating memory for 245 processing. " "Record not processed");
-      return CM_STAT_KILL_RECORD;
-    }
-#endif
+    tmpp = (char *) cmp_alloc(pp, src_len+4);
 
     memset(tmpp, '\0', src_len+4);
 
@@ -2030,9 +2006,7 @@ CM_STAT cmp_checkdups (
     /*=======================================================================*/
     /* We want to look at the $a data...                                     */
     /*=======================================================================*/
-    if(allocate_n_ncopy(&src2,tsrc_len,1,(char *)tsrcp,
-			NO_COLLAPSE_SPACES,pp->args[0])!=0)
-      return CM_STAT_KILL_RECORD;
+    arena_n_ncopy(pp,&src2,tsrc_len,1,(char *)tsrcp,NO_COLLAPSE_SPACES);
 
     srcp = (char *)tsrcp;
     src_len = strlen(srcp);
@@ -2046,17 +2020,7 @@ CM_STAT cmp_checkdups (
     /* concatenate $a & $x together with '!' separator                       */
     /*=======================================================================*/
     if(tmp1len>0) {
-
-#ifdef DEBUG
-        marc_dealloc(src2, 102);  //TAG:102
-#else
-        free(src2);
-#endif
-
-		src2 = NULL;
-
-        if(allocate_n_ncopy(&src2,tsrc_len,tmp1len+1,(char *)tsrcp, NO_COLLAPSE_SPACES,pp->args[0])!=0)
-	        return CM_STAT_KILL_RECORD;
+        arena_n_ncopy(pp,&src2,tsrc_len,tmp1len+1,(char *)tsrcp,NO_COLLAPSE_SPACES);
 
         strcat(src2,"!");
         strncat(src2,(char *)tmp1,tmp1len);
@@ -2088,7 +2052,7 @@ CM_STAT cmp_checkdups (
       /*=======================================================================*/
       /* Allocate space for each part and place them into decode element       */
       /*=======================================================================*/
-      if ((rc=allocate_n_copy(&tmpp, srcp, "")) == 0)
+      if ((rc=arena_n_copy(pp, &tmpp, srcp)) == 0)
 	DupChkTbl[entry_cnt++] = tmpp;
     }
 
@@ -2102,12 +2066,6 @@ CM_STAT cmp_checkdups (
   for (;entry_cnt > 0; entry_cnt--) {
       printf ("ENTRY #%d\tENTRY CONTENT: '%s'\n", entry_cnt, DupChkTbl[entry_cnt]);
 
-#ifdef DEBUG
-      marc_dealloc(DupChkTbl[entry_cnt], 103);  //TAG:103
-#else
-      free(DupChkTbl[entry_cnt]);
-#endif
-
       DupChkTbl[entry_cnt] = '\0';
   }
 
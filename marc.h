@@ -39,6 +39,7 @@ extern "C" {
 
 #include <stdlib.h>                 /* For size_t                   */
 #include <stdio.h>
+#include <sys/types.h>              /* For off_t                    */
 #ifdef MCK
 #include <memcheck.h>
 #endif
@@ -55,6 +56,34 @@ extern "C" {
 *********************************************************************/
 typedef struct marcctl * MARCP;
 
+/*********************************************************************
+* MARCMAPP                                                           *
+*   Handle for a sequential marc file mapped into memory, see        *
+*   marc_map_open().  Also an incomplete type.                       *
+*********************************************************************/
+typedef struct marcmap * MARCMAPP;
+
+/*********************************************************************
+* MARCBLKP                                                           *
+*   Handle for a sequential marc file read in large blocks, see      *
+*   marc_blk_open().  Also an incomplete type.                       *
+*********************************************************************/
+typedef struct marcblk * MARCBLKP;
+
+/*********************************************************************
+* MARCWRTP                                                           *
+*   Handle for a sequential marc file written by a separate writer   *
+*   thread, see marc_wrt_open().  Also an incomplete type.           *
+*********************************************************************/
+typedef struct marcwrt * MARCWRTP;
+
+/*********************************************************************
+* MARCIDXP                                                           *
+*   Handle for a sidecar record offset index, see marc_idx_build().  *
+*   Also an incomplete type.                                         *
+*********************************************************************/
+typedef struct marcidx * MARCIDXP;
+
 
 /*********************************************************************
 *   Constants                                                        *
@@ -151,6 +180,18 @@ typedef struct marcctl * MARCP;
 #define MARC_ERR_CHK_PARM   (-4065) /* Internal err marc_xcheck_data*/
 #define MARC_ERR_SAME_REC   (-4066) /* Attempt to copy into same rec*/
 #define MARC_ERR_DIFF_FLD   (-4067) /* Can't copy fld to diff field */
+#define MARC_ERR_MAP_OPEN   (-4068) /* Can't open file to map       */
+#define MARC_ERR_MAP        (-4069) /* mmap/munmap failed           */
+#define MARC_ERR_BLK_OPEN   (-4070) /* Can't open file to blk read  */
+#define MARC_ERR_WRT_OPEN   (-4071) /* Can't open file for wrt thrd */
+#define MARC_ERR_WRT_THREAD (-4072) /* Can't start writer thread    */
+#define MARC_ERR_IDX_OPEN   (-4073) /* Can't open/create index file */
+#define MARC_ERR_IDX_WRITE  (-4074) /* Error writing index file     */
+#define MARC_ERR_IDX_STALE  (-4075) /* Index doesn't match marc file*/
+#define MARC_ERR_IDX_RANGE  (-4076) /* Record number not in index   */
+#define MARC_ERR_SEEK       (-4077) /* Can't seek to record offset  */
+#define MARC_ERR_NON_CURSOR (-4078) /* Refresh of non marc_cursor() */
+#define MARC_ERR_SFD_SHARE  (-4079) /* Cursor can't share its sfdir */
 
 
 /*********************************************************************
@@ -166,6 +207,7 @@ typedef struct marcctl * MARCP;
 #define MARC_RET_FX_LENGTH    4008  /* No req. length in fixed field*/
 #define MARC_RET_NO_POS       4009  /* No current field, can't save */
 #define MARC_RET_NO_SAVE_POS  4010  /* Saved pos gone, can't restore*/
+#define MARC_RET_RAW_SUBFLD   4011  /* Can't raw copy, copy by sfs  */
 
 
 /*********************************************************************
@@ -175,10 +217,14 @@ int marc_init               (MARCP *);
 int marc_free               (MARCP);
 int marc_new                (MARCP);
 int marc_old                (MARCP, unsigned char *);
+int marc_old_map            (MARCP, unsigned char *);
 int marc_dup                (MARCP, MARCP *);
+int marc_cursor             (MARCP, MARCP *);
 int marc_add_field          (MARCP, int);
 int marc_add_subfield       (MARCP, int, unsigned char *, size_t);
 int marc_copy_field         (MARCP, MARCP, int);
+int marc_copy_raw_field     (MARCP, MARCP, int);
+int marc_ok_raw_record      (MARCP, char *);
 int marc_get_record         (MARCP, unsigned char **, size_t *);
 int marc_get_field          (MARCP, int, int, unsigned char **, size_t *);
 int marc_get_subfield       (MARCP, int, int, unsigned char **, size_t *);
@@ -199,6 +245,8 @@ int marc_del_subfield       (MARCP);
 int marc_field_sort         (MARCP, int);
 int marc_field_order        (MARCP, int, int);
 int marc_subfield_sort      (MARCP, int);
+int marc_subfield_index     (MARCP, int);
+int marc_share_sfdir        (MARCP, MARCP);
 int marc_subfield_order     (MARCP, int, int);
 int marc_set_collate        (MARCP, char *);
 int marc_cur_field_count    (MARCP, int *);
@@ -219,6 +267,23 @@ int marc_read_rec           (FILE *, unsigned char *, size_t, int *);
 int marc_read_rec           (FILE *, unsigned char *, size_t);
 #endif
 int marc_write_rec          (FILE *, void *);
+int marc_map_open           (char *, MARCMAPP *);
+int marc_map_read           (MARCMAPP, unsigned char **, size_t *);
+int marc_map_seek           (MARCMAPP, off_t);
+int marc_map_close          (MARCMAPP);
+int marc_blk_open           (char *, size_t, MARCBLKP *);
+int marc_blk_read           (MARCBLKP, unsigned char **, size_t *);
+int marc_blk_seek           (MARCBLKP, off_t);
+int marc_blk_close          (MARCBLKP);
+int marc_wrt_open           (char *, char *, size_t, MARCWRTP *);
+int marc_wrt_rec            (MARCWRTP, void *);
+int marc_wrt_flush          (MARCWRTP, int);
+int marc_wrt_close          (MARCWRTP);
+int marc_idx_build          (char *, char *, int);
+int marc_idx_open           (char *, char *, MARCIDXP *);
+int marc_idx_count          (MARCIDXP, long *);
+int marc_idx_get            (MARCIDXP, long, off_t *, size_t *, char **);
+int marc_idx_close          (MARCIDXP);
 
 #ifdef  __cplusplus
 }
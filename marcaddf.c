@@ -72,7 +72,7 @@ int marc_add_field (
 
         /* Re-size field directory */
         if (marc_xallocate ((void **) &mp->fdirp, (void **) NULL,
-                            (size_t *) &mp->field_max,
+                            &mp->field_max,
                             mp->field_max + MARC_DFT_DIRINC,
                             sizeof(FLDDIR)) != 0)
             return MARC_ERR_DIRALLOC;
@@ -83,8 +83,11 @@ int marc_add_field (
     dp->tag      = field_id;
     dp->offset   = mp->raw_datalen;
     dp->len      = 0;
+    dp->room     = 0;
     dp->order    = mp->field_count;
     dp->pos_bits = 0;
+    dp->sfix_first = MARC_NO_SFIX;
+    dp->sfix_cnt   = MARC_NO_SFIX;
 
     /* Create defaults for variable length fields */
     if (field_id >= MARC_FIRST_VARFIELD) {
@@ -103,6 +106,7 @@ int marc_add_field (
         *datap++ = ' ';
         *datap   = ' ';
         dp->len  = 2;
+        dp->room = 2;
         mp->raw_datalen += 2;
 
         /* Assume default subfield collation */
@@ -112,6 +116,7 @@ int marc_add_field (
 
     /* Set current and next fields */
     mp->cur_field = mp->field_count++;
+    marc_xtag_add (mp, mp->cur_field);
 
     /* Any field parse is no longer guaranteed accurate.
      * We could get more specific here to only invalidate it if it
@@ -77,15 +77,13 @@ int marc_add_subfield (
 ) {
     FLDDIR  *dp;            /* Ptr to directory entry   */
     ADDTYPE add_type;       /* Fixed, var, or indics    */
-    int     i,              /* Field loop counter       */
-            add_len,        /* Adding this many bytes   */
+    int     add_len,        /* Adding this many bytes   */
             stat;           /* Return code from func    */
-    size_t  new_buflen,     /* New size if buf too small*/
-            data_offset;    /* Offset to insertion point*/
+    size_t  data_offset,    /* Insertion point in field */
+            shift_offset;   /* Shift field from here    */
     unsigned char *insertp, /* Insert data here         */
             *shiftp,        /* Shift from here          */
-            *srcp,          /* Right end of shift       */
-            *destp;         /* To here                  */
+            *destp;         /* Pad to here              */
 
 
     /* Test, return if failed */
@@ -102,8 +100,8 @@ int marc_add_subfield (
     /* These initializations aren't needed, but they silence warnings
      *   from the Microsoft compiler
      */
-    data_offset = 0;
-    shiftp      = NULL;
+    data_offset  = 0;
+    shift_offset = 0;
 
     /* Get length of data to add */
     if (datalen == MARC_SF_STRLEN)
@@ -161,10 +159,10 @@ int marc_add_subfield (
             add_len = datalen + 2;
 
             /* Data will be appended to the end of the current field */
-            data_offset = dp->offset + dp->len;
+            data_offset = dp->len;
 
-            /* We shift data if necessary to make room for it */
-            shiftp = mp->rawbufp + data_offset;
+            /* So there's nothing in the field to shift */
+            shift_offset = dp->len;
 
             break;
 
@@ -182,45 +180,34 @@ int marc_add_subfield (
             if ((add_len = sf_code + datalen - dp->len) < 0)
                 add_len = 0;
 
-            /* Data inserted at passed offset, adjusted for origin */
-            data_offset = dp->offset + sf_code;
+            /* Data inserted at passed offset, origin 0 */
+            data_offset = sf_code;
 
             /* We shift data from the data offset, or end of field,
              *   whichever is less.
              * This is because end of field may be before data offset
              */
-            shiftp = mp->rawbufp + data_offset;
-            if (shiftp > mp->rawbufp + dp->offset + dp->len)
-                shiftp = mp->rawbufp + dp->offset + dp->len;
+            shift_offset = data_offset;
+            if (shift_offset > dp->len)
+                shift_offset = dp->len;
     }
 
-    /* If too small, increase raw buffer */
-    new_buflen = mp->raw_datalen + add_len + 1;
-    if (new_buflen >= mp->raw_buflen) {
-
-        /* Marc limits overall record by 5 char ASCII record length */
-        if (new_buflen > (size_t) MARC_MAX_MARCDATA)
-            return MARC_ERR_RECLEN;
-
-        /* Test buffer and get larger if needed */
-        if (marc_xallocate ((void **) &mp->rawbufp, (void **) &mp->endrawp,
-                            &mp->raw_buflen, new_buflen,
-                            sizeof(unsigned char)) != 0)
-            return MARC_ERR_RAWALLOC;
+    /* Make room in the field.
+     * Only this field's bytes are shifted, never the rest of the
+     *   record.  The field may move to get the room, see marc_xroom().
+     */
+    if (add_len > 0) {
+        if ((stat = marc_xroom (mp, dp, (size_t) add_len)) != 0)
+            return stat;
     }
 
-    /* Insert is at data_offset from buffer start */
-    insertp = mp->rawbufp + data_offset;
+    /* Insert and shift points, now that the field is where it'll stay */
+    insertp = mp->rawbufp + dp->offset + data_offset;
+    shiftp  = mp->rawbufp + dp->offset + shift_offset;
 
-    /* If not adding to the end of the record, shift stuff down */
-    if (data_offset != mp->raw_datalen && add_len > 0) {
-
-        /* Shift from end of record */
-        srcp    = mp->rawbufp + mp->raw_datalen ;
-        destp   = srcp + add_len;
-        while (srcp > shiftp)
-            *--destp = *--srcp;
-    }
+    /* Shift the rest of the field down */
+    if (add_len > 0 && shift_offset < dp->len)
+        memmove (shiftp + add_len, shiftp, dp->len - shift_offset);
 
     /* Fixed length fields may require padding
      * If last byte of current field is before our insertion point
@@ -242,25 +229,19 @@ int marc_add_subfield (
     /* Copy in the data */
     memcpy (insertp, datap, datalen);
 
-    /* Update buffer used and field length */
-    mp->raw_datalen += add_len;
-    dp->len         += add_len;
-
-    /* Update any fields beyond this one to reflect new offsets */
-    if (add_len) {
-        ++dp;
-        for (i=mp->cur_field+1; i<mp->field_count; i++) {
-            dp->offset += add_len;
-            ++dp;
-        }
-    }
+    /* Update field length.  marc_xroom() already accounted for
+     *   the buffer.
+     */
+    dp->len += add_len;
 
     /* Invalidate any previous subfield parse.
      * We could get more specific here to only invalidate it if it
      *   is known to have changed, but that optimization is unlikely
      *   to make a difference in real applications.
+     * The field must also be parsed again for the whole record index.
      */
     mp->cur_sf_field = MARC_NO_FIELD;
+    mp->fdirp[mp->cur_field].sfix_cnt = MARC_NO_SFIX;
 
     return 0;
 
@@ -100,6 +100,11 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "marc.h"
 #include "marcconv.h"
 #include "amuopt.h"
@@ -112,26 +117,85 @@
 |   Statics                                                          |
 \-------------------------------------------------------------------*/
 static int      S_line_num;     /* Configuration file line number   */
-static int      S_errs;         /* Count of errors                  */
-static int      S_warns;        /* Count of warnings                */
-static long     S_in_recs;      /* Number of recs read in           */
-static long     S_out_recs;     /* Number of recs written out       */
-static MARCP    S_inmp;         /* Input pseudo marc control struct */
-static MARCP    S_outmp;        /* Output real marc struct          */
+static MARCWRTP S_outwp;        /* Output file, via writer thread   */
 static CM_PROC  *S_sessprepp;   /* Head of session pre-process list */
 static CM_PROC  *S_sesspostp;   /* Head of session post-process list*/
 static CM_PROC  *S_recprepp;    /* Head of record pre-process list  */
 static CM_PROC  *S_recpostp;    /* Head of record post-process list */
+static CM_CODE  *S_sessprepc;   /* Session pre-processes, compiled  */
+static CM_CODE  *S_sesspostc;   /* Session post-processes, compiled */
+static CM_CODE  *S_recprepc;    /* Record pre-processes, compiled   */
+static CM_CODE  *S_recpostc;    /* Record post-processes, compiled  */
 static CM_FIELD *S_fieldp[1000];/* One for each possible field      */
+static char     S_field_busy[1000]; /* True=S_fieldp[] has procs    */
+static int      S_passthru;     /* True=no record procs, see conv_rec*/
 static CM_PARMS S_parms;        /* Command line parameters          */
 static char     S_ctlfile[FILENAME_MAX]; /* Current open ctl file   */
+static char     *S_unsafep;     /* First proc in table not CMP_MT   */
+static int      S_bibid_slot;   /* Named buffer slot of "bibid"     */
+static int      S_ui_slot;      /* Same for "ui", see cm_error()    */
+
+/* Conversion contexts.
+ * S_main holds the run's counters and is used by everything outside
+ *   the -j workers.  Each worker has its own, see conv_worker().
+ * S_ctxp is only for routines called without one, e.g., cm_error().
+ */
+static CM_CTX   *S_main;        /* Main thread's context            */
+static _Thread_local CM_CTX *S_ctxp; /* Calling thread's context    */
+
+/* Records in flight with -j, see conv_jobs() */
+static CM_JOB   *S_jobs;        /* Ring of jobs                     */
+static int      S_job_cnt;      /* Size of ring                     */
+static long     S_job_fill;     /* Count of jobs queued             */
+static long     S_job_next;     /* Next one for a worker to take    */
+static int      S_job_stop;     /* True=workers should quit         */
+static int      S_job_mapped;   /* True=job input is in a mapping   */
+static pthread_mutex_t S_job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  S_job_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  S_job_done = PTHREAD_COND_INITIALIZER;
+
+/* Input ranges with -f, see conv_shards() */
+static CM_SHARD *S_shards;      /* One per child process            */
+static int      S_shard_cnt;    /* Number of them                   */
+static int      S_shard;        /* In a child, its shard + 1, else 0*/
+static long     S_in_last;      /* Stop after this input rec, 0=EOF */
+static int      S_log_begun;    /* True=run's separator is in log   */
 
 
 /*-------------------------------------------------------------------\
 |   Internal prototypes                                              |
 \-------------------------------------------------------------------*/
-static CM_STAT exec_proc    (CM_PROC *, unsigned char **, size_t, size_t *);
+static CM_STAT exec_proc    (CM_CTX *, CM_CODE *, unsigned char **,
+                             size_t, size_t *);
+static void ctx_init        (CM_CTX **, CM_CTX *);
+static void ctx_free        (CM_CTX *);
+static int  conv_rec        (CM_CTX *, unsigned char *, int);
+static int  conv_serial     (MARCBLKP, MARCMAPP);
+static int  conv_jobs       (MARCBLKP, MARCMAPP);
+static void *conv_worker    (void *);
+static int  shard_bounds    (void);
+static int  conv_shards     (MARCBLKP *, MARCMAPP *);
+static int  shard_child     (int, MARCBLKP *, MARCMAPP *);
+static int  merge_shard     (int);
+static char *shard_name     (char *, int, char *);
+static void shard_status    (void);
+static void job_buf         (unsigned char **, size_t *, size_t);
+static char *dup_named_buf  (int);
+static void hold_msg        (CM_JOB *, CM_SEVERITY, char *, char *);
+static void put_msg         (CM_SEVERITY, char *, char *);
+static void fatal_exit      (void);
+static int  read_input      (MARCBLKP, MARCMAPP, unsigned char **, size_t *);
+static void skip_by_index   (MARCBLKP, MARCMAPP);
 static CM_PROC *make_proc   (char **, CM_CND *, int, CM_LVL, int);
+static CM_CODE *compile_chain (CM_PROC *);
+static int  chain_target    (CM_PROC *, int);
+static int  chain_order     (const void *, const void *);
+static int  insn_need       (CM_INSN *);
+static char *carried_buf    (void);
+static int  buf_use         (CM_INSN *);
+static void chain_writes    (CM_CODE *, int, char *);
+static char *chain_reads    (CM_CODE *, int, char *, char *);
+static void merge_defs      (char *, char *, char *, int);
 static int  load_switch_file(char *);
 static int  load_ctl_file   (char *);
 static int  get_key_line    (FILE *, char **, char **, int *);
@@ -149,440 +213,1800 @@ int g_reclen;
 int check(int);
 void *marc_alloc(int, int);
 void *marc_calloc(int, int, int);
+void *marc_realloc(void *, int, int);
+void marc_dealloc(void *, int);
 void marc_end(void);
 #endif
 
 
 int main (int argc, char *argv[])
 {
-    CM_FIELD *fieldp;       /* Current field control            */
-    CM_SF    *sfp;          /* Current subfield control         */
-    FILE     *infp,         /* Input sequential marc file       */
-             *outfp;        /* Output marc file                 */
-    unsigned char *datap,   /* Ptr to input/output data         */
-             *data2p,       /* Second ptr for copies            */
-             *inbuf;        /* Buffer for input records         */
-    size_t   datalen,       /* Length of data                   */
-             data2len,      /* Second length, for copies        */
-             outlen;        /* Length of output field           */
-    int      fpos,          /* Field position / loop counter    */
-             spos,          /* Subfield position / loop counter */
-             field_count,   /* Number of fields in current rec  */
-             sf_count,      /* Num sfs in current field         */
-             field_id,      /* Current field id/tag             */
-             sf_id,         /* Current subfield id/code         */
-             stat,          /* Return from lower level funcs    */
-             estat;         /* Return from exec_proc()          */
+    MARCBLKP inblkp;        /* Input file if block read, or NULL*/
+    MARCWRTP outwp;         /* Output file, when closing        */
+    MARCMAPP inmapp;        /* Input file if mapped, else NULL  */
+    char     *namep;        /* Buffer carried between records   */
+    int      i,             /* Loop counter                     */
+             stat;          /* Return from lower level funcs    */
 
 
     /* Load parameters from command line */
     get_parms (&S_parms, argc, argv);
 
+    /* Buffers looked at for every log message and record */
+    S_bibid_slot = cmp_buf_slot ("bibid");
+    S_ui_slot    = cmp_buf_slot ("ui");
+
+    /* Records, named buffers, etc. for converting in this thread */
+    ctx_init (&S_main, NULL);
+
     /* Load switches file */
     if (load_switch_file (S_parms.swfile) != 0)
-        cm_error (CM_FATAL, "Aborting with %d switch file errors", S_errs);
+        cm_error (CM_FATAL, "Aborting with %d switch file errors",
+                  S_main->errs);
 
     /* Load control table */
     if (load_ctl_file (S_parms.ctlfile) != 0)
-        cm_error (CM_FATAL, "Aborting with %d control table errors", S_errs);
+        cm_error (CM_FATAL, "Aborting with %d control table errors",
+                  S_main->errs);
+
+    /* Records with none of the fields in the table can be written
+     *   as is, unless record procs might change them
+     */
+    S_passthru = !S_recprepp && !S_recpostp;
+    for (i=0; i<1000; i++)
+        S_field_busy[i] = (S_fieldp[i] != NULL);
 
     /* Open input and output files */
-    if ((infp = fopen (S_parms.infile, "rb")) == NULL) {
+    inblkp = NULL;
+    inmapp = NULL;
+    if (S_parms.mapped) {
+        if ((stat = marc_map_open (S_parms.infile, &inmapp)) != 0)
+            cm_error (CM_FATAL, "Error %d mapping input file \"%s\"",
+                      stat, S_parms.infile);
+    }
+    else if ((stat = marc_blk_open (S_parms.infile, 0, &inblkp)) != 0) {
         perror (S_parms.infile);
         cm_error (CM_FATAL, "Unable to open input file \"%s\"",
                   S_parms.infile);
     }
-    if ((outfp = fopen (S_parms.outfile, S_parms.omode)) == NULL) {
+    if ((stat = marc_wrt_open (S_parms.outfile, S_parms.omode, 0, &S_outwp)) != 0) {
         perror (S_parms.outfile);
         cm_error (CM_FATAL, "Unable to open output file \"%s\"",
                   S_parms.outfile);
     }
 
-    /* Create input record buffer */
-#ifdef DEBUG
-    if ((inbuf = (unsigned char *) marc_alloc(CM_MAX_MARC_SIZE, 200)) == NULL) {   //TAG:200
-        cm_error (CM_FATAL, "Insufficient memory for input record buffer");
+    /* Execute any session pre-processes.
+     * With -f, children start with whatever these leave behind.
+     */
+    exec_proc (S_main, S_sessprepc, NULL, 0, NULL);
+
+    /* Split input for -f.  Shards start after any skipped records */
+    if (S_parms.shards > 1 && S_parms.conv_recs < CM_DFT_CONV_RECS) {
+        cm_error (CM_WARNING, "-n can't be used with -f, "
+                  "converting in one process");
+        S_parms.shards = 1;
     }
-#else
-    if ((inbuf = malloc (CM_MAX_MARC_SIZE)) == NULL) {
-        cm_error (CM_FATAL, "Insufficient memory for input record buffer");
+    if (S_parms.shards > 1 && (namep = carried_buf ()) != NULL) {
+        cm_error (CM_WARNING, "Buffer %s may carry data from one record "
+                  "to the next, converting in one process", namep);
+        S_parms.shards = 1;
     }
-#endif
+    if (S_parms.shards > 1)
+        S_shard_cnt = shard_bounds ();
 
-    /* Create record controls for input and output */
-    if ((stat = marc_init (&S_inmp)) != 0)
-        cm_error (CM_FATAL, "Error %d initializing input record control");
-    if ((stat = marc_init (&S_outmp)) != 0)
-        cm_error (CM_FATAL, "Error %d initializing output record control");
+    /* Go straight to the first record wanted if we can */
+    if (!S_shard_cnt && S_parms.indexed && S_parms.skip_recs > 0)
+        skip_by_index (inblkp, inmapp);
 
-    /* Turn off subfield sorting on output */
-    marc_subfield_sort (S_outmp, 0);
+    setbuf(stdout, NULL);
 
-    /* Execute any session pre-processes */
-    exec_proc (S_sessprepp, NULL, 0, NULL);
+    /* Threads only if every proc in the table is safe in them */
+    if (S_parms.jobs > 1 && S_unsafep) {
+        cm_error (CM_WARNING, "Procedure %s is not thread safe, "
+                  "converting without -j", S_unsafep);
+        S_parms.jobs = 1;
+    }
 
-    setbuf(stdout, NULL);
+    /* Nor if a record can see what the one before it left in a buffer */
+    if (S_parms.jobs > 1 && (namep = carried_buf ()) != NULL) {
+        cm_error (CM_WARNING, "Buffer %s may carry data from one record "
+                  "to the next, converting without -j", namep);
+        S_parms.jobs = 1;
+    }
 
-    /* Read records until done */
+    /* Convert records until done */
+    if (S_shard_cnt)
+        stat = conv_shards (&inblkp, &inmapp);
+    else if (S_parms.jobs > 1)
+        stat = conv_jobs (inblkp, inmapp);
+    else
+        stat = conv_serial (inblkp, inmapp);
 
-#ifdef DEBUG
-    while (!(stat = marc_read_rec(infp, inbuf, CM_MAX_MARC_SIZE, &g_reclen))) {
-#else
-    while ((stat = marc_read_rec(infp, inbuf, CM_MAX_MARC_SIZE)) == 0) {
-#endif
+    if (stat != EOF) {
+        cm_error (CM_ERROR, "Unexpected %s error = %d",
+                  inmapp ? "marc_map_read" : "marc_blk_read", stat);
+        if (stat == MARC_ERR_READ)
+            perror ("Input file");
+    }
+
+    /* Execute any session post-processes, only once with -f */
+    if (!S_shard)
+        exec_proc (S_main, S_sesspostc, NULL, 0, NULL);
+
+    /* Last input record may still point into the mapping */
+    if (inmapp) {
+        marc_new (S_main->inmp);
+        marc_map_close (inmapp);
+    }
+    else
+        marc_blk_close (inblkp);
+
+    /* Close output file.
+     * Writes are done by another thread, this is where we find out
+     *   if they all succeeded.
+     */
+    outwp   = S_outwp;
+    S_outwp = NULL;
+    if (marc_wrt_close (outwp) != 0)
+        cm_error (CM_ERROR, "Failed to close output file, disk space full?");
+
+    /* Report results, or pass them to the -f parent */
+    report ();
+
+    ctx_free (S_main);
 
-        /*  g_recnum++ happens in function marc_read_rec */
 #ifdef DEBUG
-if (check(0) < 0) {
-    printf("===> check failed for record %d\n", g_recnum);
-}
+    marc_end();
 #endif
+    return 0;
 
-        /* Are we skipping some? */
-        if (++S_in_recs <= S_parms.skip_recs)
-            continue;
+} /* main */
 
-        /* Parse the input record */
-        if ((stat = marc_old (S_inmp, inbuf)) != 0) {
-            cm_error (CM_FATAL, "marc_old error %d on input record", stat);
-        }
 
-        /* Start a new output record */
-        if ((stat = marc_new (S_outmp)) != 0) {
-            cm_error (CM_FATAL, "marc_new error %d on output record", stat);
-        }
+/************************************************************************
+* conv_rec ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Convert one input record into the context's output record,      *
+*       running all of the record, field and subfield procedures in     *
+*       the control table.                                              *
+*                                                                       *
+*       Everything changed along the way is in the context, so -j       *
+*       worker threads can each convert a record at the same time.      *
+*                                                                       *
+*       If no record procs are in the table, a record none of whose     *
+*       fields are in it either would come out exactly as it went in.   *
+*       Unless something in it would need fixing or reporting along     *
+*       the way, we don't rebuild it, and the caller writes the input.  *
+*                                                                       *
+*   PASS                                                                *
+*       Conversion context.                                             *
+*       Ptr to input record.                                            *
+*       True = record is in a mapped file, parse it in place.           *
+*                                                                       *
+*   RETURN                                                              *
+*       CM_REC_CONV = ctxp->outmp has a record to write.                *
+*       CM_REC_PASS = Write the input record, it's unchanged.           *
+*       CM_REC_NONE = Record was killed, or nothing was left in it.     *
+************************************************************************/
 
-        /* Replace the default leader in the new output record
-         *   with the leader in the original input record
-         */
-        if ((stat = marc_get_item (S_inmp, 0, 0, 0, 24, &datap, &datalen)) == 0) {
-            if ((stat = marc_pos_field (S_outmp, 0, &field_id, &data2p, &data2len)) == 0)
-                stat = marc_add_subfield (S_outmp, 0, datap, datalen);
-        }
+static int conv_rec (
+    CM_CTX   *ctxp,         /* Conversion context               */
+    unsigned char *recp,    /* Input record                     */
+    int      mapped         /* True=recp is in a mapping        */
+) {
+    MARCP    inmp,          /* Input record                     */
+             outmp;         /* Output record                    */
+    CM_FIELD *fieldp;       /* Current field control            */
+    CM_SF    *sfp;          /* Current subfield control         */
+    unsigned char *datap,   /* Ptr to input/output data         */
+             *data2p;       /* Second ptr for copies            */
+    size_t   datalen,       /* Length of data                   */
+             data2len,      /* Second length, for copies        */
+             outlen;        /* Length of output field           */
+    int      fpos,          /* Field position / loop counter    */
+             spos,          /* Subfield position / loop counter */
+             field_count,   /* Number of fields in current rec  */
+             sf_count,      /* Num sfs in current field         */
+             field_id,      /* Current field id/tag             */
+             sf_id,         /* Current subfield id/code         */
+             stat,          /* Return from lower level funcs    */
+             estat;         /* Return from exec_proc()          */
 
-        if (stat != 0)
-            cm_error (CM_FATAL, "Error %d copying leader");
 
-        /* Execute any record level pre-processes */
-        if ((estat = exec_proc (S_recprepp, NULL, 0, NULL)) >= CM_STAT_DONE_RECORD) {
-            /* Don't do any more with this record.  Might kill it */
-            goto done_rec;
-        }
+    inmp  = ctxp->inmp;
+    outmp = ctxp->outmp;
 
-        /* Find count of input fields */
-        if ((stat = marc_cur_field_count (S_inmp, &field_count)) != 0) {
-            cm_error (CM_FATAL, "Error %d fetching field count", stat);
-        }
+    /* The last record, already written or packed, is done with
+     *   whatever its procs got from cmp_alloc()
+     */
+    cmp_reset_arena (ctxp->pparms.arenap);
+
+    /* Parse the input record, in place if it's mapped */
+    if (mapped)
+        stat = marc_old_map (inmp, recp);
+    else
+        stat = marc_old (inmp, recp);
+    if (stat != 0) {
+        cm_error (CM_FATAL, "marc_old error %d on input record", stat);
+    }
 
-        /* Loop through all fields after dummy leader */
-        for (fpos=1; fpos<field_count; fpos++) {
+    /* Nothing to do to it? */
+    if (S_passthru && marc_ok_raw_record (inmp, S_field_busy) == 0)
+        return CM_REC_PASS;
 
-            /* Position to field */
-            if ((stat = marc_pos_field (S_inmp, fpos, &field_id, &datap, &datalen)) != 0) {
-                cm_error (CM_FATAL, "Error %d positioning to field %d", stat, fpos);
-            }
+    /* Start a new output record */
+    if ((stat = marc_new (outmp)) != 0) {
+        cm_error (CM_FATAL, "marc_new error %d on output record", stat);
+    }
 
-            /* Create the output field */
-            if ((stat = marc_add_field (S_outmp, field_id)) != 0) {
-                cm_error (CM_FATAL, "Error %d adding field %d", stat, field_id);
-            }
+    /* Replace the default leader in the new output record
+     *   with the leader in the original input record
+     */
+    if ((stat = marc_get_item (inmp, 0, 0, 0, 24, &datap, &datalen)) == 0) {
+        if ((stat = marc_pos_field (outmp, 0, &field_id, &data2p, &data2len)) == 0)
+            stat = marc_add_subfield (outmp, 0, datap, datalen);
+    }
+
+    if (stat != 0)
+        cm_error (CM_FATAL, "Error %d copying leader");
+
+    /* Execute any record level pre-processes */
+    if ((estat = exec_proc (ctxp, S_recprepc, NULL, 0, NULL)) >= CM_STAT_DONE_RECORD) {
+        /* Don't do any more with this record.  Might kill it */
+        goto done_rec;
+    }
+
+    /* Find count of input fields */
+    if ((stat = marc_cur_field_count (inmp, &field_count)) != 0) {
+        cm_error (CM_FATAL, "Error %d fetching field count", stat);
+    }
+
+    /* Loop through all fields after dummy leader */
+    for (fpos=1; fpos<field_count; fpos++) {
 
-            /* Do we have any procs for this field? */
-            fieldp = S_fieldp[field_id];
+        /* Position to field */
+        if ((stat = marc_pos_field (inmp, fpos, &field_id, &datap, &datalen)) != 0) {
+            cm_error (CM_FATAL, "Error %d positioning to field %d", stat, fpos);
+        }
+
+        /* Do we have any procs for this field? */
+        fieldp = S_fieldp[field_id];
 
-            /* Execute all pre-processes */
+        /* If not, copy it whole, as is, if we can */
+        if (!fieldp) {
             estat = CM_STAT_OK;
-            if (fieldp) {
-                if ((estat = exec_proc (fieldp->prepp, &datap, datalen, &datalen)) >= CM_STAT_DONE_FIELD) {
-                    switch (estat) {
-                        case CM_STAT_DONE_FIELD:
-                        case CM_STAT_KILL_FIELD:
-                            goto done_field;
-                        case CM_STAT_DONE_RECORD:
-                        case CM_STAT_KILL_RECORD:
-                            goto done_rec;
-                    }
-                }
+            stat  = marc_copy_raw_field (inmp, outmp, field_id);
+            if (stat == 0)
+                goto done_field;
+            if (stat != MARC_RET_RAW_SUBFLD) {
+                cm_error (CM_FATAL, "Error %d copying field %d", stat, field_id);
             }
+        }
 
-            /* Process subfields in variable fields */
-            if (field_id >= 10) {
+        /* Create the output field */
+        if ((stat = marc_add_field (outmp, field_id)) != 0) {
+            cm_error (CM_FATAL, "Error %d adding field %d", stat, field_id);
+        }
 
-                /* Get count of subfields */
-                if ((stat = marc_cur_subfield_count (S_inmp, &sf_count)) != 0) {
-                    cm_error (CM_FATAL, "Error %d fetching sf count", stat);
+        /* Execute all pre-processes */
+        estat = CM_STAT_OK;
+        if (fieldp) {
+            if ((estat = exec_proc (ctxp, fieldp->prepc, &datap, datalen, &datalen)) >= CM_STAT_DONE_FIELD) {
+                switch (estat) {
+                    case CM_STAT_DONE_FIELD:
+                    case CM_STAT_KILL_FIELD:
+                        goto done_field;
+                    case CM_STAT_DONE_RECORD:
+                    case CM_STAT_KILL_RECORD:
+                        goto done_rec;
                 }
+            }
+        }
 
-                /* Process all subfields, starting with indicators */
-                for (spos=0; spos<sf_count; spos++) {
+        /* Process subfields in variable fields */
+        if (field_id >= 10) {
 
-                    /* Fetch next available subfield */
-                    if ((stat = marc_pos_subfield (S_inmp, spos, &sf_id, &datap, &datalen)) != 0) {
-                        cm_error (CM_FATAL, "Error %d positioning to field %d sf %d", stat, field_id, spos + 1);
-                    }
+            /* Get count of subfields */
+            if ((stat = marc_cur_subfield_count (inmp, &sf_count)) != 0) {
+                cm_error (CM_FATAL, "Error %d fetching sf count", stat);
+            }
 
-                    /* Test for bad input subfield code
-                     * spos 0 and 1 are indicators, so we only check
-                     *   for subfields beyond that range.
-                     */
-                    if (spos > 1 && marc_ok_subfield (sf_id) != 0) {
-                        cm_error (CM_ERROR, "Bad sf code (int) %d in field %d", sf_id, field_id);
-                        estat = CM_STAT_KILL_RECORD;
-                        goto done_rec;
-                    }
+            /* Process all subfields, starting with indicators */
+            for (spos=0; spos<sf_count; spos++) {
 
-                    /* Is there a matching subfield control? */
-                    sfp = fieldp ? &fieldp->sf[get_sf_ctl (sf_id)] : NULL;
-
-                    /* Pre-procs */
-                    if (sfp) {
-                        if ((estat = exec_proc (sfp->prepp, &datap,
-                                               datalen, &datalen)) != 0) {
-                            switch (estat) {
-                                case CM_STAT_DONE_SF:
-                                    continue;
-                                case CM_STAT_DONE_FIELD:
-                                case CM_STAT_KILL_FIELD:
-                                    goto done_field;
-                                case CM_STAT_DONE_RECORD:
-                                case CM_STAT_KILL_RECORD:
-                                    goto done_rec;
-                            }
-                        }
-                    }
+                /* Fetch next available subfield */
+                if ((stat = marc_pos_subfield (inmp, spos, &sf_id, &datap, &datalen)) != 0) {
+                    cm_error (CM_FATAL, "Error %d positioning to field %d sf %d", stat, field_id, spos + 1);
+                }
 
-                    /* Insert subfield itself */
-                    if ((stat = marc_add_subfield (S_outmp, sf_id, datap, datalen)) != 0) {
-                        cm_error (CM_FATAL, "Error %d inserting sf %c in " "field %d", stat, sf_id, field_id);
-                    }
+                /* Test for bad input subfield code
+                 * spos 0 and 1 are indicators, so we only check
+                 *   for subfields beyond that range.
+                 */
+                if (spos > 1 && marc_ok_subfield (sf_id) != 0) {
+                    cm_error (CM_ERROR, "Bad sf code (int) %d in field %d", sf_id, field_id);
+                    estat = CM_STAT_KILL_RECORD;
+                    goto done_rec;
+                }
 
-                    /* Post-procs */
-                    if (sfp) {
-                        if ((estat = exec_proc (sfp->postp, &datap, datalen, &datalen)) > 0) {
-                            switch (estat) {
-                                case CM_STAT_DONE_FIELD:
-                                case CM_STAT_KILL_FIELD:
-                                    goto done_field;
-                                case CM_STAT_DONE_RECORD:
-                                case CM_STAT_KILL_RECORD:
-                                    goto done_rec;
-                            }
+                /* Is there a matching subfield control? */
+                sfp = fieldp ? &fieldp->sf[get_sf_ctl (sf_id)] : NULL;
+
+                /* Pre-procs */
+                if (sfp) {
+                    if ((estat = exec_proc (ctxp, sfp->prepc, &datap,
+                                           datalen, &datalen)) != 0) {
+                        switch (estat) {
+                            case CM_STAT_DONE_SF:
+                                continue;
+                            case CM_STAT_DONE_FIELD:
+                            case CM_STAT_KILL_FIELD:
+                                goto done_field;
+                            case CM_STAT_DONE_RECORD:
+                            case CM_STAT_KILL_RECORD:
+                                goto done_rec;
                         }
                     }
+                }
 
+                /* Insert subfield itself */
+                if ((stat = marc_add_subfield (outmp, sf_id, datap, datalen)) != 0) {
+                    cm_error (CM_FATAL, "Error %d inserting sf %c in " "field %d", stat, sf_id, field_id);
                 }
-            } else {
 
-                /* Copy fixed field data */
-                if ((stat = marc_add_subfield (S_outmp, 0, datap, datalen)) != 0) {
-                    cm_error (CM_FATAL, "Error %d inserting fixed field %d", stat, field_id);
+                /* Post-procs */
+                if (sfp) {
+                    if ((estat = exec_proc (ctxp, sfp->postc, &datap, datalen, &datalen)) > 0) {
+                        switch (estat) {
+                            case CM_STAT_DONE_FIELD:
+                            case CM_STAT_KILL_FIELD:
+                                goto done_field;
+                            case CM_STAT_DONE_RECORD:
+                            case CM_STAT_KILL_RECORD:
+                                goto done_rec;
+                        }
+                    }
                 }
+
             }
+        } else {
 
-            /* Field post procs */
-            estat = CM_STAT_OK;
-            if (fieldp) {
-                if ((estat = exec_proc (fieldp->postp, NULL, 0, NULL)) > 0)
-                    if (estat >= CM_STAT_DONE_RECORD) goto done_rec;
+            /* Copy fixed field data */
+            if ((stat = marc_add_subfield (outmp, 0, datap, datalen)) != 0) {
+                cm_error (CM_FATAL, "Error %d inserting fixed field %d", stat, field_id);
             }
+        }
+
+        /* Field post procs */
+        estat = CM_STAT_OK;
+        if (fieldp) {
+            if ((estat = exec_proc (ctxp, fieldp->postc, NULL, 0, NULL)) > 0)
+                if (estat >= CM_STAT_DONE_RECORD) goto done_rec;
+        }
 
 /* Go here if done all work on the field */
 done_field:
-            /* Is there data in the current field? */
-            if ((stat = marc_cur_field_len (S_outmp, &outlen)) != 0) {
-                cm_error (CM_FATAL, "Error %d fetching field length", stat);
-            }
+        /* Is there data in the current field? */
+        if ((stat = marc_cur_field_len (outmp, &outlen)) != 0) {
+            cm_error (CM_FATAL, "Error %d fetching field length", stat);
+        }
 
-            /* If we quit before copying any data to field, kill it
-             * Note that the input field id may no longer match the
-             *   output field id if the program changed field ids.
-             * However we don't care here since a fixed field could
-             *   never be changed to a variable field, or vice versa.
-             * So we'll use the info we already have.
-             * Fixed fields with no data have len==1 for field term.
-             * Var fields have len==3 for field term + 2 indicators.
-             */
-            if (estat == CM_STAT_KILL_FIELD || (field_id<10 && outlen==1) || (field_id>9 && outlen==3)) {
-                if ((stat = marc_del_field (S_outmp)) != 0) {
-                    cm_error (CM_FATAL, "Error %d deleting empty field, " "input id = %d", stat, field_id);
-                }
+        /* If we quit before copying any data to field, kill it
+         * Note that the input field id may no longer match the
+         *   output field id if the program changed field ids.
+         * However we don't care here since a fixed field could
+         *   never be changed to a variable field, or vice versa.
+         * So we'll use the info we already have.
+         * Fixed fields with no data have len==1 for field term.
+         * Var fields have len==3 for field term + 2 indicators.
+         */
+        if (estat == CM_STAT_KILL_FIELD || (field_id<10 && outlen==1) || (field_id>9 && outlen==3)) {
+            if ((stat = marc_del_field (outmp)) != 0) {
+                cm_error (CM_FATAL, "Error %d deleting empty field, " "input id = %d", stat, field_id);
             }
         }
+    }
 
-        /* Record post procs */
-        estat = exec_proc (S_recpostp, NULL, 0, NULL);
+    /* Record post procs */
+    estat = exec_proc (ctxp, S_recpostc, NULL, 0, NULL);
 
 
-/* Go here to write the record and continue to the next */
+/* Go here when done with the record */
 done_rec:
-        /* Write record if not killed and it contains data */
-        if (estat != CM_STAT_KILL_RECORD) {
+    /* Nothing to write if killed */
+    if (estat == CM_STAT_KILL_RECORD)
+        return CM_REC_NONE;
 
-            /* Get field count */
-            if ((stat = marc_cur_field_count (S_outmp, &field_count)) != 0) {
-                cm_error (CM_FATAL, "Error %d fetching field count", stat);
-            }
+    /* Get field count */
+    if ((stat = marc_cur_field_count (outmp, &field_count)) != 0) {
+        cm_error (CM_FATAL, "Error %d fetching field count", stat);
+    }
 
-            /* If there is anything to write */
-            if (field_count > 1) {
+    /* Write it if there is anything in it */
+    return (field_count > 1) ? CM_REC_CONV : CM_REC_NONE;
 
-                /* Write to output */
-                if ((stat = marc_write_rec (outfp, S_outmp)) != 0) {
-                    cm_error (CM_FATAL, "Error %d writing record", stat);
-                }
+} /* conv_rec */
 
-                /* Count and test after successful write */
-                if (++S_out_recs >= S_parms.conv_recs) {
-                    break;
-                }
+
+/************************************************************************
+* conv_serial ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Read, convert and write records one at a time, in this thread.  *
+*                                                                       *
+*   PASS                                                                *
+*       Block read input file, NULL if mapped.                          *
+*       Mapped input file, NULL if not mapped.                          *
+*                                                                       *
+*   RETURN                                                              *
+*       EOF if all records were read, or all in a -f child's shard.     *
+*       Else the read error, or 0 if we stopped at the -n count.        *
+************************************************************************/
+
+static int conv_serial (
+    MARCBLKP      inblkp,   /* Input file               */
+    MARCMAPP      inmapp    /* Or mapped input file     */
+) {
+    unsigned char *recp;    /* Current input record     */
+    size_t        reclen;   /* Its length               */
+    int           conv,     /* From conv_rec()          */
+                  stat;     /* Return from read/write   */
+
+
+    for (;;) {
+
+        /* A -f child stops at the end of its shard */
+        if (S_in_last && S_main->in_recs >= S_in_last) {
+            stat = EOF;
+            break;
+        }
+        if ((stat = read_input (inblkp, inmapp, &recp, &reclen)) != 0)
+            break;
+
+        /*  g_recnum++ happens in marc_blk_read / marc_map_read */
+        /* Are we skipping some? */
+        if (++S_main->in_recs <= S_parms.skip_recs)
+            continue;
+
+        /* Write record if not killed and it contains data */
+        if ((conv = conv_rec (S_main, recp, inmapp != NULL)) != CM_REC_NONE) {
+
+            /* Write to output */
+            if ((stat = marc_wrt_rec (S_outwp, (conv == CM_REC_PASS) ?
+                            (void *) recp : (void *) S_main->outmp)) != 0) {
+                cm_error (CM_FATAL, "Error %d writing record", stat);
+            }
+
+            /* Count and test after successful write */
+            if (++S_main->out_recs >= S_parms.conv_recs) {
+                break;
             }
         }
     }
 
-    if (!feof (infp)) {
-        cm_error (CM_ERROR, "Unexpected marc_read_rec error = %d", stat);
-        perror ("Input file");
+    return stat;
+
+} /* conv_serial */
+
+
+/************************************************************************
+* conv_jobs ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Convert records in S_parms.jobs worker threads (-j).            *
+*                                                                       *
+*       We read records here and queue them in a ring of jobs.  Each    *
+*       worker takes the next queued job and converts it in its own     *
+*       conversion context, packing the result into the job.  Back      *
+*       here we take finished jobs in input order and write them, so    *
+*       the output is the same as without threads.                      *
+*                                                                       *
+*       Workers don't log anything themselves.  cm_error() holds their  *
+*       messages in the job, and we log them here, in order, as each    *
+*       job is written.  So the error count, the switch to a fatal      *
+*       error past max_errs, and the records written before it, are     *
+*       all just as they would be if we were converting one at a time.  *
+*       Records read ahead of the one that stops the run are thrown     *
+*       away, messages and all.                                         *
+*                                                                       *
+*       Workers start with a copy of the named buffers as they are      *
+*       after session pre-processes.  Anything a record leaves in a     *
+*       buffer is only seen by later records in the same worker, so     *
+*       main() doesn't come here for tables where a record might read   *
+*       what the one before left, see carried_buf().  The "bibid" and   *
+*       "ui" of the last record are copied back here for logging and    *
+*       session post-processes.                                         *
+*                                                                       *
+*   PASS                                                                *
+*       Block read input file, NULL if mapped.                          *
+*       Mapped input file, NULL if not mapped.                          *
+*                                                                       *
+*   RETURN                                                              *
+*       As conv_serial().                                               *
+************************************************************************/
+
+static int conv_jobs (
+    MARCBLKP      inblkp,   /* Input file               */
+    MARCMAPP      inmapp    /* Or mapped input file     */
+) {
+    pthread_t     tids[CM_MAX_JOBS];    /* Worker threads   */
+    CM_JOB        *jp;      /* Job to fill or write     */
+    CM_MSG        *msgp;    /* Held message             */
+    unsigned char *recp,    /* Input record             */
+                  *bufp;    /* Named buffer             */
+    size_t        reclen,   /* Its length               */
+                  buflen;   /* Named buffer length      */
+    char          *bibidp,  /* Last record's bibid      */
+                  *uip;     /*   and ui                 */
+    long          in_count, /* Records read             */
+                  head;     /* Oldest job not written   */
+    int           rstat,    /* Return from read         */
+                  stat,     /* Return from write        */
+                  i;        /* Loop counter             */
+
+
+    /* Ring with enough jobs to keep every worker busy */
+    S_job_cnt    = S_parms.jobs * CM_JOB_RECS;
+    S_job_mapped = (inmapp != NULL);
+#ifdef DEBUG
+    S_jobs = (CM_JOB *) marc_calloc (sizeof(CM_JOB), S_job_cnt, 202); //TAG:202
+#else
+    S_jobs = (CM_JOB *) calloc (sizeof(CM_JOB), S_job_cnt);
+#endif
+    if (!S_jobs)
+        cm_error (CM_FATAL, "Job ring memory");
+
+    for (i=0; i<S_parms.jobs; i++) {
+        if (pthread_create (&tids[i], NULL, conv_worker, S_main) != 0)
+            cm_error (CM_FATAL, "Unable to start conversion thread %d", i);
     }
 
-    /* Execute any session post-processes */
-    exec_proc (S_sesspostp, NULL, 0, NULL);
+    in_count = S_main->in_recs;
+    head     = 0;
+    rstat    = 0;
+    stat     = 0;
+    bibidp   = uip = NULL;
+    for (;;) {
 
-    /* Close output file */
-    if (fclose (outfp) != 0)
-        cm_error (CM_ERROR, "Failed to close output file, disk space full?");
+        /* Queue records until the ring is full */
+        while (!rstat && S_job_fill - head < S_job_cnt) {
+            if ((rstat = read_input (inblkp, inmapp, &recp, &reclen)) != 0)
+                break;
 
-    /* Report results */
-    report ();
+            /* Are we skipping some? */
+            if (++in_count <= S_parms.skip_recs)
+                continue;
+
+            /* Only we touch a job that isn't queued */
+            jp = &S_jobs[S_job_fill % S_job_cnt];
+            jp->rec_num = in_count;
+            jp->outlen  = 0;
+            jp->passed  = 0;
+            jp->msgp    = NULL;
+            jp->lastpp  = &jp->msgp;
+            jp->done    = 0;
+
+            /* Block reads reuse their buffer, keep a copy.
+             * marc_old() looks at one byte past the record.
+             */
+            if (inmapp)
+                jp->recp = recp;
+            else {
+                job_buf (&jp->inbufp, &jp->insize, reclen + 1);
+                memcpy (jp->inbufp, recp, reclen + 1);
+                jp->recp = jp->inbufp;
+            }
+
+            pthread_mutex_lock (&S_job_lock);
+            ++S_job_fill;
+            pthread_cond_signal (&S_job_work);
+            pthread_mutex_unlock (&S_job_lock);
+        }
+
+        /* Nothing more coming */
+        if (head == S_job_fill)
+            break;
+
+        /* Wait for the oldest job */
+        jp = &S_jobs[head % S_job_cnt];
+        pthread_mutex_lock (&S_job_lock);
+        while (!jp->done)
+            pthread_cond_wait (&S_job_done, &S_job_lock);
+        pthread_mutex_unlock (&S_job_lock);
+        ++head;
+
+        /* Log its messages as if we had just converted it.
+         * Might not return.
+         */
+        S_main->in_recs = jp->rec_num;
+        while ((msgp = jp->msgp) != NULL) {
+            jp->msgp = msgp->nextp;
+            put_msg (msgp->severity, msgp->hdrp, msgp->msgp);
+            free (msgp);
+        }
+
+        free (bibidp);
+        free (uip);
+        bibidp = jp->bibidp;
+        uip    = jp->uip;
+        jp->bibidp = jp->uip = NULL;
+
+        /* Write record if not killed and it contains data */
+        if (jp->outlen || jp->passed) {
+            if ((stat = marc_wrt_rec (S_outwp, jp->passed ?
+                                      jp->recp : jp->outbufp)) != 0) {
+                cm_error (CM_FATAL, "Error %d writing record", stat);
+            }
+
+            /* Count and test after successful write */
+            if (++S_main->out_recs >= S_parms.conv_recs)
+                break;
+        }
+    }
+
+    /* Stop workers, whatever they were doing */
+    pthread_mutex_lock (&S_job_lock);
+    S_job_stop = 1;
+    pthread_cond_broadcast (&S_job_work);
+    pthread_mutex_unlock (&S_job_lock);
+    for (i=0; i<S_parms.jobs; i++)
+        pthread_join (tids[i], NULL);
+
+    /* Unless stopped by count, we read everything we could */
+    if (head == S_job_fill) {
+        S_main->in_recs = in_count;
+        stat            = rstat;
+    }
 
+    /* Last record's UI, for logging and session post-processes */
+    if (bibidp && cmp_get_slot_buf (S_bibid_slot, &bufp, 1,
+                                    strlen (bibidp) + 1, &buflen) == CM_STAT_OK)
+        strcpy ((char *) bufp, bibidp);
+    if (uip && cmp_get_slot_buf (S_ui_slot, &bufp, 1, strlen (uip) + 1,
+                                 &buflen) == CM_STAT_OK)
+        strcpy ((char *) bufp, uip);
+    free (bibidp);
+    free (uip);
+
+    for (i=0; i<S_job_cnt; i++) {
+        jp = &S_jobs[i];
+        while ((msgp = jp->msgp) != NULL) {
+            jp->msgp = msgp->nextp;
+            free (msgp);
+        }
+        free (jp->bibidp);
+        free (jp->uip);
 #ifdef DEBUG
-    marc_end();
+        if (jp->inbufp)
+            marc_dealloc (jp->inbufp, 203);  //TAG:203
+        if (jp->outbufp)
+            marc_dealloc (jp->outbufp, 203); //TAG:203
+#else
+        free (jp->inbufp);
+        free (jp->outbufp);
 #endif
-    return 0;
+    }
+#ifdef DEBUG
+    marc_dealloc (S_jobs, 202);  //TAG:202
+#else
+    free (S_jobs);
+#endif
+    S_jobs = NULL;
 
-} /* main */
+    return stat;
+
+} /* conv_jobs */
 
 
 /************************************************************************
-* exec_proc ()                                                          *
+* conv_worker ()                                                        *
 *                                                                       *
 *   DEFINITION                                                          *
-*       Execute a chain of procedures.                                  *
+*       Worker thread for conv_jobs().  Convert queued jobs until       *
+*       told to stop.                                                   *
 *                                                                       *
-*   PASS                                                                *
-*       Ptr to head of chain of procedures.                             *
-*       Ptr to ptr to current data.                                     *
-*           This points directly into the record.                       *
-*           If we call any funcs, we'll copy the data out to another    *
-*               buffer and point to this buffer instead.                *
-*           NULL if no current data, i.e., we're at a level above       *
-*               a level (field or subfield) which has actual data.      *
-*       Length of current data.                                         *
-*       Ptr to place to put new length                                  *
-*           NULL if caller doesn't need new length.                     *
+*       A fatal error in a record ends the thread.  The job is marked   *
+*       done, and the run ends when conv_jobs() logs its messages.      *
 *                                                                       *
-*       Rest of data comes from statics.                                *
+*   PASS                                                                *
+*       Ptr to main conversion context, to copy named buffers from.     *
 *                                                                       *
 *   RETURN                                                              *
-*       0 = Success.                                                    *
+*       NULL.                                                           *
 ************************************************************************/
 
-/* Simple checksum of things that should never change */
-#define CM_CHECKSUM \
-    ( (long) s_pparms.outmp + (long) s_pparms.bufp + (long) s_pparms.buflen )
-
-static CM_STAT exec_proc (
-    CM_PROC       *linkp,           /* Ptr linked list of proc ctls */
-    unsigned char **datapp,         /* Ptr to ptr to data           */
-    size_t        datalen,          /* Length of data at *datpp     */
-    size_t        *newlen           /* Put new length here          */
+static void *conv_worker (
+    void          *argp     /* CM_CTX to start from     */
 ) {
-    int           save_stat,        /* Return from marc_save_pos    */
-                  retcode;          /* Return code                  */
+    CM_CTX        *ctxp;    /* Our conversion context   */
+    CM_JOB        *jp;      /* Current job              */
+    unsigned char *datap;   /* Packed output record     */
+    size_t        datalen;  /* Its length               */
+    int           failed,   /* True=fatal error in rec  */
+                  conv,     /* From conv_rec()          */
+                  stat;     /* From marc_get_record()  */
+
+
+    /* Our own records, buffers, etc. */
+    ctx_init (&ctxp, (CM_CTX *) argp);
+
+    failed = 0;
+    while (!failed) {
+
+        /* Next job */
+        pthread_mutex_lock (&S_job_lock);
+        while (S_job_next == S_job_fill && !S_job_stop)
+            pthread_cond_wait (&S_job_work, &S_job_lock);
+        if (S_job_stop) {
+            pthread_mutex_unlock (&S_job_lock);
+            break;
+        }
+        jp = &S_jobs[S_job_next++ % S_job_cnt];
+        pthread_mutex_unlock (&S_job_lock);
 
-    static int s_first_time = 1;    /* Initialization flag          */
-    static CM_PROC_PARMS s_pparms;  /* Parm struct to pass arund    */
-    static unsigned char *s_bufp;   /* Buffer for modifiable data   */
-    static long s_checksum;         /* Checksum for static parms    */
+        /* Messages go into the job from here on */
+        ctxp->jobp    = jp;
+        ctxp->in_recs = jp->rec_num;
 
+        if (setjmp (ctxp->fatal) == 0) {
+            conv = conv_rec (ctxp, jp->recp, S_job_mapped);
 
-    /* If no passed procedure list, nothing to do
-     * This is actually the most common case since any field or
-     *   subfield not requiring pre or post procs will have a
-     *   null pointer to procs
-     */
-    if (!linkp)
-        return CM_STAT_OK;
+            /* Unchanged input can be written from where it is */
+            if (conv == CM_REC_PASS)
+                jp->passed = 1;
 
-    /* If first time in function, initialize buffers and parms */
-    if (s_first_time) {
+            else if (conv == CM_REC_CONV) {
 
-        /* Get a buffer which procs can modify */
-#ifdef DEBUG
-        if ((s_bufp = (unsigned char *) marc_alloc(CM_PROC_BUF_SIZE, 201)) == NULL) { //TAG:201
-            cm_error (CM_FATAL, "Proc buffer memory");
-        }
-#else
-        if ((s_bufp = (unsigned char *) malloc (CM_PROC_BUF_SIZE)) == NULL) {
-            cm_error (CM_FATAL, "Proc buffer memory");
+                /* Pack it for conv_jobs() to write */
+                if ((stat = marc_get_record (ctxp->outmp, &datap, &datalen)) != 0) {
+                    cm_error (CM_FATAL, "Error %d writing record", stat);
+                }
+                job_buf (&jp->outbufp, &jp->outsize, datalen);
+                memcpy (jp->outbufp, datap, datalen);
+                jp->outlen = datalen;
+            }
         }
-#endif
+        else
+            failed = 1;
+
+        /* UI for conv_jobs() to keep, if it's the last record */
+        ctxp->jobp = NULL;
+        jp->bibidp = dup_named_buf (S_bibid_slot);
+        jp->uip    = dup_named_buf (S_ui_slot);
+
+        pthread_mutex_lock (&S_job_lock);
+        jp->done = 1;
+        pthread_cond_broadcast (&S_job_done);
+        pthread_mutex_unlock (&S_job_lock);
+    }
 
-        /* Fill unchanging parts of the parameter structure */
-        s_pparms.outmp  = S_outmp;
-        s_pparms.bufp   = s_bufp;
-        s_pparms.buflen = CM_PROC_BUF_SIZE;
+    /* Mapped input must be let go before conv_jobs() returns */
+    ctx_free (ctxp);
 
-        /* Compute checksum to find wayward procs */
-        s_checksum = CM_CHECKSUM;
+    return NULL;
 
-        s_first_time = 0;
+} /* conv_worker */
+
+
+/************************************************************************
+* job_buf ()                                                            *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make sure a job's input or output buffer is big enough.         *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to ptr to buffer, NULL if none yet.                         *
+*       Ptr to its size.                                                *
+*       Size needed.                                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  Fatal error if no memory.                                *
+************************************************************************/
+
+static void job_buf (
+    unsigned char **bufpp,  /* Ptr to ptr to buffer     */
+    size_t        *sizep,   /* Ptr to its size          */
+    size_t        need      /* Bytes needed             */
+) {
+    unsigned char *bufp;    /* Resized buffer           */
+
+
+    if (need <= *sizep)
+        return;
+
+    /* Round up so we don't do this for every record */
+    need = (need + 0xfff) & ~((size_t) 0xfff);
+#ifdef DEBUG
+    bufp = (unsigned char *) marc_realloc (*bufpp, need, 203);  //TAG:203
+#else
+    bufp = (unsigned char *) realloc (*bufpp, need);
+#endif
+    if (!bufp)
+        cm_error (CM_FATAL, "Job buffer memory");
+
+    *bufpp = bufp;
+    *sizep = need;
+
+} /* job_buf */
+
+
+/************************************************************************
+* dup_named_buf ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Copy the string in a named buffer, if there is one.             *
+*                                                                       *
+*   PASS                                                                *
+*       Slot of buffer name, see cmp_buf_slot().                        *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to malloc'd copy, caller must free.                         *
+*       NULL if no such buffer.                                         *
+************************************************************************/
+
+static char *dup_named_buf (
+    int           slot      /* Buffer name's slot       */
+) {
+    unsigned char *bufp;    /* Ptr to buffer            */
+    size_t        buflen;   /* Its length               */
+
+
+    if (cmp_get_slot_buf (slot, &bufp, 0, 0, &buflen) != CM_STAT_OK)
+        return NULL;
+
+    return strdup ((char *) bufp);
+
+} /* dup_named_buf */
+
+
+/************************************************************************
+* shard_bounds ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Split the input records after any skipped ones into             *
+*       S_parms.shards ranges of about the same size in bytes, one      *
+*       for each -f child, in S_shards.                                 *
+*                                                                       *
+*       Ranges always start on a record.  If there is an up to date     *
+*       index (see skip_by_index()) we look the starts up in it,        *
+*       else we hop from leader to leader through the mapped input.     *
+*       Anything from the first bad record on is left in the last       *
+*       range, whose child then finds the error just where we would     *
+*       have without -f.                                                *
+*                                                                       *
+*   PASS                                                                *
+*       Void.                                                           *
+*                                                                       *
+*   RETURN                                                              *
+*       Number of ranges, at least 2.                                   *
+*       0 = Too few records to split, convert in one process.           *
+************************************************************************/
+
+static int shard_bounds ()
+{
+    MARCIDXP      ixp;      /* Index of input file      */
+    MARCMAPP      map;      /* Or the mapped input file */
+    CM_SHARD      *sp;      /* Shard being filled       */
+    struct stat   sbuf;     /* For input file size      */
+    char          idxname[FILENAME_MAX], /* Index name      */
+                  namebuf[FILENAME_MAX]; /* Test shard name */
+    unsigned char *recp;    /* Record from mapping      */
+    size_t        reclen;   /* Its length               */
+    off_t         offset,   /* Current record's offset  */
+                  start,    /* Of first shard           */
+                  size,     /* Bytes in all shards      */
+                  want;     /* Next shard at or after   */
+    long          count,    /* Records in index         */
+                  rec,      /* Current record number    */
+                  lo, hi;   /* Binary search bounds     */
+    int           n,        /* Shards found so far      */
+                  k,        /* Next split point         */
+                  mstat;    /* From marc_idx/map_...    */
+
+
+    /* Temporary file names must fit */
+    if (strlen (S_parms.outfile) + 16 > sizeof(namebuf)) {
+        cm_error (CM_WARNING, "Output file name too long for -f, "
+                  "converting in one process");
+        return 0;
+    }
+
+    if (stat (S_parms.infile, &sbuf) != 0)
+        return 0;
+
+#ifdef DEBUG
+    S_shards = (CM_SHARD *) marc_calloc (sizeof(CM_SHARD), S_parms.shards, 205); //TAG:205
+#else
+    S_shards = (CM_SHARD *) calloc (sizeof(CM_SHARD), S_parms.shards);
+#endif
+    if (!S_shards)
+        cm_error (CM_FATAL, "Shard table memory");
+
+    n = 0;
+
+    /* Index if we have one, or are allowed to make one */
+    ixp = NULL;
+    if (strlen (S_parms.infile) + 5 <= sizeof(idxname)) {
+        sprintf (idxname, "%s.idx", S_parms.infile);
+        mstat = marc_idx_open (idxname, S_parms.infile, &ixp);
+        if ((mstat == MARC_ERR_IDX_OPEN || mstat == MARC_ERR_IDX_STALE)
+                && S_parms.indexed) {
+            if (marc_idx_build (S_parms.infile, idxname, 0) == 0)
+                mstat = marc_idx_open (idxname, S_parms.infile, &ixp);
+        }
+        if (mstat != 0)
+            ixp = NULL;
+    }
+
+    if (ixp) {
+        marc_idx_count (ixp, &count);
+        if (S_parms.skip_recs < count) {
+            rec = S_parms.skip_recs;
+            marc_idx_get (ixp, rec, &start, &reclen, NULL);
+            size = (off_t) sbuf.st_size - start;
+
+            S_shards[n].offset = start;
+            S_shards[n++].first = rec;
+            for (k=1; k<S_parms.shards; k++) {
+
+                /* First record at or after the split point */
+                want = start + size * k / S_parms.shards;
+                lo   = rec + 1;
+                hi   = count;
+                while (lo < hi) {
+                    marc_idx_get (ixp, (lo + hi) / 2, &offset, &reclen, NULL);
+                    if (offset < want)
+                        lo = (lo + hi) / 2 + 1;
+                    else
+                        hi = (lo + hi) / 2;
+                }
+                if (lo == count)
+                    break;
+                rec = lo;
+                marc_idx_get (ixp, rec, &offset, &reclen, NULL);
+                S_shards[n].offset = offset;
+                S_shards[n++].first = rec;
+            }
+        }
+        marc_idx_close (ixp);
+    }
+
+    /* Else hop through the leaders */
+    else if (marc_map_open (S_parms.infile, &map) == 0) {
+        offset = 0;
+        rec    = 0;
+        mstat  = 0;
+        while (rec < S_parms.skip_recs
+                && (mstat = marc_map_read (map, &recp, &reclen)) == 0) {
+            offset += reclen;
+            ++rec;
+        }
+
+        if (!mstat) {
+            start = offset;
+            size  = (off_t) sbuf.st_size - start;
+            k     = 1;
+            while ((mstat = marc_map_read (map, &recp, &reclen)) == 0) {
+                if (!n) {
+                    S_shards[n].offset = offset;
+                    S_shards[n++].first = rec;
+                }
+
+                /* Split here if we've passed the next split point */
+                else if (offset >= start + size * k / S_parms.shards) {
+                    S_shards[n].offset = offset;
+                    S_shards[n++].first = rec;
+                    while (k < S_parms.shards
+                            && offset >= start + size * k / S_parms.shards)
+                        ++k;
+                    if (n == S_parms.shards)
+                        break;
+                }
+                offset += reclen;
+                ++rec;
+            }
+        }
+        marc_map_close (map);
+    }
+
+    /* Each shard ends where the next one starts */
+    for (k=0; k<n; k++) {
+        sp = &S_shards[k];
+        sp->last = (k < n - 1) ? sp[1].first : 0;
+    }
+
+    if (n < 2) {
+#ifdef DEBUG
+        marc_dealloc (S_shards, 205);  //TAG:205
+#else
+        free (S_shards);
+#endif
+        S_shards = NULL;
+        n = 0;
+    }
+
+    return n;
+
+} /* shard_bounds */
+
+
+/************************************************************************
+* conv_shards ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Convert records in S_shard_cnt child processes (-f).            *
+*                                                                       *
+*       Each child converts one range of input records from             *
+*       shard_bounds(), one at a time, just as we would without -f,     *
+*       into a temporary output file and log of its own.  Procs that    *
+*       aren't safe in -j threads are fine here, each child has its     *
+*       own copy of everything.                                         *
+*                                                                       *
+*       Back here we wait for the children in order, and append each    *
+*       one's output to ours, its log to ours, and its counts to        *
+*       ours, so the results are as if there had been only one          *
+*       process.  Except that the error limit, -e, applies to each      *
+*       child separately, and that console messages from different      *
+*       children may be mixed together.                                 *
+*                                                                       *
+*       Session pre-processes have already run, children start with     *
+*       whatever they left.  Session post-processes run here after      *
+*       all children are done, with the "bibid" and "ui" of the last    *
+*       record, and no other buffer a child sets.  main() doesn't come  *
+*       here for tables passing data in named buffers from one record   *
+*       to the next, or to session post-processes, see carried_buf().   *
+*       Custom procs keeping it in static data see only the records in  *
+*       their own range.                                                *
+*                                                                       *
+*       A fatal error in a child ends the run after everything before   *
+*       it has been added, killing any children after it.              *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to block read input file, NULL if mapped.                   *
+*       Ptr to mapped input file, NULL if not mapped.                   *
+*           A child replaces these with its own.                        *
+*                                                                       *
+*   RETURN                                                              *
+*       In a child, as conv_serial().                                   *
+*       Else EOF.  Read errors were logged by the last child.           *
+************************************************************************/
+
+static int conv_shards (
+    MARCBLKP      *inblkpp, /* Input file               */
+    MARCMAPP      *inmappp  /* Or mapped input file     */
+) {
+    pid_t         pid;      /* From fork()              */
+    char          namebuf[FILENAME_MAX]; /* Temp file name  */
+    int           i, j,     /* Loop counters            */
+                  failed,   /* True=a shard failed      */
+                  killed,   /* Shard + 1 if it crashed  */
+                  wstat;    /* From waitpid()           */
+
+
+    /* Anything buffered would be written by every child */
+    fflush (stdout);
+    fflush (stderr);
+
+    for (i=0; i<S_shard_cnt; i++) {
+        if ((pid = fork ()) == 0)
+            return shard_child (i, inblkpp, inmappp);
+
+        if (pid < 0) {
+            for (j=0; j<i; j++)
+                kill (S_shards[j].pid, SIGTERM);
+            while (wait (NULL) > 0)
+                ;
+            cm_error (CM_FATAL, "Unable to start conversion process %d", i);
+        }
+        S_shards[i].pid = pid;
+    }
+
+    /* Add each shard's results in order */
+    failed = 0;
+    killed = 0;
+    for (i=0; i<S_shard_cnt; i++) {
+        while (waitpid (S_shards[i].pid, &wstat, 0) < 0 && errno == EINTR)
+            ;
+        if (failed)
+            continue;
+
+        if (merge_shard (i) != 0 || !WIFEXITED (wstat)
+                || WEXITSTATUS (wstat) != 0) {
+
+            /* Nothing after it counts */
+            failed = 1;
+            for (j=i+1; j<S_shard_cnt; j++)
+                kill (S_shards[j].pid, SIGTERM);
+
+            if (!WIFEXITED (wstat))
+                killed = i + 1;
+        }
+    }
+
+    /* Anything left by children we stopped */
+    for (i=0; i<S_shard_cnt; i++) {
+        remove (shard_name (namebuf, i, "mrc"));
+        remove (shard_name (namebuf, i, "log"));
+        remove (shard_name (namebuf, i, "sts"));
+    }
+
+    /* A child ended the run, end it here too */
+    if (killed)
+        cm_error (CM_FATAL, "Conversion process for input records %ld "
+                  "and after ended abnormally", S_shards[killed-1].first + 1);
+    if (failed)
+        fatal_exit ();
+
+#ifdef DEBUG
+    marc_dealloc (S_shards, 205);  //TAG:205
+#else
+    free (S_shards);
+#endif
+    S_shards = NULL;
+
+    return EOF;
+
+} /* conv_shards */
+
+
+/************************************************************************
+* shard_child ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Set up a -f child process to convert its shard, then convert    *
+*       it.                                                             *
+*                                                                       *
+*       Output and log go to temporary files for conv_shards() in the   *
+*       parent.  The child then goes on through the rest of main(),     *
+*       except for session post-processes, and report() passes its      *
+*       counts to the parent.                                           *
+*                                                                       *
+*   PASS                                                                *
+*       Shard number, org 0.                                            *
+*       Ptr to block read input file, NULL if mapped.                   *
+*       Ptr to mapped input file, NULL if not mapped.                   *
+*                                                                       *
+*   RETURN                                                              *
+*       As conv_serial().                                               *
+************************************************************************/
+
+static int shard_child (
+    int           shard,    /* Shard number             */
+    MARCBLKP      *inblkpp, /* Input file               */
+    MARCMAPP      *inmappp  /* Or mapped input file     */
+) {
+    CM_SHARD      *sp;      /* Our shard                */
+    char          namebuf[FILENAME_MAX]; /* Temp file name  */
+    int           stat;     /* From marc_...            */
+
+
+    sp = &S_shards[shard];
+    S_shard = shard + 1;
+
+    /* The parent puts the run's separator in the log */
+    S_log_begun     = 1;
+    S_parms.logfile = strdup (shard_name (namebuf, shard, "log"));
+
+    /* Parent's output and its writer thread aren't ours */
+    S_outwp = NULL;
+    if ((stat = marc_wrt_open (shard_name (namebuf, shard, "mrc"), "wb", 0,
+                               &S_outwp)) != 0)
+        cm_error (CM_FATAL, "Error %d opening temporary output file \"%s\"",
+                  stat, namebuf);
+
+    /* A mapping is ours now, but a block reader's file position is
+     *   still shared with the parent, so get our own
+     */
+    if (*inmappp)
+        stat = marc_map_seek (*inmappp, sp->offset);
+    else {
+        marc_blk_close (*inblkpp);
+        if ((stat = marc_blk_open (S_parms.infile, 0, inblkpp)) == 0)
+            stat = marc_blk_seek (*inblkpp, sp->offset);
+    }
+    if (stat != 0)
+        cm_error (CM_FATAL, "Error %d seeking to input record %ld",
+                  stat, sp->first);
+
+    /* Record numbers in messages are for the whole file */
+    S_main->in_recs = sp->first;
+    S_in_last       = sp->last;
+
+    return conv_serial (*inblkpp, *inmappp);
+
+} /* shard_child */
+
+
+/************************************************************************
+* merge_shard ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Add the log, output and counts of a finished -f child to        *
+*       ours.                                                           *
+*                                                                       *
+*   PASS                                                                *
+*       Shard number, org 0.                                            *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else the child didn't leave its counts, it never finished.      *
+************************************************************************/
+
+static int merge_shard (
+    int           shard     /* Shard number             */
+) {
+    FILE          *fp,      /* Child's log or counts    */
+                  *logfp;   /* Our log                  */
+    MARCMAPP      map;      /* Child's output           */
+    unsigned char *recp,    /* Record from it           */
+                  *bufp;    /* Named buffer             */
+    size_t        reclen,   /* Its length               */
+                  buflen,   /* Named buffer length      */
+                  n;        /* Bytes of log copied      */
+    char          namebuf[FILENAME_MAX], /* Temp file name  */
+                  copybuf[8192],  /* For copying log    */
+                  line[CM_MAX_LOG_MSG], /* Count file line  */
+                  *valp;    /* Named buffer value       */
+    long          in_recs,  /* Child's counts           */
+                  out_recs;
+    int           warns,
+                  errs,
+                  stat,     /* From marc_...            */
+                  ok;       /* True=got counts          */
+
+
+    /* Log, after this run's separator */
+    if ((fp = fopen (shard_name (namebuf, shard, "log"), "rb")) != NULL) {
+        if ((n = fread (copybuf, 1, sizeof(copybuf), fp)) > 0
+                && (logfp = fopen (S_parms.logfile, "a")) != NULL) {
+            if (!S_log_begun) {
+                get_log_time (line);
+                fprintf (logfp, "%s", line);
+                S_log_begun = 1;
+            }
+            do
+                fwrite (copybuf, 1, n, logfp);
+            while ((n = fread (copybuf, 1, sizeof(copybuf), fp)) > 0);
+            fclose (logfp);
+        }
+        fclose (fp);
+    }
+
+    /* Output records, as if we had just converted them */
+    if (marc_map_open (shard_name (namebuf, shard, "mrc"), &map) == 0) {
+        while (marc_map_read (map, &recp, &reclen) == 0) {
+            if ((stat = marc_wrt_rec (S_outwp, recp)) != 0)
+                cm_error (CM_FATAL, "Error %d writing record", stat);
+        }
+        marc_map_close (map);
+    }
+
+    /* Counts, and the last record's UI */
+    ok = 0;
+    if ((fp = fopen (shard_name (namebuf, shard, "sts"), "r")) != NULL) {
+        if (fscanf (fp, "%ld %ld %d %d\n",
+                    &in_recs, &out_recs, &warns, &errs) == 4) {
+            S_main->in_recs   = in_recs;
+            S_main->out_recs += out_recs;
+            S_main->warns    += warns;
+            S_main->errs     += errs;
+            ok = 1;
+        }
+        while (fgets (line, sizeof(line), fp)) {
+            line[strcspn (line, "\n")] = '\0';
+            if ((valp = strchr (line, '=')) == NULL)
+                continue;
+            *valp++ = '\0';
+            if (cmp_get_named_buf (line, &bufp, 1, strlen (valp) + 1,
+                                   &buflen) == CM_STAT_OK)
+                strcpy ((char *) bufp, valp);
+        }
+        fclose (fp);
+    }
+
+    return ok ? 0 : -1;
+
+} /* merge_shard */
+
+
+/************************************************************************
+* shard_name ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make the name of a temporary file for a -f child, next to       *
+*       the output file.                                                *
+*                                                                       *
+*   PASS                                                                *
+*       Buffer for name, FILENAME_MAX chars.                            *
+*       Shard number, org 0.                                            *
+*       Kind of file, "mrc", "log" or "sts".                            *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to buffer.                                                  *
+************************************************************************/
+
+static char *shard_name (
+    char          *bufp,    /* Put name here            */
+    int           shard,    /* Shard number             */
+    char          *extp     /* Kind of file             */
+) {
+    sprintf (bufp, "%s.%d.%s", S_parms.outfile, shard, extp);
+
+    return bufp;
+
+} /* shard_name */
+
+
+/************************************************************************
+* shard_status ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       In a -f child, write our counts and the last record's UI for    *
+*       merge_shard() in the parent.                                    *
+*                                                                       *
+*   PASS                                                                *
+*       Void.                                                           *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  If it can't be written, the parent treats the child      *
+*       as having failed.                                               *
+************************************************************************/
+
+static void shard_status ()
+{
+    FILE          *fp;      /* Counts file              */
+    char          namebuf[FILENAME_MAX], /* Its name        */
+                  *namep;   /* Named buffer to pass on  */
+    unsigned char *bufp;    /* Its contents             */
+    size_t        buflen;   /* Its length               */
+    int           i;        /* Loop counter             */
+
+    static char *s_names[] = {"bibid", "ui"};
+
+
+    if ((fp = fopen (shard_name (namebuf, S_shard - 1, "sts"), "w")) == NULL)
+        return;
+
+    fprintf (fp, "%ld %ld %d %d\n", S_main->in_recs, S_main->out_recs,
+             S_main->warns, S_main->errs);
+    for (i=0; i<2; i++) {
+        namep = s_names[i];
+        if (cmp_get_named_buf (namep, &bufp, 0, 0, &buflen) == CM_STAT_OK)
+            fprintf (fp, "%s=%s\n", namep, (char *) bufp);
+    }
+
+    fclose (fp);
+
+} /* shard_status */
+
+
+/************************************************************************
+* read_input ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Read the next input record, from the mapped input file if       *
+*       there is one, else from the block reader.                       *
+*                                                                       *
+*   PASS                                                                *
+*       Block read input file, NULL if mapped.                          *
+*       Mapped input file, NULL if not mapped.                          *
+*       Ptr to place to put ptr to record.                              *
+*       Ptr to place to put its length.                                 *
+*                                                                       *
+*   RETURN                                                              *
+*       Return from marc_map_read() or marc_blk_read().                 *
+************************************************************************/
+
+static int read_input (
+    MARCBLKP      inblkp,   /* Input file               */
+    MARCMAPP      inmapp,   /* Or mapped input file     */
+    unsigned char **recpp,  /* Put ptr to record here   */
+    size_t        *reclenp  /* Put length here          */
+) {
+    int           stat;     /* Return from read         */
+
+
+    if (inmapp)
+        stat = marc_map_read (inmapp, recpp, reclenp);
+    else
+        stat = marc_blk_read (inblkp, recpp, reclenp);
+
+#ifdef DEBUG
+    if (stat == 0)
+        g_reclen = (int) *reclenp;
+#endif
+
+    return stat;
+
+} /* read_input */
+
+
+/************************************************************************
+* skip_by_index ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Position the input file at the first record after those to      *
+*       be skipped, using the sidecar index infile.idx instead of       *
+*       reading through them.                                           *
+*                                                                       *
+*       If there is no index, or it is out of date, we build one        *
+*       first.  It's then there for the next run.                       *
+*                                                                       *
+*       If no usable index can be had, we warn and leave the input      *
+*       alone.  The main loop then skips by reading, as usual.          *
+*                                                                       *
+*   PASS                                                                *
+*       Block read input file, NULL if mapped.                          *
+*       Mapped input file, NULL if not mapped.                          *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+*       In_recs counts the skipped records, as if they had been read.   *
+************************************************************************/
+
+static void skip_by_index (
+    MARCBLKP      inblkp,   /* Input file               */
+    MARCMAPP      inmapp    /* Or mapped input file     */
+) {
+    MARCIDXP      ixp;      /* Index of input file      */
+    char          idxname[FILENAME_MAX]; /* Its name        */
+    long          count,    /* Records in input file    */
+                  skip;     /* Records to skip          */
+    off_t         offset;   /* Of first record wanted   */
+    size_t        len;      /* Record length            */
+    int           stat;     /* Return from marc_idx_... */
+
+
+    if (strlen (S_parms.infile) + 5 > sizeof(idxname)) {
+        cm_error (CM_WARNING, "Input file name too long to index");
+        return;
+    }
+    sprintf (idxname, "%s.idx", S_parms.infile);
+
+    stat = marc_idx_open (idxname, S_parms.infile, &ixp);
+    if (stat == MARC_ERR_IDX_OPEN || stat == MARC_ERR_IDX_STALE) {
+        if ((stat = marc_idx_build (S_parms.infile, idxname, 0)) == 0)
+            stat = marc_idx_open (idxname, S_parms.infile, &ixp);
+    }
+    if (stat != 0) {
+        cm_error (CM_WARNING, "Error %d using index \"%s\", "
+                  "skipping by reading", stat, idxname);
+        return;
+    }
+
+    /* Skipping everything just leaves us at the end */
+    marc_idx_count (ixp, &count);
+    skip = S_parms.skip_recs < count ? S_parms.skip_recs : count;
+    if (skip == count) {
+        if (count > 0) {
+            marc_idx_get (ixp, count - 1, &offset, &len, NULL);
+            offset += len;
+        }
+        else
+            offset = 0;
+    }
+    else
+        marc_idx_get (ixp, skip, &offset, &len, NULL);
+    marc_idx_close (ixp);
+
+    if (inmapp)
+        stat = marc_map_seek (inmapp, offset);
+    else
+        stat = marc_blk_seek (inblkp, offset);
+    if (stat != 0)
+        cm_error (CM_FATAL, "Error %d seeking to input record %ld",
+                  stat, skip);
+
+    S_main->in_recs = skip;
+
+} /* skip_by_index */
+
+
+/************************************************************************
+* ctx_init ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Create a conversion context and make it the calling thread's.   *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to place to put ptr to new context.                         *
+*       Ptr to context to copy named buffers from, NULL to start        *
+*           with none.                                                  *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  Fatal error if anything fails.                           *
+************************************************************************/
+
+/* Simple checksum of things that should never change */
+#define CM_CHECKSUM(c) \
+    ( (long) (c)->pparms.outmp + (long) (c)->pparms.bufp \
+    + (long) (c)->pparms.buflen + (long) (c)->pparms.ctxp \
+    + (long) (c)->pparms.arenap )
+
+static void ctx_init (
+    CM_CTX        **ctxpp,  /* Put new context here     */
+    CM_CTX        *fromp    /* Copy named bufs, or NULL */
+) {
+    CM_CTX        *ctxp;    /* New context              */
+    int           stat;     /* From marc_init()         */
+
+
+#ifdef DEBUG
+    ctxp = (CM_CTX *) marc_calloc (sizeof(CM_CTX), 1, 204); //TAG:204
+#else
+    ctxp = (CM_CTX *) calloc (sizeof(CM_CTX), 1);
+#endif
+    if (!ctxp) {
+        fprintf (stderr, "Out of memory for conversion context\n");
+        exit (1);
+    }
+
+    /* From here on cm_error() can find it */
+    S_ctxp = *ctxpp = ctxp;
+
+    /* Create record controls for input and output */
+    if ((stat = marc_init (&ctxp->inmp)) != 0)
+        cm_error (CM_FATAL, "Error %d initializing input record control");
+    if ((stat = marc_init (&ctxp->outmp)) != 0)
+        cm_error (CM_FATAL, "Error %d initializing output record control");
+
+    /* Turn off subfield sorting on output */
+    marc_subfield_sort (ctxp->outmp, 0);
+
+    /* Procs look back and forth through input fields, parse each
+     *   input record once for all of them
+     */
+    marc_subfield_index (ctxp->inmp, 1);
+
+    /* Get a buffer which procs can modify */
+#ifdef DEBUG
+    if ((ctxp->bufp = (unsigned char *) marc_alloc(CM_PROC_BUF_SIZE, 201)) == NULL) { //TAG:201
+        cm_error (CM_FATAL, "Proc buffer memory");
+    }
+#else
+    if ((ctxp->bufp = (unsigned char *) malloc (CM_PROC_BUF_SIZE)) == NULL) {
+        cm_error (CM_FATAL, "Proc buffer memory");
     }
+#endif
+
+    /* Fill unchanging parts of the parameter structure */
+    ctxp->pparms.outmp  = ctxp->outmp;
+    ctxp->pparms.bufp   = ctxp->bufp;
+    ctxp->pparms.buflen = CM_PROC_BUF_SIZE;
+    ctxp->pparms.ctxp   = ctxp;
+    cmp_new_arena (&ctxp->pparms.arenap);
+
+    /* Compute checksum to find wayward procs */
+    ctxp->checksum = CM_CHECKSUM (ctxp);
+
+    cmp_new_named_bufs (&ctxp->nbufp, fromp ? fromp->nbufp : NULL);
+
+} /* ctx_init */
+
+
+/************************************************************************
+* ctx_free ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Free everything in a conversion context from ctx_init().        *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to context.                                                 *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void ctx_free (
+    CM_CTX        *ctxp     /* Context to free          */
+) {
+    marc_free (ctxp->inmp);
+    marc_free (ctxp->outmp);
+
+    /* Proc's cursor on input only borrows its buffers */
+    if (ctxp->pparms.inmp)
+        marc_free (ctxp->pparms.inmp);
+    cmp_free_named_bufs (ctxp->nbufp);
+    cmp_free_arena (ctxp->pparms.arenap);
+
+#ifdef DEBUG
+    marc_dealloc (ctxp->bufp, 201);  //TAG:201
+    marc_dealloc (ctxp, 204);        //TAG:204
+#else
+    free (ctxp->bufp);
+    free (ctxp);
+#endif
+
+    if (S_ctxp == ctxp)
+        S_ctxp = NULL;
+
+} /* ctx_free */
+
+
+/************************************************************************
+* cm_ctx ()                                                             *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Get the calling thread's conversion context.                    *
+*                                                                       *
+*       Procs should use the one in their CM_PROC_PARMS.  This is for   *
+*       routines called without one, like cm_error() and                *
+*       cmp_get_named_buf().                                            *
+*                                                                       *
+*   PASS                                                                *
+*       Void.                                                           *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to context, NULL if none yet.                               *
+************************************************************************/
+
+CM_CTX *cm_ctx ()
+{
+    return S_ctxp;
+
+} /* cm_ctx */
+
+
+/************************************************************************
+* exec_proc ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Execute a chain of procedures.                                  *
+*                                                                       *
+*       The chain was compiled by compile_chain().  Procedures it       *
+*       turned into opcodes are done here, the rest are called.         *
+*                                                                       *
+*   PASS                                                                *
+*       Conversion context.                                             *
+*       Ptr to compiled chain of procedures.                            *
+*       Ptr to ptr to current data.                                     *
+*           This points directly into the record.                       *
+*           It stays there until a proc changes it, or one not flagged  *
+*               CMP_NOBUF is called, then it's copied out to another    *
+*               buffer and we point to this buffer instead.             *
+*           NULL if no current data, i.e., we're at a level above       *
+*               a level (field or subfield) which has actual data.      *
+*       Length of current data.                                         *
+*       Ptr to place to put new length                                  *
+*           NULL if caller doesn't need new length.                     *
+*                                                                       *
+*       Rest of data comes from the context.                            *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+************************************************************************/
+
+static CM_STAT exec_proc (
+    CM_CTX        *ctxp,            /* Conversion context           */
+    CM_CODE       *codep,           /* Compiled chain of procs      */
+    unsigned char **datapp,         /* Ptr to ptr to data           */
+    size_t        datalen,          /* Length of data at *datpp     */
+    size_t        *newlen           /* Put new length here          */
+) {
+    CM_PROC_PARMS *pp;              /* Parms to pass                */
+    CM_INSN       *ip;              /* Current instruction          */
+    unsigned char *bufp;            /* Modifiable data              */
+    int           i,                /* Index of ip                  */
+                  save_stat,        /* Return from marc_save_pos    */
+                  stat,             /* Return from marc_cursor      */
+                  retcode;          /* Return code                  */
+
+
+    /* If no passed procedure list, nothing to do
+     * This is actually the most common case since any field or
+     *   subfield not requiring pre or post procs will have a
+     *   null pointer to procs
+     */
+    if (!codep)
+        return CM_STAT_OK;
+
+    pp   = &ctxp->pparms;
+    bufp = ctxp->bufp;
 
     /* Validate data length, longer is impossible in marc */
     if (datalen >= CM_PROC_BUF_SIZE)
         cm_error (CM_FATAL, "Data length exceeds max allowed (%d)",
                   CM_PROC_BUF_SIZE);
 
-    /* May or may not be passed data */
+    /* May or may not be passed data.
+     * Procs that only read it see it where it is, it's copied to the
+     *   modifiable buffer when something writes to it.
+     */
     if (datalen) {
-
-        /* Copy current data to modifiable buffer */
-        memcpy (s_bufp, *datapp, datalen);
-        s_bufp[datalen] = '\0';
+        pp->datap   = *datapp;
+        pp->datalen = datalen;
+    }
+    else {
+        *bufp       = '\0';
+        pp->datap   = bufp;
+        pp->datalen = 0;
     }
-    else
-        *s_bufp = '\0';
 
-    /* Tell caller where to find (possibly) modified data, if he wants it */
-    if (datapp)
-        *datapp = s_bufp;
+    i       = 0;
+    retcode = 0;
+    while (i < codep->count && !retcode) {
+        ip = &codep->insn[i];
 
-    do {
         /* Make arguments available to function */
-        s_pparms.args      = linkp->args;
-        s_pparms.arg_count = linkp->arg_count;
+        pp->args      = ip->args;
+        pp->arg_count = ip->arg_count;
+        pp->opnds     = ip->opnds;
+        pp->predp     = ip->predp;
 
         /* Give proc an input rec to play with
-         *   without disturbing the input position.
+         *   without disturbing the input position, or its parse.
+         * Not needed by those that never look at it.
          */
-        marc_dup (S_inmp, &s_pparms.inmp);
+        if (ip->need & CM_NEED_CURSOR) {
+            if ((stat = marc_cursor (ctxp->inmp, &pp->inmp)) != 0)
+                cm_error (CM_FATAL, "Error %d from marc_cursor", stat);
+        }
 
         /* Remember where we are in the output record so we
          *   can return here if the proc changes things
          */
-        if ((save_stat = marc_save_pos (S_outmp)) < 0)
-            cm_error (CM_FATAL, "Error %d from marc_save_pos", save_stat);
+        save_stat = MARC_RET_NO_POS;
+        if (ip->need & CM_NEED_SAVE) {
+            if ((save_stat = marc_save_pos (ctxp->outmp)) < 0)
+                cm_error (CM_FATAL, "Error %d from marc_save_pos",
+                          save_stat);
+        }
+
+        /* One that may use pp->bufp gets the data there */
+        if (ip->need & CM_NEED_DATA)
+            cmp_own_data (pp);
+
+        switch (ip->op) {
+
+            case CM_OP_CALL:
+                retcode = (ip->procp) (pp);
+
+                /* Ensure no obvious damage done */
+                if (ctxp->checksum != CM_CHECKSUM (ctxp))
+                    cm_error (CM_FATAL, "Badly behaved function %s",
+                              ip->func_name);
+                break;
 
-        /* Call next function */
-        retcode = (linkp->procp) (&s_pparms);
+            /* Generic procs, done as they would do themselves */
+            case CM_OP_IF:
+                retcode = cmp_if (pp);
+                break;
+
+            case CM_OP_CLEAR:
+                retcode = cmp_buf_copy (pp, ip->args[0], "\"\"", 0);
+                break;
+
+            case CM_OP_COPY:
+                retcode = cmp_buf_copy (pp, ip->args[0], ip->args[1], 0);
+                break;
+
+            case CM_OP_APPEND:
+                retcode = cmp_buf_copy (pp, ip->args[0], ip->args[1], 1);
+                break;
+
+            case CM_OP_SUBSTR:
+                retcode = cmp_substr (pp);
+                break;
+
+            case CM_OP_INDIC:
+                retcode = cmp_indic (pp);
+                break;
+
+            case CM_OP_STAT:
+                retcode = ip->stat;
+                break;
+        }
 
-        /* Ensure no obvious damage done */
-        if (s_checksum != CM_CHECKSUM)
-            cm_error (CM_FATAL, "Badly behaved function %s", linkp->func_name);
+        /* And it may leave any length of it there */
+        if (ip->need & CM_NEED_DATA) {
+            pp->datap   = bufp;
+            pp->datalen = strlen ((char *) bufp);
+        }
 
         /* Restore position if we saved one */
         if (!save_stat) {
-            if ((save_stat = marc_restore_pos (S_outmp)) < 0)
+            if ((save_stat = marc_restore_pos (ctxp->outmp)) < 0)
                 cm_error (CM_FATAL, "Error %d from marc_restore_pos",
                           save_stat);
         }
@@ -591,13 +2015,13 @@ static CM_STAT exec_proc (
         switch (retcode) {
 
             case CM_STAT_OK:
-                /* Point to next proc on list */
-                linkp = linkp->true_nextp;
+                /* On to next instruction */
+                i = ip->nexti;
                 break;
 
             case CM_STAT_IF_FAILED:
                 /* Evaluation of conditional requires jump to false branch */
-                linkp   = linkp->false_nextp;
+                i       = ip->faili;
                 retcode = 0;
                 break;
 
@@ -607,11 +2031,15 @@ static CM_STAT exec_proc (
                  */
                 break;
         }
-    } while (linkp && !retcode);
+    }
+
+    /* Tell caller where to find (possibly) modified data, if he wants it */
+    if (datapp)
+        *datapp = pp->datap;
 
     /* If new length desired, return it */
     if (newlen)
-        *newlen = strlen ((char *) s_bufp);
+        *newlen = pp->datalen;
 
     return (retcode);
 
@@ -624,6 +2052,9 @@ static CM_STAT exec_proc (
 *   DEFINITION                                                          *
 *       Report results of run.                                          *
 *                                                                       *
+*       A -f child only passes its counts on to the parent, which       *
+*       reports for the whole run.                                      *
+*                                                                       *
 *   PASS                                                                *
 *       Void.                                                           *
 *                                                                       *
@@ -637,6 +2068,11 @@ static void report ()
     FILE *logfp;        /* Log file             */
 
 
+    if (S_shard) {
+        shard_status ();
+        return;
+    }
+
     /* Open logfile */
     if ((logfp = fopen (S_parms.logfile, "a")) == NULL) {
         fprintf (stderr, "Error opening logfile \"%s\", using stderr\n",
@@ -649,10 +2085,10 @@ static void report ()
     fprintf (logfp, "%s", sepbuf);
 
     /* Report */
-    fprintf (logfp, "      Input records: %7ld\n", S_in_recs);
-    fprintf (logfp, "     Output records: %7ld\n", S_out_recs);
-    fprintf (logfp, "           Warnings: %7d\n", S_warns);
-    fprintf (logfp, "             Errors: %7d\n", S_errs);
+    fprintf (logfp, "      Input records: %7ld\n", S_main->in_recs);
+    fprintf (logfp, "     Output records: %7ld\n", S_main->out_recs);
+    fprintf (logfp, "           Warnings: %7d\n", S_main->warns);
+    fprintf (logfp, "             Errors: %7d\n", S_main->errs);
 
     if (logfp != stderr) {
 
@@ -771,7 +2207,6 @@ static int load_switch_file (
     unsigned char *bufp;            /* Dummy for get_named_buf()*/
     int    val_count;               /* Number of value parts    */
     size_t buflen;                  /* Dummy for get_named_buf()*/
-    CM_PROC_PARMS pparm;            /* Dummy for buf_write()    */
 
 
     /* Null switch file is no error */
@@ -805,14 +2240,14 @@ static int load_switch_file (
                       "switch \"%s\" has multiple / separated values", keyp);
 
         /* Add switch and value to named buffer area */
-        cmp_buf_write (&pparm, keyp, (unsigned char *) valpp[0],
+        cmp_buf_write (&S_main->pparms, keyp, (unsigned char *) valpp[0],
                        strlen (valpp[0]), 0);
     }
 
     close_ctl_file (&sfp);
 
     /* Return count of errors */
-    return (S_errs);
+    return (S_main->errs);
 
 } /* load_switch_file */
 
@@ -844,7 +2279,7 @@ static int load_ctl_file (
     CM_LVL   level;                 /* Record, field, or sf     */
     CM_TOK   token;                 /* Control file line type   */
     CM_CND   condition;             /* Controls if/else/endif   */
-    int      i,                     /* Loop counter             */
+    int      i, j,                  /* Loop counters            */
              val_count,             /* Number of value parts    */
              tvalue,                /* Token value              */
              if_nest,               /* Index into cond_stack    */
@@ -1144,136 +2579,798 @@ static int load_ctl_file (
                     }
                 }
 
-                /* Check for valid subfield code */
-                else if (in_field_id >= 10) {
-                    if (marc_ok_subfield (in_sf_id) != 0) {
-                        cm_error (CM_ERROR, "Invalid sf code = %c", in_sf_id);
+                /* Check for valid subfield code */
+                else if (in_field_id >= 10) {
+                    if (marc_ok_subfield (in_sf_id) != 0) {
+                        cm_error (CM_ERROR, "Invalid sf code = %c", in_sf_id);
+
+                        /* In order to complete compile, we'll just
+                         *   overwrite an existing one.  Doesn't
+                         *   matter since we won't execute anyway.
+                         */
+                        in_sf_id = 'a';
+                    }
+                }
+
+                /* Point to subfield control block */
+                cursfp = &curfdp->sf[get_sf_ctl (in_sf_id)];
+
+                /* Set context for subsequent statements */
+                level = CM_LVL_SF;
+        }
+    }
+
+    /* Done with control file */
+    close_ctl_file (&cfp);
+
+    /* Lay out every chain for exec_proc()
+     * Fields from nnX and nXX share one control, compile it once.
+     */
+    S_sessprepc = compile_chain (S_sessprepp);
+    S_sesspostc = compile_chain (S_sesspostp);
+    S_recprepc  = compile_chain (S_recprepp);
+    S_recpostc  = compile_chain (S_recpostp);
+    for (i=0; i<1000; i++) {
+        if ((curfdp = S_fieldp[i]) == NULL)
+            continue;
+        if (curfdp->prepp && !curfdp->prepc)
+            curfdp->prepc = compile_chain (curfdp->prepp);
+        if (curfdp->postp && !curfdp->postc)
+            curfdp->postc = compile_chain (curfdp->postp);
+        for (j=0; j<CM_MAX_MARC_SFS; j++) {
+            cursfp = &curfdp->sf[j];
+            if (cursfp->prepp && !cursfp->prepc)
+                cursfp->prepc = compile_chain (cursfp->prepp);
+            if (cursfp->postp && !cursfp->postc)
+                cursfp->postc = compile_chain (cursfp->postp);
+        }
+    }
+
+    /* Return count of errors */
+    return (S_main->errs);
+
+} /* load_ctl_file */
+
+
+/************************************************************************
+*   make_proc ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Create and initialize a procedure control block.                *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to array of pointers to components.                     *
+*           First component (part[0]) is procedure name.                *
+*           Additional components are optional arguments.               *
+*       Pointer to place to put pointer to condition info.              *
+*           Caller needs this to keep track of if/else/endif            *
+*           groupings of procedure calls.                               *
+*       Count of total passed components.                               *
+*       Current processing level: record, field or subfield.            *
+*       Current procedure position: pre or post-process.                *
+*                                                                       *
+*                                                                       *
+*   RETURN                                                              *
+*       Pointer to initialized block.                                   *
+************************************************************************/
+
+static CM_PROC *make_proc (
+    char    **part,         /* Ptr to array of part ptrs*/
+    CM_CND  *condition,     /* Controls if/else/endif   */
+    int     count,          /* Number of parts          */
+    CM_LVL  level,          /* Record, field or subfield*/
+    int     ppos            /* Procedure position       */
+) {
+    int     i,              /* Loop counter             */
+            arg_min,        /* Min arg count for proc   */
+            arg_max,        /* Max arg count            */
+            flags,          /* Bit flags from func table*/
+            valid_pos;      /* Valid position bit flag  */
+    CM_PROC *pp;            /* Ptr to new proc block    */
+    static int s_seq;       /* Count of procs made      */
+
+
+    /* Allocate block */
+#ifdef DEBUG
+    if ((pp = (CM_PROC *) marc_calloc (sizeof(CM_PROC), 1, 1002)) == NULL) {  // TAG:1002
+        cm_error (CM_FATAL, "Procedure block memory");
+    }
+#else
+    if ((pp = (CM_PROC *) calloc (sizeof(CM_PROC), 1)) == NULL) {
+        cm_error (CM_FATAL, "Procedure block memory");
+    }
+#endif
+
+    /* Lookup procedure name and convert to token */
+    if ((pp->procp = cmp_lookup_proc (part[0], condition, &arg_min,
+                                      &arg_max, &flags)) == NULL)
+        cm_error (CM_ERROR, "Unknown procedure %s", part[0]);
+    pp->flags = flags;
+
+    /* -j needs every proc run on records to be thread safe */
+    if (pp->procp && !(flags & CMP_MT) && level != CM_LVL_SESSION
+                  && !S_unsafep)
+        S_unsafep = strdup (part[0]);
+
+    /* Validate argument count, args are in part[1], part[2] ... */
+    if (arg_min > count - 1)
+        cm_error (CM_ERROR, "Insufficient arguments for function %s",
+                  part[0]);
+    if (arg_max < count - 1)
+        cm_error (CM_ERROR, "Too many arguments for function %s",
+                  part[0]);
+
+    /* Create bit flag to validate positioning */
+    valid_pos = 0;
+    switch (level) {
+        case CM_LVL_RECORD: valid_pos = CMP_RE; break;
+        case CM_LVL_FIELD:  valid_pos = CMP_FE; break;
+        case CM_LVL_SF:     valid_pos = CMP_SE; break;
+        default: break;
+    }
+    if (ppos == CM_TK_POST)
+        valid_pos <<= 1;
+
+    /* Perform position validation */
+    if (!(flags | valid_pos))
+        cm_error (CM_ERROR, "Can't use this procedure in this position");
+
+    /* Deep copy of function name */
+    if ((pp->func_name = strdup (part[0])) == NULL)
+        cm_error (CM_FATAL, "Procedure name memory");
+
+    /* Deep copy of args */
+    for (i=0; i<count-1; i++) {
+        if (i >= CM_MAX_ARGS) {
+            cm_error (CM_ERROR, "Exceeded max argument count of %d",
+                      CM_MAX_ARGS);
+            break;
+        }
+        if ((pp->args[i] = strdup (part[i+1])) == NULL)
+            cm_error (CM_FATAL, "Procedure argument memory");
+
+        /* Decode it now, whatever it turns out to be used for */
+        cmp_compile_opnd (pp->args[i], &pp->opnds[i]);
+    }
+    pp->arg_count = count - 1;
+
+    /* Tests are decided once here, not every time they're run */
+    if (pp->procp == cmp_if)
+        pp->predp = cmp_compile_if (pp);
+
+    /* Chains are laid out in the order procs appear in the table */
+    pp->seq  = s_seq++;
+    pp->insn = -1;
+
+    /* Initialize next pointers
+     * Not necessary, but aids debugging
+     */
+    pp->true_nextp = pp->false_nextp = NULL;
+
+    return (pp);
+
+} /* make_proc */
+
+
+/************************************************************************
+* compile_chain ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Compile a chain of procedure control blocks into an array of    *
+*       instructions for exec_proc().                                   *
+*                                                                       *
+*       The blocks are laid out in the order they came in the control   *
+*       table, so a chain mostly runs straight down the array.  Each    *
+*       instruction has the number of the one to go to next, and the    *
+*       one to go to if it's a test that fails.  Else and endif blocks  *
+*       do nothing, they get no instruction and anything going to one   *
+*       goes to whatever follows it.                                    *
+*                                                                       *
+*       Generic procs in S_inline[] become opcodes exec_proc() does     *
+*       itself, everything else is called through its pointer.          *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to head of chain, may be NULL.                              *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to compiled chain, NULL if no chain.                        *
+*       All errors are fatal.                                           *
+************************************************************************/
+
+/* Procs done by exec_proc(), and what they turn into */
+static struct {
+    CM_FUNCP procp;         /* Proc in G_proc_list          */
+    CM_OP    op;            /* Opcode for it                */
+    CM_STAT  stat;          /* Return code, for CM_OP_STAT  */
+} S_inline[] = {
+    {cmp_if,      CM_OP_IF,     CM_STAT_OK},
+    {cmp_clear,   CM_OP_CLEAR,  CM_STAT_OK},
+    {cmp_copy,    CM_OP_COPY,   CM_STAT_OK},
+    {cmp_append,  CM_OP_APPEND, CM_STAT_OK},
+    {cmp_substr,  CM_OP_SUBSTR, CM_STAT_OK},
+    {cmp_indic,   CM_OP_INDIC,  CM_STAT_OK},
+    {cmp_donesf,  CM_OP_STAT,   CM_STAT_DONE_SF},
+    {cmp_donefld, CM_OP_STAT,   CM_STAT_DONE_FIELD},
+    {cmp_donerec, CM_OP_STAT,   CM_STAT_DONE_RECORD},
+    {cmp_killfld, CM_OP_STAT,   CM_STAT_KILL_FIELD},
+    {cmp_killrec, CM_OP_STAT,   CM_STAT_KILL_RECORD},
+    {NULL,        CM_OP_CALL,   CM_STAT_OK}
+};
+
+static CM_CODE *compile_chain (
+    CM_PROC  *headp         /* First proc in chain          */
+) {
+    CM_PROC  **nodes,       /* Every block in the chain     */
+             *p;            /* One of them                  */
+    CM_CODE  *codep;        /* Compiled chain               */
+    CM_INSN  *ip;           /* Instruction being filled in  */
+    int      node_cnt,      /* Blocks found so far          */
+             node_max,      /* Room in nodes                */
+             count,         /* Number of instructions       */
+             i, j;          /* Loop counters                */
+
+
+    if (!headp)
+        return NULL;
+
+    /* Find every block reachable from the head
+     * Nodes found are marked with insn 0 and queued at the end,
+     *   each is looked at in turn until no new ones turn up.
+     */
+    node_max = 16;
+    if ((nodes = (CM_PROC **) malloc (node_max * sizeof(CM_PROC *))) == NULL)
+        cm_error (CM_FATAL, "Procedure chain memory");
+    nodes[0]    = headp;
+    headp->insn = 0;
+    node_cnt    = 1;
+    for (i=0; i<node_cnt; i++) {
+        for (j=0; j<2; j++) {
+            p = j ? nodes[i]->false_nextp : nodes[i]->true_nextp;
+            if (!p || p->insn >= 0)
+                continue;
+            if (node_cnt == node_max) {
+                node_max *= 2;
+                if ((nodes = (CM_PROC **) realloc (nodes,
+                                node_max * sizeof(CM_PROC *))) == NULL)
+                    cm_error (CM_FATAL, "Procedure chain memory");
+            }
+            p->insn = 0;
+            nodes[node_cnt++] = p;
+        }
+    }
+
+    /* Back in table order, number everything but else and endif */
+    qsort (nodes, node_cnt, sizeof(CM_PROC *), chain_order);
+    count = 0;
+    for (i=0; i<node_cnt; i++) {
+        if (nodes[i]->procp != cmp_nop)
+            nodes[i]->insn = count++;
+    }
+
+    /* All else's and endif's, nothing to do */
+    if (count == 0) {
+        free (nodes);
+        return NULL;
+    }
+
+    /* One block for the chain and its instructions */
+#ifdef DEBUG
+    if ((codep = (CM_CODE *) marc_calloc (sizeof(CM_CODE)
+                      + count * sizeof(CM_INSN), 1, 1003)) == NULL)  // TAG:1003
+        cm_error (CM_FATAL, "Procedure chain memory");
+#else
+    if ((codep = (CM_CODE *) calloc (sizeof(CM_CODE)
+                      + count * sizeof(CM_INSN), 1)) == NULL)
+        cm_error (CM_FATAL, "Procedure chain memory");
+#endif
+    codep->count = count;
+    codep->insn  = (CM_INSN *) (codep + 1);
+
+    for (i=0; i<node_cnt; i++) {
+        if ((p = nodes[i])->procp == cmp_nop)
+            continue;
+        ip = &codep->insn[p->insn];
+
+        /* Opcode, or a call */
+        for (j=0; S_inline[j].procp; j++) {
+            if (S_inline[j].procp == p->procp)
+                break;
+        }
+        ip->op        = S_inline[j].op;
+        ip->stat      = S_inline[j].stat;
+        ip->procp     = p->procp;
+        ip->args      = p->args;
+        ip->opnds     = p->opnds;
+        ip->predp     = p->predp;
+        ip->arg_count = p->arg_count;
+        ip->func_name = p->func_name;
+        ip->need      = insn_need (ip);
+        if (!(p->flags & CMP_NOBUF))
+            ip->need |= CM_NEED_DATA;
+
+        /* Branches */
+        ip->nexti = chain_target (p->true_nextp, count);
+        ip->faili = chain_target (p->false_nextp, count);
+    }
+
+    free (nodes);
+
+    return codep;
+
+} /* compile_chain */
+
+
+/************************************************************************
+* chain_target ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Get the instruction number a branch goes to, past any else or   *
+*       endif, which have none.                                         *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to block branched to, NULL = end of chain.                  *
+*       Number of instructions in the chain.                            *
+*                                                                       *
+*   RETURN                                                              *
+*       Instruction number, count for end of chain.                     *
+************************************************************************/
+
+static int chain_target (
+    CM_PROC *p,             /* Block branched to            */
+    int     count           /* Instructions in chain        */
+) {
+    while (p && p->procp == cmp_nop)
+        p = p->true_nextp;
+
+    return p ? p->insn : count;
+
+} /* chain_target */
+
+
+/************************************************************************
+* chain_order ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       qsort() comparison of procedure blocks, in the order they       *
+*       were made, i.e., their order in the control table.              *
+*                                                                       *
+*   PASS                                                                *
+*       Ptrs to two ptrs to CM_PROCs.                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       Negative, 0, or positive, as for qsort().                       *
+************************************************************************/
+
+static int chain_order (
+    const void *ap,         /* Ptr to ptr to one block      */
+    const void *bp          /* Ptr to ptr to other          */
+) {
+    return (*(CM_PROC **) ap)->seq - (*(CM_PROC **) bp)->seq;
+
+} /* chain_order */
+
+
+/************************************************************************
+* insn_need ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Decide what exec_proc() has to set up for an instruction.       *
+*                                                                       *
+*       Procs that are called get everything.  Opcodes that only use    *
+*       named buffers, %data and literals need neither a fresh cursor   *
+*       on the input record nor the output position saved.             *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to instruction, with op, args and opnds filled in.          *
+*                                                                       *
+*   RETURN                                                              *
+*       CM_NEED_... bits.                                               *
+************************************************************************/
+
+static int insn_need (
+    CM_INSN *ip             /* Instruction to look at       */
+) {
+    int     ids[2],         /* Args naming data, or -1      */
+            i;              /* Loop counter                 */
+
+
+    ids[0] = ids[1] = -1;
+    switch (ip->op) {
+        case CM_OP_CALL:
+            return CM_NEED_CURSOR | CM_NEED_SAVE;
+        case CM_OP_INDIC:
+            return CM_NEED_SAVE;
+        case CM_OP_STAT:
+            return 0;
+        case CM_OP_IF:
+            /* Data tested, and what it's tested against */
+            ids[0] = 0;
+            ids[1] = 2;
+            break;
+        case CM_OP_CLEAR:
+            ids[0] = 0;
+            break;
+        default:
+            /* Destination and source */
+            ids[0] = 0;
+            ids[1] = 1;
+            break;
+    }
+
+    for (i=0; i<2; i++) {
+        if (ids[i] < 0 || ids[i] >= ip->arg_count)
+            continue;
+        switch (ip->opnds[ids[i]].type) {
+            case CM_ID_BUF:
+            case CM_ID_CURRENT:
+            case CM_ID_LITERAL:
+                break;
+            default:
+                /* MARC reference, builtin, or something odd */
+                return CM_NEED_CURSOR | CM_NEED_SAVE;
+        }
+    }
 
-                        /* In order to complete compile, we'll just
-                         *   overwrite an existing one.  Doesn't
-                         *   matter since we won't execute anyway.
-                         */
-                        in_sf_id = 'a';
-                    }
-                }
+    return 0;
 
-                /* Point to subfield control block */
-                cursfp = &curfdp->sf[get_sf_ctl (in_sf_id)];
+} /* insn_need */
 
-                /* Set context for subsequent statements */
-                level = CM_LVL_SF;
+
+/************************************************************************
+* carried_buf ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find a named buffer that a record might read before writing,    *
+*       and so see what the record before it left there.                *
+*                                                                       *
+*       Buffers only set by session procs or the switch file are the    *
+*       same for every record and are fine.  Any other is fine where    *
+*       it's read only if something in the same record wrote it on      *
+*       every way there: earlier in the chain, or in a chain that       *
+*       always runs first - the record pre-procs for everything, the    *
+*       field pre-procs for the field's subfields and post-procs, the   *
+*       subfield pre-procs for its post-procs.                          *
+*                                                                       *
+*       Session post-procs mustn't read any of them either, they'd see  *
+*       what the last record left.  Only "bibid" and "ui" are copied    *
+*       back from it, those are fine if every record sets them.         *
+*                                                                       *
+*       conv_jobs() gives each worker its own buffers, and each -f      *
+*       child starts its shard with the buffers as session pre-procs    *
+*       left them, so a table that reads one of these can't use either. *
+*                                                                       *
+*   PASS                                                                *
+*       Nothing, looks at the compiled control table.                   *
+*                                                                       *
+*   RETURN                                                              *
+*       Name of first such buffer found, as in the table.               *
+*       NULL if none.                                                   *
+************************************************************************/
+
+/* How procs use their args, by arg number bit
+ * Procs not here may read or write any buffer, named in their args
+ *   or not, and return anything.  What they write is never counted
+ *   as set, see chain_reads().
+ */
+static struct {
+    CM_FUNCP procp;         /* Proc in G_proc_list          */
+    int      reads;         /* Args read                    */
+    int      writes;        /* Args written                 */
+    int      stops;         /* True=may end the chain       */
+} S_bufuse[] = {
+    {cmp_if,        0x05,  0x00,  0},
+    {cmp_clear,     0x00,  0x01,  0},
+    {cmp_copy,      ~0x01, 0x01,  0},
+    {cmp_append,    ~0x00, 0x01,  0},
+    {cmp_substr,    0x02,  0x01,  0},
+    {cmp_normalize, 0x02,  0x01,  0},
+    {cmp_y2toy4,    0x02,  0x01,  1},
+    {cmp_today,     0x00,  0x01,  0},
+    {cmp_log,       ~0x01, 0x00,  0},
+    {cmp_indic,     0x00,  0x00,  1},
+    {cmp_makefld,   0x00,  0x00,  0},
+    {cmp_makesf,    0x00,  0x00,  0},
+    {cmp_renfld,    0x00,  0x00,  0},
+    {cmp_rensf,     0x00,  0x00,  0},
+    {cmp_donesf,    0x00,  0x00,  1},
+    {cmp_donefld,   0x00,  0x00,  1},
+    {cmp_donerec,   0x00,  0x00,  1},
+    {cmp_killfld,   0x00,  0x00,  1},
+    {cmp_killrec,   0x00,  0x00,  1},
+    {NULL,          ~0x00, ~0x00, 1}
+};
+
+static char *carried_buf (void)
+{
+    CM_FIELD *fieldp;       /* Field control                */
+    CM_SF    *sfp;          /* Subfield control             */
+    char     *wrotep,       /* True for each slot written   */
+             *recp,         /* Written by record pre-procs  */
+             *fldp,         /*   then field pre-procs       */
+             *sfdp,         /*   then subfield pre-procs    */
+             *namep;        /* Buffer found, or NULL        */
+    int      nslots,        /* Number of buffer slots       */
+             i, j;          /* Loop counters                */
+
+
+    if ((nslots = cmp_buf_slots ()) == 0)
+        return NULL;
+    if ((wrotep = (char *) calloc (4, nslots)) == NULL)
+        cm_error (CM_FATAL, "Buffer check memory");
+    recp = wrotep + nslots;
+    fldp = recp + nslots;
+    sfdp = fldp + nslots;
+
+    /* Every buffer a record might write */
+    chain_writes (S_recprepc, nslots, wrotep);
+    chain_writes (S_recpostc, nslots, wrotep);
+    for (i=0; i<1000; i++) {
+        if ((fieldp = S_fieldp[i]) == NULL)
+            continue;
+        chain_writes (fieldp->prepc, nslots, wrotep);
+        chain_writes (fieldp->postc, nslots, wrotep);
+        for (j=0; j<CM_MAX_MARC_SFS; j++) {
+            chain_writes (fieldp->sf[j].prepc, nslots, wrotep);
+            chain_writes (fieldp->sf[j].postc, nslots, wrotep);
         }
     }
 
-    /* Done with control file */
-    close_ctl_file (&cfp);
+    /* Are any of them read before they're written? */
+    namep = chain_reads (S_recprepc, nslots, wrotep, recp);
+    for (i=0; i<1000 && !namep; i++) {
+        if ((fieldp = S_fieldp[i]) == NULL)
+            continue;
+        memcpy (fldp, recp, nslots);
+        namep = chain_reads (fieldp->prepc, nslots, wrotep, fldp);
+        for (j=0; j<CM_MAX_MARC_SFS && !namep; j++) {
+            sfp = &fieldp->sf[j];
+            memcpy (sfdp, fldp, nslots);
+            if ((namep = chain_reads (sfp->prepc, nslots, wrotep, sfdp)) == NULL)
+                namep = chain_reads (sfp->postc, nslots, wrotep, sfdp);
+        }
+        if (!namep)
+            namep = chain_reads (fieldp->postc, nslots, wrotep, fldp);
+    }
+    if (!namep)
+        namep = chain_reads (S_recpostc, nslots, wrotep, recp);
 
-    /* Return count of errors */
-    return (S_errs);
+    /* Session post-procs see only what's copied back from the last
+     *   record, its "bibid" and "ui", and only if it always sets them
+     */
+    if (!namep) {
+        memset (fldp, 0, nslots);
+        fldp[S_bibid_slot] = recp[S_bibid_slot];
+        fldp[S_ui_slot]    = recp[S_ui_slot];
+        namep = chain_reads (S_sesspostc, nslots, wrotep, fldp);
+    }
 
-} /* load_ctl_file */
+    free (wrotep);
+
+    return namep;
+
+} /* carried_buf */
 
 
 /************************************************************************
-*   make_proc ()                                                        *
+* buf_use ()                                                            *
 *                                                                       *
 *   DEFINITION                                                          *
-*       Create and initialize a procedure control block.                *
+*       Find how a proc uses named buffers, see carried_buf().          *
 *                                                                       *
 *   PASS                                                                *
-*       Pointer to array of pointers to components.                     *
-*           First component (part[0]) is procedure name.                *
-*           Additional components are optional arguments.               *
-*       Pointer to place to put pointer to condition info.              *
-*           Caller needs this to keep track of if/else/endif            *
-*           groupings of procedure calls.                               *
-*       Count of total passed components.                               *
-*       Current processing level: record, field or subfield.            *
-*       Current procedure position: pre or post-process.                *
-*                                                                       *
+*       Ptr to instruction.                                             *
 *                                                                       *
 *   RETURN                                                              *
-*       Pointer to initialized block.                                   *
+*       Index into S_bufuse[].                                          *
 ************************************************************************/
 
-static CM_PROC *make_proc (
-    char    **part,         /* Ptr to array of part ptrs*/
-    CM_CND  *condition,     /* Controls if/else/endif   */
-    int     count,          /* Number of parts          */
-    CM_LVL  level,          /* Record, field or subfield*/
-    int     ppos            /* Procedure position       */
+static int buf_use (
+    CM_INSN *ip             /* Instruction to look at       */
 ) {
-    int     i,              /* Loop counter             */
-            arg_min,        /* Min arg count for proc   */
-            arg_max,        /* Max arg count            */
-            flags,          /* Bit flags from func table*/
-            valid_pos;      /* Valid position bit flag  */
-    CM_PROC *pp;            /* Ptr to new proc block    */
+    int     i;              /* Loop counter                 */
 
 
-    /* Allocate block */
-#ifdef DEBUG
-    if ((pp = (CM_PROC *) marc_calloc (sizeof(CM_PROC), 1, 1002)) == NULL) {  // TAG:1002
-        cm_error (CM_FATAL, "Procedure block memory");
-    }
-#else
-    if ((pp = (CM_PROC *) calloc (sizeof(CM_PROC), 1)) == NULL) {
-        cm_error (CM_FATAL, "Procedure block memory");
+    for (i=0; S_bufuse[i].procp; i++) {
+        if (S_bufuse[i].procp == ip->procp)
+            break;
     }
-#endif
 
-    /* Lookup procedure name and convert to token */
-    if ((pp->procp = cmp_lookup_proc (part[0], condition, &arg_min,
-                                      &arg_max, &flags)) == NULL)
-        cm_error (CM_ERROR, "Unknown procedure %s", part[0]);
+    return i;
 
-    /* Validate argument count, args are in part[1], part[2] ... */
-    if (arg_min > count - 1)
-        cm_error (CM_ERROR, "Insufficient arguments for function %s",
-                  part[0]);
-    if (arg_max < count - 1)
-        cm_error (CM_ERROR, "Too many arguments for function %s",
-                  part[0]);
+} /* buf_use */
 
-    /* Create bit flag to validate positioning */
-    valid_pos = 0;
-    switch (level) {
-        case CM_LVL_RECORD: valid_pos = CMP_RE; break;
-        case CM_LVL_FIELD:  valid_pos = CMP_FE; break;
-        case CM_LVL_SF:     valid_pos = CMP_SE; break;
-        default: break;
+
+/************************************************************************
+* chain_writes ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Mark every named buffer a chain might write.                    *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to compiled chain, may be NULL.                             *
+*       Number of buffer slots.                                         *
+*       Ptr to a flag for each buffer slot, set for each one written.   *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void chain_writes (
+    CM_CODE *codep,         /* Compiled chain               */
+    int     nslots,         /* Number of buffer slots       */
+    char    *wrotep         /* Flag slots written here      */
+) {
+    CM_INSN *ip;            /* Current instruction          */
+    int     use,            /* Its S_bufuse[] entry         */
+            i, k;           /* Loop counters                */
+
+
+    if (!codep)
+        return;
+
+    for (i=0; i<codep->count; i++) {
+        ip  = &codep->insn[i];
+        use = buf_use (ip);
+
+        /* Don't know what it does, so it might write anything */
+        if (!S_bufuse[use].procp) {
+            memset (wrotep, 1, nslots);
+            return;
+        }
+
+        for (k=0; k<ip->arg_count; k++) {
+            if ((S_bufuse[use].writes & (1 << k))
+                        && ip->opnds[k].type == CM_ID_BUF
+                        && ip->opnds[k].slot >= 0)
+                wrotep[ip->opnds[k].slot] = 1;
+        }
     }
-    if (ppos == CM_TK_POST)
-        valid_pos <<= 1;
 
-    /* Perform position validation */
-    if (!(flags | valid_pos))
-        cm_error (CM_ERROR, "Can't use this procedure in this position");
+} /* chain_writes */
 
-    /* Deep copy of function name */
-    if ((pp->func_name = strdup (part[0])) == NULL)
-        cm_error (CM_FATAL, "Procedure name memory");
 
-    /* Deep copy of args */
-    for (i=0; i<count-1; i++) {
-        if (i >= CM_MAX_ARGS) {
-            cm_error (CM_ERROR, "Exceeded max argument count of %d",
-                      CM_MAX_ARGS);
-            break;
+/************************************************************************
+* chain_reads ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Look for a read of a named buffer that the record might not     *
+*       have written yet, following every way through a chain.          *
+*                                                                       *
+*       Instructions are in table order and branches only go forward,   *
+*       so one pass down the chain sees everything that can come        *
+*       before each instruction.  A buffer is written at an             *
+*       instruction if it was on every way there.                       *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to compiled chain, may be NULL.                             *
+*       Number of buffer slots.                                         *
+*       Ptr to flag for each slot, set if a record may write it.        *
+*       Ptr to flag for each slot, set if written before the chain.     *
+*           Replaced by those written however the chain ends.           *
+*                                                                       *
+*   RETURN                                                              *
+*       Name of a buffer read before it's written.                      *
+*       NULL if none.                                                   *
+************************************************************************/
+
+static char *chain_reads (
+    CM_CODE *codep,         /* Compiled chain               */
+    int     nslots,         /* Number of buffer slots       */
+    char    *wrotep,        /* Slots a record may write     */
+    char    *defp           /* Slots written so far         */
+) {
+    CM_INSN *ip;            /* Current instruction          */
+    CM_OPND *op;            /* One of its operands          */
+    char    *sets,          /* Written, before each insn    */
+            *reached,       /* True=some way to each insn   */
+            *curp,          /* Set before this instruction  */
+            *outp,          /*   and after it               */
+            *namep;         /* Buffer found, or NULL        */
+    int     use,            /* S_bufuse[] entry of ip       */
+            count,          /* Number of instructions       */
+            i, k, n;        /* Loop counters                */
+
+
+    if (!codep)
+        return NULL;
+
+    /* A set for each instruction, one for the end, and a scratch one */
+    count = codep->count;
+    sets  = (char *) calloc (count + 2, nslots);
+    reached = (char *) calloc (count + 1, 1);
+    if (!sets || !reached)
+        cm_error (CM_FATAL, "Buffer check memory");
+    outp = sets + (size_t) (count + 1) * nslots;
+
+    memcpy (sets, defp, nslots);
+    reached[0] = 1;
+    namep = NULL;
+    for (i=0; i<count && !namep; i++) {
+        if (!reached[i])
+            continue;
+        ip   = &codep->insn[i];
+        use  = buf_use (ip);
+        curp = sets + (size_t) i * nslots;
+
+        for (k=0; k<ip->arg_count; k++) {
+            op = &ip->opnds[k];
+            if ((S_bufuse[use].reads & (1 << k)) && op->type == CM_ID_BUF
+                        && op->slot >= 0 && wrotep[op->slot]
+                        && !curp[op->slot]) {
+                namep = ip->args[k];
+                break;
+            }
+        }
+
+        /* Chain may end here, before anything is written */
+        if (S_bufuse[use].stops)
+            merge_defs (sets + (size_t) count * nslots, &reached[count],
+                        curp, nslots);
+
+        /* Only writes we're sure of count */
+        memcpy (outp, curp, nslots);
+        for (k=0; k<ip->arg_count && S_bufuse[use].procp; k++) {
+            op = &ip->opnds[k];
+            if ((S_bufuse[use].writes & (1 << k)) && op->type == CM_ID_BUF
+                        && op->slot >= 0)
+                outp[op->slot] = 1;
+        }
+
+        /* On to whatever can come next */
+        n = ip->nexti;
+        merge_defs (sets + (size_t) n * nslots, &reached[n], outp, nslots);
+        if (ip->op == CM_OP_IF) {
+            n = ip->faili;
+            merge_defs (sets + (size_t) n * nslots, &reached[n], outp,
+                        nslots);
         }
-        if ((pp->args[i] = strdup (part[i+1])) == NULL)
-            cm_error (CM_FATAL, "Procedure argument memory");
     }
-    pp->arg_count = count - 1;
 
-    /* Initialize next pointers
-     * Not necessary, but aids debugging
-     */
-    pp->true_nextp = pp->false_nextp = NULL;
+    memcpy (defp, sets + (size_t) count * nslots, nslots);
+    free (sets);
+    free (reached);
 
-    return (pp);
+    return namep;
 
-} /* make_proc */
+} /* chain_reads */
+
+
+/************************************************************************
+* merge_defs ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Add one way into an instruction to what's known written there,  *
+*       for chain_reads().  A buffer stays written only if it was       *
+*       written on every way in.                                        *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to set of slots written at the instruction.                 *
+*       Ptr to flag, true if any way in has been seen yet.              *
+*       Ptr to set written on the way being added.                      *
+*       Number of buffer slots.                                         *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void merge_defs (
+    char    *setp,          /* Written at the instruction   */
+    char    *reachedp,      /* True=some way in seen        */
+    char    *fromp,         /* Written on this way in       */
+    int     nslots          /* Number of buffer slots       */
+) {
+    int     i;              /* Loop counter                 */
+
+
+    if (!*reachedp) {
+        memcpy (setp, fromp, nslots);
+        *reachedp = 1;
+        return;
+    }
+    for (i=0; i<nslots; i++)
+        setp[i] = setp[i] && fromp[i];
+
+} /* merge_defs */
 
 
 /************************************************************************
@@ -1655,16 +3752,11 @@ void cm_error (
     ...                     /* Additional vsprintf args     */
 ) {
     va_list args;           /* Ptr to first variable arg.   */
+    CM_CTX  *ctxp;          /* Calling thread's context     */
     char    hdrbuf[256],    /* Message header               */
             msgbuf[CM_MAX_LOG_MSG], /* Message buffer       */
-            *notep,         /* Note to add into msgbuf      */
-            *uip,           /* Ptr to record UI             */
-            *fmtp,          /* Output print format          */
-            sepbuf[256];    /* For separator and time string*/
+            *uip;           /* Ptr to record UI             */
     size_t  buflen;         /* Length of buffer at uip      */
-    FILE    *logfp;         /* Log file                     */
-
-    static int s_first_time = 1;
 
 
     /* Create a message string */
@@ -1677,21 +3769,22 @@ void cm_error (
         cm_error (CM_FATAL, "Log message too big, message buffer overflow");
 
     /* Create message file line or record number prefix */
+    ctxp    = cm_ctx ();
     *hdrbuf = '\0';
     if (S_line_num)
         sprintf (hdrbuf, "%s(%d) : ", S_ctlfile, S_line_num);
 
-    else if (S_in_recs) {
+    else if (ctxp && ctxp->in_recs) {
 
         /* Start with input record number */
-        sprintf (hdrbuf, "Input rec# %ld : ", S_in_recs);
+        sprintf (hdrbuf, "Input rec# %ld : ", ctxp->in_recs);
 
         /* If there's a UI, add it to the header */
         uip = NULL;
 
         /* Look for Bib ID first */
-        if (cmp_get_named_buf ("bibid", (unsigned char **) &uip, 0, 0, &buflen)
-                              == CM_STAT_OK) {
+        if (cmp_get_slot_buf (S_bibid_slot, (unsigned char **) &uip, 0, 0,
+                              &buflen) == CM_STAT_OK) {
             if (*uip)
                 strcat (hdrbuf, "BibID=");
             else
@@ -1700,7 +3793,7 @@ void cm_error (
 
         /* If no Bib ID, try for UI */
         if (!uip) {
-            if (cmp_get_named_buf ("ui", (unsigned char **) &uip,
+            if (cmp_get_slot_buf (S_ui_slot, (unsigned char **) &uip,
                      0, 0, &buflen) == CM_STAT_OK) {
                 if (*uip)
                     strcat (hdrbuf, "UI=");
@@ -1716,11 +3809,56 @@ void cm_error (
         }
     }
 
+    /* In a -j worker, conv_jobs() logs it when the record's turn comes.
+     * A fatal error ends the record, and the worker, right here.
+     */
+    if (ctxp && ctxp->jobp) {
+        hold_msg (ctxp->jobp, severity, hdrbuf, msgbuf);
+        if (severity == CM_FATAL)
+            longjmp (ctxp->fatal, 1);
+        return;
+    }
+
+    put_msg (severity, hdrbuf, msgbuf);
+
+} /* cm_error */
+
+
+/************************************************************************
+* put_msg ()                                                            *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Count, display and log a message for cm_error().                *
+*       Exit program if fatal error.                                    *
+*                                                                       *
+*   PASS                                                                *
+*       Severity.                                                       *
+*       Message header, with ctl file line or input record number.      *
+*       Message.                                                        *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void put_msg (
+    CM_SEVERITY severity,   /* Fatal or warning             */
+    char        *hdrp,      /* Message header               */
+    char        *msgp       /* Message                      */
+) {
+    char    hdrbuf[256],    /* Header + severity            */
+            *notep,         /* Note to add into hdrbuf      */
+            *fmtp,          /* Output print format          */
+            sepbuf[256];    /* For separator and time string*/
+    FILE    *logfp;         /* Log file                     */
+
+
+    strcpy (hdrbuf, hdrp);
+
     /* Count and check occurrences */
     if (severity == CM_WARNING)
-        ++S_warns;
+        ++S_main->warns;
     else if (severity == CM_ERROR) {
-        if (++S_errs > S_parms.max_errs)
+        if (++S_main->errs > S_parms.max_errs)
             severity = CM_FATAL;
     }
 
@@ -1740,37 +3878,114 @@ void cm_error (
     strcat (hdrbuf, notep);
 
     /* Output to console */
-    fprintf (stderr, fmtp, hdrbuf, msgbuf);
+    fprintf (stderr, fmtp, hdrbuf, msgp);
 
     /* Open in current directory */
     if ((logfp = fopen (S_parms.logfile, "a")) != NULL) {
 
         /* If first time in run, print separator, date and time */
-        if (s_first_time) {
+        if (!S_log_begun) {
             get_log_time (sepbuf);
             fprintf (logfp, "%s", sepbuf);
-            s_first_time = 0;
+            S_log_begun = 1;
         }
 
         /* Print header, and message */
-        fprintf (logfp, fmtp, hdrbuf, msgbuf);
+        fprintf (logfp, fmtp, hdrbuf, msgp);
 
         /* Abort message */
         if (severity == CM_FATAL)
-            fprintf (logfp, "Aborting after %d errors\n", S_errs);
+            fprintf (logfp, "Aborting after %d errors\n", S_main->errs);
 
         /* Close/flush */
         fclose (logfp);
     }
 
     /* Fatal error? */
-    if (severity == CM_FATAL) {
+    if (severity == CM_FATAL)
+        fatal_exit ();
+
+} /* put_msg */
+
+
+/************************************************************************
+* fatal_exit ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Perform any cleanup we can after a fatal error and exit.        *
+*                                                                       *
+*       Records already converted are written, as stdio would have      *
+*       done at exit.                                                   *
+*                                                                       *
+*   PASS                                                                *
+*       Void.                                                           *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  No return.                                               *
+************************************************************************/
+
+static void fatal_exit ()
+{
+    MARCWRTP outwp;         /* Output file to flush         */
 
-        /* Perform any cleanup we can and exit */
-        report ();
+
+    if ((outwp = S_outwp) != NULL) {
+        S_outwp = NULL;
+        marc_wrt_close (outwp);
+    }
+    report ();
+    exit (1);
+
+} /* fatal_exit */
+
+
+/************************************************************************
+* hold_msg ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Keep a message from cm_error() in a -j worker thread, in the    *
+*       job being converted, for conv_jobs() to pass to put_msg().      *
+*                                                                       *
+*   PASS                                                                *
+*       Job to hold it in.                                              *
+*       Severity.                                                       *
+*       Message header, with input record number.                       *
+*       Message.                                                        *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void hold_msg (
+    CM_JOB      *jobp,      /* Worker's current job         */
+    CM_SEVERITY severity,   /* Fatal or warning             */
+    char        *hdrp,      /* Message header               */
+    char        *msgp       /* Message                      */
+) {
+    CM_MSG      *mp;        /* Held message                 */
+    size_t      hdrlen,     /* Length of header             */
+                msglen;     /* Length of message            */
+
+
+    /* Header and message are kept right after the struct */
+    hdrlen = strlen (hdrp) + 1;
+    msglen = strlen (msgp) + 1;
+    if ((mp = (CM_MSG *) malloc (sizeof(CM_MSG) + hdrlen + msglen)) == NULL) {
+        fprintf (stderr, "Out of memory holding message:\n  %s\n", msgp);
         exit (1);
     }
-} /* cm_error */
+    mp->nextp    = NULL;
+    mp->severity = severity;
+    mp->hdrp     = (char *) (mp + 1);
+    mp->msgp     = mp->hdrp + hdrlen;
+    memcpy (mp->hdrp, hdrp, hdrlen);
+    memcpy (mp->msgp, msgp, msglen);
+
+    /* Keep them in order */
+    *jobp->lastpp = mp;
+    jobp->lastpp  = &mp->nextp;
+
+} /* hold_msg */
 
 
 /************************************************************************
@@ -1788,7 +4003,7 @@ void cm_error (
 
 int get_errs ()
 {
-    return S_errs;
+    return S_main->errs;
 }
 
 
@@ -1848,14 +4063,18 @@ static void get_parms (
     /* Default parameters */
     parmp->omode     = "wb";
     parmp->skip_recs = 0L;
-    parmp->conv_recs = 999999999L;
+    parmp->conv_recs = CM_DFT_CONV_RECS;
     parmp->max_errs  = CM_DFT_MAX_ERRORS;
     parmp->logfile   = CM_DFT_LOGFILE;
     parmp->outfile   = NULL;
     parmp->ctlpath   = ".";
+    parmp->mapped    = 0;
+    parmp->indexed   = 0;
+    parmp->jobs      = 1;
+    parmp->shards    = 1;
 
     /* Process each command line arg */
-    while ((opt = amuopt (argc, argv, "ae:l:n:p:s:?h", &argptr))
+    while ((opt = amuopt (argc, argv, "ae:f:j:l:mn:p:s:x?h", &argptr))
                != AMU_OPT_DONE) {
 
         switch (opt) {
@@ -1869,11 +4088,30 @@ static void get_parms (
                 parmp->max_errs = atoi (argptr);
                 break;
 
+            case 'f':
+                /* Convert in this many child processes */
+                parmp->shards = atoi (argptr);
+                if (parmp->shards < 1 || parmp->shards > CM_MAX_SHARDS)
+                    usage ("Bad number of processes");
+                break;
+
+            case 'j':
+                /* Convert in this many threads */
+                parmp->jobs = atoi (argptr);
+                if (parmp->jobs < 1 || parmp->jobs > CM_MAX_JOBS)
+                    usage ("Bad number of threads");
+                break;
+
             case 'l':
                 /* Change logfile name */
                 parmp->logfile = strdup (argptr);
                 break;
 
+            case 'm':
+                /* Memory map input file */
+                parmp->mapped = 1;
+                break;
+
             case 'n':
                 /* Convert this many records */
                 parmp->conv_recs = atol (argptr);
@@ -1889,6 +4127,11 @@ static void get_parms (
                 parmp->skip_recs = atol (argptr);
                 break;
 
+            case 'x':
+                /* Skip using index */
+                parmp->indexed = 1;
+                break;
+
             case 1:
                 /* Input marc record file */
                 parmp->infile = strdup (argptr);
@@ -1922,6 +4165,9 @@ static void get_parms (
     if (!parmp->infile || !parmp->outfile)
         usage ("Insufficient arguments");
 
+    if (parmp->shards > 1 && parmp->jobs > 1)
+        usage ("Use -f or -j, not both");
+
 } /* get_parms */
 
 
@@ -1955,12 +4201,19 @@ static void usage (
   fprintf (stderr, "    -a      = Append to output file, else overwrite\n");
   fprintf (stderr, "    -e<num> = Max allowed errs, default=%d\n",
                                       CM_DFT_MAX_ERRORS);
+  fprintf (stderr, "    -f<num> = Convert in num processes, max=%d\n",
+                                      CM_MAX_SHARDS);
+  fprintf (stderr, "    -j<num> = Convert in num threads, max=%d\n",
+                                      CM_MAX_JOBS);
   fprintf (stderr, "    -l<str> = Error log file, default=%s\n",
                                       CM_DFT_LOGFILE);
+  fprintf (stderr, "    -m      = Memory map input file instead of reading it\n");
   fprintf (stderr, "    -n<num> = Num records to convert, default=all\n");
   fprintf (stderr, "    -p<str> = Alternate path to ctl files if not "
                                   "in current directory\n");
   fprintf (stderr, "    -s<num> = Starting record number, default=0\n");
+  fprintf (stderr, "    -x      = Use index infile.idx to find -s start, "
+                                  "building it if needed\n");
 
   exit (1);
 
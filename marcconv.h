@@ -50,6 +50,8 @@
 #ifndef MARCCONV_H
 #define MARCCONV_H
 
+#include <setjmp.h>
+#include <sys/types.h>
 #include "marc.h"       /* Public definitions   */
 
 /*********************************************************************
@@ -65,18 +67,32 @@
 #define CM_CTL_MAX_LINE        512  /* Max line len in ctl file     */
 #define CM_CTL_SEPARATOR       '/'  /* Between parts in proc/arg lst*/
 #define CM_CTL_COMMENT         '#'  /* Comment from her to eol      */
+#define CM_MAX_JOBS             64  /* Max -j conversion threads    */
+#define CM_JOB_RECS              8  /* Recs in flight per thread    */
+#define CM_MAX_SHARDS           64  /* Max -f conversion processes  */
 
 /*-------------------------------------------------------------------\
 |   Defaults                                                         |
 \-------------------------------------------------------------------*/
 #define CM_DFT_LOGFILE "marcconv.log" /* Default log file name      */
 #define CM_DFT_MAX_ERRORS         50  /* Default max errors allowed */
+#define CM_DFT_CONV_RECS   999999999L /* Default records to convert */
 
 /*-------------------------------------------------------------------\
 | Procedure placement bit flags                                      |
 |                                                                    |
 |   These are or'd together to indicate where a procedure may        |
 |   be legally applied.                                              |
+|                                                                    |
+|   CMP_MT is or'd in for procedures that keep no state outside      |
+|   the record and named buffers, so marcconv -j may run them in     |
+|   several threads at once.                                         |
+|                                                                    |
+|   CMP_NOBUF is or'd in for procedures that only get at %data       |
+|   through cmp_buf_find() and cmp_buf_write(), never pp->bufp.      |
+|   Chains of them leave the data where it is in the record until    |
+|   something writes to it.  Others get it copied to pp->bufp        |
+|   first, and its length is taken from there afterwards.            |
 \-------------------------------------------------------------------*/
 #define CMP_EE                   1  /* Session pre-process okay     */
 #define CMP_EO                   2  /*         post-process         */
@@ -87,6 +103,8 @@
 #define CMP_SE                  16  /* Subfield pre-process         */
 #define CMP_SO                  32  /*          post-process        */
 #define CMP_ANY                 63  /* Any position okay            */
+#define CMP_MT                  64  /* Safe in -j worker threads    */
+#define CMP_NOBUF              128  /* Leaves pp->bufp alone        */
 
 
 /*-------------------------------------------------------------------\
@@ -117,10 +135,16 @@
 #define CM_MAX_MARC_SIZE    100000  /* Biggest record we support    */
 #define CM_MIN_INPUT_FIELDS      3  /* Reject record if fewer fields*/
 #define CM_MAX_LOG_MSG        1024  /* Max loggable msg             */
+#define CM_TMPBUF_SIZE       10000  /* Append copy, no field larger */
 #define CM_FID_UNUSED         (-1)  /* No field assigned to CM_FIELD*/
 
 #define CMP_PROC_ERROR        (-1)  /* Error from custom proc       */
 
+/* What a converted record left to write */
+#define CM_REC_NONE              0  /* Killed, or nothing left in it*/
+#define CM_REC_CONV              1  /* Output record in the context */
+#define CM_REC_PASS              2  /* Input record, just as it was */
+
 
 /********************************************************************
 *   Types                                                            *
@@ -173,6 +197,22 @@ typedef enum cm_id {
 } CM_ID;
 
 
+/*-------------------------------------------------------------------\
+| Builtin variables                                                  |
+|                                                                    |
+|   What %fid, %socc, etc. ask for, see cmp_get_builtin().           |
+\-------------------------------------------------------------------*/
+typedef enum cm_bi {
+    CM_BI_UNKNOWN = 0,          /* Error, name not recognized       */
+    CM_BI_FID,                  /* %fid,  current field id          */
+    CM_BI_FOCC,                 /* %focc, field occurrence          */
+    CM_BI_FPOS,                 /* %fpos, field position            */
+    CM_BI_SID,                  /* %sid,  current subfield id       */
+    CM_BI_SOCC,                 /* %socc, subfield occurrence       */
+    CM_BI_SPOS                  /* %spos, subfield position         */
+} CM_BI;
+
+
 /*-------------------------------------------------------------------\
 | Condition types                                                    |
 |                                                                    |
@@ -227,6 +267,41 @@ typedef enum {
 *   Structures                                                       *
 *********************************************************************/
 
+/*-------------------------------------------------------------------\
+| Per record memory for procs, see cmp_alloc()                       |
+|                                                                    |
+|   Private to marcproc.c, one per conversion context.               |
+\-------------------------------------------------------------------*/
+typedef struct cm_arena CM_ARENA;
+
+/*-------------------------------------------------------------------\
+| Compiled cmp_if() test, see cmp_compile_if()                       |
+|                                                                    |
+|   Private to marcproc.c, one per "if" in the control table.        |
+\-------------------------------------------------------------------*/
+typedef struct cm_pred CM_PRED;
+
+/*-------------------------------------------------------------------\
+| Operand descriptor                                                 |
+|                                                                    |
+|   An argument naming a data source or destination, decoded once    |
+|   by cmp_compile_opnd() when the control table is loaded, so       |
+|   cmp_buf_find() and cmp_buf_write() needn't look at the text.     |
+|   Errors found decoding it are only reported if it's used.         |
+\-------------------------------------------------------------------*/
+typedef struct cm_opnd {
+    CM_ID  type;                /* What kind of operand             */
+    int    stat;                /* marc_ref() return, 0 = good      */
+    int    fid;                 /* MARC field id                    */
+    int    focc;                /* Field occurrence number          */
+    int    sid;                 /* Subfield id                      */
+    int    socc;                /* Subfield occurrence number       */
+    CM_BI  builtin;             /* Which builtin variable           */
+    int    slot;                /* Named buffer slot, -1 = by name  */
+    unsigned char *datap;       /* Literal data, after the quote    */
+    size_t len;                 /* Length of literal                */
+} CM_OPND;
+
 /*-------------------------------------------------------------------\
 | Argument passed to a custom procedure.                             |
 |                                                                    |
@@ -236,14 +311,27 @@ typedef enum {
 typedef struct cm_proc_parms {
     MARCP  inmp;                /* Input marc record                */
     MARCP  outmp;               /* Output marc record               */
-    unsigned char *bufp;        /* Ptr to current data              */
-    size_t buflen;              /* Length of datap buffer           */
+    unsigned char *bufp;        /* Modifiable copy of current data  */
+    size_t buflen;              /* Length of bufp buffer            */
+    unsigned char *datap;       /* Current data, bufp once copied   */
+    size_t datalen;             /* Length of data at datap          */
     char   **args;              /* Ptr to array of arg pointers     */
     int    arg_count;           /* Number of argument pointers      */
+    struct cm_ctx *ctxp;        /* Conversion this call is part of  */
+    CM_ARENA *arenap;           /* Memory for record, cmp_alloc()   */
+    CM_OPND *opnds;             /* Decoded args, NULL if none       */
+    CM_PRED *predp;             /* Compiled if test, NULL if none   */
 } CM_PROC_PARMS;
 
 typedef CM_STAT (*CM_FUNCP)(struct cm_proc_parms *);
 
+/*-------------------------------------------------------------------\
+| Named buffers                                                      |
+|                                                                    |
+|   Private to marcproc.c, one set per conversion context.           |
+\-------------------------------------------------------------------*/
+typedef struct cm_named_bufs CM_NAMED_BUFS;
+
 /*-------------------------------------------------------------------\
 | Custom procedure control                                           |
 |                                                                    |
@@ -257,12 +345,61 @@ typedef struct cm_proc {
     CM_FUNCP procp;             /* Pointer to procedure             */
     char     *func_name;        /* For error reporting              */
     char     *args[CM_MAX_ARGS+1];/* Array of pointers to arguments */
+    CM_OPND  opnds[CM_MAX_ARGS+1];/* Same args, decoded             */
+    CM_PRED  *predp;            /* Compiled test if cmp_if, or null */
+    int      flags;             /* CMP_... flags from proc table    */
     int      arg_count;         /* Number of arguments              */
+    int      seq;               /* Order made, lays out the chain   */
+    int      insn;              /* Instruction number once compiled */
     struct cm_proc *true_nextp; /* Next procedure in chain, or null */
     struct cm_proc *false_nextp;/* Next proc if condition fails     */
 } CM_PROC;
 
 
+/*-------------------------------------------------------------------\
+| Compiled procedure chain                                           |
+|                                                                    |
+|   Once the control table is loaded each chain of CM_PROCs is laid  |
+|   out as an array of instructions, in table order, and that's      |
+|   what exec_proc() runs.  Else and endif are gone, branches are    |
+|   instruction numbers, and the simplest generic procedures are     |
+|   done by exec_proc() itself instead of called through procp.      |
+\-------------------------------------------------------------------*/
+typedef enum cm_op {
+    CM_OP_CALL = 0,             /* Call procp                       */
+    CM_OP_IF,                   /* cmp_if()                         */
+    CM_OP_CLEAR,                /* cmp_clear()                      */
+    CM_OP_COPY,                 /* cmp_copy()                       */
+    CM_OP_APPEND,               /* cmp_append()                     */
+    CM_OP_SUBSTR,               /* cmp_substr()                     */
+    CM_OP_INDIC,                /* cmp_indic()                      */
+    CM_OP_STAT                  /* Just return stat, donesf etc.    */
+} CM_OP;
+
+#define CM_NEED_CURSOR           1  /* Reads the input record       */
+#define CM_NEED_SAVE             2  /* May move in output record    */
+#define CM_NEED_DATA             4  /* Uses pp->bufp, not CMP_NOBUF */
+
+typedef struct cm_insn {
+    CM_OP    op;                /* What to do                       */
+    int      need;              /* CM_NEED_... bits                 */
+    CM_STAT  stat;              /* Return code for CM_OP_STAT       */
+    int      nexti;             /* Next instruction, count = end    */
+    int      faili;             /* Next if test fails               */
+    CM_FUNCP procp;             /* Procedure for CM_OP_CALL         */
+    char     **args;            /* Arguments, in the CM_PROC        */
+    CM_OPND  *opnds;            /* Same args, decoded               */
+    CM_PRED  *predp;            /* Compiled test if CM_OP_IF        */
+    int      arg_count;         /* Number of arguments              */
+    char     *func_name;        /* For error reporting              */
+} CM_INSN;
+
+typedef struct cm_code {
+    int      count;             /* Number of instructions           */
+    CM_INSN  *insn;             /* Array of them, follows this      */
+} CM_CODE;
+
+
 /*-------------------------------------------------------------------\
 | Subfield control                                                   |
 |                                                                    |
@@ -272,6 +409,8 @@ typedef struct cm_sf {
     int     marc_sf;            /* Output marc subfield id, or -1   */
     CM_PROC *prepp;             /* First proc in chain, or null     */
     CM_PROC *postp;             /* First proc in chain, or null     */
+    CM_CODE *prepc;             /* prepp compiled, or null          */
+    CM_CODE *postc;             /* postp compiled, or null          */
 } CM_SF;
 
 
@@ -287,6 +426,8 @@ typedef struct cm_field {
     CM_SF   sf[CM_MAX_MARC_SFS];/* Ctls for possible sf positions   */
     CM_PROC *prepp;             /* First proc in chain, or null     */
     CM_PROC *postp;             /* First proc in chain, or null     */
+    CM_CODE *prepc;             /* prepp compiled, or null          */
+    CM_CODE *postc;             /* postp compiled, or null          */
 } CM_FIELD;
 
 
@@ -321,6 +462,81 @@ typedef struct cmp_table {
 } CMP_TABLE;
 
 
+/*-------------------------------------------------------------------\
+| Held log message                                                   |
+|                                                                    |
+|   Messages from -j worker threads are held in the job until it's   |
+|   the record's turn to be logged and written.                      |
+\-------------------------------------------------------------------*/
+typedef struct cm_msg {
+    struct cm_msg *nextp;       /* Next message for same record     */
+    CM_SEVERITY   severity;     /* As passed to cm_error()          */
+    char          *hdrp;        /* Header, with input rec number    */
+    char          *msgp;        /* Message text                     */
+} CM_MSG;
+
+
+/*-------------------------------------------------------------------\
+| Conversion job                                                     |
+|                                                                    |
+|   One input record on its way through -j worker threads.           |
+\-------------------------------------------------------------------*/
+typedef struct cm_job {
+    long          rec_num;      /* Input record number              */
+    unsigned char *recp;        /* Input record                     */
+    unsigned char *inbufp;      /* Copy of it, unless mapped        */
+    size_t        insize;       /* Size of inbufp                   */
+    unsigned char *outbufp;     /* Packed output record             */
+    size_t        outsize;      /* Size of outbufp                  */
+    size_t        outlen;       /* Length of output, 0=none         */
+    int           passed;       /* True=write recp, it's unchanged  */
+    CM_MSG        *msgp;        /* Held messages, in order          */
+    CM_MSG        **lastpp;     /* Add next message here            */
+    char          *bibidp;      /* "bibid" buffer after conversion  */
+    char          *uip;         /* "ui" buffer after conversion     */
+    int           done;         /* True=worker is finished with it  */
+} CM_JOB;
+
+
+/*-------------------------------------------------------------------\
+| Input shard                                                        |
+|                                                                    |
+|   One range of input records, converted by one -f child process.   |
+\-------------------------------------------------------------------*/
+typedef struct cm_shard {
+    off_t         offset;       /* Byte offset of first record      */
+    long          first;        /* Input records before it          */
+    long          last;         /* Its last input rec, 0=to EOF     */
+    pid_t         pid;          /* Child converting it              */
+} CM_SHARD;
+
+
+/*-------------------------------------------------------------------\
+| Conversion context                                                 |
+|                                                                    |
+|   Everything that changes while converting records.  marcconv has  |
+|   one for the main thread and one for each -j worker.  The         |
+|   compiled control table is shared by all of them and is never     |
+|   changed after it is loaded.                                      |
+\-------------------------------------------------------------------*/
+typedef struct cm_ctx {
+    MARCP         inmp;         /* Input record                     */
+    MARCP         outmp;        /* Output record                    */
+    CM_PROC_PARMS pparms;       /* Parms passed to procs            */
+    unsigned char *bufp;        /* Data procs can modify            */
+    long          checksum;     /* Of fixed parts of pparms         */
+    CM_NAMED_BUFS *nbufp;       /* Named buffers                    */
+    unsigned char tmpbuf[CM_TMPBUF_SIZE]; /* For cmp_buf_write()    */
+    char          bvarbuf[20];  /* For cmp_buf_find() builtins      */
+    long          in_recs;      /* Input record number              */
+    long          out_recs;     /* Records written                  */
+    int           errs;         /* Count of errors                  */
+    int           warns;        /* Count of warnings                */
+    CM_JOB        *jobp;        /* Worker's job, else NULL          */
+    jmp_buf       fatal;        /* Worker's exit if fatal           */
+} CM_CTX;
+
+
 /*-------------------------------------------------------------------\
 | Command line parameters                                            |
 |                                                                    |
@@ -337,6 +553,10 @@ typedef struct cm_parms {
     long skip_recs;     /* Skip this many before starting           */
     long conv_recs;     /* Convert this many, or to end of file     */
     int  max_errs;      /* Stop after this many                     */
+    int  mapped;        /* True=memory map infile, don't fread it   */
+    int  indexed;       /* True=skip via infile.idx, build if needed*/
+    int  jobs;          /* Conversion threads, 1=no threads         */
+    int  shards;        /* Conversion processes, 1=no children      */
 } CM_PARMS;
 
 
@@ -345,6 +565,7 @@ typedef struct cm_parms {
 *********************************************************************/
 
 void     cm_error        (CM_SEVERITY, char *, ...);
+CM_CTX   *cm_ctx         (void);
 CM_FUNCP cmp_lookup_proc (char *, CM_CND *, int *, int *, int *);
 
 /* Call this to call one of the others from outside with modified args */
@@ -377,7 +598,19 @@ void    cmp_buf_find     (CM_PROC_PARMS *, char *, unsigned char **, size_t *);
 CM_STAT cmp_buf_write    (CM_PROC_PARMS *, char *, unsigned char *,size_t,int);
 CM_STAT cmp_buf_copy     (CM_PROC_PARMS *, char *, char *, int);
 CM_STAT cmp_get_named_buf(char *, unsigned char **, int, size_t, size_t *);
+CM_STAT cmp_get_slot_buf (int, unsigned char **, int, size_t, size_t *);
+int     cmp_buf_slot     (char *);
+int     cmp_buf_slots    (void);
+void    cmp_new_named_bufs (CM_NAMED_BUFS **, CM_NAMED_BUFS *);
+void    cmp_free_named_bufs(CM_NAMED_BUFS *);
+void    *cmp_alloc       (CM_PROC_PARMS *, size_t);
+void    cmp_new_arena    (CM_ARENA **);
+void    cmp_reset_arena  (CM_ARENA *);
+void    cmp_free_arena   (CM_ARENA *);
+void    cmp_own_data     (CM_PROC_PARMS *);
 int     cmp_get_builtin  (CM_PROC_PARMS *, char *);
+void    cmp_compile_opnd (char *, CM_OPND *);
+CM_PRED *cmp_compile_if  (CM_PROC *);
 
 /* Some control table routines used for different tables */
 void    open_ctl_file    (char *, FILE **);
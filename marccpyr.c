@@ -0,0 +1,207 @@
+/************************************************************************
+* marc_copy_raw_field ()                                                *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Copy an entire field from one record to another as raw bytes.   *
+*                                                                       *
+*       marc_copy_field() parses the input field and re-adds it one     *
+*       subfield at a time.  Here the indicators and all subfields      *
+*       are appended to the end of the output record with a single      *
+*       memcpy.                                                         *
+*                                                                       *
+*       We only do that if the field would come out exactly the same    *
+*       way, and exactly the same checks would pass, as if it were      *
+*       copied subfield by subfield (see marc_xraw_field()).  If not,   *
+*       e.g., a bad subfield code, a reserved character in the data,    *
+*       or data before the first delimiter, nothing is added and        *
+*       MARC_RET_RAW_SUBFLD tells the caller to copy it the slow way,   *
+*       where the problem will be found and reported in the usual       *
+*       manner.                                                         *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to structure returned by marc_init, positioned          *
+*           at input field.                                             *
+*       Pointer to structure for output record.  Must be a different    *
+*           record.                                                     *
+*       Field id for new copy of field.  Need not be the same.          *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.  Output is positioned at new field.                *
+*       MARC_RET_RAW_SUBFLD = Not copied, copy by subfield.             *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <string.h>
+#include "marcdefs.h"
+
+int marc_copy_raw_field (
+    MARCP   inmp,           /* Pointer to input recstruc*/
+    MARCP   outmp,          /* Pointer to output        */
+    int     field_id        /* Field tag/identifier     */
+) {
+    FLDDIR  *indp,          /* Input directory entry    */
+            *outdp;         /* Output directory entry   */
+    unsigned char *srcp;    /* Ptr to input field data  */
+    size_t  len,            /* Length of field          */
+            newlen;         /* Raw buffer size needed   */
+    int     stat;           /* Return code              */
+
+
+    /* Test, return if failed */
+    MARC_XCHECK(inmp)
+
+    /* Test that records are different */
+    if (inmp->marcbufp == outmp->marcbufp)
+        return MARC_ERR_SAME_REC;
+
+    /* Must be positioned at a real field, not the leader */
+    if (inmp->cur_field < 1)
+        return MARC_ERR_CUR_FIELD;
+
+    indp = inmp->fdirp + inmp->cur_field;
+    srcp = inmp->rawbufp + indp->offset;
+    len  = indp->len;
+
+    /* Fixed field can only be copied to same fixed field */
+    if (indp->tag < MARC_FIRST_VARFIELD && indp->tag != field_id)
+        return MARC_ERR_DIFF_FLD;
+
+    /* Only if it would come out the same by subfield */
+    if ((stat = marc_xraw_field (inmp, indp)) != 0)
+        return stat;
+
+    /* Add the output field.  Var fields come with blank indicators,
+     *   which we'll overwrite.
+     */
+    if ((stat = marc_add_field (outmp, field_id)) != 0)
+        return stat;
+    outdp = outmp->fdirp + outmp->cur_field;
+
+    /* Room for the whole field, plus the null marc_add_subfield()
+     *   always leaves room for
+     */
+    newlen = outdp->offset + len + 1;
+    if (newlen >= outmp->raw_buflen) {
+        if (newlen > (size_t) MARC_MAX_MARCDATA)
+            return MARC_ERR_RECLEN;
+        if (marc_xallocate ((void **) &outmp->rawbufp,
+                            (void **) &outmp->endrawp, &outmp->raw_buflen,
+                            newlen, sizeof(unsigned char)) != 0)
+            return MARC_ERR_RAWALLOC;
+    }
+
+    /* New field is always last in the raw buffer */
+    memcpy (outmp->rawbufp + outdp->offset, srcp, len);
+    outmp->raw_datalen = outdp->offset + len;
+    outdp->len         =
+    outdp->room        = len;
+
+    /* marc_add_field() already invalidated any subfield parse */
+
+    return 0;
+
+} /* marc_copy_raw_field */
+
+
+/************************************************************************
+* marc_ok_raw_record ()                                                 *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Tell if a record parsed by marc_old() or marc_old_map() can be  *
+*       written out just as it came in.                                 *
+*                                                                       *
+*       That's if copying its leader and every field into a new record  *
+*       and packing that with marc_get_record() would give back the     *
+*       same bytes: fields in tag order, packed end to end in the       *
+*       order of the directory, none empty, every one passing           *
+*       marc_xraw_field(), and no more of them than marc_add_field()    *
+*       allows.                                                         *
+*                                                                       *
+*       It's up to the caller to know it wasn't going to change         *
+*       anything else in the copy.  Tags it might change are passed     *
+*       as flags, and looked at first, as that's all it takes to turn   *
+*       down most records that won't do.                                *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to structure for parsed record.                         *
+*       Ptr to MARC_MAX_FIELDID+1 flags, true = caller would change     *
+*           fields with that tag.  NULL if none.                        *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Record is good as is.                                       *
+*       MARC_RET_RAW_SUBFLD = It must be rebuilt to be written.         *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_ok_raw_record (
+    MARCP   mp,             /* Pointer to recstruc      */
+    char    *busyp          /* Tags not to pass as is   */
+) {
+    FLDDIR  *dp;            /* Ptr to directory entry   */
+    unsigned char *p;       /* Ptr into leader          */
+    size_t  lrecl,          /* Logical record length    */
+            base_addr,      /* Base address of data     */
+            offset;         /* Where next field must be */
+    int     i,              /* Loop counter             */
+            prev_tag;       /* Tag of previous field    */
+
+
+    /* Test, return if failed */
+    MARC_XCHECK(mp)
+
+    /* Anything the caller wants to change */
+    if (busyp) {
+        dp = mp->fdirp + 1;
+        for (i=1; i<mp->field_count; i++, dp++)
+            if (busyp[dp->tag])
+                return MARC_RET_RAW_SUBFLD;
+    }
+
+    /* Copying the leader checks it like any other data */
+    p = mp->rawbufp;
+    if (marc_xscan_resv (p, p + MARC_LEADER_LEN) != p + MARC_LEADER_LEN)
+        return MARC_RET_RAW_SUBFLD;
+
+    /* marc_add_field() won't grow the directory past this */
+    if (mp->field_count + MARC_DFT_DIRINC > MARC_MAX_FLDCOUNT)
+        return MARC_RET_RAW_SUBFLD;
+
+    /* Directory must be exactly the size marc_get_record() makes it.
+     * marc_old() only divides the space up into entries.
+     */
+    lrecl     = marc_xnum (mp->rawbufp + MARC_RECLEN_OFF, MARC_RECLEN_LEN);
+    base_addr = marc_xnum (mp->rawbufp + MARC_BASEADDR_OFF,
+                           MARC_BASEADDR_LEN);
+    if (lrecl > MARC_MAX_RECLEN || base_addr != MARC_LEADER_LEN
+            + (size_t) (mp->field_count - 1) * MARC_DIR_SIZE + 1)
+        return MARC_RET_RAW_SUBFLD;
+
+    /* First field starts the data, wherever marc_old() put it */
+    offset = mp->mapped ? base_addr : MARC_LEADER_LEN;
+
+    prev_tag = 1;
+    dp = mp->fdirp + 1;
+    for (i=1; i<mp->field_count; i++, dp++) {
+
+        /* Sorting mustn't move it, or find a duplicate of the leader */
+        if (dp->tag < prev_tag)
+            return MARC_RET_RAW_SUBFLD;
+        prev_tag = dp->tag;
+
+        /* Right after the last one, ending with a field terminator */
+        if (dp->offset != offset
+                || mp->rawbufp[offset + dp->len] != MARC_FIELD_TERM)
+            return MARC_RET_RAW_SUBFLD;
+        offset += dp->len + 1;
+
+        /* Empty fields aren't written */
+        if (dp->len < ((dp->tag < MARC_FIRST_VARFIELD) ? 1 : 3))
+            return MARC_RET_RAW_SUBFLD;
+
+        if (marc_xraw_field (mp, dp) != 0)
+            return MARC_RET_RAW_SUBFLD;
+    }
+
+    return 0;
+
+} /* marc_ok_raw_record */
@@ -182,10 +182,14 @@ int marc_cur_field (
          * Thus if 0 found, this will be the 0th occurrence.  It's
          *   a way of adjusting to origin 0.
          */
-        occ = 0;
-        for (i=0; i<pos; i++)
-            if (mp->fdirp[i].tag == id)
-                    ++occ;
+        if (mp->tagixp && mp->tagixp->valid)
+            occ = mp->fdirp[pos].occ;
+        else {
+            occ = 0;
+            for (i=0; i<pos; i++)
+                if (mp->fdirp[i].tag == id)
+                        ++occ;
+        }
 
         /* Info to caller */
         *tagp = id;
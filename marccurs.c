@@ -0,0 +1,103 @@
+/************************************************************************
+* marc_cursor ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Create or refresh a read only cursor on a record.               *
+*                                                                       *
+*       A cursor is a marcctl that can be passed to any of the read     *
+*       functions, positioned where the record was, that can be moved   *
+*       around without moving the record.  Like a marc_dup() copy it    *
+*       shares the record's buffers, field directory and indexes, but   *
+*       it also borrows the record's subfield directory until it's      *
+*       moved to another field and has to parse one of its own.  It     *
+*       then uses its own, and the record's parse is left alone.        *
+*       If the record parses again first, the cursor just parses its    *
+*       field again, on the same subfield.                              *
+*                                                                       *
+*       Creating it allocates, refreshing it for the same or another    *
+*       record doesn't, so a program that needs a fresh look at a       *
+*       record over and over, e.g., before every conversion proc,       *
+*       should keep one and refresh it each time.                       *
+*                                                                       *
+*       The cursor is good until the record is changed, and must be     *
+*       refreshed after that.  Free it with marc_free(), which frees    *
+*       only what the cursor owns.                                      *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl for record.                                  *
+*       Pointer to place to put pointer to cursor.                      *
+*           If initial value pointed to is NULL, then allocate a        *
+*               new cursor.                                             *
+*           Else refresh the cursor pointed to.                         *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <string.h>
+#include "marcdefs.h"
+
+#ifdef DEBUG
+void *marc_alloc(int, int);
+void marc_dealloc(void *, int);
+#endif
+
+int marc_cursor (
+    MARCP   mp,             /* Pointer to record        */
+    MARCP   *cpp            /* Pointer to ptr to cursor */
+) {
+    MARCP   cp;             /* The cursor               */
+    MARCSFDIR *sfdp;        /* Cursor's own sf dir      */
+
+
+    /* Test, return if failed */
+    MARC_XCHECK(mp)
+
+    /* Refreshing, keep its own subfield directory */
+    if (*cpp) {
+        cp = *cpp;
+        if (marc_xcheck (cp) || !cp->cursor)
+            return MARC_ERR_NON_CURSOR;
+        sfdp = cp->sfdp;
+    }
+
+    else {
+        /* Create a new structure, with a directory as small as any */
+#ifdef DEBUG
+        if ((cp = (MARCCTL *) marc_alloc(sizeof(MARCCTL), 1160)) == NULL) {  //TAG:1160
+            return MARC_ERR_ALLOC;
+        }
+#else
+        if ((cp = (MARCCTL *) malloc (sizeof(MARCCTL))) == NULL) {
+            return MARC_ERR_ALLOC;
+        }
+#endif
+        if (marc_xsfd_new (&sfdp) != 0) {
+#ifdef DEBUG
+            marc_dealloc (cp, 1160);  //TAG:1160
+#else
+            free (cp);
+#endif
+            return MARC_ERR_SFDIRALLOC;
+        }
+    }
+
+    /* Same record and position, record's parse of the current field.
+     * Its sdirp, sfinp and sf_gen are the borrowed parse, good until
+     *   the record parses again.
+     */
+    memcpy (cp, mp, sizeof(MARCCTL));
+    cp->sfdp      = sfdp;
+    cp->cursor    = 1;
+    cp->read_only = 1;
+    cp->mapped    = 0;
+
+    /* Positions saved in the record are for the record to restore */
+    cp->last_pos  = 0;
+
+    *cpp = cp;
+
+    return 0;
+
+} /* marc_cursor */
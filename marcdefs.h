@@ -31,6 +31,8 @@
 #ifndef MARCDEFS_H
 #define MARCDEFS_H
 
+#include <stdint.h>     /* For marcidx          */
+#include <pthread.h>    /* For marcwrt          */
 #include "marc.h"       /* Public definitions   */
 
 /*********************************************************************
@@ -43,11 +45,15 @@
 \-------------------------------------------------------------------*/
 #define MARC_DFT_RAWSIZE    0x4000  /* Initial raw buffer size      */
 #define MARC_DFT_RAWINC        400  /* Add this much at a time      */
+#define MARC_DFT_FLDSLACK       16  /* Least spare room, moved field*/
 #define MARC_DFT_MARCSIZE   0x4000  /* Initial marc buffer size     */
 #define MARC_DFT_DIRSIZE        60  /* Initial entries in field dir */
 #define MARC_DFT_DIRINC         50  /* Add this many at a time      */
-#define MARC_DFT_SFDIRSIZE     5000  /* Room for this many in 1 field*/
-#define MARC_DFT_SFDIRINC       10  /* Add this many at a time      */
+#define MARC_DFT_SFDIRSIZE      16  /* Initial entries in sf dir    */
+#define MARC_DFT_SFIXSIZE     2000  /* Initial whole record sf index*/
+#define MARC_DFT_BLKSIZE  0x800000  /* marc_blk_read() block, 8 MB  */
+#define MARC_DFT_WRTSEG   0x400000  /* marc_wrt_rec() segment, 4 MB */
+#define MARC_DFT_WRTSEGS         4  /* Segments in writer ring      */
 
 /*-------------------------------------------------------------------\
 |   Maximum sizes                                                    |
@@ -58,6 +64,8 @@
 #define MARC_MAX_VARLEN       9999  /* Max legal marc field length  */
 #define MARC_MAX_SFID          'z'  /* Max legal subfield code      */
 #define MARC_MAX_FIXLEN        150  /* Max expected fixed field len */
+#define MARC_MAX_SFIXSIZE  0x10000  /* Max entries in sf index      */
+#define MARC_MAX_SFDIRSIZE    5000  /* Most subfields in one field  */
 #ifdef MARC16
 #define MARC_MAX_RECLEN      65000  /* Max legal for 16 bits        */
 #else
@@ -110,6 +118,7 @@
 #define MARC_FILL_CHAR         '|'  /* Fixed field filler char      */
 #define MARC_DIR_SIZE           12  /* Size of one directory entry  */
 #define MARC_NO_FIELD          (-1) /* Refers to no field           */
+#define MARC_NO_SFIX           (-1) /* Field not in sf index        */
 #define MARC_SFTBL_SIZE        128  /* Size subfield collation table*/
 
 /* Default collation sequence for subfields, see marc_set_collate() */
@@ -137,6 +146,13 @@
 #define MARC_INDIC(mp,i) \
     (*(mp->rawbufp + mp->fdirp[mp->cur_field].offset + i - 1))
 
+/* Field directory entries moved or changed tags, see marcxtag.c.
+ * The tag index is rebuilt the next time it's needed.
+ */
+#define MARC_XTAG_STALE(mp) { \
+    if ((mp)->tagixp) (mp)->tagixp->valid = 0; \
+}
+
 
 /*********************************************************************
 * flddir                                                             *
@@ -152,10 +168,15 @@ typedef struct flddir {
     int    tag;             /* Field number, 0=directory            */
     size_t len;             /* Length, including field term         */
     size_t offset;          /* Offset from rawbufp to field start   */
+    size_t room;            /* Bytes it may fill there, marc_xroom  */
     int    order;           /* Order entered, used in sorting       */
     unsigned pos_bits;      /* For marc_save_pos() positioning      */
     unsigned char startprot;/* First sf in sort protected range     */
     unsigned char endprot;  /* End sf - see marc_get_record()       */
+    int    occ;             /* Occurrence of tag, see marctagix     */
+    int    next_occ;        /* Entry for occ + 1, or MARC_NO_FIELD  */
+    int    sfix_first;      /* First entry in sf index, see marcsfix*/
+    int    sfix_cnt;        /* Entries there, or MARC_NO_SFIX       */
 } FLDDIR;
 
 
@@ -180,6 +201,91 @@ typedef struct sfdir {
 } SFDIR;
 
 
+/*********************************************************************
+* marcsfdir                                                          *
+*                                                                    *
+*   The memory a field is parsed into.                               *
+*                                                                    *
+*   It starts small and doubles whenever a field has more            *
+*   subfields than it can hold.  Each marcctl normally has its       *
+*   own, but any number of them that are never parsed at the same    *
+*   time may share one, see marc_share_sfdir().  Every parse into    *
+*   it bumps gen, and a marcctl's parse is only good while gen is    *
+*   what it was when that marcctl made it.  Otherwise it's parsed    *
+*   again, so sharers needn't know about each other.                 *
+*********************************************************************/
+typedef struct marcsfdir {
+    SFDIR  *sdirp;          /* The directory                        */
+    size_t sf_max;          /* Length (num entries) in sdirp        */
+    unsigned gen;           /* Bumped by every parse into it        */
+    int    users;           /* marcctls sharing it                  */
+} MARCSFDIR;
+
+
+/*********************************************************************
+* marcsfix                                                           *
+*                                                                    *
+*   Subfield index for a whole record.                               *
+*                                                                    *
+*   With marc_subfield_index() on, the first marc_xsfdir() for a     *
+*   record parses every variable field at once into this flat        *
+*   array, and later ones just copy a field's entries into sdirp.    *
+*   Each field's entries, indicators first, are found through        *
+*   FLDDIR.sfix_first and sfix_cnt.  Offsets are from the start      *
+*   of the field, so they survive changes to other fields.           *
+*                                                                    *
+*   Adding or deleting data in a field drops only that field from    *
+*   the index.  It's parsed again, alone, the next time it's used.   *
+*********************************************************************/
+typedef struct sfixent {
+    unsigned short offset;  /* Of delimiter or indicator in field   */
+    unsigned short len;     /* As in SFDIR                          */
+    unsigned char  id;      /* Subfield code                        */
+    unsigned char  spare[3];/* Pad to 8 bytes                       */
+} SFIXENT;
+
+typedef struct marcsfix {
+    SFIXENT *entp;          /* Entries for all indexed fields       */
+    size_t max;             /* Room in entp                         */
+    size_t count;           /* In use                               */
+    int    tail;            /* First entry of last field parsed     */
+    int    built;           /* True=whole record has been parsed    */
+} MARCSFIX;
+
+
+/*********************************************************************
+* marctagix                                                          *
+*                                                                    *
+*   Index of the field directory by tag.                             *
+*                                                                    *
+*   The entries for each tag are chained together in directory       *
+*   order through FLDDIR.next_occ, from the first and last kept      *
+*   here in one slot per tag.  A slot is only good if its gen        *
+*   matches the index's, so starting a new record needn't clear      *
+*   all of them.  The last field found is kept, so walking up the    *
+*   occurrences of a tag takes one step each.                        *
+*                                                                    *
+*   Kept up to date as fields are added.  Anything that moves        *
+*   directory entries or changes their tags marks it invalid, and    *
+*   it's rebuilt on the next lookup.  See marcxtag.c.                *
+*********************************************************************/
+typedef struct marctagslot {
+    unsigned gen;           /* Slot is good if == marctagix.gen     */
+    int    first;           /* First fdirp entry with this tag      */
+    int    last;            /* Last one                             */
+    int    count;           /* Number of them                       */
+} MARCTAGSLOT;
+
+typedef struct marctagix {
+    unsigned gen;           /* Current generation of slots          */
+    int    valid;           /* False=rebuild before use             */
+    int    last_tag;        /* Tag of last field found, -1=none     */
+    int    last_occ;        /* Its occurrence                       */
+    int    last_pos;        /* Its fdirp entry                      */
+    MARCTAGSLOT slot[MARC_MAX_FIELDID+1]; /* One per tag            */
+} MARCTAGIX;
+
+
 /*********************************************************************
 * marcctl                                                            *
 *                                                                    *
@@ -197,29 +303,138 @@ typedef struct marcctl {
     unsigned char *endmarcp;/* Ptr to byte after end of marc buffer */
     FLDDIR *fdirp;          /* Ptr internal format field directory  */
     SFDIR  *sdirp;          /* Ptr to internal subfield directory   */
+    MARCSFDIR *sfdp;        /* Where we parse it, maybe shared      */
+    MARCSFDIR *sfinp;       /* Where sdirp is, sfdp or borrowed     */
+    unsigned sf_gen;        /* sfinp->gen when sdirp was parsed     */
     size_t raw_buflen;      /* Length of raw buffer                 */
     size_t raw_datalen;     /* Amount of data in buffer             */
+    size_t raw_holes;       /* Unused bytes left there, marc_xroom  */
     size_t marc_buflen;     /* Length of marc buffer                */
     size_t marc_datalen;    /* Amount of data in buffer             */
     int    rectype;         /* Bib or Auth (currently unused)       */
     int    read_only;       /* True=no modifications allowed        */
-    int    field_max;       /* Length (num entries) in fdirp        */
+    size_t field_max;       /* Length (num entries) in fdirp        */
     int    field_count;     /* Num entries in use in fdirp          */
     int    cur_field;       /* Last field op was on this fdirp entry*/
     int    field_sort;      /* True=Use start/end_prot in sorting   */
     int    start_prot;      /* Don't sort fields between start      */
     int    end_prot;        /*   and end.  Caller specified order   */
-    int    sf_max;          /* Length (num entries) in sdirp        */
     int    sf_count;        /* Num entries in use in sdirp          */
     int    cur_sf;          /* Last sf op was on this sdirp entry   */
     int    cur_sf_field;    /* sf directory is for this fielddir    */
     int    sf_sort;         /* True=Use start/end_prot sorting sfs  */
     unsigned last_pos;      /* Last bit used in marking field dirs  */
+    int    pos_field[MARC_MAX_SAVE_POS]; /* Where each was, a hint  */
     unsigned char sf_collate[MARC_SFTBL_SIZE]; /* Sf collation table*/
+    int    mapped;          /* True=rawbufp borrowed by marc_old_map*/
+    unsigned char *ownrawp; /* Our own raw buffer, while borrowing  */
+    unsigned char *ownendrawp;/* Its end                            */
+    size_t own_buflen;      /* Its length                           */
+    MARCTAGIX *tagixp;      /* Index by tag, shared by marc_dup()s  */
+    int    sf_index;        /* True=use whole record sf index       */
+    MARCSFIX *sfixp;        /* The index, NULL until first used     */
+    int    cursor;          /* True=marc_cursor(), owns only sfdp   */
     long   end_tag;         /* Sentinel                             */
 } MARCCTL;
 
 
+/*********************************************************************
+* marcmap                                                            *
+*                                                                    *
+*   Sequential marc file mapped into memory by marc_map_open().      *
+*   Records are returned in place by marc_map_read().                *
+*********************************************************************/
+typedef struct marcmap {
+    unsigned char *basep;   /* Start of mapped file                 */
+    unsigned char *endp;    /* Byte after end of mapped file        */
+    unsigned char *curp;    /* Next record starts here              */
+    size_t maplen;          /* Length of mapping                    */
+} MARCMAP;
+
+
+/*********************************************************************
+* marcblk                                                            *
+*                                                                    *
+*   Sequential marc file read in large blocks by marc_blk_read().    *
+*   Unread data is always curp..endp, moved to the front of the      *
+*   buffer before the next read.                                     *
+*********************************************************************/
+typedef struct marcblk {
+    unsigned char *bufp;    /* Block buffer, buflen + 1 bytes       */
+    unsigned char *curp;    /* Next record starts here              */
+    unsigned char *endp;    /* Byte after end of data read          */
+    size_t buflen;          /* Block size + room for carried record */
+    int    fd;              /* File being read                      */
+    int    eof;             /* True=read() hit end of file          */
+} MARCBLK;
+
+
+/*********************************************************************
+* marcwrt                                                            *
+*                                                                    *
+*   Sequential marc file written by a thread, see marc_wrt_open().   *
+*                                                                    *
+*   The caller fills segp[fill].  Segments queued for the thread     *
+*   run from head up to, not including, fill.  Everything from       *
+*   queued on down is shared and only touched under lock.            *
+*********************************************************************/
+typedef struct marcwrt {
+    unsigned char *segp[MARC_DFT_WRTSEGS]; /* Ring of segments      */
+    size_t seglen[MARC_DFT_WRTSEGS];       /* Bytes used in each    */
+    size_t segsize;         /* Size of each segment                 */
+    int    nsegs;           /* Number of segments in ring           */
+    int    fill;            /* Segment caller is filling            */
+    int    fd;              /* Output file                          */
+    pthread_t thread;       /* Writer thread                        */
+    pthread_mutex_t lock;   /* Protects all that follows            */
+    pthread_cond_t cond;    /* Broadcast on any change below        */
+    int    head;            /* Next segment for thread to write     */
+    int    queued;          /* Segments waiting for or in write     */
+    int    stop;            /* True=thread exits once queue empty   */
+    int    err;             /* First write error, 0 if none         */
+} MARCWRT;
+
+
+/*********************************************************************
+* marcidx                                                            *
+*                                                                    *
+*   Sidecar record offset index, see marc_idx_build().               *
+*                                                                    *
+*   The file is a header, then one fixed size entry per record in    *
+*   record order, then, if MARC_IDX_CN, all the 001s as null         *
+*   terminated strings.  Entries give their 001's offset in the      *
+*   strings, 0 being an empty string for records without one.        *
+*   Numbers are in native byte order; the index is a cache of the    *
+*   marc file, for use on the machine that built it.                 *
+*********************************************************************/
+#define MARC_IDX_MAGIC  "MARCIDX1"  /* First 8 bytes of index file  */
+#define MARC_IDX_CN           0x01  /* Flag: index holds 001s       */
+
+typedef struct marcidxhdr {
+    char     magic[8];      /* MARC_IDX_MAGIC, not null terminated  */
+    uint32_t flags;         /* MARC_IDX_CN or 0                     */
+    uint32_t ent_size;      /* sizeof(MARCIDXENT), sanity check     */
+    uint64_t file_size;     /* Size of marc file indexed            */
+    int64_t  file_mtime;    /* Its modification time, nanoseconds   */
+    uint64_t rec_count;     /* Number of entries                    */
+    uint64_t cn_size;       /* Bytes of 001 strings after entries   */
+} MARCIDXHDR;
+
+typedef struct marcidxent {
+    uint64_t offset;        /* Byte offset of record in marc file   */
+    uint32_t len;           /* Record length                        */
+    uint32_t cnoff;         /* Offset of 001 in strings             */
+} MARCIDXENT;
+
+typedef struct marcidx {
+    unsigned char *basep;   /* Mapped index file                    */
+    size_t maplen;          /* Its length                           */
+    MARCIDXHDR *hdrp;       /* Header, at basep                     */
+    MARCIDXENT *entp;       /* First entry, after header            */
+    char   *cnp;            /* 001 strings, after entries           */
+} MARCIDX;
+
+
 /*********************************************************************
 *   Prototypes for internal functions                                *
 *********************************************************************/
@@ -227,9 +442,22 @@ int marc_xcheck        (MARCP);
 int marc_xsfdir        (MARCP);
 int marc_xallocate     (void **, void **, size_t *, size_t, size_t);
 int marc_xdel_field    (MARCP, int);
-int marc_xcompress     (MARCP, size_t, size_t);
+int marc_xcompress     (MARCP, FLDDIR *, size_t, size_t);
+int marc_xroom         (MARCP, FLDDIR *, size_t);
 int marc_xcheck_data   (int, int, unsigned char *, size_t);
+int marc_xpack         (void *, unsigned char **, size_t *);
+int marc_xraw_field    (MARCP, FLDDIR *);
+int marc_xsfix         (MARCP, FLDDIR *);
+int marc_xsfd_new      (MARCSFDIR **);
+int marc_xsfd_room     (MARCSFDIR *, size_t);
+void marc_xsfd_free    (MARCSFDIR *);
+void marc_xtag_reset   (MARCP);
+void marc_xtag_add     (MARCP, int);
+int marc_xtag_find     (MARCP, int, int, int *);
 unsigned int marc_xnum (unsigned char *, int);
+void marc_xputnum      (unsigned char *, unsigned int, int);
+unsigned char *marc_xscan_resv   (unsigned char *, unsigned char *);
+unsigned char *marc_xscan_digits (unsigned char *, unsigned char *);
 
 #define _FILE_OFFSET_BITS 64
 
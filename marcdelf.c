@@ -73,27 +73,40 @@ int marc_xdel_field (
     int     fpos            /* Position to delete       */
 ) {
     FLDDIR  *fdp;           /* Ptr to directory entry   */
-    int     stat;           /* Return from called func  */
     size_t  move_bytes;     /* Number of bytes to shift */
+    int     i;              /* Loop counter             */
 
 
     /* Find field to delete.  Caller must have already checked this */
     fdp = mp->fdirp + fpos;
 
-    /* If any data there, compress it out */
-    if (fdp->len)
-        if ((stat = marc_xcompress (mp, fdp->offset, fdp->len)) != 0)
-            return (stat);
+    /* Its room in the raw buffer is given back if it's at the end,
+     *   else left as a hole.  No other data moves.
+     */
+    if (fdp->offset + fdp->room == mp->raw_datalen)
+        mp->raw_datalen = fdp->offset;
+    else
+        mp->raw_holes += fdp->room;
 
     /* Compress directory entry by right number of bytes */
     if ((move_bytes = ((mp->field_count - 1) - fpos) * sizeof(FLDDIR)) > 0)
         memmove (fdp, fdp+1, move_bytes);
     --mp->field_count;
+    MARC_XTAG_STALE(mp)
 
     /* Adjust position of current field if possible */
     if (mp->cur_field >= fpos)
         --mp->cur_field;
 
+    /* And where saved positions will look for theirs */
+    for (i=0; i<(int) mp->last_pos; i++) {
+        if (mp->pos_field[i] > fpos)
+            --mp->pos_field[i];
+    }
+
+    /* Subfield directory may be for a field that moved up */
+    mp->cur_sf_field = MARC_NO_FIELD;
+
     return 0;
 
 } /* marc_xdel_field */
@@ -103,13 +116,18 @@ int marc_xdel_field (
 * marc_xcompress ()                                                     *
 *                                                                       *
 *   DEFINITION                                                          *
-*       Compress bytes out of the raw data buffer.                      *
+*       Compress bytes out of a field in the raw data buffer.           *
+*                                                                       *
+*       Only the rest of the field is shifted.  The field keeps the     *
+*       room it had, for anything added to it later, unless it ends     *
+*       the buffer, where the room is given back.                       *
 *                                                                       *
 *       Caller should have performed all checks.                        *
 *                                                                       *
 *   PASS                                                                *
 *       Pointer to structure returned by marc_init.                     *
-*       Offset to first byte to compress out.                           *
+*       Ptr to directory entry for field containing the bytes.          *
+*       Offset to first byte to compress out, from rawbufp.             *
 *       Number of bytes to compress out.                                *
 *                                                                       *
 *   RETURN                                                              *
@@ -118,13 +136,12 @@ int marc_xdel_field (
 
 int marc_xcompress (
     MARCP   mp,             /* Pointer to structure     */
+    FLDDIR  *fdp,           /* Field holding the bytes  */
     size_t  offset,         /* Compress starting here   */
     size_t  del_len         /* For this many bytes      */
 ) {
     unsigned char *srcp,    /* Source of data to copy   */
                   *destp;   /* Destination for copy     */
-    FLDDIR  *fdp,           /* Ptr to directory entry   */
-            *end_fdp;       /* Ptr after end of directry*/
     size_t  move_len;       /* Bytes to move            */
 
 
@@ -132,45 +149,25 @@ int marc_xcompress (
     destp = mp->rawbufp + offset;
     srcp  = destp + del_len;
 
-    /* Number of bytes to move */
-    move_len = (size_t) ((mp->rawbufp + mp->raw_datalen) - srcp);
+    /* Number of bytes to move, to the end of the field */
+    move_len = (size_t) ((mp->rawbufp + fdp->offset + fdp->len) - srcp);
 
     /* If there are any, shift the lower bytes up */
     if (move_len)
         memmove (destp, srcp, move_len);
 
-    /* Find first affected directory entry
-     * We'll actually search from after first entry (leader)
-     *   since the leader cannot be deleted from a record.
-     */
-    fdp     = mp->fdirp;
-    end_fdp = fdp + mp->field_count;
-    while (++fdp < end_fdp) {
-        if (fdp->offset > offset)
-            break;
+    /* Give back room at the end of the buffer */
+    if (fdp->offset + fdp->room == mp->raw_datalen) {
+        mp->raw_datalen -= fdp->room - (fdp->len - del_len);
+        fdp->room        = fdp->len - del_len;
     }
+    fdp->len -= del_len;
 
-    /* Deleted bytes might be inside a field.
-     * Check last entry with offset before deleted bytes.
-     * Since we can't delete leader with this technique, and
-     *   leader has an entry in the field directory, we don't
-     *   have to worry about there not being a previous entry.
+    /* Dirty the current subfield directory, and the field's entries
+     *   in the whole record index
      */
-    --fdp;
-    if (fdp->offset + fdp->len >= offset)
-        fdp->len -= del_len;
-
-    /* Adjust all directory offsets after deleted data */
-    while (++fdp < end_fdp) {
-        if (fdp->offset > offset)
-            fdp->offset -= del_len;
-    }
-
-    /* Adjust data end info */
-    mp->raw_datalen -= del_len;
-
-    /* Dirty the current subfield directory */
     mp->cur_sf_field = MARC_NO_FIELD;
+    fdp->sfix_cnt    = MARC_NO_SFIX;
 
     /* Might add checking in the future, but none for now */
     return 0;
@@ -62,7 +62,7 @@ int marc_del_subfield (
                 sfp = mp->sdirp + mp->cur_sf;
 
                 /* Delete bytes at that point */
-                retcode = marc_xcompress (mp,
+                retcode = marc_xcompress (mp, mp->fdirp + mp->cur_field,
                           (size_t) (sfp->startp - mp->rawbufp), sfp->len);
 
                 /* Subfield directory and position now invalid */
@@ -59,12 +59,18 @@ int marc_dup (
 #endif
     }
 
-    /* Duplicate as requested */
+    /* Duplicate as requested.
+     * The copy shares the original's buffers, field directory and
+     *   tag index.  Only the original frees them.
+     */
     memcpy (*dpp, mp, sizeof(MARCCTL));
 
     /* Make copy read only */
     (*dpp)->read_only = 1;
 
+    /* Copy only points at a borrowed buffer, it never owned one */
+    (*dpp)->mapped = 0;
+
     return 0;
 
 } /* marc_dup */
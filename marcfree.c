@@ -4,6 +4,8 @@
 *   DEFINITION                                                          *
 *       Free all buffers used in marc processing.                       *
 *                                                                       *
+*       A marc_cursor() is freed without its record's buffers.          *
+*                                                                       *
 *   PASS                                                                *
 *       Pointer to marcctl structure.                                   *
 *                                                                       *
@@ -33,17 +35,30 @@ int marc_free (
     if (mp->end_tag != MARC_END_TAG)
         return MARC_ERR_END_TAG;
 
-    /* Free all allocated buffers */
-
-    if (mp->sdirp) {
+    /* A marc_cursor() owns only its subfield directory */
+    if (mp->cursor) {
+        marc_xsfd_free (mp->sfdp);
+        mp->start_tag = 0;
+        mp->end_tag   = 0;
 #ifdef DEBUG
-        marc_dealloc(mp->sdirp, 400); //TAG:400
+        marc_dealloc(mp, 1160);           //TAG:1160
 #else
-        free (mp->sdirp);
+        free (mp);
 #endif
-        mp->sdirp = NULL;
+        return 0;
     }
 
+    /* Raw buffer may be borrowed, see marc_old_map() */
+    if (mp->mapped)
+        mp->rawbufp = mp->ownrawp;
+
+    /* Free all allocated buffers */
+
+    /* Subfield directory may be shared, see marc_share_sfdir() */
+    marc_xsfd_free (mp->sfdp);
+    mp->sfdp  = NULL;
+    mp->sdirp = NULL;
+
     if (mp->fdirp) {
 #ifdef DEBUG
         marc_dealloc (mp->fdirp, 401);  //TAG:401
@@ -72,6 +87,31 @@ int marc_free (
         mp->rawbufp = NULL;
     }
 
+    if (mp->tagixp) {
+#ifdef DEBUG
+        marc_dealloc(mp->tagixp, 1131);  //TAG:1131
+#else
+        free (mp->tagixp);
+#endif
+        mp->tagixp = NULL;
+    }
+
+    if (mp->sfixp) {
+        if (mp->sfixp->entp) {
+#ifdef DEBUG
+            marc_dealloc(mp->sfixp->entp, 1141);  //TAG:1141
+#else
+            free (mp->sfixp->entp);
+#endif
+        }
+#ifdef DEBUG
+        marc_dealloc(mp->sfixp, 1142);  //TAG:1142
+#else
+        free (mp->sfixp);
+#endif
+        mp->sfixp = NULL;
+    }
+
     /* Set tags to prevent user re-using this memory, just in case */
     mp->start_tag = 0;
     mp->end_tag   = 0;
@@ -60,8 +60,14 @@ int marc_get_field (
     /* Haven't found the field yet */
     retcode = MARC_RET_NO_FIELD;
 
+    /* Go straight to it if the record has a tag index */
+    if (mp->tagixp) {
+        if ((retcode = marc_xtag_find (mp, field_id, field_occ, &count)) == 0)
+            dp = mp->fdirp + count;
+    }
+
     /* Look for positive field occs */
-    if (field_occ >= 0) {
+    else if (field_occ >= 0) {
 
         /* Walk field directory looking for id and occurrence number */
         dp  = mp->fdirp;
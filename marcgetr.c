@@ -42,21 +42,30 @@
  *
  */
 
+#define _GNU_SOURCE         /* qsort_r  */
 #include <string.h>         /* memcpy   */
-#include <stdio.h>          /* sprintf  */
 #include "marcdefs.h"
 
-/* qsort compare routine needs access to control information */
-static MARCCTL *S_mp;
-static FLDDIR  *S_dp;
-
-/* Internal prototypes */
-static int  marc_xcompfld    (const void *, const void *);
-static int  marc_xcompsf     (const void *, const void *);
+/* Internal prototypes.
+ * No statics here.  Compare routines get their control information
+ *   through qsort_r(), so any number of records can be built at
+ *   once in different threads.
+ */
+static int  marc_xsortfld    (MARCCTL *);
+static int  marc_xcompfld    (const void *, const void *, void *);
+static int  marc_xcompsf     (const void *, const void *, void *);
 static int  marc_xoutfield   (MARCCTL *, FLDDIR *, unsigned char *,
-                              unsigned char *, size_t *);
+                              unsigned char *, size_t, size_t *);
 int check(int);
 
+/* Most fields marc_xsortfld() will sort, more go to qsort_r() */
+#define SORT_MAX_FIELDS (MARC_MAX_FLDCOUNT + MARC_DFT_DIRINC)
+
+/* marc_xsortfld() return codes */
+#define SORT_MOVED      0   /* Fields sorted            */
+#define SORT_IN_ORDER   1   /* Already sorted, no change*/
+#define SORT_CANT     (-1)  /* Use marc_xcompfld()      */
+
 /* Tells if a field is empty */
 #define IS_EMPTYFLD(x) ((x->tag<10 && x->len<1) || (x->tag>9 && x->len<3))
 
@@ -73,8 +82,8 @@ int marc_get_record (
             data_len,       /* Bytes in data portion    */
             dir_len,        /* Bytes in directory       */
             rec_len;        /* Bytes in marc record     */
-    char    numbuf[15];     /* Construct numbers here   */
     unsigned char *datap,   /* Ptr to output data       */
+                  *basep,   /* Ptr to start of data     */
                   *dirp;    /* Ptr char fmt directory   */
 
     /* Test, return if failed */
@@ -129,7 +138,7 @@ int marc_get_record (
 
     /* Point to output destinations for directory and data */
     dirp  = mp->marcbufp + MARC_LEADER_LEN;
-    datap = dirp + dir_len;
+    basep = datap = dirp + dir_len;
 
     /* Sort fields into directory order.
      * Default directory order is:
@@ -141,9 +150,11 @@ int marc_get_record (
      * Sorting requires access to the marcctl.
      */
     if (mp->field_sort) {
-        S_mp = mp;
-        qsort ((void *) mp->fdirp, mp->field_count, sizeof(FLDDIR),
-               marc_xcompfld);
+        if ((stat = marc_xsortfld (mp)) == SORT_CANT)
+            qsort_r ((void *) mp->fdirp, mp->field_count, sizeof(FLDDIR),
+                     marc_xcompfld, mp);
+        if (stat != SORT_IN_ORDER)
+            MARC_XTAG_STALE(mp)
     }
 
     /* Create each field, in sorted order, starting after leader */
@@ -153,9 +164,12 @@ int marc_get_record (
         /* Only fields with data */
         if (!IS_EMPTYFLD(dp)) {
 
-            /* Create directory entry and field data */
+            /* Create directory entry and field data.
+             * Its offset is the length of all fields before it.
+             */
             mp->cur_field = i;
-            if ((stat = marc_xoutfield (mp, dp, dirp, datap, &field_len)) != 0) {
+            if ((stat = marc_xoutfield (mp, dp, dirp, datap,
+                            (size_t) (datap - basep), &field_len)) != 0) {
                 return (stat);
             }
 
@@ -177,18 +191,14 @@ int marc_get_record (
     /* Add null terminator, not marc but a convenience for caller */
     *datap = '\0';   // REC NULL TERMINATOR
 
-    /*
-     *  Insert logical record length into leader.
-     *  We save and restore the byte after the record length
-     *  so we can use sprintf, which plants a terminating 0 after
-     *  the number.
-     */
-    sprintf (numbuf, "%0*u", MARC_RECLEN_LEN, rec_len);
-    memcpy (mp->marcbufp + MARC_RECLEN_OFF, numbuf, MARC_RECLEN_LEN);
+    /* Insert logical record length into leader */
+    marc_xputnum (mp->marcbufp + MARC_RECLEN_OFF, (unsigned int) rec_len,
+                  MARC_RECLEN_LEN);
 
     /* Same for base address of data */
-    sprintf (numbuf, "%0*u", MARC_BASEADDR_LEN, MARC_LEADER_LEN + dir_len);
-    memcpy (mp->marcbufp + MARC_BASEADDR_OFF, numbuf, MARC_BASEADDR_LEN);
+    marc_xputnum (mp->marcbufp + MARC_BASEADDR_OFF,
+                  (unsigned int) (MARC_LEADER_LEN + dir_len),
+                  MARC_BASEADDR_LEN);
 
     /* Return info to caller */
     *recp   = mp->marcbufp;
@@ -214,6 +224,7 @@ int marc_get_record (
 *       Ptr to internal marc directory for field to output.             *
 *       Ptr to place to put output directory entry.                     *
 *       Ptr to place to put field data.                                 *
+*       Offset of field data from start of data in record.              *
 *       Ptr to place to put length of output field.                     *
 *           This includes indicators and field terminator.              *
 *                                                                       *
@@ -227,20 +238,16 @@ static int marc_xoutfield (
     FLDDIR        *fdp,     /* Ptr to internal field info   */
     unsigned char *dirp,    /* Put marc directory here      */
     unsigned char *datap,   /* Copy data here               */
+    size_t        offset,   /* Offset in marc directory     */
     size_t        *flenp    /* Put field length here        */
 ) {
     SFDIR         *sdp;     /* Ptr to internal sf info      */
-    size_t        len,      /* Length of output data        */
-                  offset;   /* Offset in marc directory     */
+    size_t        len;      /* Length of output data        */
     unsigned char *srcp,    /* Ptr to source for copy       */
                   *destp;   /* Ptr to next output byte      */
     int           i,        /* Loop counter                 */
                   retcode;  /* Return code                  */
 
-    /* Keep track of directory offsets and lengths here */
-    static size_t s_last_offset;
-    static size_t s_last_len;
-
 
     /* No errors yet */
     retcode = 0;
@@ -265,11 +272,9 @@ static int marc_xoutfield (
         if ((retcode = marc_xsfdir (mp)) == 0) {
 
             /* Sort the portion of it after the two indicators */
-            if (mp->sf_sort && mp->sf_count > 3) {
-                S_dp = fdp;
-                qsort ((void *) (mp->sdirp + 2), mp->sf_count - 2,
-                       sizeof(SFDIR), marc_xcompsf);
-            }
+            if (mp->sf_sort && mp->sf_count > 3)
+                qsort_r ((void *) (mp->sdirp + 2), mp->sf_count - 2,
+                         sizeof(SFDIR), marc_xcompsf, fdp);
 
             /* Output data in sorted order, after 2 indicators */
             sdp = mp->sdirp + 2;
@@ -293,21 +298,12 @@ static int marc_xoutfield (
         *destp = MARC_FIELD_TERM;
         ++len;
 
-        /* Compute offset to field.
-         * First field, offset always = 0.
-         * Subsequent fields refer to offset to previous field.
-         */
-        if (mp->cur_field == 1)
-            offset = 0;
-        else
-            offset = s_last_offset + s_last_len;
-
         /* Create marc directory entry */
-        sprintf ((char *) dirp, "%03d%04u%05u", fdp->tag, len, offset);
-
-        /* Remember for next field */
-        s_last_offset = offset;
-        s_last_len    = len;
+        marc_xputnum (dirp, (unsigned int) fdp->tag, MARC_TAG_LEN);
+        marc_xputnum (dirp + MARC_TAG_LEN, (unsigned int) len,
+                      MARC_FIELDLEN_LEN);
+        marc_xputnum (dirp + (MARC_TAG_LEN + MARC_FIELDLEN_LEN),
+                      (unsigned int) offset, MARC_OFFSET_LEN);
 
         /* Tell caller how many bytes were output */
         *flenp = len;
@@ -322,6 +318,107 @@ static int marc_xoutfield (
 } /* marc_xoutfield */
 
 
+/************************************************************************
+* marc_xsortfld ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Sort the field directory into the same order qsort_r() with     *
+*       marc_xcompfld() would, in linear time.                          *
+*                                                                       *
+*       marc_xcompfld() puts fields in order by tag, except that all    *
+*       fields in the protected range sort together, where the tags     *
+*       < start_prot and >= end_prot would put them.  Ties are broken   *
+*       by order entered, then by position, qsort_r() being a stable    *
+*       merge sort.                                                     *
+*                                                                       *
+*       So each field gets a bucket, its tag, or start_prot for all     *
+*       protected fields.  If within each bucket the orders entered     *
+*       already go up with position, as they nearly always do, a        *
+*       stable counting sort by bucket is all it takes.  Directories    *
+*       already in order, e.g., from marc_old(), aren't moved at all.   *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*                                                                       *
+*   RETURN                                                              *
+*       SORT_MOVED    = Directory sorted.                               *
+*       SORT_IN_ORDER = It was already sorted.  Nothing moved.          *
+*       SORT_CANT     = Orders entered are out of position within a     *
+*                       bucket, or too many fields.  Nothing moved,     *
+*                       caller must sort with marc_xcompfld().          *
+************************************************************************/
+
+static int marc_xsortfld (
+    MARCCTL *mp             /* Control for marc record      */
+) {
+    FLDDIR  *fdp,           /* Ptr to field directory       */
+            tmp;            /* For swapping entries         */
+    int     count[MARC_MAX_FIELDID+1],  /* Fields per bucket*/
+            last[MARC_MAX_FIELDID+1];   /* Last order seen  */
+    unsigned short dest[SORT_MAX_FIELDS];  /* New positions */
+    int     i,              /* Loop counter                 */
+            j,              /* Where entry i goes           */
+            n,              /* Number of fields             */
+            bucket,         /* Bucket of current entry      */
+            prev,           /* Bucket of previous entry     */
+            in_order,       /* True=no entry out of place   */
+            sum;            /* Running total of counts      */
+
+
+    fdp = mp->fdirp;
+    n   = mp->field_count;
+    if (n > SORT_MAX_FIELDS)
+        return SORT_CANT;
+
+    /* Count fields per bucket, checking orders as we go */
+    memset (count, 0, sizeof(count));
+    in_order = 1;
+    prev     = -1;
+    for (i=0; i<n; i++) {
+        if (fdp[i].tag < 0 || fdp[i].tag > MARC_MAX_FIELDID)
+            return SORT_CANT;
+        bucket = (mp->start_prot <= fdp[i].tag && mp->end_prot > fdp[i].tag)
+                 ? mp->start_prot : fdp[i].tag;
+        if (count[bucket]++ && fdp[i].order < last[bucket])
+            return SORT_CANT;
+        last[bucket] = fdp[i].order;
+        if (bucket < prev)
+            in_order = 0;
+        prev = bucket;
+        dest[i] = (unsigned short) bucket;
+    }
+
+    if (in_order)
+        return SORT_IN_ORDER;
+
+    /* Each bucket starts after all those before it */
+    sum = 0;
+    for (i=0; i<=MARC_MAX_FIELDID; i++) {
+        j        = count[i];
+        count[i] = sum;
+        sum     += j;
+    }
+
+    /* Turn buckets into new positions, keeping order within each */
+    for (i=0; i<n; i++)
+        dest[i] = (unsigned short) count[dest[i]]++;
+
+    /* Move each entry into place, following cycles of the permutation */
+    for (i=0; i<n; i++) {
+        while ((j = dest[i]) != i) {
+            tmp     = fdp[j];
+            fdp[j]  = fdp[i];
+            fdp[i]  = tmp;
+            dest[i] = dest[j];
+            dest[j] = (unsigned short) j;
+        }
+    }
+
+    return SORT_MOVED;
+
+} /* marc_xsortfld */
+
+
 /************************************************************************
 * marc_xcompfld ()                                                      *
 *                                                                       *
@@ -338,9 +435,7 @@ static int marc_xoutfield (
 *   PASS                                                                *
 *       Pointer to first directory entry.                               *
 *       Pointer to second.                                              *
-*                                                                       *
-*       marc_xcompfld() also requires access to the marcctl struct      *
-*       for the record - which must be provided via filewide static.    *
+*       Pointer to marcctl struct for the record, from qsort_r().       *
 *                                                                       *
 *   RETURN                                                              *
 *       Negative number if d1 sorts before d2.                          *
@@ -350,15 +445,18 @@ static int marc_xoutfield (
 
 static int marc_xcompfld (
     const void *dir1p,
-    const void *dir2p
+    const void *dir2p,
+    void       *ctlp
 ) {
-    FLDDIR *d1p,        /* dir1p in correct data type   */
-           *d2p;        /* dir2p  "    "      "    "    */
+    FLDDIR  *d1p,       /* dir1p in correct data type   */
+            *d2p;       /* dir2p  "    "      "    "    */
+    MARCCTL *mp;        /* ctlp   "    "      "    "    */
 
 
     /* Cast pointer types */
     d1p = (FLDDIR *) dir1p;
     d2p = (FLDDIR *) dir2p;
+    mp  = (MARCCTL *) ctlp;
 
     /* If field id and sort order both indicate the same thing */
     if (d1p->tag < d2p->tag && d1p->order < d2p->order)
@@ -368,8 +466,8 @@ static int marc_xcompfld (
         return 1;
 
     /* Else check to see if fields are in range protected from sorting */
-    if (S_mp->start_prot <= d1p->tag && S_mp->end_prot > d1p->tag &&
-            S_mp->start_prot <= d2p->tag && S_mp->end_prot > d2p->tag)
+    if (mp->start_prot <= d1p->tag && mp->end_prot > d1p->tag &&
+            mp->start_prot <= d2p->tag && mp->end_prot > d2p->tag)
 
         /* Fields are protected from sorting.  Use entry order */
         return (d1p->order - d2p->order);
@@ -396,9 +494,7 @@ static int marc_xcompfld (
 *   PASS                                                                *
 *       Pointer to first directory entry.                               *
 *       Pointer to second.                                              *
-*                                                                       *
-*       marc_xcompsf() also requires access to the flddir struct        *
-*       for the field - which must be provided via filewide static.     *
+*       Pointer to flddir struct for the field, from qsort_r().         *
 *                                                                       *
 *   RETURN                                                              *
 *       Negative number if d1 sorts before d2.                          *
@@ -408,14 +504,17 @@ static int marc_xcompfld (
 
 static int marc_xcompsf (
     const void *dir1p,
-    const void *dir2p
+    const void *dir2p,
+    void       *fldp
 ) {
-    SFDIR *d1p,         /* dir1p in correct data type   */
-          *d2p;         /* dir2p  "    "      "    "    */
+    SFDIR  *d1p,        /* dir1p in correct data type   */
+           *d2p;        /* dir2p  "    "      "    "    */
+    FLDDIR *fdp;        /* fldp   "    "      "    "    */
 
     /* Cast pointer types */
     d1p = (SFDIR *) dir1p;
     d2p = (SFDIR *) dir2p;
+    fdp = (FLDDIR *) fldp;
 
     /* If sf coll and sort order both indicate the same thing */
     if (d1p->coll < d2p->coll && d1p->order < d2p->order)
@@ -424,8 +523,8 @@ static int marc_xcompsf (
         return 1;
 
     /* Else check to see if fields are in range protected from sorting */
-    if (S_dp->startprot <= d1p->coll && S_dp->endprot > d1p->coll &&
-            S_dp->startprot <= d2p->coll && S_dp->endprot > d2p->coll)
+    if (fdp->startprot <= d1p->coll && fdp->endprot > d1p->coll &&
+            fdp->startprot <= d2p->coll && fdp->endprot > d2p->coll)
 
         /* Subfields are protected from sorting.  Use entry order */
         return (d1p->order - d2p->order);
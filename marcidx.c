@@ -0,0 +1,424 @@
+/************************************************************************
+* marc_idx_build ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Build a sidecar offset index for a sequential marc file.        *
+*                                                                       *
+*       The index holds the byte offset and length of every record,     *
+*       by record number, and optionally each record's 001 control      *
+*       number.  With it, marc_idx_get() finds any record without       *
+*       reading the ones before it.                                     *
+*                                                                       *
+*       The index also records the size and modification time of the    *
+*       marc file it was built from.  marc_idx_open() refuses an        *
+*       index which no longer matches its marc file.                    *
+*                                                                       *
+*       Indexing stops at the first record marc_map_read() rejects.     *
+*       No index is written in that case, since the records after it    *
+*       could not be found by reading sequentially either.              *
+*                                                                       *
+*       The index is written under a temporary name and renamed, so     *
+*       a reader never sees a partly written one.                       *
+*                                                                       *
+*   PASS                                                                *
+*       Name of marc file to index.                                     *
+*       Name of index file to create.                                   *
+*       True = include 001 control numbers.                             *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "marcdefs.h"
+
+#ifdef DEBUG
+void *marc_alloc(int, int);
+void marc_dealloc(void *, int);
+#endif
+
+static int idx_stat (char *, uint64_t *, int64_t *);
+
+int marc_idx_build (
+    char          *marcfile,/* File to index            */
+    char          *idxfile, /* Index to create          */
+    int           with_cn   /* True=keep 001s too       */
+) {
+    MARCMAPP      map;      /* Marc file, mapped        */
+    MARCP         mp;       /* For finding 001s         */
+    MARCIDXHDR    hdr;      /* Index header             */
+    MARCIDXENT    ent;      /* One index entry          */
+    FILE          *fp;      /* Index file being written */
+    char          tmpname[FILENAME_MAX]; /* Written here first  */
+    unsigned char *recp,    /* Current record           */
+                  *cnp,     /* Its 001                  */
+                  *cnbufp;  /* All 001s, null terminated*/
+    size_t        reclen,   /* Record length            */
+                  cnlen,    /* Length of 001            */
+                  cnbuflen, /* Allocated size of cnbufp */
+                  cnused,   /* Bytes used in cnbufp     */
+                  need;     /* cnbufp size needed       */
+    int           stat;     /* Return code              */
+
+
+    if (strlen (idxfile) + 5 > sizeof(tmpname))
+        return MARC_ERR_IDX_OPEN;
+    sprintf (tmpname, "%s.tmp", idxfile);
+
+    memset (&hdr, 0, sizeof(hdr));
+    memcpy (hdr.magic, MARC_IDX_MAGIC, sizeof(hdr.magic));
+    hdr.ent_size = sizeof(MARCIDXENT);
+    if ((stat = idx_stat (marcfile, &hdr.file_size, &hdr.file_mtime)) != 0)
+        return stat;
+
+    if ((stat = marc_map_open (marcfile, &map)) != 0)
+        return stat;
+
+    /* Control numbers need the record parsed */
+    mp       = NULL;
+    cnbufp   = NULL;
+    cnbuflen = 0;
+    cnused   = 0;
+    if (with_cn) {
+        hdr.flags |= MARC_IDX_CN;
+        if ((stat = marc_init (&mp)) != 0) {
+            marc_map_close (map);
+            return stat;
+        }
+
+        /* Offset 0 is the empty string, for records without a 001 */
+        need = 0x10000;
+        if (marc_xallocate ((void **) &cnbufp, NULL, &cnbuflen, need,
+                            sizeof(unsigned char)) != 0) {
+            marc_free (mp);
+            marc_map_close (map);
+            return MARC_ERR_ALLOC;
+        }
+        cnbufp[cnused++] = '\0';
+    }
+
+    if ((fp = fopen (tmpname, "wb")) == NULL) {
+        stat = MARC_ERR_IDX_OPEN;
+        goto done;
+    }
+
+    /* Header is rewritten with the final counts when we're done */
+    if (fwrite (&hdr, sizeof(hdr), 1, fp) != 1) {
+        stat = MARC_ERR_IDX_WRITE;
+        goto done;
+    }
+
+    while ((stat = marc_map_read (map, &recp, &reclen)) == 0) {
+
+        ent.offset = (uint64_t) (recp - map->basep);
+        ent.len    = (uint32_t) reclen;
+        ent.cnoff  = 0;
+
+        if (with_cn) {
+            if ((stat = marc_old_map (mp, recp)) != 0)
+                break;
+
+            /* Keep 001, if there is one */
+            if (marc_get_field (mp, 1, 0, &cnp, &cnlen) == 0 && cnlen > 0) {
+                need = cnused + cnlen + 1;
+                if (need > cnbuflen) {
+                    if (marc_xallocate ((void **) &cnbufp, NULL, &cnbuflen,
+                                    need * 2, sizeof(unsigned char)) != 0) {
+                        stat = MARC_ERR_ALLOC;
+                        break;
+                    }
+                }
+                ent.cnoff = (uint32_t) cnused;
+                memcpy (cnbufp + cnused, cnp, cnlen);
+                cnused += cnlen;
+                cnbufp[cnused++] = '\0';
+            }
+        }
+
+        if (fwrite (&ent, sizeof(ent), 1, fp) != 1) {
+            stat = MARC_ERR_IDX_WRITE;
+            break;
+        }
+        ++hdr.rec_count;
+    }
+
+    /* Normal end is EOF, anything else is a failure */
+    if (stat != EOF)
+        goto done;
+    stat = 0;
+
+    if (with_cn) {
+        hdr.cn_size = cnused;
+        if (fwrite (cnbufp, cnused, 1, fp) != 1)
+            stat = MARC_ERR_IDX_WRITE;
+    }
+
+    if (!stat && (fseek (fp, 0L, SEEK_SET) != 0
+               || fwrite (&hdr, sizeof(hdr), 1, fp) != 1))
+        stat = MARC_ERR_IDX_WRITE;
+
+done:
+    if (fp) {
+        if (fclose (fp) != 0 && !stat)
+            stat = MARC_ERR_IDX_WRITE;
+        if (!stat && rename (tmpname, idxfile) != 0)
+            stat = MARC_ERR_IDX_WRITE;
+        if (stat)
+            remove (tmpname);
+    }
+    if (mp)
+        marc_free (mp);
+    if (cnbufp) {
+#ifdef DEBUG
+        marc_dealloc (cnbufp, 1132);  //TAG:1132
+#else
+        free (cnbufp);
+#endif
+    }
+    marc_map_close (map);
+
+    return stat;
+
+} /* marc_idx_build */
+
+
+/************************************************************************
+* marc_idx_open ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Open an index created by marc_idx_build(), first checking       *
+*       that it still describes the marc file it was built for.         *
+*                                                                       *
+*       The index is mapped, not read, so opening even a very large     *
+*       one costs next to nothing.                                      *
+*                                                                       *
+*   PASS                                                                *
+*       Name of index file.                                             *
+*       Name of the marc file it indexes.                               *
+*       Pointer to place to put handle for the index.                   *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       MARC_ERR_IDX_OPEN  = No index.                                  *
+*       MARC_ERR_IDX_STALE = Index doesn't match marc file.             *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_idx_open (
+    char          *idxfile, /* Index to open            */
+    char          *marcfile,/* File it indexes          */
+    MARCIDXP      *ixpp     /* Put handle here          */
+) {
+    MARCIDXP      ixp;      /* Handle to return         */
+    MARCIDXHDR    *hdrp;    /* Header in mapping        */
+    struct stat   sbuf;     /* For index size           */
+    uint64_t      size;     /* Marc file size now       */
+    int64_t       mtime;    /* And modification time    */
+    void          *basep;   /* Start of mapping         */
+    int           fd,       /* Index file descriptor    */
+                  stat;     /* Return code              */
+
+
+    /* Will return null pointer if error */
+    *ixpp = NULL;
+
+    if ((stat = idx_stat (marcfile, &size, &mtime)) != 0)
+        return stat;
+
+    if ((fd = open (idxfile, O_RDONLY)) < 0)
+        return MARC_ERR_IDX_OPEN;
+    if (fstat (fd, &sbuf) != 0 || (size_t) sbuf.st_size < sizeof(MARCIDXHDR)) {
+        close (fd);
+        return MARC_ERR_IDX_STALE;
+    }
+    basep = mmap (NULL, (size_t) sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (basep == MAP_FAILED)
+        return MARC_ERR_MAP;
+
+    /* Must be ours, complete, and for the marc file as it is now */
+    hdrp = (MARCIDXHDR *) basep;
+    stat = 0;
+    if (memcmp (hdrp->magic, MARC_IDX_MAGIC, sizeof(hdrp->magic)) != 0
+            || hdrp->ent_size != sizeof(MARCIDXENT)
+            || (uint64_t) sbuf.st_size != sizeof(MARCIDXHDR)
+                   + hdrp->rec_count * sizeof(MARCIDXENT) + hdrp->cn_size
+            || hdrp->file_size != size
+            || hdrp->file_mtime != mtime)
+        stat = MARC_ERR_IDX_STALE;
+
+#ifdef DEBUG
+    ixp = (MARCIDX *) marc_alloc (sizeof(MARCIDX), 1130);  //TAG:1130
+#else
+    ixp = (MARCIDX *) malloc (sizeof(MARCIDX));
+#endif
+    if (!stat && !ixp)
+        stat = MARC_ERR_ALLOC;
+    if (stat) {
+        if (ixp) {
+#ifdef DEBUG
+            marc_dealloc (ixp, 1131);  //TAG:1131
+#else
+            free (ixp);
+#endif
+        }
+        munmap (basep, (size_t) sbuf.st_size);
+        return stat;
+    }
+
+    ixp->basep  = (unsigned char *) basep;
+    ixp->maplen = (size_t) sbuf.st_size;
+    ixp->hdrp   = hdrp;
+    ixp->entp   = (MARCIDXENT *) (hdrp + 1);
+    ixp->cnp    = (char *) (ixp->entp + hdrp->rec_count);
+
+    *ixpp = ixp;
+
+    return 0;
+
+} /* marc_idx_open */
+
+
+/************************************************************************
+* marc_idx_count ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Get the number of records in an indexed marc file.              *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_idx_open().                                    *
+*       Pointer to place to put count.                                  *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+************************************************************************/
+
+int marc_idx_count (
+    MARCIDXP      ixp,      /* Index                    */
+    long          *countp   /* Put count here           */
+) {
+    *countp = (long) ixp->hdrp->rec_count;
+
+    return 0;
+
+} /* marc_idx_count */
+
+
+/************************************************************************
+* marc_idx_get ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find a record by record number.                                 *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_idx_open().                                    *
+*       Record number, origin 0.                                        *
+*       Pointer to place to put byte offset of record in marc file.     *
+*       Pointer to place to put record length.                          *
+*       Pointer to place to put pointer to null terminated 001,         *
+*           "" if none or index built without them.                     *
+*           NULL if caller doesn't want it.                             *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       MARC_ERR_IDX_RANGE = No such record.                            *
+************************************************************************/
+
+int marc_idx_get (
+    MARCIDXP      ixp,      /* Index                    */
+    long          recnum,   /* Record wanted, org 0     */
+    off_t         *offsetp, /* Put offset here          */
+    size_t        *lenp,    /* Put length here          */
+    char          **cnpp    /* Put ptr to 001 here      */
+) {
+    MARCIDXENT    *ep;      /* Entry for record         */
+
+
+    if (recnum < 0 || (uint64_t) recnum >= ixp->hdrp->rec_count)
+        return MARC_ERR_IDX_RANGE;
+
+    ep = ixp->entp + recnum;
+    *offsetp = (off_t) ep->offset;
+    *lenp    = (size_t) ep->len;
+    if (cnpp)
+        *cnpp = (ixp->hdrp->flags & MARC_IDX_CN) ? ixp->cnp + ep->cnoff : "";
+
+    return 0;
+
+} /* marc_idx_get */
+
+
+/************************************************************************
+* marc_idx_close ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Unmap an index opened by marc_idx_open() and free its handle.   *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_idx_open().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_idx_close (
+    MARCIDXP      ixp       /* Index                    */
+) {
+    int           stat;     /* Return from munmap       */
+
+
+    stat = munmap (ixp->basep, ixp->maplen) ? MARC_ERR_MAP : 0;
+
+#ifdef DEBUG
+    marc_dealloc (ixp, 1131);  //TAG:1131
+#else
+    free (ixp);
+#endif
+
+    return stat;
+
+} /* marc_idx_close */
+
+
+/************************************************************************
+* idx_stat ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Get the size and modification time identifying the current      *
+*       version of a marc file.                                         *
+*                                                                       *
+*   PASS                                                                *
+*       Name of marc file.                                              *
+*       Pointer to place to put size.                                   *
+*       Pointer to place to put modification time, in nanoseconds.      *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int idx_stat (
+    char          *marcfile,/* File to look at          */
+    uint64_t      *sizep,   /* Put size here            */
+    int64_t       *mtimep   /* Put mod time here        */
+) {
+    struct stat   sbuf;     /* From stat()              */
+
+
+    if (stat (marcfile, &sbuf) != 0)
+        return MARC_ERR_MAP_OPEN;
+
+    *sizep  = (uint64_t) sbuf.st_size;
+    *mtimep = (int64_t) sbuf.st_mtim.tv_sec * 1000000000
+            + sbuf.st_mtim.tv_nsec;
+
+    return 0;
+
+} /* idx_stat */
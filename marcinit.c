@@ -78,17 +78,29 @@ int marc_init (
 
     /* Internal field directory */
     if (marc_xallocate ((void **) &mp->fdirp, (void **) NULL,
-            (size_t *) &mp->field_max, MARC_DFT_DIRSIZE, sizeof(FLDDIR)) != 0){
+            &mp->field_max, MARC_DFT_DIRSIZE, sizeof(FLDDIR)) != 0){
         marc_free (mp);
         return MARC_ERR_DIRALLOC;
     }
 
-    /* Internal subfield directory */
-    if (marc_xallocate ((void **) &mp->sdirp, (void **) NULL,
-            (size_t *) &mp->sf_max, MARC_DFT_SFDIRSIZE, sizeof(SFDIR)) != 0) {
+    /* Internal subfield directory, small until a field needs more */
+    if (marc_xsfd_new (&mp->sfdp) != 0) {
         marc_free (mp);
         return MARC_ERR_SFDIRALLOC;
     }
+    mp->sdirp = mp->sfdp->sdirp;
+    mp->sfinp = mp->sfdp;
+
+    /* Index of field directory by tag */
+#ifdef DEBUG
+    mp->tagixp = (MARCTAGIX *) marc_calloc (sizeof(MARCTAGIX), 1, 1130);  //TAG:1130
+#else
+    mp->tagixp = (MARCTAGIX *) calloc (sizeof(MARCTAGIX), 1);
+#endif
+    if (!mp->tagixp) {
+        marc_free (mp);
+        return MARC_ERR_ALLOC;
+    }
 
     /* Default is that all fields sort, subfields do not sort for output */
     mp->start_prot =
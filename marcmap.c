@@ -0,0 +1,250 @@
+/************************************************************************
+* marc_map_open ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Open a sequential marc file for reading by mapping the whole    *
+*       file into memory.                                               *
+*                                                                       *
+*       Records are then fetched with marc_map_read(), which returns    *
+*       a pointer directly into the mapping instead of copying the      *
+*       record into a caller's buffer the way marc_read_rec() does.     *
+*       Pass that pointer to marc_old_map() to parse the record         *
+*       without copying it again.                                       *
+*                                                                       *
+*   PASS                                                                *
+*       Name of file to map.                                            *
+*       Pointer to place to put handle for the mapped file.             *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "marcdefs.h"
+
+#ifdef DEBUG
+extern int g_recnum;
+void *marc_alloc(int, int);
+void marc_dealloc(void *, int);
+#endif
+
+int marc_map_open (
+    char          *fname,   /* File to map              */
+    MARCMAPP      *mapp     /* Put handle here          */
+) {
+    MARCMAPP      map;      /* Handle to return         */
+    struct stat   sbuf;     /* For file size            */
+    int           fd;       /* Descriptor to map        */
+    void          *basep;   /* Start of mapping         */
+
+
+    /* Will return null pointer if error */
+    *mapp = NULL;
+
+    if ((fd = open (fname, O_RDONLY)) < 0)
+        return MARC_ERR_MAP_OPEN;
+    if (fstat (fd, &sbuf) != 0) {
+        close (fd);
+        return MARC_ERR_MAP_OPEN;
+    }
+
+    /* mmap() refuses a zero length, an empty file just reads EOF */
+    basep = NULL;
+    if (sbuf.st_size > 0) {
+        basep = mmap (NULL, (size_t) sbuf.st_size, PROT_READ, MAP_PRIVATE,
+                      fd, 0);
+        if (basep == MAP_FAILED) {
+            close (fd);
+            return MARC_ERR_MAP;
+        }
+
+        /* We read front to back, let the kernel read ahead for us */
+        madvise (basep, (size_t) sbuf.st_size, MADV_SEQUENTIAL);
+    }
+
+    /* Mapping stays valid without the descriptor */
+    close (fd);
+
+#ifdef DEBUG
+    map = (MARCMAP *) marc_alloc (sizeof(MARCMAP), 1100);  //TAG:1100
+#else
+    map = (MARCMAP *) malloc (sizeof(MARCMAP));
+#endif
+    if (!map) {
+        if (basep)
+            munmap (basep, (size_t) sbuf.st_size);
+        return MARC_ERR_ALLOC;
+    }
+
+    map->basep  = (unsigned char *) basep;
+    map->curp   = map->basep;
+    map->endp   = map->basep + sbuf.st_size;
+    map->maplen = (size_t) sbuf.st_size;
+
+    *mapp = map;
+
+    return 0;
+
+} /* marc_map_open */
+
+
+/************************************************************************
+* marc_map_read ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Return the next record from a file opened by marc_map_open().   *
+*                                                                       *
+*       The record is not copied.  The returned pointer addresses the   *
+*       mapped file itself, which is read only, and remains valid       *
+*       until marc_map_close().  Unlike marc_read_rec(), the record     *
+*       is not null terminated.                                         *
+*                                                                       *
+*       Parse it with marc_old_map(), not marc_old().  marc_old()       *
+*       copies the byte after the record, which for the last record     *
+*       may be past the end of the mapping.                             *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_map_open().                                    *
+*       Pointer to place to put pointer to record.                      *
+*       Pointer to place to put record length.                          *
+*                                                                       *
+*   RETURN                                                              *
+*       0   = Success.                                                  *
+*       EOF = End of file.                                              *
+*       Else error, using the same codes as marc_read_rec().            *
+************************************************************************/
+
+int marc_map_read (
+    MARCMAPP      map,      /* Mapped file              */
+    unsigned char **recpp,  /* Put ptr to record here   */
+    size_t        *reclenp  /* Put length here          */
+) {
+    unsigned char *recp;    /* Start of this record     */
+    size_t        left,     /* Bytes left in mapping    */
+                  lrecl,    /* Logical record length    */
+                  i;        /* Loop counter             */
+
+#ifdef DEBUG
+    g_recnum++;
+#endif
+
+    recp = map->curp;
+    left = (size_t) (map->endp - recp);
+
+    /* Partial leader at end is treated as end of file, as in
+     *   marc_read_rec()
+     */
+    if (left < MARC_LEADER_LEN)
+        return EOF;
+
+    /* Get logical record length.
+     * We can't trust it to stay inside the mapping unless it's
+     *   really a number.  If it isn't, nothing after it can be
+     *   found either, so stop here for good.
+     */
+    for (i=0; i<MARC_RECLEN_LEN; i++) {
+        if (recp[MARC_RECLEN_OFF + i] < '0' || recp[MARC_RECLEN_OFF + i] > '9'){
+            map->curp = map->endp;
+            return MARC_ERR_READ_LDR;
+        }
+    }
+    lrecl = marc_xnum (recp + MARC_RECLEN_OFF, MARC_RECLEN_LEN);
+    if (lrecl <= MARC_LEADER_LEN) {
+        map->curp = map->endp;
+        return MARC_ERR_READ_LDR;
+    }
+
+    /* Incomplete record at end */
+    if (lrecl > left) {
+        map->curp = map->endp;
+        return MARC_ERR_READ_INC;
+    }
+
+    /* Consume the record whether or not it's any good */
+    map->curp += lrecl;
+
+    /* Simple test of complete record */
+    if (recp[lrecl - 1] != MARC_REC_TERM)
+        return MARC_ERR_READ_TERM;
+
+    *recpp   = recp;
+    *reclenp = lrecl;
+
+    return 0;
+
+} /* marc_map_read */
+
+
+/************************************************************************
+* marc_map_seek ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Position a mapped file so the next marc_map_read() returns      *
+*       the record at a given byte offset, e.g., one found by           *
+*       marc_idx_get().                                                 *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_map_open().                                    *
+*       Byte offset of record.                                          *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_map_seek (
+    MARCMAPP      map,      /* Mapped file              */
+    off_t         offset    /* Where next record starts */
+) {
+    if (offset < 0 || (size_t) offset > map->maplen)
+        return MARC_ERR_SEEK;
+
+    map->curp = map->basep + offset;
+
+    return 0;
+
+} /* marc_map_seek */
+
+
+/************************************************************************
+* marc_map_close ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Unmap a file opened by marc_map_open() and free its handle.     *
+*                                                                       *
+*       Any MARCP still parsed from the mapping with marc_old_map()     *
+*       must be re-initialized with marc_new() or marc_old() before     *
+*       it is used again.                                               *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_map_open().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_map_close (
+    MARCMAPP      map       /* Mapped file              */
+) {
+    int           stat;     /* Return from munmap       */
+
+
+    stat = 0;
+    if (map->basep && munmap (map->basep, map->maplen) != 0)
+        stat = MARC_ERR_MAP;
+
+#ifdef DEBUG
+    marc_dealloc (map, 1101);  //TAG:1101
+#else
+    free (map);
+#endif
+
+    return stat;
+
+} /* marc_map_close */
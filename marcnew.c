@@ -29,6 +29,17 @@ int marc_new (
     /* Test, return if failed */
     MARC_XCHECK(mp);
 
+    /* A record parsed by marc_old_map() only borrowed its raw buffer,
+     *   which is why it was read only.  Take our own buffer back.
+     */
+    if (mp->mapped) {
+        mp->rawbufp    = mp->ownrawp;
+        mp->endrawp    = mp->ownendrawp;
+        mp->raw_buflen = mp->own_buflen;
+        mp->mapped     = 0;
+        mp->read_only  = 0;
+    }
+
     /* Can't re-initialize read only record */
     if (mp->read_only)
         return MARC_ERR_READ_ONLY;
@@ -70,10 +81,19 @@ int marc_new (
     /* Re-initialize all pointers and counts */
     mp->marc_datalen = 0;
     mp->raw_datalen  = 0;
+    mp->raw_holes    = 0;
     mp->field_count  = 0;
     mp->sf_count     = 0;
     mp->cur_sf       = 0;
     mp->cur_sf_field = MARC_NO_FIELD;
+    marc_xtag_reset (mp);
+
+    /* Whole record subfield index is built again when first used */
+    if (mp->sfixp) {
+        mp->sfixp->count = 0;
+        mp->sfixp->tail  = MARC_NO_SFIX;
+        mp->sfixp->built = 0;
+    }
 
     /* Create a default record leader.
      * Also initializes current field information.
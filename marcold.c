@@ -37,26 +37,156 @@
 #include <string.h>
 #include "marcdefs.h"
 
+static int old_check (unsigned char *, size_t *, size_t *);
+static int old_dir   (MARCP, unsigned char *, size_t, size_t, size_t);
+
 int marc_old (
     MARCP         mp,       /* Pointer to structure     */
     unsigned char *marcp    /* Pointer to record        */
 ) {
-    FLDDIR        *dp;      /* Ptr to internal directory*/
-    unsigned char *srcp;    /* Temp ptr into marc rec   */
-    size_t        i,        /* Loop counter             */
-                  lrecl,    /* Logical record length    */
+    size_t        lrecl,    /* Logical record length    */
                   base_addr,/* Base address of data     */
-                  dirlen,   /* Directory length in bytes*/
                   datalen,  /* Length of data portion   */
-                  datasum,  /* Sum of all data bytes    */
                   needlen;  /* New buffer size needed   */
     int           stat;     /* Return from lower level  */
 
 
-    /* Can't re-initialize read only record */
-    if (mp->read_only)
+    /* Can't re-initialize read only record.
+     * A record borrowed by marc_old_map() is read only only because
+     *   we don't own its buffer.  marc_new() gives ours back.
+     */
+    if (mp->read_only && !mp->mapped)
         return MARC_ERR_READ_ONLY;
 
+    /* Validate leader and directory */
+    if ((stat = old_check (marcp, &lrecl, &base_addr)) != 0)
+        return stat;
+
+    /* Initialize marcctl for new record.
+     * This eliminates whatever was there.
+     * Also performs marc_xcheck() for us.
+     */
+    if ((stat = marc_new (mp)) != 0)
+        return (stat);
+
+    /* Ensure sufficient room in output buffer */
+    datalen = lrecl - base_addr + 1;
+    needlen = MARC_LEADER_LEN + datalen;
+    if (marc_xallocate ((void **) &mp->rawbufp, (void **) &mp->endrawp,
+                        &mp->raw_buflen, needlen, sizeof(unsigned char)) != 0)
+        return MARC_ERR_RAWALLOC;
+
+    /* Copy in leader, overwriting default set in marc_new() */
+    memcpy (mp->rawbufp, marcp, MARC_LEADER_LEN);
+    mp->raw_datalen = MARC_LEADER_LEN;
+
+    /* Same for data */
+    memcpy (mp->rawbufp + MARC_LEADER_LEN, marcp + base_addr, datalen);
+    mp->raw_datalen += datalen;
+
+    /* Build internal directory, offsets normalized for stored leader.
+     * datalen has 2 extra bytes, for recterm + null delimiters
+     */
+    return old_dir (mp, marcp, base_addr, MARC_LEADER_LEN, datalen - 2);
+
+} /* marc_old */
+
+
+/************************************************************************
+* marc_old_map ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Like marc_old(), but parse the record in place instead of       *
+*       copying it into our own raw buffer.                             *
+*                                                                       *
+*       Intended for records returned by marc_map_read(), though any    *
+*       record will do.  The record must stay where it is, unchanged,   *
+*       for as long as the marcctl refers to it.                        *
+*                                                                       *
+*       Since we don't own the data, the marcctl is read only until     *
+*       the next marc_new(), marc_old() or marc_old_map(), which        *
+*       return it to its own buffer.  marc_dup() copies work as usual.  *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to structure returned by marc_init.                     *
+*       Pointer to valid marc record.                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_old_map (
+    MARCP         mp,       /* Pointer to structure     */
+    unsigned char *marcp    /* Pointer to record        */
+) {
+    size_t        lrecl,    /* Logical record length    */
+                  base_addr;/* Base address of data     */
+    int           stat;     /* Return from lower level  */
+
+
+    /* Same rules as marc_old() */
+    if (mp->read_only && !mp->mapped)
+        return MARC_ERR_READ_ONLY;
+
+    if ((stat = old_check (marcp, &lrecl, &base_addr)) != 0)
+        return stat;
+
+    /* Start fresh, recovering our own buffer if mapped before */
+    if ((stat = marc_new (mp)) != 0)
+        return (stat);
+
+    /* Put our own raw buffer aside and borrow the record instead.
+     * Field 0, the leader created by marc_new(), is at offset 0,
+     *   right where the leader of the passed record is.
+     */
+    mp->ownrawp     = mp->rawbufp;
+    mp->ownendrawp  = mp->endrawp;
+    mp->own_buflen  = mp->raw_buflen;
+    mp->rawbufp     = marcp;
+    mp->endrawp     = marcp + lrecl;
+    mp->raw_buflen  = lrecl;
+    mp->raw_datalen = lrecl;
+    mp->mapped      = 1;
+    mp->read_only   = 1;
+
+    /* Field offsets are relative to the record itself.
+     * Data excludes the record terminator.
+     */
+    return old_dir (mp, marcp, base_addr, base_addr, lrecl - base_addr - 1);
+
+} /* marc_old_map */
+
+
+/************************************************************************
+* old_check ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Validate the leader and directory of a record passed to         *
+*       marc_old() or marc_old_map().                                   *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marc record.                                         *
+*       Pointer to place to put logical record length.                  *
+*       Pointer to place to put base address of data.                   *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int old_check (
+    unsigned char *marcp,   /* Pointer to record        */
+    size_t        *lreclp,  /* Put lrecl here           */
+    size_t        *basep    /* Put base address here    */
+) {
+    unsigned char *srcp;    /* Temp ptr into marc rec   */
+    size_t        i,        /* Loop counter             */
+                  lrecl,    /* Logical record length    */
+                  base_addr,/* Base address of data     */
+                  dirlen;   /* Directory length in bytes*/
+
+
     /* Get logical record length, first testing for good format */
     srcp = marcp + MARC_RECLEN_OFF;
     for (i=0; i<MARC_RECLEN_LEN; i++)
@@ -83,41 +213,59 @@ int marc_old (
     /* Physically validate the directory */
     srcp   = marcp + MARC_LEADER_LEN;
     dirlen = base_addr - MARC_LEADER_LEN - 1;
-    for (i=0; i<dirlen; i++)
-        if (!isdigit(*srcp++))
-            return MARC_ERR_MDIRCHARS;
+    if (marc_xscan_digits (srcp, srcp + dirlen) != srcp + dirlen)
+        return MARC_ERR_MDIRCHARS;
 
-    /* Initialize marcctl for new record.
-     * This eliminates whatever was there.
-     * Also performs marc_xcheck() for us.
-     */
-    if ((stat = marc_new (mp)) != 0)
-        return (stat);
+    *lreclp = lrecl;
+    *basep  = base_addr;
 
-    /* Ensure sufficient room in output buffer */
-    datalen = lrecl - base_addr + 1;
-    needlen = MARC_LEADER_LEN + datalen;
-    if (marc_xallocate ((void **) &mp->rawbufp, (void **) &mp->endrawp,
-                        &mp->raw_buflen, needlen, sizeof(unsigned char)) != 0)
-        return MARC_ERR_RAWALLOC;
+    return 0;
 
-    /* Copy in leader, overwriting default set in marc_new() */
-    memcpy (mp->rawbufp, marcp, MARC_LEADER_LEN);
-    mp->raw_datalen = MARC_LEADER_LEN;
+} /* old_check */
+
+
+/************************************************************************
+* old_dir ()                                                            *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Build the internal field directory from the marc directory      *
+*       of a record validated by old_check().                           *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to structure, already initialized by marc_new().        *
+*       Pointer to marc record.                                         *
+*       Base address of data.                                           *
+*       Add this to each directory offset to get offset in rawbufp.     *
+*       Expected sum of field lengths, for integrity check.             *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int old_dir (
+    MARCP         mp,       /* Pointer to structure     */
+    unsigned char *marcp,   /* Pointer to record        */
+    size_t        base_addr,/* Base address of data     */
+    size_t        adjust,   /* Offset normalization     */
+    size_t        expectsum /* Sum of all data bytes    */
+) {
+    FLDDIR        *dp;      /* Ptr to internal directory*/
+    unsigned char *srcp;    /* Temp ptr into marc rec   */
+    size_t        i,        /* Loop counter             */
+                  dirlen,   /* Directory length, entries*/
+                  datasum;  /* Sum of all data bytes    */
 
-    /* Same for data */
-    memcpy (mp->rawbufp + MARC_LEADER_LEN, marcp + base_addr, datalen);
-    mp->raw_datalen += datalen;
 
     /* Convert directory length to count */
-    dirlen /= MARC_DIR_SIZE;
+    dirlen = (base_addr - MARC_LEADER_LEN - 1) / MARC_DIR_SIZE;
 
     /* Ensure sufficient room.
      * One directory entry for each marc field, plus one for
      *   the leader - which we temporarily treat as a control field.
      */
     if (marc_xallocate ((void **) &mp->fdirp, (void **) NULL,
-                        (size_t *) &mp->field_max, dirlen + 1,
+                        &mp->field_max, dirlen + 1,
                         sizeof(FLDDIR)) != 0)
         return MARC_ERR_DIRALLOC;
 
@@ -142,14 +290,20 @@ int marc_old (
         /* Add to sum for later integrity check */
         datasum += dp->len + 1;
 
-        /* Normalize offset for stored leader */
-        dp->offset += MARC_LEADER_LEN;
+        /* Normalize offset for where the data really is */
+        dp->offset += adjust;
+        dp->room    = dp->len;
 
         /* Default values of internal directory fields */
         dp->order     = i;
         dp->pos_bits  = 0;
         dp->startprot = 0;
         dp->endprot   = 0;
+        dp->sfix_first = MARC_NO_SFIX;
+        dp->sfix_cnt   = MARC_NO_SFIX;
+
+        /* Index it by tag */
+        marc_xtag_add (mp, mp->field_count);
 
         /* Next entry */
         ++dp;
@@ -157,12 +311,11 @@ int marc_old (
         srcp += MARC_DIR_SIZE;
     }
 
-    /* Another integrity check                                  */
-    /* datalen has 2 extra bytes, for recterm + null delimiters */
-    if (datasum != datalen - 2)
+    /* Another integrity check */
+    if (datasum != expectsum)
         return MARC_ERR_LENMATCH;
 
     /* All done */
     return 0;
 
-} /* marc_old */
+} /* old_dir */
@@ -83,6 +83,7 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <time.h>
+#include <pthread.h>
 #include "marcproclist.h"   /* Includes marcconv.h and marc.h */
 #include "istrstr.h"        /* Case insensitive strstr()      */
 
@@ -95,6 +96,8 @@
 
 void *marc_alloc(int, int);
 void *marc_realloc(void*, int, int);
+void *marc_calloc(int, int, int);
+void marc_dealloc(void *, int);
 
 /*********************************************************************
 * qual_tbl                                                           *
@@ -112,6 +115,19 @@ typedef struct qual_tbl {
 *********************************************************************/
 
 static CM_ID get_src_type(char *);
+static void parse_if_op   (char *, CM_PRED *);
+static unsigned char *pred_search (CM_PRED *, unsigned char *, size_t);
+static unsigned char *data_search (unsigned char *, size_t, unsigned char *,
+                                   size_t, int, int);
+static CM_OPND *find_opnd (CM_PROC_PARMS *, char *, CM_OPND *);
+static void compile_opnd  (char *, CM_OPND *, int);
+static CM_STAT get_named_buf (CM_NAMED_BUFS *, int, char *, unsigned char **,
+                              int, size_t, size_t *);
+static int  name_slot     (char *, int);
+static void grow_named_bufs (CM_NAMED_BUFS *, int);
+static size_t bname_hash  (char *);
+static CM_BI builtin_id   (char *);
+static int  get_builtin   (CM_PROC_PARMS *, CM_BI, char *);
 static void load_quals    (QUAL_TBL **, size_t *);
 static int  compare_quals (const void *, const void *);
 static int  lookup_qual   (QUAL_TBL *, size_t, unsigned char *,
@@ -211,23 +227,37 @@ CM_FUNCP cmp_lookup_proc (
 *       Else fatal error.                                               *
 ************************************************************************/
 
+/* A compiled test */
+struct cm_pred {
+    int    op;              /* Operator, CM_OP_..., 0 = none        */
+    int    bad_op;          /* Unknown operator char, or 0          */
+    int    negate;          /* True=Negate meaning of operator      */
+    int    insensitive;     /* True=Search/compare case insensitive */
+    int    num2_ok;         /* 1=num2 is value, 0=not a number,     */
+                            /*   -1=convert value each time         */
+    int    num2;            /* Numeric value to compare against     */
+    unsigned char *patp;    /* Value for ^ and ?, upper case if ~,  */
+                            /*   NULL=find and search for it each   */
+                            /*   time                               */
+    size_t patlen;          /* Length of pattern                    */
+    size_t skip[256];       /* ? search shift for each last char    */
+};
+
+/* Case folding used by instrstr() */
+#define PRED_FOLD(c) (((c) >= 'a' && (c) <= 'z') ? (c) - 'a' + 'A' : (c))
+
 CM_STAT cmp_if (
     CM_PROC_PARMS *pp       /* Pointer to parameter structure       */
 ) {
-    int  negate,            /* True=Negate meaning of operator      */
-         insensitive,       /* True=Search/compare case insensitive */
-         op,                /* Operator   * = > or ?                */
-         last_op,           /* Previous operator character          */
-         num1,              /* Numeric conversion of datap          */
+    CM_PRED *predp,         /* Compiled test                        */
+            pred;           /* Compiled here if caller has none     */
+    int  num1,              /* Numeric conversion of datap          */
          num2,              /* Same for data2p                      */
          rc;                /* Return from strncmp                  */
-    char *p,                /* Ptr into operator string             */
-         *rp;               /* Return from strstr                   */
+    char *rp;               /* Return from strstr                   */
     unsigned char *datap,   /* Ptr to data in source elem or buf    */
                   *data2p,  /* Ptr to data to compare against       */
-                  *holdp,   /* Ptr to end of data2p, terminator     */
-                  empty[1], /* Nullstring standing for dummy data   */
-                  hold;     /* Char at holdp                        */
+                  empty[1]; /* Nullstring standing for dummy data   */
     size_t        datalen,  /* Length of data at datap              */
                   data2len; /* Length of data at data2p             */
 
@@ -248,25 +278,245 @@ CM_STAT cmp_if (
         data2len = 0;
     }
 
-    /* Initial assumptions about operator modifiers */
-    negate      =
-    insensitive =
-    last_op     = 0;
+    /* Operator was parsed when the table was loaded, unless we
+     *   were called by another proc with arguments of its own
+     */
+    if ((predp = pp->predp) == NULL) {
+        predp = &pred;
+        parse_if_op (pp->args[1], predp);
+    }
+    if (predp->bad_op)
+        cm_error (CM_FATAL, "Unknown operator '%c' in if test",
+                  predp->bad_op);
+    if (!predp->op)
+        cm_error (CM_FATAL, "No operator in if test");
+
+    /* If no data found, all tests fail unless negated */
+    if (!datalen)
+        return (predp->negate ? CM_STAT_OK : CM_STAT_IF_FAILED);
+
+    /* Execute operation */
+    switch (predp->op) {
+        case CM_OP_EXISTS:
+            /* Already taken care of 0 datalen, hence assume data found */
+            rc = 1;
+            break;
+
+        case CM_OP_EQ:
+            /* Compare data to passed string */
+            if ((rc = data2len - datalen) == 0) {
+                if (predp->insensitive)
+                    rc = istrncmp ((char *) datap, (char *) data2p, datalen);
+                else
+                    rc = strncmp ((char *) datap, (char *) data2p, datalen);
+            }
+            rc = !rc;
+            break;
+
+        case CM_OP_NUMERIC:
+            /* Is passed data numeric? */
+            rc = get_fixed_num ((char *) datap, datalen, &num1);
+            break;
+
+        case CM_OP_GT:
+        case CM_OP_LT:
+        case CM_OP_GTE:
+        case CM_OP_LTE:
+            /* If we've got integers, prepare for numeric compare */
+            rc = 0;
+            if (get_fixed_num ((char *) datap, datalen, &num1)) {
+                if (predp->num2_ok < 0)
+                    rc = get_fixed_num ((char *) data2p, data2len, &num2);
+                else {
+                    rc   = predp->num2_ok;
+                    num2 = predp->num2;
+                }
+            }
+
+            /* Something was not an integer */
+            if (!rc) {
+                cm_error (CM_ERROR,
+                          "Data \"%.*s\" or \"%.*s\" not numeric in compare",
+                          (int) datalen, datap, (int) data2len, data2p);
+                return CM_STAT_IF_FAILED;
+            }
+
+            switch (predp->op) {
+                case CM_OP_GT:
+                    rc = (num1 > num2);
+                    break;
+                case CM_OP_LT:
+                    rc = (num1 < num2);
+                    break;
+                case CM_OP_GTE:
+                    rc = (num1 >= num2);
+                    break;
+                case CM_OP_LTE:
+                    rc = (num1 <= num2);
+                    break;
+            }
+            break;
+
+        case CM_OP_BEGINS:
+        case CM_OP_CONTAINS:
+            if (predp->patp)
+                rp = (char *) pred_search (predp, datap, datalen);
+
+            /* Case insensitive or not substring search
+             * Neither operand is terminated, either may be in a
+             *   record we mustn't write to
+             */
+            else
+                rp = (char *) data_search (datap, datalen, data2p, data2len,
+                                           predp->insensitive,
+                                           predp->op == CM_OP_BEGINS);
+            rc = (rp != NULL);
+            break;
+
+        default:
+            return CM_STAT_OK;
+    }
+
+    if (rc)
+        return predp->negate ? CM_STAT_IF_FAILED : CM_STAT_OK;
+    return predp->negate ? CM_STAT_OK : CM_STAT_IF_FAILED;
+
+} /* cmp_if */
+
+
+/************************************************************************
+* cmp_compile_if ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Compile the test of an "if" proc when the control table is      *
+*       loaded, so cmp_if() only has to run it.                         *
+*                                                                       *
+*       The operator is decoded, and if the value to test against is    *
+*       a literal, a number for < and > is converted and a string for   *
+*       ^ and ? is readied for searching.  Values from buffers or       *
+*       records are still found each time.                              *
+*                                                                       *
+*       An unknown operator is reported by cmp_if(), when the test is   *
+*       run, as it always was.                                          *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to procedure block for the "if", args decoded.          *
+*                                                                       *
+*   RETURN                                                              *
+*       Pointer to compiled test, lasting as long as the program.       *
+*       Fatal error if no memory.                                       *
+************************************************************************/
+
+CM_PRED *cmp_compile_if (
+    CM_PROC  *procp         /* The "if"                 */
+) {
+    CM_PRED  *predp;        /* Compiled test            */
+    CM_OPND  *op;           /* Decoded value to test    */
+    unsigned char *p;       /* Ptr into pattern         */
+    size_t   i,             /* Loop counter             */
+             len;           /* Length of pattern        */
+
+
+    /* Room for a copy of any literal pattern after the test */
+    op  = (procp->arg_count > 2) ? &procp->opnds[2] : NULL;
+    len = (op && op->type == CM_ID_LITERAL) ? op->len : 0;
+
+#ifdef DEBUG
+    if ((predp = (CM_PRED *) marc_alloc (sizeof(CM_PRED) + len + 1, 607)) == NULL)  //TAG:607
+#else
+    if ((predp = (CM_PRED *) malloc (sizeof(CM_PRED) + len + 1)) == NULL)
+#endif
+        cm_error (CM_FATAL, "If test memory");
+
+    parse_if_op (procp->args[1], predp);
+
+    if (len) {
+        switch (predp->op) {
+            case CM_OP_GT:
+            case CM_OP_LT:
+            case CM_OP_GTE:
+            case CM_OP_LTE:
+                /* Any number short enough can't overflow, or be
+                 *   reported by get_fixed_num() at load time
+                 */
+                if (len < 10)
+                    predp->num2_ok = get_fixed_num ((char *) op->datap,
+                                                    len, &predp->num2) != 0;
+                break;
+
+            case CM_OP_BEGINS:
+            case CM_OP_CONTAINS:
+                /* Our own copy, folded the way instrstr() folds data */
+                p = (unsigned char *) (predp + 1);
+                for (i=0; i<len; i++)
+                    p[i] = predp->insensitive ? PRED_FOLD(op->datap[i])
+                                              : op->datap[i];
+                p[len] = '\0';
+                predp->patp   = p;
+                predp->patlen = len;
+
+                /* How far to move the pattern along the data when the
+                 *   char under its last one is c (Horspool's method)
+                 */
+                for (i=0; i<256; i++)
+                    predp->skip[i] = len;
+                for (i=0; i<len-1; i++) {
+                    predp->skip[p[i]] = len - 1 - i;
+                    if (predp->insensitive && p[i] >= 'A' && p[i] <= 'Z')
+                        predp->skip[p[i] - 'A' + 'a'] = len - 1 - i;
+                }
+                break;
+        }
+    }
+
+    return predp;
+
+} /* cmp_compile_if */
+
+
+/************************************************************************
+* parse_if_op ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Decode the operator of an "if" test, see cmp_if().              *
+*                                                                       *
+*       The last operator char is the operator, '=' after '<' or '>'    *
+*       making it <= or >=.  '!' and '~' anywhere modify it.            *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to operator string, may be NULL.                        *
+*       Pointer to test to start, nothing yet known of the value.       *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  Errors are left in the test for cmp_if() to report.      *
+************************************************************************/
+
+static void parse_if_op (
+    char    *opp,           /* Ptr to operator string   */
+    CM_PRED *predp          /* Put operator here        */
+) {
+    char    *p;             /* Ptr into operator string */
+    int     op,             /* Operator char            */
+            last_op;        /* Previous operator char   */
+
+
+    memset (predp, 0, sizeof(CM_PRED));
+    predp->num2_ok = -1;
 
     /* Parse operator */
-    p = pp->args[1];
-    while (*p) {
+    last_op = 0;
+    for (p=opp; p && *p; p++) {
 
         /* Look for single char op code */
         op = *p;
         switch (op) {
             case CM_OP_NOT:
                 /* It's a prefix to op code */
-                negate = 1;
+                predp->negate = 1;
                 break;
             case CM_OP_NOCASE:
                 /* Another prefix */
-                insensitive = 1;
+                predp->insensitive = 1;
                 break;
             case CM_OP_EQ:
                 /* If part of ">=" or "<=" */
@@ -283,102 +533,155 @@ CM_STAT cmp_if (
             case CM_OP_LT:
                 break;
             default:
-                cm_error (CM_FATAL, "Unknown operator '%c' in if test", op);
+                /* cmp_if() stops at the first one */
+                predp->bad_op = op;
+                return;
         }
         last_op = op;
-        ++p;
     }
 
-    /* If no data found, all tests fail unless negated */
-    if (!datalen)
-        return (negate ? CM_STAT_OK : CM_STAT_IF_FAILED);
+    predp->op = last_op;
 
-    /* Execute operation */
-    switch (op) {
-        case CM_OP_EXISTS:
-            /* Already taken care of 0 datalen, hence assume data found */
-            return negate ? CM_STAT_IF_FAILED : CM_STAT_OK;
+} /* parse_if_op */
 
-        case CM_OP_EQ:
-            /* Compare data to passed string */
-            if ((rc = data2len - datalen) == 0) {
-                if (insensitive)
-                    rc = istrncmp ((char *) datap, (char *) data2p, datalen);
-                else
-                    rc = strncmp ((char *) datap, (char *) data2p, datalen);
-            }
-            if (!rc)
-                return negate ? CM_STAT_IF_FAILED : CM_STAT_OK;
-            return negate ? CM_STAT_OK : CM_STAT_IF_FAILED;
 
-        case CM_OP_NUMERIC:
-            /* Is passed data numeric? */
-            if (get_fixed_num ((char *) datap, datalen, &num1))
-                return negate ? CM_STAT_IF_FAILED : CM_STAT_OK;
-            return negate ? CM_STAT_OK : CM_STAT_IF_FAILED;
+/************************************************************************
+* pred_search ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Look for the compiled pattern of a ^ or ? test in some data.    *
+*                                                                       *
+*       Finds what nstrstr() or instrstr() would, but skips ahead       *
+*       using the pattern's skip table instead of trying every          *
+*       position.  Like nstrstr(), a case sensitive search stops at     *
+*       a null in the data.                                             *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to compiled test.                                       *
+*       Pointer to data.                                                *
+*       Length of data.                                                 *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to match in data, only at the start for ^.                  *
+*       NULL if not found.                                              *
+************************************************************************/
 
-        case CM_OP_GT:
-        case CM_OP_LT:
-        case CM_OP_GTE:
-        case CM_OP_LTE:
-            /* If we've got integers, prepare for numeric compare */
-            if (get_fixed_num ((char *) datap, datalen, &num1)) {
-                if (get_fixed_num ((char *) data2p, data2len, &num2)) {
-
-                    switch (op) {
-                        case CM_OP_GT:
-                            rc = (num1 > num2);
-                            break;
-                        case CM_OP_LT:
-                            rc = (num1 < num2);
-                            break;
-                        case CM_OP_GTE:
-                            rc = (num1 >= num2);
-                            break;
-                        case CM_OP_LTE:
-                            rc = (num1 <= num2);
-                            break;
-                    }
+static unsigned char *pred_search (
+    CM_PRED       *predp,   /* Compiled test            */
+    unsigned char *datap,   /* Data to search           */
+    size_t        datalen   /* Its length               */
+) {
+    unsigned char *patp,    /* Pattern                  */
+                  *endp,    /* Nullterm in data, or NULL*/
+                  c;        /* Data char, folded        */
+    size_t        m,        /* Length of pattern        */
+                  i,        /* Position in data         */
+                  j;        /* Chars matched            */
+
+
+    if (!predp->insensitive
+            && (endp = memchr (datap, '\0', datalen)) != NULL)
+        datalen = endp - datap;
+
+    patp = predp->patp;
+    m    = predp->patlen;
+    if (datalen < m)
+        return NULL;
+
+    for (i=0; i<=datalen-m; ) {
+
+        /* Compare right to left, only the last char for most tries */
+        j = m;
+        while (j > 0) {
+            c = datap[i + j - 1];
+            if (predp->insensitive)
+                c = PRED_FOLD(c);
+            if (c != patp[j - 1])
+                break;
+            --j;
+        }
+        if (j == 0)
+            return datap + i;
 
-                    if (rc)
-                        return negate ? CM_STAT_IF_FAILED : CM_STAT_OK;
-                    return negate ? CM_STAT_OK : CM_STAT_IF_FAILED;
-                }
-            }
+        /* Only one place to look for ^ */
+        if (predp->op == CM_OP_BEGINS)
+            break;
 
-            /* Something was not an integer */
-            cm_error (CM_ERROR,
-                      "Data \"%*s\" or \"%*s\" not numeric in compare",
-                      datalen, datap, data2len, data2p);
-            return CM_STAT_IF_FAILED;
+        i += predp->skip[datap[i + m - 1]];
+    }
 
-        case CM_OP_BEGINS:
-        case CM_OP_CONTAINS:
-            /* Case insensitive or not substring search
-             * Requires null terminated search string, which
-             *   we guarantee here
-             */
-            holdp  = data2p + data2len;
-            hold   = *holdp;
-            *holdp = '\0';
-            if (insensitive)
-                rp = instrstr ((char *) datap, (char *) data2p, datalen);
-            else
-                rp = nstrstr ((char *) datap, (char *) data2p, datalen);
-            *holdp = hold;
+    return NULL;
 
-            /* Do we need substring at start of data? */
-            if (op == CM_OP_BEGINS) {
-                if (rp != (char *) datap)
-                    rp = NULL;
-            }
+} /* pred_search */
+
+
+/************************************************************************
+* data_search ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Look for one piece of data in another, neither of them null     *
+*       terminated, for a ^ or ? test with no compiled pattern.         *
+*                                                                       *
+*       Finds what nstrstr() or instrstr() would if both were           *
+*       terminated at their lengths, but never reads past either or     *
+*       writes to them.  The search string ends at a null in it, and    *
+*       a case sensitive search stops at a null in the data.  An        *
+*       empty search string is never found.                             *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to data.                                                *
+*       Length of data.                                                 *
+*       Pointer to string to search for.                                *
+*       Length of it.                                                   *
+*       True = case insensitive.                                        *
+*       True = only look at the start of the data, for ^.               *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to match in data.                                           *
+*       NULL if not found.                                              *
+************************************************************************/
 
-            if (rp)
-                return negate ? CM_STAT_IF_FAILED : CM_STAT_OK;
-            return negate ? CM_STAT_OK : CM_STAT_IF_FAILED;
+static unsigned char *data_search (
+    unsigned char *datap,   /* Data to search           */
+    size_t        datalen,  /* Its length               */
+    unsigned char *srchp,   /* Search for this          */
+    size_t        srchlen,  /* Its length               */
+    int           nocase,   /* True=ignore case         */
+    int           begins    /* True=only at start       */
+) {
+    unsigned char *endp,    /* Nullterm, or NULL        */
+                  c1, c2;   /* Chars compared, folded   */
+    size_t        last,     /* Last place a match fits  */
+                  i,        /* Position in data         */
+                  j;        /* Chars matched            */
+
+
+    if ((endp = memchr (srchp, '\0', srchlen)) != NULL)
+        srchlen = endp - srchp;
+    if (!nocase && (endp = memchr (datap, '\0', datalen)) != NULL)
+        datalen = endp - datap;
+    if (srchlen == 0 || datalen < srchlen)
+        return NULL;
+
+    last = begins ? 0 : datalen - srchlen;
+    for (i=0; i<=last; i++) {
+        for (j=0; j<srchlen; j++) {
+            c1 = datap[i + j];
+            c2 = srchp[j];
+            if (nocase) {
+                c1 = PRED_FOLD(c1);
+                c2 = PRED_FOLD(c2);
+            }
+            if (c1 != c2)
+                break;
+        }
+        if (j == srchlen)
+            return datap + i;
     }
-    return CM_STAT_OK;
-} /* cmp_if */
+
+    return NULL;
+
+} /* data_search */
 
 
 /************************************************************************
@@ -416,7 +719,7 @@ int get_fixed_num (
 
     /* Test for leading unary minus */
     p = strp;
-    if (*p == '-') {
+    if (numlen && *p == '-') {
         sign = -1;
         ++p;
         --len;
@@ -432,7 +735,8 @@ int get_fixed_num (
 
         /* Test for overflow */
         if (num < 0) {
-            cm_error (CM_ERROR, "Numeric overflow converting \"%s\"", strp);
+            cm_error (CM_ERROR, "Numeric overflow converting \"%.*s\"",
+                      (int) numlen, strp);
             break;
         }
     }
@@ -665,6 +969,9 @@ CM_STAT cmp_copy (
 *       no error is returned but the destination buffer will be         *
 *       empty.                                                          *
 *                                                                       *
+*       Not CMP_NOBUF.  Tables extracting %data into itself rely on     *
+*       the clear hitting %data in pp->bufp before it's read.           *
+*                                                                       *
 *   CONFIGURATION FILE PARAMETERS                                       *
 *       ID of destination to copy to.                                   *
 *       ID of source from which to extract substring.                   *
@@ -765,18 +1072,9 @@ CM_STAT cmp_normalize (
   srcp=(char *)tsrcp;
 
   /*=========================================================================*/
-  /* Allocate memory based on size of src...                                 */
+  /* Memory based on size of src, good until the record is done...           */
   /*=========================================================================*/
-
-#ifdef DEBUG
-  if ((dest = (char *) marc_alloc(src_len+1, 600)) == NULL) {  //TAG:600
-    cm_error(CM_FATAL, "Error allocating memory for normalization process.");
-  }
-#else
-  if ((dest = (char *)malloc(src_len+1)) == NULL) {
-    cm_error(CM_FATAL, "Error allocating memory for normalization process.");
-  }
-#endif
+  dest = (char *) cmp_alloc(pp, src_len+1);
 
   /*=========================================================================*/
   /* Initialize the destination buffer...                                    */
@@ -786,7 +1084,7 @@ CM_STAT cmp_normalize (
   /*=========================================================================*/
   /* and begin copying over the contents of the source buffer                */
   /*=========================================================================*/
-  for(tmpp=srcp;(*tmpp) && (tmpp<srcp+src_len);tmpp++) {
+  for(tmpp=srcp;(tmpp<srcp+src_len) && (*tmpp);tmpp++) {
     /*=======================================================================*/
     /* If a character is alpha-numeric, copy it over...                      */
     /*=======================================================================*/
@@ -798,7 +1096,7 @@ CM_STAT cmp_normalize (
       /* also copy over a single space but ignore any other non-alphanumerics*/
       /*=====================================================================*/
       numspaces = 0;
-      for(;(*tmpp)&&(!isalnum(*tmpp))&&(tmpp<srcp+src_len); tmpp++) {
+      for(;(tmpp<srcp+src_len)&&(*tmpp)&&(!isalnum(*tmpp)); tmpp++) {
 	if((*tmpp==' ')&&(numspaces==0)) {
 	  strcat(dest, " ");
 	  numspaces++;
@@ -891,7 +1189,7 @@ CM_STAT cmp_makesf (
 
 
     /* Only do any of this if there is something to insert */
-    if (*pp->bufp) {
+    if (pp->datalen) {
 
         /* Fixed length field? */
         if ((stat = marc_cur_field (pp->outmp, &field_id, &field_occ,
@@ -906,8 +1204,8 @@ CM_STAT cmp_makesf (
             sf_code = *(pp->args[0]);
 
         /* Insert the new subfield */
-        if ((stat = marc_add_subfield (pp->outmp, sf_code, pp->bufp,
-                                       MARC_SF_STRLEN)) != 0)
+        if ((stat = marc_add_subfield (pp->outmp, sf_code, pp->datap,
+                                       pp->datalen)) != 0)
             cm_error (CM_FATAL, "makesf: Error %d adding subfield %d",
                       stat, sf_code);
     }
@@ -941,7 +1239,8 @@ CM_STAT cmp_makesf (
 CM_STAT cmp_today (
     CM_PROC_PARMS *pp           /* Pointer to parameter structure   */
 ) {
-    struct tm *ptm;             /* Ptr to time info from localtime()*/
+    struct tm tmbuf,            /* Time info from localtime_r()     */
+              *ptm;             /* Ptr to it                        */
     time_t ltime;               /* Time in seconds                  */
     char timebuf[20],           /* Create string here               */
          *fmtp;                 /* Ptr to sprintf format string     */
@@ -949,7 +1248,7 @@ CM_STAT cmp_today (
 
     /* Get current time info */
     time (&ltime);
-    ptm = localtime (&ltime);
+    ptm = localtime_r (&ltime, &tmbuf);
 
     /* Format as requested */
     if (!strcmp (pp->args[1], "\"YYYYMMDD\""))
@@ -1009,14 +1308,14 @@ CM_STAT cmp_y2toy4 (
     for (i=0; i<src_len; i++) {
         if (!isdigit(*(srcp + i))) {
             cm_error (CM_ERROR, "Expecting digits in \"%s\" data, got %.*s",
-                      pp->args[1], src_len, srcp);
+                      pp->args[1], (int) src_len, srcp);
             return CM_STAT_ERROR;
         }
     }
 
     /* Examine first two bytes */
-    inyear[0] = *srcp;
-    inyear[1] = *(srcp + 1);
+    inyear[0] = src_len > 0 ? *srcp : '\0';
+    inyear[1] = src_len > 1 ? *(srcp + 1) : '\0';
     inyear[2] = '\0';
     year = atoi ((char *) inyear);
 
@@ -1330,6 +1629,7 @@ CM_STAT cmp_call (
     CM_PROC_PARMS cm;       /* Copy of parms with new args  */
     char *newargs[MAXARGS]; /* Copy all new args to here    */
     va_list       pvar;     /* Ptr to variable args         */
+    CM_STAT       stat;     /* Return from called function  */
     int          i;         /* Loop counter                 */
 
 
@@ -1346,16 +1646,59 @@ CM_STAT cmp_call (
         newargs[i] = va_arg(pvar, char *);
     va_end(pvar);
 
-    /* Set new args into new proc_parms */
+    /* Set new args into new proc_parms, nothing decoded for them */
     cm.args      = newargs;
     cm.arg_count = argc;
+    cm.opnds     = NULL;
+    cm.predp     = NULL;
+
+    /* Caller may have changed its copy of %data without telling us */
+    if (cm.datap == cm.bufp)
+        cm.datalen = strlen ((char *) cm.bufp);
 
-    /* Call desired function and hand the return code back to caller */
-    return ((procp) (&cm));
+    /* Call desired function */
+    stat = (procp) (&cm);
+
+    /* %data is shared with the caller, wherever it ended up */
+    pp->datap   = cm.datap;
+    pp->datalen = cm.datalen;
+
+    return stat;
 
 } /* cmp_call */
 
 
+/************************************************************************
+* cmp_own_data ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make sure %data is in the proc's own buffer, pp->bufp, copying  *
+*       it there from the record if it hasn't been copied yet.          *
+*                                                                       *
+*       %data is left where it is in the input record until something   *
+*       changes it, so procs that only look at it don't pay for a       *
+*       copy.  Anything that wants to work on pp->bufp directly must    *
+*       call this first.                                                *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to proc parm structure.                                 *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+void cmp_own_data (
+    CM_PROC_PARMS *pp       /* Ptr to parameter struct      */
+) {
+    if (pp->datap != pp->bufp) {
+        memcpy (pp->bufp, pp->datap, pp->datalen);
+        pp->bufp[pp->datalen] = '\0';
+        pp->datap = pp->bufp;
+    }
+
+} /* cmp_own_data */
+
+
 /************************************************************************
 * cmp_buf_find ()                                                       *
 *                                                                       *
@@ -1366,6 +1709,9 @@ CM_STAT cmp_call (
 *                                                                       *
 *       Internal subroutine of multiple higher level routines.          *
 *                                                                       *
+*       If the id is one of the proc's own arguments, we use what       *
+*       make_proc() decoded from it, else we decode it now.             *
+*                                                                       *
 *   PASS                                                                *
 *       Pointer to proc parm args from higher level routine.            *
 *       Pointer to identifier string for data source.                   *
@@ -1387,7 +1733,8 @@ void cmp_buf_find (
     unsigned char **datapp, /* Put ptr to data here         */
     size_t        *lenp     /* Put ptr to data length here  */
 ) {
-    unsigned char *p;       /* Temp pointer                 */
+    CM_OPND       opnd,     /* Source id decoded here, or   */
+                  *op;      /*   ptr to the one in the proc */
     size_t        buf_len;  /* Length of named buffer       */
     int           stat,     /* Return from called func      */
                   fid,      /* Field id                     */
@@ -1398,12 +1745,12 @@ void cmp_buf_find (
                   occ,      /* Generic occurrence number    */
                   pos,      /* Unused parm for marc_cur...  */
                   bvar;     /* Value of builtin variable    */
-
-    static char s_bvarbuf[20]; /* Put builtin variable here */
+    char          *bvarbuf; /* Builtin variable, as string  */
 
 
     /* Find source data using id */
-    switch (get_src_type (idsrcp)) {
+    op = find_opnd (pp, idsrcp, &opnd);
+    switch (op->type) {
 
         case CM_ID_UNKNOWN:
             /* Error in control table */
@@ -1411,13 +1758,18 @@ void cmp_buf_find (
                       idsrcp);
 
         case CM_ID_MARC:
-            /* Parse marc reference string */
-            if ((stat = marc_ref (idsrcp, &fid, &focc, &sid, &socc)) != 0)
+            /* Marc reference string was parsed when decoded */
+            if ((stat = op->stat) != 0)
 
                 /* Bad reference string, fatal error */
                 cm_error (CM_FATAL, "cmp_buf_read: Error %d parsing marc "
                           "reference \"%s\"", stat, idsrcp);
 
+            fid  = op->fid;
+            focc = op->focc;
+            sid  = op->sid;
+            socc = op->socc;
+
             /* If referencing current occurrence, get it from input rec */
             if (fid == MARC_REF_CURRENT || focc == MARC_REF_CURRENT) {
 
@@ -1475,7 +1827,8 @@ void cmp_buf_find (
 
         case CM_ID_BUF:
             /* Get it from a named buffer */
-            if (cmp_get_named_buf (idsrcp, datapp, 0, 0, &buf_len) != 0) {
+            if (get_named_buf (pp->ctxp->nbufp, op->slot, idsrcp, datapp,
+                               0, 0, &buf_len) != 0) {
 
                 /* Request for non-existent switch same as if switch off */
                 if (*idsrcp == '&')
@@ -1494,14 +1847,14 @@ void cmp_buf_find (
             break;
 
         case CM_ID_CURRENT:
-            /* Data comes from proc buffer, may have originated in inmp */
-            *datapp = pp->bufp;
-            *lenp   = strlen ((char *) (*datapp));
+            /* In the input record, or the proc buffer once written */
+            *datapp = pp->datap;
+            *lenp   = pp->datalen;
             break;
 
         case CM_ID_BUILTIN:
             /* Get requested builtin, as an integer */
-            bvar = cmp_get_builtin (pp, idsrcp);
+            bvar = get_builtin (pp, op->builtin, idsrcp);
 
             /* Return it as a string
              * ASSUMPTION:
@@ -1509,22 +1862,19 @@ void cmp_buf_find (
              *   the first one is used.
              *   We're using just one buffer.
              */
-            sprintf (s_bvarbuf, "%d", bvar);
-            *datapp = (unsigned char *) s_bvarbuf;
-            *lenp   = strlen (s_bvarbuf);
+            bvarbuf = pp->ctxp->bvarbuf;
+            sprintf (bvarbuf, "%d", bvar);
+            *datapp = (unsigned char *) bvarbuf;
+            *lenp   = strlen (bvarbuf);
             break;
 
         case CM_ID_LITERAL:
             /* Data from control table passed directly by caller.
-             * It starts after the " and continues till next quote.
-             * We assume second quote has been found and verified at
-             *   table load time and need not be checked for here.
+             * It starts after the " and continues till next quote,
+             *   found when it was decoded.
              */
-            p = (unsigned char *) idsrcp + 1;
-            *datapp = p;
-            while (*p != '"')
-                ++p;
-            *lenp = p - *datapp;
+            *datapp = op->datap;
+            *lenp   = op->len;
             break;
         default:
             break;
@@ -1539,6 +1889,7 @@ void cmp_buf_find (
 *       Write data to an output MARC record, or internal buffer.        *
 *                                                                       *
 *       Internal subroutine of multiple higher level routines.          *
+*       Ids are decoded as for cmp_buf_find().                          *
 *                                                                       *
 *   PASS                                                                *
 *       Pointer to proc parm args from higher level routine.            *
@@ -1554,8 +1905,6 @@ void cmp_buf_find (
 *       All errors are currently fatal.                                 *
 ************************************************************************/
 
-#define TMPBUF_SIZE 10000   /* No marc field can be larger  */
-
 CM_STAT cmp_buf_write (
     CM_PROC_PARMS *pp,      /* Ptr to parameter struct      */
     char          *iddestp, /* Ptr to destination id string */
@@ -1563,6 +1912,8 @@ CM_STAT cmp_buf_write (
     size_t        data_len, /* Length of data to write      */
     int           append    /* Non-zero = append data       */
 ) {
+    CM_OPND       opnd,     /* Dest id decoded here, or     */
+                  *op;      /*   ptr to the one in the proc */
     unsigned char *destp;   /* Ptr to destination data      */
     size_t        dest_len, /* Len data at destp            */
                   buf_len;  /* Length of named buffer       */
@@ -1576,12 +1927,11 @@ CM_STAT cmp_buf_write (
                   id,       /* Generic field or sf id       */
                   occ,      /* Generic occurrence number    */
                   pos;      /* Unused parm for marc_cur...  */
-
-    /* Temporary copy buffer */
-    static unsigned char s_tmpbuf[TMPBUF_SIZE];
+    unsigned char *tmpbuf;  /* Temporary copy buffer        */
 
     /* Output to destination */
-    switch (get_src_type (iddestp)) {
+    op = find_opnd (pp, iddestp, &opnd);
+    switch (op->type) {
 
         case CM_ID_LITERAL:
             /* Error in control table */
@@ -1594,14 +1944,19 @@ CM_STAT cmp_buf_write (
             if (data_len < 1)
                 break;
 
-            /* Parse marc reference string */
-            if ((stat = marc_ref (iddestp, &fid, &focc, &sid, &socc)) != 0)
+            /* Marc reference string was parsed when decoded */
+            if ((stat = op->stat) != 0)
 
                 /* Bad reference string, fatal error */
                 cm_error (CM_FATAL,
                         "cmp_buf_write: Error %d parsing marc reference = "
                         "\"%s\"", stat, iddestp);
 
+            fid  = op->fid;
+            focc = op->focc;
+            sid  = op->sid;
+            socc = op->socc;
+
             /* Assume we're positioned to the field we want */
             find_stat = 0;
             new_field = 0;
@@ -1702,20 +2057,21 @@ CM_STAT cmp_buf_write (
                 if (append && find_stat == 0) {
 
                     /* Check lengths */
-                    if (data_len + dest_len >= TMPBUF_SIZE)
+                    if (data_len + dest_len >= CM_TMPBUF_SIZE)
                         cm_error (CM_FATAL,
                            "cmp_buf_write: Impossible output length=%u ",
                            "fid=%d, focc=%d, sid=%d, socc=%d",
                             data_len + dest_len, fid, focc, sid, socc);
 
                     /* Copy to temp buf */
-                    memcpy (s_tmpbuf, destp, dest_len);
+                    tmpbuf = pp->ctxp->tmpbuf;
+                    memcpy (tmpbuf, destp, dest_len);
 
                     /* Append new data */
-                    memcpy (s_tmpbuf + dest_len, datap, data_len);
+                    memcpy (tmpbuf + dest_len, datap, data_len);
 
                     /* Now have a new source */
-                    datap     = s_tmpbuf;
+                    datap     = tmpbuf;
                     data_len += dest_len;
 
                     /* Delete source */
@@ -1738,8 +2094,8 @@ CM_STAT cmp_buf_write (
 
         case CM_ID_BUF:
             /* Find or create named buffer to receive output */
-            if (cmp_get_named_buf (iddestp, &destp, 1, data_len+1,
-                                   &buf_len) != 0)
+            if (get_named_buf (pp->ctxp->nbufp, op->slot, iddestp, &destp,
+                               1, data_len+1, &buf_len) != 0)
                 cm_error (CM_FATAL,
                       "cmp_buf_write: Could not find or create buffer \"%s\"",
                       iddestp);
@@ -1747,9 +2103,10 @@ CM_STAT cmp_buf_write (
             /* If appending, need to check for extra space */
             if (append) {
                 dest_len = strlen ((char *) destp);
-                if (buf_len < data_len + dest_len) {
-                    if (cmp_get_named_buf (iddestp, &destp, 1, data_len +
-                                       dest_len + 1, &buf_len) != 0)
+                if (buf_len < data_len + dest_len + 1) {
+                    if (get_named_buf (pp->ctxp->nbufp, op->slot, iddestp,
+                                   &destp, 1, data_len + dest_len + 1,
+                                   &buf_len) != 0)
                         cm_error (CM_FATAL,
                               "cmp_buf_write: Could not increase buffer size "
                               "to % for \"%s\"", data_len + dest_len + 1, iddestp);
@@ -1759,19 +2116,24 @@ CM_STAT cmp_buf_write (
                 destp += dest_len;
             }
 
-            /* Copy in data */
-            memcpy (destp, datap, data_len);
+            /* Copy in data, it may be from this buffer */
+            memmove (destp, datap, data_len);
             *(destp + data_len) = '\0';
 
             break;
 
         case CM_ID_CURRENT:
-            /* Using caller supplied buffer */
+            /* Using caller supplied buffer.
+             * Data being appended to has to get there first, data
+             *   being replaced is never copied at all.
+             */
+            if (append)
+                cmp_own_data (pp);
             destp = pp->bufp;
 
             /* Copy after if so specified */
             if (append)
-                destp += strlen ((char *) destp);
+                destp += pp->datalen;
 
             /* Test for space
              * Shouldn't ever fail
@@ -1780,10 +2142,13 @@ CM_STAT cmp_buf_write (
                 cm_error (CM_FATAL,
                           "cmp_buf_write: Data too large for internal buffer for \"%s\"", iddestp);
 
-            /* Copy it in */
-            memcpy (destp, datap, data_len);
+            /* Copy it in, source may be part of %data itself */
+            memmove (destp, datap, data_len);
             *(destp + data_len) = '\0';
 
+            pp->datap   = pp->bufp;
+            pp->datalen = (size_t) (destp - pp->bufp) + data_len;
+
             break;
 
         case CM_ID_BUILTIN:
@@ -1899,108 +2264,884 @@ static CM_ID get_src_type (
 
 
 /************************************************************************
-* cmp_get_named_buf ()                                                  *
+* cmp_compile_opnd ()                                                   *
 *                                                                       *
 *   DEFINITION                                                          *
-*       Internal routine to find or create a named buffer.              *
+*       Decode a proc argument that may be used as a data source or     *
+*       destination, so cmp_buf_find() and cmp_buf_write() can go       *
+*       straight to it.                                                 *
+*                                                                       *
+*       Called by make_proc() for every argument while the control      *
+*       table is loaded, before any conversion threads are started.     *
+*       Arguments that are really something else, e.g., a cmp_if        *
+*       operator, decode to something that's never used.                *
+*                                                                       *
+*       Nothing is reported here.  A bad MARC reference or an unknown   *
+*       builtin is only an error if a proc tries to use it, as before.  *
 *                                                                       *
 *   PASS                                                                *
-*       Pointer to buffer name string, max 32 chars.                    *
-*       Pointer to place to put pointer to buffer.                      *
-*       Create indicator:                                               *
-*           True  = Create buffer if not found.                         *
-*           False = Don't create.                                       *
-*       Minimum desired buffer length.                                  *
-*           Pass 0 if reading.                                          *
-*           Pass length needed if writing.                              *
-*           Will realloc if need.                                       *
-*       Pointer to place to put current buffer length.                  *
+*       Pointer to argument string.  Must last as long as the           *
+*           descriptor, which may point into it.                        *
+*       Pointer to descriptor to fill in.                               *
 *                                                                       *
 *   RETURN                                                              *
-*       0 = Success.                                                    *
-*       Else error.                                                     *
+*       Void.                                                           *
 ************************************************************************/
 
-#define MAX_NAME_BUFS 60
-#define MAX_BNAME     32
-
-CM_STAT cmp_get_named_buf (
-    char   *namep,              /* Ptr to name          */
-    unsigned char **bufpp,      /* Put ptr to buf here  */
-    int    create,              /* True=Create if need  */
-    size_t minlen,              /* Min if create        */
-    size_t *lenp                /* Current buffer len   */
+void cmp_compile_opnd (
+    char    *idp,           /* Ptr to id string         */
+    CM_OPND *op             /* Put decoded id here      */
 ) {
-    static struct {
-        char name[MAX_BNAME];   /* Buffer name          */
-        unsigned char *bufp;    /* Buffer pointer       */
-        size_t size;            /* Num bytes            */
-    } s_bufs[MAX_NAME_BUFS];
-    static int s_bufcnt;        /* Num in use           */
+    compile_opnd (idp, op, 1);
 
-    int i,                      /* Loop counter         */
-        found;                  /* True=have a buffer   */
+} /* cmp_compile_opnd */
 
-    /* Search for existing buffer */
-    found = 0;
-    for (i=0; i<s_bufcnt; i++) {
 
-        /* Fast, then slow compare */
-        if (*namep == s_bufs[i].name[0] && !strcmp (namep, s_bufs[i].name)) {
+/************************************************************************
+* compile_opnd ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Decode an id string, see cmp_compile_opnd().                    *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to id string.                                           *
+*       Pointer to descriptor to fill in.                               *
+*       True  = give a buffer name a slot, if it doesn't have one.      *
+*       False = leave it to get_named_buf() to find by name.            *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
 
-            /* Found it.  Enlarge if necessary */
-            if (s_bufs[i].size < minlen) {
+static void compile_opnd (
+    char    *idp,           /* Ptr to id string         */
+    CM_OPND *op,            /* Put decoded id here      */
+    int     intern          /* True=Assign buffer slot  */
+) {
+    unsigned char *p;       /* Ptr into literal         */
 
-#ifdef DEBUG
-                if ((s_bufs[i].bufp = marc_realloc(s_bufs[i].bufp, minlen, 601)) == NULL) {  //TAG:601
-                    cm_error (CM_FATAL, "Unable to realloc for %u bytes " "for named buffer %s", minlen, namep);
-                }
-#else
-                if ((s_bufs[i].bufp = realloc(s_bufs[i].bufp, minlen)) == NULL) {
-                    cm_error (CM_FATAL, "Unable to realloc for %u bytes " "for named buffer %s", minlen, namep);
-                }
-#endif
-                s_bufs[i].size = minlen;
-            }
-            found = 1;
-            break;
-        }
-    }
 
-    /* If not found, then create if desired */
-    if (i == s_bufcnt && create) {
+    memset (op, 0, sizeof(CM_OPND));
+    op->slot = -1;
 
-        /* Too many? */
-        if (s_bufcnt >= MAX_NAME_BUFS)
-            cm_error (CM_FATAL, "Too many buffers, adding name=%s", namep);
+    switch (op->type = get_src_type (idp)) {
 
-        /* Create */
-#ifdef DEBUG
-        if ((s_bufs[i].bufp = marc_alloc(minlen, 602)) == NULL) {  //TAG:602
-            cm_error (CM_FATAL, "Unable to malloc for %u bytes " "for named buffer %s", minlen, namep);
-        }
+        case CM_ID_MARC:
+            op->stat = marc_ref (idp, &op->fid, &op->focc, &op->sid,
+                                 &op->socc);
+            break;
+
+        case CM_ID_BUF:
+            if (intern)
+                op->slot = name_slot (idp, 1);
+            break;
+
+        case CM_ID_BUILTIN:
+            op->builtin = builtin_id (idp);
+            break;
+
+        case CM_ID_LITERAL:
+            /* Data starts after the " and continues till next quote */
+            p = (unsigned char *) idp + 1;
+            op->datap = p;
+            while (*p && *p != '"')
+                ++p;
+            op->len = p - op->datap;
+            break;
+
+        default:
+            break;
+    }
+
+} /* compile_opnd */
+
+
+/************************************************************************
+* find_opnd ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Get the decoded form of an id passed to cmp_buf_find() or       *
+*       cmp_buf_write().                                                *
+*                                                                       *
+*       Procs almost always pass one of their own arguments, which      *
+*       make_proc() decoded.  We know it by its address.  Anything      *
+*       else, e.g., a string built by a custom proc, or arguments       *
+*       passed through cmp_call(), is decoded into the caller's         *
+*       descriptor.                                                     *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to proc parm args from higher level routine.            *
+*       Pointer to id string.                                           *
+*       Pointer to descriptor to use if id isn't an argument.           *
+*                                                                       *
+*   RETURN                                                              *
+*       Pointer to descriptor.                                          *
+************************************************************************/
+
+static CM_OPND *find_opnd (
+    CM_PROC_PARMS *pp,      /* Ptr to parameter struct  */
+    char    *idp,           /* Ptr to id string         */
+    CM_OPND *tmpp           /* Decode here if need be   */
+) {
+    int     i;              /* Loop counter             */
+
+
+    if (pp->opnds) {
+        for (i=0; i<pp->arg_count && i<CM_MAX_ARGS; i++)
+            if (pp->args[i] == idp)
+                return pp->opnds + i;
+    }
+
+    compile_opnd (idp, tmpp, 0);
+
+    return tmpp;
+
+} /* find_opnd */
+
+
+/************************************************************************
+* cmp_get_named_buf ()                                                  *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Internal routine to find or create a named buffer.              *
+*                                                                       *
+*       Uses the named buffers of the calling thread's conversion       *
+*       context, see cm_ctx().                                          *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to buffer name string, any length.                      *
+*       Pointer to place to put pointer to buffer.                      *
+*       Create indicator:                                               *
+*           True  = Create buffer if not found.                         *
+*           False = Don't create.                                       *
+*       Minimum desired buffer length.                                  *
+*           Pass 0 if reading.                                          *
+*           Pass length needed if writing.                              *
+*           Will realloc if need.                                       *
+*       Pointer to place to put current buffer length.                  *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#define BNAME_HASH_MIN  64      /* Least hash table size, power of 2*/
+#define BSLOT_MIN       16      /* Least slots in a context         */
+
+/* Every buffer name ever seen gets a slot, the same one in every
+ *   context.  Names from the control table get theirs when it's
+ *   loaded, cmp_buf_slot() gives them to names a program uses a lot,
+ *   and the hash table finds the few made up as we go.
+ */
+static struct {
+    char   **names;             /* Name in each slot                */
+    int    count;               /* Slots in use                     */
+    int    max;                 /* Room in names                    */
+    int    *hashp;              /* Slot+1 for each hash, 0=empty    */
+    size_t hash_size;           /* Entries in hashp, power of 2     */
+} S_bnames;
+static pthread_mutex_t S_bname_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* One named buffer */
+typedef struct cm_nbuf {
+    unsigned char *bufp;        /* Buffer ptr, NULL=none            */
+    size_t size;                /* Num bytes                        */
+} CM_NBUF;
+
+/* All named buffers of one conversion context, by slot */
+struct cm_named_bufs {
+    CM_NBUF *bufs;              /* Buffer for each slot             */
+    int     *usedp;             /* Slots with buffers, in order made*/
+    int     bufmax;             /* Room in bufs and usedp           */
+    int     bufcnt;             /* Num in use                       */
+};
+
+CM_STAT cmp_get_named_buf (
+    char   *namep,              /* Ptr to name          */
+    unsigned char **bufpp,      /* Put ptr to buf here  */
+    int    create,              /* True=Create if need  */
+    size_t minlen,              /* Min if create        */
+    size_t *lenp                /* Current buffer len   */
+) {
+    return get_named_buf (cm_ctx()->nbufp, -1, namep, bufpp, create,
+                          minlen, lenp);
+
+} /* cmp_get_named_buf */
+
+
+/************************************************************************
+* cmp_get_slot_buf ()                                                   *
+*                                                                       *
+*   DEFINITION                                                          *
+*       cmp_get_named_buf() for a name already given a slot by          *
+*       cmp_buf_slot(), found without looking the name up again.        *
+*                                                                       *
+*   PASS                                                                *
+*       Slot of name.                                                   *
+*       Rest as cmp_get_named_buf().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+CM_STAT cmp_get_slot_buf (
+    int    slot,                /* Name's slot          */
+    unsigned char **bufpp,      /* Put ptr to buf here  */
+    int    create,              /* True=Create if need  */
+    size_t minlen,              /* Min if create        */
+    size_t *lenp                /* Current buffer len   */
+) {
+    return get_named_buf (cm_ctx()->nbufp, slot, "", bufpp, create,
+                          minlen, lenp);
+
+} /* cmp_get_slot_buf */
+
+
+/************************************************************************
+* get_named_buf ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find or create a named buffer in a given set.                   *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to set of named buffers.                                    *
+*       Slot of name, from cmp_compile_opnd(), or -1 to look up name.   *
+*       Rest as cmp_get_named_buf().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static CM_STAT get_named_buf (
+    CM_NAMED_BUFS *nbp,         /* Search these         */
+    int    slot,                /* Name's slot, or -1   */
+    char   *namep,              /* Ptr to name          */
+    unsigned char **bufpp,      /* Put ptr to buf here  */
+    int    create,              /* True=Create if need  */
+    size_t minlen,              /* Min if create        */
+    size_t *lenp                /* Current buffer len   */
+) {
+    CM_NBUF *bp;                /* The buffer           */
+
+
+    /* Name never seen can't have a buffer yet */
+    if (slot < 0 && (slot = name_slot (namep, create)) < 0)
+        return CM_STAT_ERROR;
+
+    /* No buffer for a slot past the end, make room if creating it */
+    if (slot >= nbp->bufmax) {
+        if (!create)
+            return CM_STAT_ERROR;
+        grow_named_bufs (nbp, slot);
+    }
+    bp = nbp->bufs + slot;
+
+    /* Found it.  Enlarge if necessary */
+    if (bp->bufp) {
+        if (bp->size < minlen) {
+
+#ifdef DEBUG
+            if ((bp->bufp = marc_realloc(bp->bufp, minlen, 601)) == NULL) {  //TAG:601
+                cm_error (CM_FATAL, "Unable to realloc for %u bytes " "for named buffer %s", minlen, namep);
+            }
 #else
-        if ((s_bufs[i].bufp = malloc (minlen)) == NULL) {
+            if ((bp->bufp = realloc(bp->bufp, minlen)) == NULL) {
+                cm_error (CM_FATAL, "Unable to realloc for %u bytes " "for named buffer %s", minlen, namep);
+            }
+#endif
+            bp->size = minlen;
+        }
+    }
+
+    /* If not found, then create if desired */
+    else if (create) {
+
+#ifdef DEBUG
+        if ((bp->bufp = marc_alloc(minlen, 602)) == NULL) {  //TAG:602
+            cm_error (CM_FATAL, "Unable to malloc for %u bytes " "for named buffer %s", minlen, namep);
+        }
+#else
+        if ((bp->bufp = malloc (minlen)) == NULL) {
             cm_error (CM_FATAL, "Unable to malloc for %u bytes " "for named buffer %s", minlen, namep);
         }
 #endif
-        strncpy (s_bufs[i].name, namep, MAX_BNAME - 1);
-        *s_bufs[i].bufp = '\0';
-        s_bufs[i].size = minlen;
+        *bp->bufp = '\0';
+        bp->size = minlen;
 
-        ++s_bufcnt;
-        found = 1;
+        /* Remember it's there, so whole sets needn't look at every slot */
+        nbp->usedp[nbp->bufcnt++] = slot;
     }
 
+    else
+        return CM_STAT_ERROR;
+
     /* Data for caller */
-    if (found) {
-        *bufpp = s_bufs[i].bufp;
-        *lenp  = s_bufs[i].size;
-        return CM_STAT_OK;
+    *bufpp = bp->bufp;
+    *lenp  = bp->size;
+    return CM_STAT_OK;
+
+} /* get_named_buf */
+
+
+/************************************************************************
+* grow_named_bufs ()                                                    *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make room in a set of named buffers for a slot, at least        *
+*       doubling it so it's seldom done.                                *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to set of named buffers.                                    *
+*       Slot needed.                                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  Fatal error if no memory.                                *
+************************************************************************/
+
+static void grow_named_bufs (
+    CM_NAMED_BUFS *nbp,         /* Grow this set        */
+    int    slot                 /* To hold this slot    */
+) {
+    int    newmax;              /* New number of slots  */
+
+
+    newmax = nbp->bufmax * 2;
+    if (newmax <= slot)
+        newmax = slot + 1;
+    if (newmax < BSLOT_MIN)
+        newmax = BSLOT_MIN;
+
+#ifdef DEBUG
+    nbp->bufs  = (CM_NBUF *) marc_realloc (nbp->bufs, newmax * sizeof(CM_NBUF), 608);  //TAG:608
+    nbp->usedp = (int *) marc_realloc (nbp->usedp, newmax * sizeof(int), 609);  //TAG:609
+#else
+    nbp->bufs  = (CM_NBUF *) realloc (nbp->bufs, newmax * sizeof(CM_NBUF));
+    nbp->usedp = (int *) realloc (nbp->usedp, newmax * sizeof(int));
+#endif
+    if (!nbp->bufs || !nbp->usedp)
+        cm_error (CM_FATAL, "Named buffer memory");
+
+    memset (nbp->bufs + nbp->bufmax, 0,
+            (newmax - nbp->bufmax) * sizeof(CM_NBUF));
+    nbp->bufmax = newmax;
+
+} /* grow_named_bufs */
+
+
+/************************************************************************
+* cmp_buf_slot ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Give a buffer name a slot, if it hasn't got one, for a program  *
+*       that will use the buffer again and again through                *
+*       cmp_get_slot_buf().                                             *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to name.                                                *
+*                                                                       *
+*   RETURN                                                              *
+*       Slot number.                                                    *
+************************************************************************/
+
+int cmp_buf_slot (
+    char   *namep               /* Ptr to name          */
+) {
+    return name_slot (namep, 1);
+
+} /* cmp_buf_slot */
+
+
+/************************************************************************
+* cmp_buf_slots ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Get the number of buffer slots given out so far, so a program   *
+*       can keep something for each of them.  Slots are numbered from   *
+*       0 up to this.                                                   *
+*                                                                       *
+*   PASS                                                                *
+*       Nothing.                                                        *
+*                                                                       *
+*   RETURN                                                              *
+*       Number of slots.                                                *
+************************************************************************/
+
+int cmp_buf_slots (void)
+{
+    int    count;               /* Slots given out      */
+
+
+    pthread_mutex_lock (&S_bname_lock);
+    count = S_bnames.count;
+    pthread_mutex_unlock (&S_bname_lock);
+
+    return count;
+
+} /* cmp_buf_slots */
+
+
+/************************************************************************
+* name_slot ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find the slot for a buffer name, optionally giving it one if    *
+*       it has none.                                                    *
+*                                                                       *
+*       Any thread may look up a name it wasn't given at load time,     *
+*       so the names are locked while we look.                          *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to name.                                                *
+*       True = add name if not found.                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       Slot number.                                                    *
+*       -1 if not found and not added.                                  *
+*       Fatal error if no memory to add it.                             *
+************************************************************************/
+
+static int name_slot (
+    char   *namep,              /* Ptr to name          */
+    int    add                  /* True=Add if need     */
+) {
+    size_t h,                   /* Hash of name, masked */
+           mask,                /* hash_size - 1        */
+           newsize;             /* Bigger hash table    */
+    int    slot,                /* Slot of name         */
+           i;                   /* Loop counter         */
+
+
+    pthread_mutex_lock (&S_bname_lock);
+
+    /* Look for it, going on to the next entry after a collision */
+    slot = -1;
+    if (S_bnames.hash_size) {
+        mask = S_bnames.hash_size - 1;
+        for (h = bname_hash (namep) & mask; S_bnames.hashp[h];
+                                            h = (h + 1) & mask) {
+            i = S_bnames.hashp[h] - 1;
+            if (!strcmp (namep, S_bnames.names[i])) {
+                slot = i;
+                break;
+            }
+        }
     }
-    return CM_STAT_ERROR;
 
-} /* cmp_get_named_buf */
+    if (slot < 0 && add) {
+
+        /* Keep the hash table no more than half full */
+        if ((size_t) (S_bnames.count + 1) * 2 > S_bnames.hash_size) {
+            newsize = S_bnames.hash_size ? S_bnames.hash_size * 2
+                                         : BNAME_HASH_MIN;
+#ifdef DEBUG
+            if (S_bnames.hashp)
+                marc_dealloc (S_bnames.hashp, 610);  //TAG:610
+            S_bnames.hashp = (int *) marc_calloc (newsize, sizeof(int), 610);  //TAG:610
+#else
+            free (S_bnames.hashp);
+            S_bnames.hashp = (int *) calloc (newsize, sizeof(int));
+#endif
+            if (!S_bnames.hashp)
+                cm_error (CM_FATAL, "Buffer name memory");
+            S_bnames.hash_size = newsize;
+
+            /* Rehash what we have */
+            mask = newsize - 1;
+            for (i=0; i<S_bnames.count; i++) {
+                for (h = bname_hash (S_bnames.names[i]) & mask;
+                        S_bnames.hashp[h]; h = (h + 1) & mask)
+                    ;
+                S_bnames.hashp[h] = i + 1;
+            }
+        }
+
+        if (S_bnames.count >= S_bnames.max) {
+            S_bnames.max = S_bnames.max ? S_bnames.max * 2 : BNAME_HASH_MIN;
+#ifdef DEBUG
+            S_bnames.names = (char **) marc_realloc (S_bnames.names, S_bnames.max * sizeof(char *), 611);  //TAG:611
+#else
+            S_bnames.names = (char **) realloc (S_bnames.names,
+                                       S_bnames.max * sizeof(char *));
+#endif
+            if (!S_bnames.names)
+                cm_error (CM_FATAL, "Buffer name memory");
+        }
+
+        /* Names last as long as the program */
+        slot = S_bnames.count;
+        if ((S_bnames.names[slot] = strdup (namep)) == NULL)
+            cm_error (CM_FATAL, "Buffer name memory");
+
+        mask = S_bnames.hash_size - 1;
+        for (h = bname_hash (namep) & mask; S_bnames.hashp[h];
+                                            h = (h + 1) & mask)
+            ;
+        S_bnames.hashp[h] = slot + 1;
+        ++S_bnames.count;
+    }
+
+    pthread_mutex_unlock (&S_bname_lock);
+
+    return slot;
+
+} /* name_slot */
+
+
+/************************************************************************
+* bname_hash ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Hash a buffer name for name_slot().                             *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to name.                                                *
+*                                                                       *
+*   RETURN                                                              *
+*       Hash value, to be masked to the table size.                     *
+************************************************************************/
+
+static size_t bname_hash (
+    char   *namep               /* Ptr to name          */
+) {
+    unsigned char *p;           /* Ptr into name        */
+    size_t h;                   /* Hash so far          */
+
+
+    /* FNV-1a */
+    h = 2166136261u;
+    for (p=(unsigned char *) namep; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+
+    return h;
+
+} /* bname_hash */
+
+
+/************************************************************************
+* cmp_new_named_bufs ()                                                 *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Create a set of named buffers for a new conversion context.     *
+*                                                                       *
+*       It may start as a copy of another context's buffers, e.g., so   *
+*       a conversion worker sees switches and anything set by session   *
+*       pre-processes.  The other context must not change its buffers   *
+*       while we copy.                                                  *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to place to put ptr to new set.                             *
+*       Ptr to set to copy, NULL to start empty.                        *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  Fatal error if no memory.                                *
+************************************************************************/
+
+void cmp_new_named_bufs (
+    CM_NAMED_BUFS **nbpp,       /* Put new set here     */
+    CM_NAMED_BUFS *fromp        /* Copy these, or NULL  */
+) {
+    CM_NAMED_BUFS *nbp;         /* New set              */
+    unsigned char *bufp;        /* Our copy of a buffer */
+    size_t        buflen;       /* Its length           */
+    int           i,            /* Loop counter         */
+                  slot;         /* Slot of a buffer     */
+
+
+#ifdef DEBUG
+    nbp = (CM_NAMED_BUFS *) marc_calloc (sizeof(CM_NAMED_BUFS), 1, 603);  //TAG:603
+#else
+    nbp = (CM_NAMED_BUFS *) calloc (sizeof(CM_NAMED_BUFS), 1);
+#endif
+    if (!nbp)
+        cm_error (CM_FATAL, "Named buffer memory");
+
+    /* Same slots, only those with buffers, in the same order */
+    if (fromp) {
+        for (i=0; i<fromp->bufcnt; i++) {
+            slot = fromp->usedp[i];
+            get_named_buf (nbp, slot, "", &bufp, 1,
+                           fromp->bufs[slot].size, &buflen);
+            memcpy (bufp, fromp->bufs[slot].bufp, fromp->bufs[slot].size);
+        }
+    }
+
+    *nbpp = nbp;
+
+} /* cmp_new_named_bufs */
+
+
+/************************************************************************
+* cmp_free_named_bufs ()                                                *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Free a set of named buffers from cmp_new_named_bufs().          *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to set, may be NULL.                                        *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+void cmp_free_named_bufs (
+    CM_NAMED_BUFS *nbp          /* Free these           */
+) {
+    int           i;            /* Loop counter         */
+
+
+    if (!nbp)
+        return;
+
+    for (i=0; i<nbp->bufcnt; i++) {
+#ifdef DEBUG
+        marc_dealloc (nbp->bufs[nbp->usedp[i]].bufp, 604);  //TAG:604
+#else
+        free (nbp->bufs[nbp->usedp[i]].bufp);
+#endif
+    }
+#ifdef DEBUG
+    if (nbp->bufs) {
+        marc_dealloc (nbp->bufs, 608);   //TAG:608
+        marc_dealloc (nbp->usedp, 609);  //TAG:609
+    }
+    marc_dealloc (nbp, 603);  //TAG:603
+#else
+    free (nbp->bufs);
+    free (nbp->usedp);
+    free (nbp);
+#endif
+
+} /* cmp_free_named_bufs */
+
+
+/************************************************************************
+* cmp_alloc ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Allocate memory that lasts until the current record is done.    *
+*                                                                       *
+*       It comes from the conversion context's arena, a block we just   *
+*       take the next bytes from.  Nothing is ever freed by itself.     *
+*       conv_rec() empties the whole arena before each new record, so   *
+*       procs needing scratch strings neither free them nor leak them.  *
+*       Don't keep pointers to it from one record to the next.          *
+*                                                                       *
+*       When a record needs more than one block, the arena is made      *
+*       one block that big for the records after it, so a run soon      *
+*       stops calling malloc() for procs at all.                        *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to proc parms.                                              *
+*       Bytes wanted.                                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to memory, aligned for any use, not initialized.            *
+*       Fatal error if no memory.                                       *
+************************************************************************/
+
+#define CM_ARENA_SIZE  0x10000  /* Least arena block size       */
+#define CM_ARENA_ALIGN      16  /* Every allocation aligned so  */
+
+/* Round up to the alignment */
+#define ARENA_ROUND(n)  (((n) + CM_ARENA_ALIGN - 1) & ~((size_t) CM_ARENA_ALIGN - 1))
+
+/* One block, data after the header */
+typedef struct cm_arena_blk {
+    struct cm_arena_blk *nextp; /* Block filled before  */
+    size_t size;                /* Bytes of data        */
+} CM_ARENA_BLK;
+
+#define ARENA_HDR       ARENA_ROUND(sizeof(CM_ARENA_BLK))
+
+/* Per record memory of one conversion context */
+struct cm_arena {
+    CM_ARENA_BLK *blkp;         /* Current block        */
+    size_t used;                /* Bytes used in it     */
+    size_t total;               /* Used since reset     */
+};
+
+static CM_ARENA_BLK *arena_blk (size_t);
+
+void *cmp_alloc (
+    CM_PROC_PARMS *pp,          /* Proc's parms         */
+    size_t        len           /* Bytes wanted         */
+) {
+    CM_ARENA      *ap;          /* The arena            */
+    CM_ARENA_BLK  *bp;          /* New block            */
+    void          *p;           /* Memory returned      */
+
+
+    ap  = pp->arenap;
+    len = ARENA_ROUND(len ? len : 1);
+
+    /* Start another block if this one's full */
+    if (ap->used + len > ap->blkp->size) {
+        bp = arena_blk ((len > CM_ARENA_SIZE) ? len : CM_ARENA_SIZE);
+        bp->nextp = ap->blkp;
+        ap->blkp  = bp;
+        ap->used  = 0;
+    }
+
+    p = (unsigned char *) ap->blkp + ARENA_HDR + ap->used;
+    ap->used  += len;
+    ap->total += len;
+
+    return p;
+
+} /* cmp_alloc */
+
+
+/************************************************************************
+* arena_blk ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Allocate an arena block.                                        *
+*                                                                       *
+*   PASS                                                                *
+*       Bytes of data it must hold, already rounded.                    *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to block.  Fatal error if no memory.                        *
+************************************************************************/
+
+static CM_ARENA_BLK *arena_blk (
+    size_t        size          /* Data bytes           */
+) {
+    CM_ARENA_BLK  *bp;          /* New block            */
+
+
+#ifdef DEBUG
+    if ((bp = (CM_ARENA_BLK *) marc_alloc(ARENA_HDR + size, 606)) == NULL) {  //TAG:606
+        cm_error (CM_FATAL, "Unable to malloc for %lu bytes " "for proc arena", (unsigned long) size);
+    }
+#else
+    if ((bp = (CM_ARENA_BLK *) malloc (ARENA_HDR + size)) == NULL) {
+        cm_error (CM_FATAL, "Unable to malloc for %lu bytes " "for proc arena", (unsigned long) size);
+    }
+#endif
+    bp->nextp = NULL;
+    bp->size  = size;
+
+    return bp;
+
+} /* arena_blk */
+
+
+/************************************************************************
+* cmp_new_arena ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Create an empty arena for a new conversion context.             *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to place to put ptr to new arena.                           *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  Fatal error if no memory.                                *
+************************************************************************/
+
+void cmp_new_arena (
+    CM_ARENA      **app         /* Put new arena here   */
+) {
+    CM_ARENA      *ap;          /* New arena            */
+
+
+#ifdef DEBUG
+    ap = (CM_ARENA *) marc_calloc (sizeof(CM_ARENA), 1, 605);  //TAG:605
+#else
+    ap = (CM_ARENA *) calloc (sizeof(CM_ARENA), 1);
+#endif
+    if (!ap)
+        cm_error (CM_FATAL, "Proc arena memory");
+
+    ap->blkp = arena_blk (CM_ARENA_SIZE);
+
+    *app = ap;
+
+} /* cmp_new_arena */
+
+
+/************************************************************************
+* cmp_reset_arena ()                                                    *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Empty an arena, making everything from cmp_alloc() since the    *
+*       last reset available again.                                     *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to arena.                                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.  Fatal error if no memory.                                *
+************************************************************************/
+
+void cmp_reset_arena (
+    CM_ARENA      *ap           /* Empty this           */
+) {
+    CM_ARENA_BLK  *bp;          /* Block to free        */
+
+
+    /* More than one block, replace them all with one that holds it all */
+    if (ap->blkp->nextp) {
+        while ((bp = ap->blkp) != NULL) {
+            ap->blkp = bp->nextp;
+#ifdef DEBUG
+            marc_dealloc (bp, 606);  //TAG:606
+#else
+            free (bp);
+#endif
+        }
+        ap->blkp = arena_blk ((ap->total > CM_ARENA_SIZE) ?
+                              ARENA_ROUND(ap->total) : CM_ARENA_SIZE);
+    }
+
+    ap->used  = 0;
+    ap->total = 0;
+
+} /* cmp_reset_arena */
+
+
+/************************************************************************
+* cmp_free_arena ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Free an arena from cmp_new_arena().                             *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to arena, may be NULL.                                      *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+void cmp_free_arena (
+    CM_ARENA      *ap           /* Free this            */
+) {
+    CM_ARENA_BLK  *bp;          /* Block to free        */
+
+
+    if (!ap)
+        return;
+
+    while ((bp = ap->blkp) != NULL) {
+        ap->blkp = bp->nextp;
+#ifdef DEBUG
+        marc_dealloc (bp, 606);  //TAG:606
+#else
+        free (bp);
+#endif
+    }
+#ifdef DEBUG
+    marc_dealloc (ap, 605);  //TAG:605
+#else
+    free (ap);
+#endif
+
+} /* cmp_free_arena */
 
 
 /************************************************************************
@@ -2024,62 +3165,114 @@ int cmp_get_builtin (
     CM_PROC_PARMS *pp,      /* Ptr to parameter struct  */
     char          *namep    /* Ptr to name              */
 ) {
-    int           okay,     /* No error in passed name  */
-                  id,       /* Field or subfield id     */
-                  occ,      /* Field or subfield occ    */
-                  pos,      /* Field or subfield pos    */
-                  stat,     /* From called subroutine   */
-                  value;    /* Return value for caller  */
+    return get_builtin (pp, builtin_id (namep), namep);
+
+} /* cmp_get_builtin */
 
 
-    okay = 1;
+/************************************************************************
+* builtin_id ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Tell which builtin variable a name asks for.                    *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to name of builtin, e.g., %focc.                        *
+*                                                                       *
+*   RETURN                                                              *
+*       One of CM_BI_... identifiers.                                   *
+************************************************************************/
 
+static CM_BI builtin_id (
+    char          *namep    /* Ptr to name              */
+) {
     /* We handle specific cases, with minimal error checking on names
      *   %fid, %focc, %fpos
      */
     if (namep[1] == 'f') {
-
-        /* Get info from input record */
-        if ((stat = marc_cur_field (pp->inmp, &id, &occ, &pos)) != 0)
-            cm_error (CM_FATAL, "cmp_get_builtins: Error %d getting curfield",
-                      stat);
-
-        /* What did caller want? */
         switch (namep[2]) {
-            case 'i': value = id;  break;
-            case 'o': value = occ; break;
-            case 'p': value = pos; break;
-            default:
-                okay = 0;
+            case 'i': return CM_BI_FID;
+            case 'o': return CM_BI_FOCC;
+            case 'p': return CM_BI_FPOS;
         }
     }
 
     /*   %sid, %socc, %spos */
     else if (namep[1] == 's') {
-
-        /* Get info from input record */
-        if ((stat = marc_cur_subfield (pp->inmp, &id, &occ, &pos)) != 0)
-            cm_error (CM_FATAL, "cmp_get_builtins: Error %d getting curfield",
-                      stat);
-
         switch (namep[2]) {
-            case 'i': value = id;  break;
-            case 'o': value = occ; break;
-            case 'p': value = pos; break;
-            default:
-                okay = 0;
+            case 'i': return CM_BI_SID;
+            case 'o': return CM_BI_SOCC;
+            case 'p': return CM_BI_SPOS;
         }
     }
 
-    else
-        okay = 0;
+    return CM_BI_UNKNOWN;
 
-    if (!okay)
-        cm_error (CM_FATAL, "Unknown builtin %s requested", namep);
+} /* builtin_id */
 
-    return value;
 
-} /* cmp_get_builtin */
+/************************************************************************
+* get_builtin ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Derive the value of a builtin variable, see cmp_get_builtin().  *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to current context to access input record.              *
+*       Which builtin.                                                  *
+*       Pointer to name of builtin, for error messages.                 *
+*                                                                       *
+*   RETURN                                                              *
+*       Value of builtin.                                               *
+************************************************************************/
+
+static int get_builtin (
+    CM_PROC_PARMS *pp,      /* Ptr to parameter struct  */
+    CM_BI         bi,       /* Which builtin            */
+    char          *namep    /* Ptr to name              */
+) {
+    int           id,       /* Field or subfield id     */
+                  occ,      /* Field or subfield occ    */
+                  pos,      /* Field or subfield pos    */
+                  stat;     /* From called subroutine   */
+
+
+    switch (bi) {
+        case CM_BI_FID:
+        case CM_BI_FOCC:
+        case CM_BI_FPOS:
+            /* Get info from input record */
+            if ((stat = marc_cur_field (pp->inmp, &id, &occ, &pos)) != 0)
+                cm_error (CM_FATAL, "cmp_get_builtins: Error %d getting "
+                          "curfield", stat);
+            break;
+
+        case CM_BI_SID:
+        case CM_BI_SOCC:
+        case CM_BI_SPOS:
+            if ((stat = marc_cur_subfield (pp->inmp, &id, &occ, &pos)) != 0)
+                cm_error (CM_FATAL, "cmp_get_builtins: Error %d getting "
+                          "curfield", stat);
+            break;
+
+        default:
+            cm_error (CM_FATAL, "Unknown builtin %s requested", namep);
+            return -1;
+    }
+
+    /* What did caller want? */
+    switch (bi) {
+        case CM_BI_FID:
+        case CM_BI_SID:
+            return id;
+        case CM_BI_FOCC:
+        case CM_BI_SOCC:
+            return occ;
+        default:
+            return pos;
+    }
+
+} /* get_builtin */
 
 
 /*********************************************************************
@@ -36,31 +36,35 @@
 *                                                                    *
 *   Place prototypes for general purpose procedures in marcconv.h,   *
 *   special purpose procedures in marcproclist.h                     *
+*                                                                    *
+*   Add CMP_MT to the position only if the procedure is thread safe. *
+*   marcconv -j won't use threads for tables calling any without it. *
+*   Add CMP_NOBUF if it never touches pp->bufp, see marcconv.h.      *
 *********************************************************************/
 
 CMP_TABLE G_proc_list[] = {
     /* Generic functions */
-    {"if",        cmp_if,        CM_CND_IF,    2, 3, CMP_ANY},
-    {"else",      cmp_nop,       CM_CND_ELSE,  0, 0, CMP_ANY},
-    {"endif",     cmp_nop,       CM_CND_ENDIF, 0, 0, CMP_ANY},
-    {"indic",     cmp_indic,     CM_CND_NONE,  2, 2, CMP_FO | CMP_SO},
-    {"clear",     cmp_clear,     CM_CND_NONE,  1, 1, CMP_ANY},
-    {"append",    cmp_append,    CM_CND_NONE,  2, 6, CMP_ANY},
-    {"copy",      cmp_copy,      CM_CND_NONE,  2, 6, CMP_ANY},
-    {"normalize", cmp_normalize, CM_CND_NONE,  2, 2, CMP_ANY},
-    {"makefld",   cmp_makefld,   CM_CND_NONE,  1, 1, CMP_RE|CMP_RO|CMP_FO|CMP_SO},
-    {"makesf",    cmp_makesf,    CM_CND_NONE,  1, 1, CMP_RE|CMP_RO|CMP_FO|CMP_SO},
-    {"y2toy4",    cmp_y2toy4,    CM_CND_NONE,  2, 2, CMP_ANY},
-    {"killrec",   cmp_killrec,   CM_CND_NONE,  0, 0, CMP_ANY},
-    {"killfld",   cmp_killfld,   CM_CND_NONE,  0, 0, CMP_FE|CMP_FO|CMP_SE|CMP_SO},
-    {"donerec",   cmp_donerec,   CM_CND_NONE,  0, 0, CMP_ANY},
-    {"donefld",   cmp_donefld,   CM_CND_NONE,  0, 0, CMP_FE|CMP_FO|CMP_SE|CMP_SO},
-    {"donesf",    cmp_donesf,    CM_CND_NONE,  0, 0, CMP_SE|CMP_SO},
-    {"renfld",    cmp_renfld,    CM_CND_NONE,  1, 1, CMP_FE|CMP_FO|CMP_SE|CMP_SO},
-    {"rensf",     cmp_rensf,     CM_CND_NONE,  1, 1, CMP_SO},
-    {"today",     cmp_today,     CM_CND_NONE,  2, 2, CMP_ANY},
-    {"substr",    cmp_substr,    CM_CND_NONE,  3, 4, CMP_ANY},
-    {"log",       cmp_log,       CM_CND_NONE,  2,99, CMP_ANY},
+    {"if",        cmp_if,        CM_CND_IF,    2, 3, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"else",      cmp_nop,       CM_CND_ELSE,  0, 0, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"endif",     cmp_nop,       CM_CND_ENDIF, 0, 0, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"indic",     cmp_indic,     CM_CND_NONE,  2, 2, CMP_FO|CMP_SO|CMP_MT|CMP_NOBUF},
+    {"clear",     cmp_clear,     CM_CND_NONE,  1, 1, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"append",    cmp_append,    CM_CND_NONE,  2, 6, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"copy",      cmp_copy,      CM_CND_NONE,  2, 6, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"normalize", cmp_normalize, CM_CND_NONE,  2, 2, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"makefld",   cmp_makefld,   CM_CND_NONE,  1, 1, CMP_RE|CMP_RO|CMP_FO|CMP_SO|CMP_MT|CMP_NOBUF},
+    {"makesf",    cmp_makesf,    CM_CND_NONE,  1, 1, CMP_RE|CMP_RO|CMP_FO|CMP_SO|CMP_MT|CMP_NOBUF},
+    {"y2toy4",    cmp_y2toy4,    CM_CND_NONE,  2, 2, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"killrec",   cmp_killrec,   CM_CND_NONE,  0, 0, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"killfld",   cmp_killfld,   CM_CND_NONE,  0, 0, CMP_FE|CMP_FO|CMP_SE|CMP_SO|CMP_MT|CMP_NOBUF},
+    {"donerec",   cmp_donerec,   CM_CND_NONE,  0, 0, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"donefld",   cmp_donefld,   CM_CND_NONE,  0, 0, CMP_FE|CMP_FO|CMP_SE|CMP_SO|CMP_MT|CMP_NOBUF},
+    {"donesf",    cmp_donesf,    CM_CND_NONE,  0, 0, CMP_SE|CMP_SO|CMP_MT|CMP_NOBUF},
+    {"renfld",    cmp_renfld,    CM_CND_NONE,  1, 1, CMP_FE|CMP_FO|CMP_SE|CMP_SO|CMP_MT|CMP_NOBUF},
+    {"rensf",     cmp_rensf,     CM_CND_NONE,  1, 1, CMP_SO|CMP_MT|CMP_NOBUF},
+    {"today",     cmp_today,     CM_CND_NONE,  2, 2, CMP_ANY|CMP_MT|CMP_NOBUF},
+    {"substr",    cmp_substr,    CM_CND_NONE,  3, 4, CMP_ANY|CMP_MT},
+    {"log",       cmp_log,       CM_CND_NONE,  2,99, CMP_ANY|CMP_MT|CMP_NOBUF},
 
     /* Specialized procedures.  Add more here           */
     /* 000 processing must be forced...                 */
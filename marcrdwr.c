@@ -30,11 +30,17 @@
 #include "marcdefs.h"
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #ifdef DEBUG
 extern int g_recnum;
+void *marc_alloc(int, int);
+void marc_dealloc(void *, int);
 #endif
 
+static int blk_fill (MARCBLKP, size_t);
+
 int marc_read_rec (
     FILE          *fp,      /* Input file       */
     unsigned char *bufp,    /* Ptr to buffer    */
@@ -118,37 +124,315 @@ int marc_write_rec (
     FILE   *fp,     /* Output file                      */
     void   *marc    /* Marc record ctl or full marcrec  */
 ) {
-    int    stat;    /* Return from marc_get_record()    */
+    int    stat;    /* Return from marc_xpack()         */
     unsigned char
            *datap;  /* Ptr to packed record             */
     size_t datalen; /* Length of packed record          */
 
 
-    /* If we have an unpacked record, pack it */
-    if ((marc_xcheck ((MARCP) marc)) == 0) {
-        if ((stat = marc_get_record ((MARCP) marc, &datap, &datalen)) != 0)
+    /* Pack record if needed, else find length of passed one */
+    if ((stat = marc_xpack (marc, &datap, &datalen)) != 0)
+        return stat;
+
+    /* Write it to the output file */
+    if (fwrite (datap, datalen, 1, fp) != 1) {
+        printf("Failed write in %s: %d err %s\n", __FILE__, __LINE__, strerror(errno));
+        return MARC_ERR_WRITE;
+    }
+
+    return 0;
+
+} /* marc_write_rec */
+
+
+/************************************************************************
+* marc_blk_open ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Open a sequential marc file for block reading.                  *
+*                                                                       *
+*       marc_read_rec() does two small freads for every record.         *
+*       Instead, marc_blk_read() reads large blocks with a single       *
+*       read() and hands out the complete records found in them,        *
+*       carrying a record that crosses the end of a block over into     *
+*       the next one.                                                   *
+*                                                                       *
+*   PASS                                                                *
+*       Name of file to read.                                           *
+*       Block size, 0 = use default.                                    *
+*       Pointer to place to put handle for the file.                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_blk_open (
+    char          *fname,   /* File to read             */
+    size_t        blksize,  /* Bytes per read, 0=default*/
+    MARCBLKP      *blkpp    /* Put handle here          */
+) {
+    MARCBLKP      bp;       /* Handle to return         */
+    int           fd;       /* Descriptor to read       */
+
+
+    /* Will return null pointer if error */
+    *blkpp = NULL;
+
+    if (!blksize)
+        blksize = MARC_DFT_BLKSIZE;
+
+    if ((fd = open (fname, O_RDONLY)) < 0)
+        return MARC_ERR_BLK_OPEN;
+
+#ifdef DEBUG
+    bp = (MARCBLK *) marc_alloc (sizeof(MARCBLK), 1110);  //TAG:1110
+#else
+    bp = (MARCBLK *) malloc (sizeof(MARCBLK));
+#endif
+    if (!bp) {
+        close (fd);
+        return MARC_ERR_ALLOC;
+    }
+
+    /* Room for a full block after the largest possible carried over
+     *   partial record, plus one byte.  marc_old() copies the byte
+     *   following the record, which must at least be addressable.
+     */
+    bp->buflen = blksize + MARC_MAX_MARCDATA;
+#ifdef DEBUG
+    bp->bufp = (unsigned char *) marc_alloc (bp->buflen + 1, 1111);  //TAG:1111
+#else
+    bp->bufp = (unsigned char *) malloc (bp->buflen + 1);
+#endif
+    if (!bp->bufp) {
+        close (fd);
+#ifdef DEBUG
+        marc_dealloc (bp, 1112);  //TAG:1112
+#else
+        free (bp);
+#endif
+        return MARC_ERR_ALLOC;
+    }
+
+    bp->curp = bp->bufp;
+    bp->endp = bp->bufp;
+    bp->fd   = fd;
+    bp->eof  = 0;
+
+    *blkpp = bp;
+
+    return 0;
+
+} /* marc_blk_open */
+
+
+/************************************************************************
+* marc_blk_read ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Return the next record from a file opened by marc_blk_open().   *
+*                                                                       *
+*       The record is not copied out of the block buffer.  The          *
+*       returned pointer is only valid until the next call.  Unlike     *
+*       marc_read_rec(), the record is not null terminated.             *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_blk_open().                                    *
+*       Pointer to place to put pointer to record.                      *
+*       Pointer to place to put record length.                          *
+*                                                                       *
+*   RETURN                                                              *
+*       0   = Success.                                                  *
+*       EOF = End of file.                                              *
+*       Else error, using the same codes as marc_read_rec().            *
+************************************************************************/
+
+int marc_blk_read (
+    MARCBLKP      bp,       /* Block reader             */
+    unsigned char **recpp,  /* Put ptr to record here   */
+    size_t        *reclenp  /* Put length here          */
+) {
+    unsigned char *recp;    /* Start of this record     */
+    size_t        lrecl,    /* Logical record length    */
+                  i;        /* Loop counter             */
+    int           stat;     /* Return from blk_fill     */
+
+#ifdef DEBUG
+    g_recnum++;
+#endif
+
+    /* Need at least a leader */
+    if ((size_t) (bp->endp - bp->curp) < MARC_LEADER_LEN) {
+        if ((stat = blk_fill (bp, MARC_LEADER_LEN)) != 0)
             return stat;
+
+        /* Partial leader at end is end of file, as in marc_read_rec() */
+        if ((size_t) (bp->endp - bp->curp) < MARC_LEADER_LEN)
+            return EOF;
+    }
+
+    /* Get logical record length.
+     * If it isn't a number we can't find this record's end, or the
+     *   start of any other, so stop here for good.
+     */
+    recp = bp->curp;
+    for (i=0; i<MARC_RECLEN_LEN; i++) {
+        if (recp[MARC_RECLEN_OFF + i] < '0' || recp[MARC_RECLEN_OFF + i] > '9'){
+            bp->curp = bp->endp;
+            bp->eof  = 1;
+            return MARC_ERR_READ_LDR;
+        }
+    }
+    lrecl = marc_xnum (recp + MARC_RECLEN_OFF, MARC_RECLEN_LEN);
+    if (lrecl <= MARC_LEADER_LEN) {
+        bp->curp = bp->endp;
+        bp->eof  = 1;
+        return MARC_ERR_READ_LDR;
     }
-    else {
-        /* Point to passed record */
-        datap = (unsigned char *) marc;
 
-        /* Find length of record from logical record length at start */
-        datalen = marc_xnum (datap, 5);
+    /* Carry a record crossing the end of the block over into the next */
+    if ((size_t) (bp->endp - bp->curp) < lrecl) {
+        if ((stat = blk_fill (bp, lrecl)) != 0)
+            return stat;
 
-        /* Sanity check */
-        if (*((datap + datalen) - 1) != MARC_REC_TERM) {
-            printf("Failed sanity check in %s: %d\n", __FILE__, __LINE__);
-            return MARC_ERR_WRITE_TERM;
+        /* Incomplete record at end */
+        if ((size_t) (bp->endp - bp->curp) < lrecl) {
+            bp->curp = bp->endp;
+            return MARC_ERR_READ_INC;
         }
+        recp = bp->curp;
     }
 
-    /* Write it to the output file */
-    if (fwrite (datap, datalen, 1, fp) != 1) {
-        printf("Failed write in %s: %d err %s\n", __FILE__, __LINE__, strerror(errno));
-        return MARC_ERR_WRITE;
+    /* Consume the record whether or not it's any good */
+    bp->curp += lrecl;
+
+    /* Simple test of complete record */
+    if (recp[lrecl - 1] != MARC_REC_TERM)
+        return MARC_ERR_READ_TERM;
+
+    *recpp   = recp;
+    *reclenp = lrecl;
+
+    return 0;
+
+} /* marc_blk_read */
+
+
+/************************************************************************
+* blk_fill ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Move any unread data to the front of the block buffer and       *
+*       read until at least the requested amount is available, or       *
+*       end of file.  Each read asks for all the room left.             *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_blk_open().                                    *
+*       Bytes needed.                                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success, possibly with fewer bytes than needed at eof.      *
+*       Else error.                                                     *
+************************************************************************/
+
+static int blk_fill (
+    MARCBLKP      bp,       /* Block reader             */
+    size_t        need      /* Bytes needed             */
+) {
+    size_t        left;     /* Unread bytes in buffer   */
+    ssize_t       got;      /* Return from read()       */
+
+
+    /* Carry over unread part of last block */
+    left = (size_t) (bp->endp - bp->curp);
+    if (bp->curp != bp->bufp) {
+        memmove (bp->bufp, bp->curp, left);
+        bp->curp = bp->bufp;
+        bp->endp = bp->bufp + left;
+    }
+
+    while (left < need && !bp->eof) {
+        got = read (bp->fd, bp->endp, bp->buflen - left);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            return MARC_ERR_READ;
+        }
+        if (got == 0)
+            bp->eof = 1;
+        bp->endp += got;
+        left     += (size_t) got;
     }
 
     return 0;
 
-} /* marc_write_rec */
+} /* blk_fill */
+
+
+/************************************************************************
+* marc_blk_seek ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Position a block read file so the next marc_blk_read()          *
+*       returns the record at a given byte offset, e.g., one found      *
+*       by marc_idx_get().  Anything already read is discarded.         *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_blk_open().                                    *
+*       Byte offset of record.                                          *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_blk_seek (
+    MARCBLKP      bp,       /* Block reader             */
+    off_t         offset    /* Where next record starts */
+) {
+    if (lseek (bp->fd, offset, SEEK_SET) != offset)
+        return MARC_ERR_SEEK;
+
+    bp->curp = bp->bufp;
+    bp->endp = bp->bufp;
+    bp->eof  = 0;
+
+    return 0;
+
+} /* marc_blk_seek */
+
+
+/************************************************************************
+* marc_blk_close ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Close a file opened by marc_blk_open() and free its buffers.    *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_blk_open().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_blk_close (
+    MARCBLKP      bp        /* Block reader             */
+) {
+    int           stat;     /* Return from close        */
+
+
+    stat = close (bp->fd) ? MARC_ERR_READ : 0;
+
+#ifdef DEBUG
+    marc_dealloc (bp->bufp, 1113);  //TAG:1113
+    marc_dealloc (bp, 1112);        //TAG:1112
+#else
+    free (bp->bufp);
+    free (bp);
+#endif
+
+    return stat;
+
+} /* marc_blk_close */
@@ -46,6 +46,7 @@ int marc_rename_field (
 
     else {
         mp->fdirp[mp->cur_field].tag = new_id;
+        MARC_XTAG_STALE(mp)
         retcode = 0;
     }
 
@@ -12,6 +12,10 @@
 *       establishing a stack of saved positions, up to the              *
 *       maximum number of bit flags we support (31).                    *
 *                                                                       *
+*       The field position is also kept on a stack in the marcctl, so   *
+*       restoring it is normally immediate.  The bit is what makes      *
+*       it right after the directory has been rearranged.               *
+*                                                                       *
 *   PASS                                                                *
 *       Pointer to marcctl structure.                                   *
 *                                                                       *
@@ -52,8 +56,11 @@ int marc_save_pos (
         retcode = MARC_ERR_POS_STACK;
 
     else {
-        /* Set the bit on for the current count of saves */
+        /* Set the bit on for the current count of saves, and
+         *   remember where it is so we needn't look for it
+         */
         mp->fdirp[mp->cur_field].pos_bits |= (1 << mp->last_pos);
+        mp->pos_field[mp->last_pos] = mp->cur_field;
         ++mp->last_pos;
         retcode = 0;
     }
@@ -110,23 +117,32 @@ int marc_restore_pos (
         /* Default return code if position not found */
         retcode = MARC_RET_NO_SAVE_POS;
 
-        /* Search for our position */
-        fdp = mp->fdirp;
-        for (i=0; i<mp->field_count; i++) {
-            if (fdp->pos_bits & mask) {
+        /* Usually the field is still where it was saved, or where
+         *   marc_xdel_field() moved it.  Only if the directory was
+         *   sorted since do we have to search for it.
+         */
+        i = mp->pos_field[mp->last_pos];
+        if (i < 0 || i >= mp->field_count
+                  || !(mp->fdirp[i].pos_bits & mask)) {
+            fdp = mp->fdirp;
+            for (i=0; i<mp->field_count; i++) {
+                if (fdp->pos_bits & mask)
+                    break;
+                ++fdp;
+            }
+        }
 
-                /* Turn bit off in field dir entry */
-                mask = ~mask;
-                fdp->pos_bits &= mask;
+        if (i < mp->field_count) {
 
-                /* Set current position in marc control */
-                mp->cur_field = i;
+            /* Turn bit off in field dir entry */
+            mask = ~mask;
+            mp->fdirp[i].pos_bits &= mask;
 
-                /* Success */
-                retcode = 0;
-                break;
-            }
-            ++fdp;
+            /* Set current position in marc control */
+            mp->cur_field = i;
+
+            /* Success */
+            retcode = 0;
         }
     }
 
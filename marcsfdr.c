@@ -0,0 +1,193 @@
+/************************************************************************
+* marc_share_sfdir ()                                                   *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Have one marcctl parse fields into the same subfield directory  *
+*       as another, instead of its own.                                 *
+*                                                                       *
+*       A program that keeps many marcctls, but only looks into the     *
+*       subfields of one at a time, e.g., one thread's input, output    *
+*       and work records, needs only one directory for all of them.     *
+*                                                                       *
+*       They may still be used in any order.  Whenever one of them      *
+*       parses a field, the parse the others had is gone, and they      *
+*       quietly parse their field again the next time it's wanted,      *
+*       keeping their current subfield.  But no two of them may be      *
+*       used at the same time, i.e., by different threads.              *
+*                                                                       *
+*       The directory is freed by marc_free() of the last marcctl       *
+*       using it.  Copies made by marc_dup() use whatever directory     *
+*       the original uses, a marc_cursor() always has its own.          *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl to use the other's directory.                *
+*       Pointer to marcctl whose directory is to be shared.             *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include "marcdefs.h"
+
+#ifdef DEBUG
+void *marc_calloc(int, int, int);
+void marc_dealloc(void *, int);
+#endif
+
+int marc_share_sfdir (
+    MARCP   mp,             /* Pointer to marcctl       */
+    MARCP   withp           /* Share this one's sf dir  */
+) {
+    /* Test, return if failed */
+    MARC_XCHECK(mp)
+    MARC_XCHECK(withp)
+
+    /* A cursor's own directory is all it owns */
+    if (mp->cursor)
+        return MARC_ERR_SFD_SHARE;
+
+    if (mp->sfdp != withp->sfdp) {
+
+        /* Let go of the old one, freeing it if no one else has it */
+        marc_xsfd_free (mp->sfdp);
+
+        mp->sfdp = withp->sfdp;
+        ++mp->sfdp->users;
+
+        /* Any parse we had is from somewhere we can't see any more */
+        mp->sdirp        = mp->sfdp->sdirp;
+        mp->sfinp        = mp->sfdp;
+        mp->cur_sf_field = MARC_NO_FIELD;
+    }
+
+    return 0;
+
+} /* marc_share_sfdir */
+
+
+/************************************************************************
+* marc_xsfd_new ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Create a subfield directory with room for a typical field,      *
+*       used by one marcctl.                                            *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to place to put ptr to new directory.                       *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_xsfd_new (
+    MARCSFDIR **sfdpp       /* Put new directory here   */
+) {
+    MARCSFDIR *sfdp;        /* New directory            */
+
+
+#ifdef DEBUG
+    sfdp = (MARCSFDIR *) marc_calloc (sizeof(MARCSFDIR), 1, 1170);  //TAG:1170
+#else
+    sfdp = (MARCSFDIR *) calloc (sizeof(MARCSFDIR), 1);
+#endif
+    if (!sfdp)
+        return MARC_ERR_SFDIRALLOC;
+
+    if (marc_xallocate ((void **) &sfdp->sdirp, (void **) NULL,
+                        &sfdp->sf_max, MARC_DFT_SFDIRSIZE,
+                        sizeof(SFDIR)) != 0) {
+#ifdef DEBUG
+        marc_dealloc (sfdp, 1170);  //TAG:1170
+#else
+        free (sfdp);
+#endif
+        return MARC_ERR_SFDIRALLOC;
+    }
+    sfdp->users = 1;
+
+    *sfdpp = sfdp;
+
+    return 0;
+
+} /* marc_xsfd_new */
+
+
+/************************************************************************
+* marc_xsfd_room ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make room in a subfield directory for a field with a given      *
+*       number of entries, at least doubling it if it must grow, so a   *
+*       field is never parsed into more than a few sizes.               *
+*                                                                       *
+*       The directory may move.  Callers pick up the new sdirp.         *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to directory.                                               *
+*       Entries needed, indicators included.                            *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+int marc_xsfd_room (
+    MARCSFDIR *sfdp,        /* Directory to grow        */
+    size_t    need          /* Entries needed           */
+) {
+    size_t    newmax;       /* New number of entries    */
+
+
+    if (need <= sfdp->sf_max)
+        return 0;
+
+    /* marc_xsfdir() never uses more than this */
+    if (need > MARC_MAX_SFDIRSIZE + 1)
+        return MARC_ERR_MAX_SFS;
+
+    newmax = sfdp->sf_max * 2;
+    if (newmax < need)
+        newmax = need;
+    if (newmax > MARC_MAX_SFDIRSIZE + 1)
+        newmax = MARC_MAX_SFDIRSIZE + 1;
+
+    if (marc_xallocate ((void **) &sfdp->sdirp, (void **) NULL,
+                        &sfdp->sf_max, newmax, sizeof(SFDIR)) != 0)
+        return MARC_ERR_SFDIRALLOC;
+
+    return 0;
+
+} /* marc_xsfd_room */
+
+
+/************************************************************************
+* marc_xsfd_free ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Let go of a subfield directory, freeing it if no other          *
+*       marcctl is using it.                                            *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to directory, may be NULL.                                  *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+void marc_xsfd_free (
+    MARCSFDIR *sfdp         /* Directory to let go of   */
+) {
+    if (!sfdp || --sfdp->users > 0)
+        return;
+
+#ifdef DEBUG
+    marc_dealloc (sfdp->sdirp, 400);  //TAG:400
+    marc_dealloc (sfdp, 1170);        //TAG:1170
+#else
+    free (sfdp->sdirp);
+    free (sfdp);
+#endif
+
+} /* marc_xsfd_free */
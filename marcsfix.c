@@ -0,0 +1,221 @@
+/************************************************************************
+* marc_subfield_index ()                                                *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Turn the whole record subfield index on or off for all          *
+*       records controlled by a given marcctl structure.                *
+*                                                                       *
+*       Without it, subfields are found by parsing the current field    *
+*       into the subfield directory each time we move to a different    *
+*       field, so going back and forth between two fields parses both   *
+*       of them over and over.  With it, the first time any subfield    *
+*       is wanted, every variable field in the record is parsed in one  *
+*       pass into a compact index (see marcsfix in marcdefs.h), and     *
+*       moving to another field only copies its entries.  Records no    *
+*       one looks into are never parsed at all.                         *
+*                                                                       *
+*       Worth it for records whose fields are visited more than once,   *
+*       e.g., input records in conversions that test other fields.      *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to structure returned by marc_init.                     *
+*       Enable indicator:                                               *
+*           True (non-zero) = Use the index.                            *
+*           False (zero)    = Parse one field at a time (the default).  *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <string.h>
+#include "marcdefs.h"
+
+#ifdef DEBUG
+void *marc_calloc(int, int, int);
+#endif
+
+static int sfix_field (MARCP, MARCSFIX *, FLDDIR *);
+
+int marc_subfield_index (
+    MARCP   mp,             /* Pointer to structure     */
+    int     enable          /* True=Use the index       */
+) {
+    /* Test, return if failed */
+    MARC_XCHECK(mp)
+
+    /* Fields are always dropped from the index when they change,
+     *   whether it's in use or not, so whatever is there stays good
+     *   while it's off.
+     */
+    if (enable && !mp->sfixp) {
+#ifdef DEBUG
+        mp->sfixp = (MARCSFIX *) marc_calloc (sizeof(MARCSFIX), 1, 1140);  //TAG:1140
+#else
+        mp->sfixp = (MARCSFIX *) calloc (sizeof(MARCSFIX), 1);
+#endif
+        if (!mp->sfixp)
+            return MARC_ERR_SFDIRALLOC;
+        mp->sfixp->tail = MARC_NO_SFIX;
+    }
+
+    mp->sf_index = (enable) ? 1 : 0;
+
+    return 0;
+
+} /* marc_subfield_index */
+
+
+/************************************************************************
+* marc_xsfix ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make sure a field is in the whole record subfield index,        *
+*       parsing the whole record first if this is the first time        *
+*       it's been asked for.                                            *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl, with the index turned on.                   *
+*       Ptr to internal directory entry for a variable field.           *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Field's entries are at fdp->sfix_first.                     *
+*       Else it couldn't be indexed.  Parse it the old way, which       *
+*           will report any problem in the usual manner.                *
+************************************************************************/
+
+int marc_xsfix (
+    MARCP         mp,       /* Control for marc record  */
+    FLDDIR        *fdp      /* Field wanted             */
+) {
+    MARCSFIX      *ixp;     /* Subfield index           */
+    FLDDIR        *dp;      /* Ptr to each field        */
+    int           i;        /* Loop counter             */
+
+
+    ixp = mp->sfixp;
+
+    /* First use since marc_new(), parse all var fields in one go */
+    if (!ixp->built) {
+        ixp->count = 0;
+        ixp->tail  = MARC_NO_SFIX;
+        dp = mp->fdirp + 1;
+        for (i=1; i<mp->field_count; i++, dp++) {
+            if (dp->tag >= MARC_FIRST_VARFIELD)
+                sfix_field (mp, ixp, dp);
+        }
+        ixp->built = 1;
+    }
+
+    /* Added or changed since */
+    if (fdp->sfix_cnt == MARC_NO_SFIX)
+        return sfix_field (mp, ixp, fdp);
+
+    return 0;
+
+} /* marc_xsfix */
+
+
+/************************************************************************
+* sfix_field ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Parse one variable field into the subfield index, exactly as    *
+*       marc_xsfdir() would parse it into the subfield directory.       *
+*                                                                       *
+*       Anything unusual is left out for marc_xsfdir() to deal with:    *
+*       fields too short for indicators, fields with more subfields     *
+*       than the subfield directory holds, fields too long for our      *
+*       short offsets, and fields that won't fit in the index.          *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*       Ptr to its subfield index.                                      *
+*       Ptr to internal directory entry for the field.                  *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else field not indexed.                                         *
+************************************************************************/
+
+static int sfix_field (
+    MARCP         mp,       /* Control for marc record  */
+    MARCSFIX      *ixp,     /* Subfield index           */
+    FLDDIR        *fdp      /* Field to parse           */
+) {
+    SFIXENT       *ep;      /* Entry being filled       */
+    unsigned char *startp,  /* Start of field           */
+                  *endp,    /* Ptr after end of field   */
+                  *p;       /* Next delimiter           */
+    size_t        first,    /* Field's first entry      */
+                  newmax;   /* Bigger index             */
+    int           sf_count; /* Entries for field        */
+
+
+    fdp->sfix_cnt = MARC_NO_SFIX;
+    if (fdp->len < 2 || fdp->len > 0xffff)
+        return MARC_ERR_FIELDLEN;
+
+    /* The last field parsed can reuse its own space */
+    if (fdp->sfix_first != MARC_NO_SFIX && fdp->sfix_first == ixp->tail)
+        ixp->count = (size_t) ixp->tail;
+    first = ixp->count;
+
+    startp = mp->rawbufp + fdp->offset;
+    endp   = startp + fdp->len;
+
+    /* Indicators, then one entry per delimiter */
+    sf_count = 0;
+    p = startp;
+    while (p) {
+
+        /* Room for this entry */
+        if (first + sf_count >= ixp->max) {
+            newmax = ixp->max ? ixp->max * 2 : MARC_DFT_SFIXSIZE;
+            if (newmax > MARC_MAX_SFIXSIZE
+                    || marc_xallocate ((void **) &ixp->entp, (void **) NULL,
+                                       &ixp->max, newmax,
+                                       sizeof(SFIXENT)) != 0)
+                return MARC_ERR_SFDIRALLOC;
+        }
+        ep = ixp->entp + first + sf_count;
+
+        if (sf_count < 2) {
+            ep->offset = (unsigned short) sf_count;
+            ep->len    = 1;
+            ep->id     = (unsigned char) ((sf_count == 0) ?
+                                          MARC_INDIC1 : MARC_INDIC2);
+            if (++sf_count == 2)
+                p = (unsigned char *) memchr (startp + 2, MARC_SF_DELIM,
+                                              fdp->len - 2);
+            continue;
+        }
+
+        /* marc_xsfdir() refuses more than this */
+        if (sf_count > MARC_MAX_SFDIRSIZE)
+            return MARC_ERR_MAX_SFS;
+
+        /* Previous var subfield ends here */
+        if (sf_count > 2)
+            (ep-1)->len = (unsigned short) (p - (startp + (ep-1)->offset));
+
+        ep->offset = (unsigned short) (p - startp);
+        ep->id     = *(p + 1);
+        ++sf_count;
+
+        ++p;
+        p = (unsigned char *) memchr (p, MARC_SF_DELIM, (size_t) (endp - p));
+    }
+
+    /* Last one runs to the end of the field */
+    ep = ixp->entp + first + sf_count - 1;
+    ep->len = (unsigned short) (endp - (startp + ep->offset));
+
+    fdp->sfix_first = (int) first;
+    fdp->sfix_cnt   = sf_count;
+    ixp->count      = first + sf_count;
+    ixp->tail       = (int) first;
+
+    return 0;
+
+} /* sfix_field */
@@ -0,0 +1,395 @@
+/************************************************************************
+* marc_wrt_open ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Open a sequential marc file for output through a writer         *
+*       thread.                                                         *
+*                                                                       *
+*       marc_write_rec() does an fwrite for each record in the          *
+*       caller's thread, so any disk stall stops the caller.  Instead,  *
+*       marc_wrt_rec() packs records into a ring of large segments.     *
+*       A dedicated thread writes each full segment with one write(),   *
+*       while the caller goes on filling the next one.                  *
+*                                                                       *
+*       Write errors found by the thread are kept and returned by the   *
+*       next marc_wrt_rec(), marc_wrt_flush() or marc_wrt_close().      *
+*       Callers must check the return from marc_wrt_close(), as they    *
+*       would from fclose(), to be sure all data made it out.           *
+*                                                                       *
+*   PASS                                                                *
+*       Name of file to write.                                          *
+*       Mode, as for fopen().  "a..." appends, anything else            *
+*           truncates.                                                  *
+*       Segment size, 0 = use default.                                  *
+*       Pointer to place to put handle for the file.                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "marcdefs.h"
+
+#ifdef DEBUG
+void *marc_alloc(int, int);
+void *marc_calloc(int, int, int);
+void marc_dealloc(void *, int);
+#endif
+
+static void *wrt_thread (void *);
+static int  wrt_submit  (MARCWRTP);
+static void wrt_free    (MARCWRTP);
+
+int marc_wrt_open (
+    char          *fname,   /* File to write            */
+    char          *mode,    /* "wb" or "ab"             */
+    size_t        segsize,  /* Bytes per write, 0=dft   */
+    MARCWRTP      *wpp      /* Put handle here          */
+) {
+    MARCWRTP      wp;       /* Handle to return         */
+    int           flags,    /* For open()               */
+                  i;        /* Loop counter             */
+
+
+    /* Will return null pointer if error */
+    *wpp = NULL;
+
+    /* A segment must hold at least the largest record */
+    if (!segsize)
+        segsize = MARC_DFT_WRTSEG;
+    if (segsize < MARC_MAX_MARCDATA)
+        segsize = MARC_MAX_MARCDATA;
+
+#ifdef DEBUG
+    wp = (MARCWRT *) marc_calloc (sizeof(MARCWRT), 1, 1120);  //TAG:1120
+#else
+    wp = (MARCWRT *) calloc (sizeof(MARCWRT), 1);
+#endif
+    if (!wp)
+        return MARC_ERR_ALLOC;
+
+    wp->fd      = -1;
+    wp->segsize = segsize;
+    wp->nsegs   = MARC_DFT_WRTSEGS;
+    for (i=0; i<wp->nsegs; i++) {
+#ifdef DEBUG
+        wp->segp[i] = (unsigned char *) marc_alloc (segsize, 1121);  //TAG:1121
+#else
+        wp->segp[i] = (unsigned char *) malloc (segsize);
+#endif
+        if (!wp->segp[i]) {
+            wrt_free (wp);
+            return MARC_ERR_ALLOC;
+        }
+    }
+
+    flags = O_WRONLY | O_CREAT;
+    flags |= (*mode == 'a') ? O_APPEND : O_TRUNC;
+    if ((wp->fd = open (fname, flags, 0666)) < 0) {
+        wrt_free (wp);
+        return MARC_ERR_WRT_OPEN;
+    }
+
+    pthread_mutex_init (&wp->lock, NULL);
+    pthread_cond_init (&wp->cond, NULL);
+    if (pthread_create (&wp->thread, NULL, wrt_thread, wp) != 0) {
+        close (wp->fd);
+        wp->fd = -1;
+        pthread_mutex_destroy (&wp->lock);
+        pthread_cond_destroy (&wp->cond);
+        wrt_free (wp);
+        return MARC_ERR_WRT_THREAD;
+    }
+
+    *wpp = wp;
+
+    return 0;
+
+} /* marc_wrt_open */
+
+
+/************************************************************************
+* marc_wrt_rec ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Queue one marc record for output by the writer thread.          *
+*                                                                       *
+*       Records are written sequentially, without separators other      *
+*       than the standard marc record terminator.                       *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_wrt_open().                                    *
+*       Pointer to marc control for record to write, or to packed       *
+*           marc record.  We autodetect the difference.                 *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error, possibly from an earlier write by the thread.       *
+*       The record is not queued if there was an error.                 *
+************************************************************************/
+
+int marc_wrt_rec (
+    MARCWRTP      wp,       /* Writer                   */
+    void          *marc     /* Marc ctl or full marcrec */
+) {
+    unsigned char *datap;   /* Ptr to packed record     */
+    size_t        datalen;  /* Length of packed record  */
+    int           stat;     /* Return from marc_xpack() */
+
+
+    if ((stat = marc_xpack (marc, &datap, &datalen)) != 0)
+        return stat;
+
+    /* Won't fit, hand off this segment and start another.
+     * That's also when we find out about write errors.
+     */
+    if (datalen > wp->segsize - wp->seglen[wp->fill]) {
+        if ((stat = wrt_submit (wp)) != 0)
+            return stat;
+    }
+
+    memcpy (wp->segp[wp->fill] + wp->seglen[wp->fill], datap, datalen);
+    wp->seglen[wp->fill] += datalen;
+
+    return 0;
+
+} /* marc_wrt_rec */
+
+
+/************************************************************************
+* marc_wrt_flush ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Wait until everything queued so far has been written.           *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_wrt_open().                                    *
+*       True = also fdatasync() the file.                               *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else first write error seen since open.                         *
+************************************************************************/
+
+int marc_wrt_flush (
+    MARCWRTP      wp,       /* Writer                   */
+    int           sync      /* True=fdatasync too       */
+) {
+    int           stat;     /* Return code              */
+
+
+    if (wp->seglen[wp->fill])
+        wrt_submit (wp);
+
+    pthread_mutex_lock (&wp->lock);
+    while (wp->queued)
+        pthread_cond_wait (&wp->cond, &wp->lock);
+    stat = wp->err;
+    pthread_mutex_unlock (&wp->lock);
+
+    /* Thread is idle now, safe to sync from here */
+    if (!stat && sync && fdatasync (wp->fd) != 0) {
+        stat = MARC_ERR_WRITE;
+        pthread_mutex_lock (&wp->lock);
+        wp->err = stat;
+        pthread_mutex_unlock (&wp->lock);
+    }
+
+    return stat;
+
+} /* marc_wrt_flush */
+
+
+/************************************************************************
+* marc_wrt_close ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Flush all queued records, stop the writer thread, close the     *
+*       file and free the handle.                                       *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_wrt_open().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else first write or close error.                                *
+************************************************************************/
+
+int marc_wrt_close (
+    MARCWRTP      wp        /* Writer                   */
+) {
+    int           stat;     /* Return code              */
+
+
+    stat = marc_wrt_flush (wp, 0);
+
+    pthread_mutex_lock (&wp->lock);
+    wp->stop = 1;
+    pthread_cond_broadcast (&wp->cond);
+    pthread_mutex_unlock (&wp->lock);
+    pthread_join (wp->thread, NULL);
+
+    if (close (wp->fd) != 0 && !stat)
+        stat = MARC_ERR_WRITE;
+    wp->fd = -1;
+
+    pthread_mutex_destroy (&wp->lock);
+    pthread_cond_destroy (&wp->cond);
+    wrt_free (wp);
+
+    return stat;
+
+} /* marc_wrt_close */
+
+
+/************************************************************************
+* wrt_submit ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Queue the segment being filled for the writer thread and        *
+*       move on to the next one, waiting for it to be written if        *
+*       the whole ring is in use.                                       *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_wrt_open().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else first write error seen by the thread.                      *
+************************************************************************/
+
+static int wrt_submit (
+    MARCWRTP      wp        /* Writer                   */
+) {
+    int           stat;     /* Thread's error so far    */
+
+
+    pthread_mutex_lock (&wp->lock);
+
+    /* Queued segments always run from head up to fill */
+    ++wp->queued;
+    pthread_cond_broadcast (&wp->cond);
+
+    wp->fill = (wp->fill + 1) % wp->nsegs;
+    while (wp->queued == wp->nsegs)
+        pthread_cond_wait (&wp->cond, &wp->lock);
+    stat = wp->err;
+
+    pthread_mutex_unlock (&wp->lock);
+
+    wp->seglen[wp->fill] = 0;
+
+    return stat;
+
+} /* wrt_submit */
+
+
+/************************************************************************
+* wrt_thread ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Writer thread.  Write queued segments in order until told to    *
+*       stop.                                                           *
+*                                                                       *
+*       After a write error, segments are still taken off the queue,    *
+*       but discarded, so the caller never waits forever.  The error    *
+*       is kept in the handle for the caller to find.                   *
+*                                                                       *
+*   PASS                                                                *
+*       Handle from marc_wrt_open().                                    *
+*                                                                       *
+*   RETURN                                                              *
+*       NULL.                                                           *
+************************************************************************/
+
+static void *wrt_thread (
+    void          *argp     /* Writer                   */
+) {
+    MARCWRTP      wp;       /* Writer                   */
+    unsigned char *datap;   /* Next byte to write       */
+    size_t        left;     /* Bytes left in segment    */
+    ssize_t       done;     /* Return from write()      */
+    int           err;      /* Error so far             */
+
+
+    wp = (MARCWRTP) argp;
+
+    pthread_mutex_lock (&wp->lock);
+    for (;;) {
+        while (!wp->queued && !wp->stop)
+            pthread_cond_wait (&wp->cond, &wp->lock);
+        if (!wp->queued)
+            break;
+
+        /* Nobody touches a queued segment but us */
+        datap = wp->segp[wp->head];
+        left  = wp->seglen[wp->head];
+        err   = wp->err;
+        pthread_mutex_unlock (&wp->lock);
+
+        while (left && !err) {
+            if ((done = write (wp->fd, datap, left)) < 0) {
+                if (errno == EINTR)
+                    continue;
+                err = MARC_ERR_WRITE;
+                break;
+            }
+            datap += done;
+            left  -= (size_t) done;
+        }
+
+        pthread_mutex_lock (&wp->lock);
+        wp->err  = err;
+        wp->head = (wp->head + 1) % wp->nsegs;
+        --wp->queued;
+        pthread_cond_broadcast (&wp->cond);
+    }
+    pthread_mutex_unlock (&wp->lock);
+
+    return NULL;
+
+} /* wrt_thread */
+
+
+/************************************************************************
+* wrt_free ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Free the segments and the handle.                               *
+*                                                                       *
+*   PASS                                                                *
+*       Handle, possibly only partly built by marc_wrt_open().          *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void wrt_free (
+    MARCWRTP      wp        /* Writer                   */
+) {
+    int           i;        /* Loop counter             */
+
+
+    if (wp->fd >= 0)
+        close (wp->fd);
+
+    for (i=0; i<wp->nsegs; i++) {
+        if (wp->segp[i]) {
+#ifdef DEBUG
+            marc_dealloc (wp->segp[i], 1122);  //TAG:1122
+#else
+            free (wp->segp[i]);
+#endif
+        }
+    }
+#ifdef DEBUG
+    marc_dealloc (wp, 1123);  //TAG:1123
+#else
+    free (wp);
+#endif
+
+} /* wrt_free */
@@ -35,17 +35,9 @@ int marc_xcheck_data (
     unsigned char *datap,   /* Pointer to data                  */
     size_t        datalen   /* Length, 1..n                     */
 ) {
-    unsigned char *p;       /* Ptr into data                    */
-    size_t        i;        /* Length counter                   */
-
-
     /* A simple check for reserved MARC delimiters */
-    p = datap;
-    for (i=0; i<datalen; i++) {
-        if (*p <= MARC_SF_DELIM && *p >= MARC_REC_TERM)
-            return MARC_ERR_BAD_CHAR;
-        ++p;
-    }
+    if (marc_xscan_resv (datap, datap + datalen) != datap + datalen)
+        return MARC_ERR_BAD_CHAR;
 
     /* Put anything else desired here */
 
@@ -29,32 +29,91 @@
 
 #include "marcdefs.h"
 
+/* "00" through "99", for turning numbers into digits two at a time */
+static const char S_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
 unsigned int marc_xnum (
     unsigned char *startp,  /* Ptr to start of digit string */
     int           digits    /* Number of digits in string   */
 ) {
-    unsigned char *digitp;  /* Ptr to single digit          */
-    int           i;        /* Loop counter                 */
-    unsigned int  mult,     /* Multiplier for digit position*/
-                  num;      /* Return value                 */
-
-
-    /* Point after last digit in string */
-    digitp = startp + digits;
+    unsigned int  num;      /* Return value                 */
 
-    /* Initial sum and multiplier */
-    num  = 0;
-    mult = 1;
 
-    /* Loop through digits */
-    for (i=0; i<digits; i++) {
+    /* Directory and leader numbers are 3, 4 or 5 digits.
+     * Those are done without a loop, longest first falling through.
+     */
+    num = 0;
+    switch (digits) {
+        case 5:
+            num = *startp++ - '0';
+            /* fall through */
+        case 4:
+            num = num * 10 + (*startp++ - '0');
+            /* fall through */
+        case 3:
+            num = num * 10 + (*startp++ - '0');
+            num = num * 10 + (*startp++ - '0');
+            num = num * 10 + (*startp   - '0');
+            break;
 
-        /* Move left and convert */
-        --digitp;
-        num += (*digitp - '0') * mult;
-        mult *= 10;
+        default:
+            while (digits-- > 0)
+                num = num * 10 + (*startp++ - '0');
     }
 
     return (num);
 
 } /* marc_xnum */
+
+
+/************************************************************************
+* marc_xputnum ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Convert a binary number to ASCII digits for the leader or       *
+*       directory of a marc record.  The reverse of marc_xnum().        *
+*                                                                       *
+*       Used instead of sprintf() when building records, where it's     *
+*       called three times for every field.  Digits are taken two at    *
+*       a time from a table, right to left.                             *
+*                                                                       *
+*   ASSUMPTIONS                                                         *
+*       The number fits in the digits.  If not, only the low order      *
+*       digits are stored.  No null terminator is added.                *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to place to put the digits.                             *
+*       Number to convert.                                              *
+*       Number of digits, zero filled on the left.                      *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+void marc_xputnum (
+    unsigned char *startp,  /* Put digit string here        */
+    unsigned int  num,      /* Number to convert            */
+    int           digits    /* Number of digits in string   */
+) {
+    unsigned char *digitp;  /* Ptr after next pair to store */
+    const char    *pairp;   /* Ptr to pair in table         */
+
+
+    /* Point after last digit in string, and work left */
+    digitp = startp + digits;
+
+    while (digits >= 2) {
+        pairp     = S_pairs + (num % 100) * 2;
+        *--digitp = pairp[1];
+        *--digitp = pairp[0];
+        num      /= 100;
+        digits   -= 2;
+    }
+
+    if (digits)
+        *--digitp = (unsigned char) ('0' + num % 10);
+
+} /* marc_xputnum */
@@ -0,0 +1,50 @@
+/************************************************************************
+* marc_xpack ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find the packed form of a record passed to one of the record    *
+*       writing routines, packing it first if necessary.                *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marc control for record to write, or to packed       *
+*           marc record.  We autodetect the difference.                 *
+*       Pointer to place to put pointer to packed record.               *
+*       Pointer to place to put its length.                             *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include "marcdefs.h"
+
+int marc_xpack (
+    void          *marc,    /* Marc record ctl or full marcrec  */
+    unsigned char **datapp, /* Put ptr to packed record here    */
+    size_t        *lenp     /* Put length of packed record here */
+) {
+    int           stat;     /* Return from marc_get_record()    */
+
+
+    /* If we have an unpacked record, pack it */
+    if ((marc_xcheck ((MARCP) marc)) == 0) {
+        if ((stat = marc_get_record ((MARCP) marc, datapp, lenp)) != 0)
+            return stat;
+    }
+    else {
+        /* Point to passed record */
+        *datapp = (unsigned char *) marc;
+
+        /* Find length of record from logical record length at start */
+        *lenp = marc_xnum (*datapp, 5);
+
+        /* Sanity check */
+        if (*((*datapp + *lenp) - 1) != MARC_REC_TERM) {
+            printf("Failed sanity check in %s: %d\n", __FILE__, __LINE__);
+            return MARC_ERR_WRITE_TERM;
+        }
+    }
+
+    return 0;
+
+} /* marc_xpack */
@@ -0,0 +1,68 @@
+/************************************************************************
+* marc_xraw_field ()                                                    *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Tell if a field can be copied to another record as raw bytes,   *
+*       i.e., if copying it subfield by subfield with marc_add_field()  *
+*       and marc_add_subfield() would pass all the same checks and      *
+*       produce exactly the same bytes.                                 *
+*                                                                       *
+*       It can't if there is a bad subfield code, a reserved character  *
+*       anywhere but a subfield delimiter, data between the indicators  *
+*       and the first subfield, more subfields than marc_xsfdir() can   *
+*       handle, or a var field longer than marc_add_subfield() allows.  *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*       Ptr to its internal directory entry for the field.              *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Field can be copied raw.                                    *
+*       MARC_RET_RAW_SUBFLD = It must be copied by subfield.            *
+************************************************************************/
+
+#include "marcdefs.h"
+
+int marc_xraw_field (
+    MARCP         mp,       /* Control for marc record  */
+    FLDDIR        *dp       /* Field to check           */
+) {
+    unsigned char *p,       /* Ptr for scan             */
+                  *endp;    /* Ptr after end of field   */
+    int           i,        /* Loop counter             */
+                  sf_count; /* Subfields found          */
+
+
+    p    = mp->rawbufp + dp->offset;
+    endp = p + dp->len;
+
+    /* Var field must have good indicators, followed by nothing or
+     *   a subfield
+     */
+    if (dp->tag >= MARC_FIRST_VARFIELD) {
+        if (dp->len < 2 || dp->len > MARC_MAX_VARLEN)
+            return MARC_RET_RAW_SUBFLD;
+        for (i=0; i<2; i++, p++)
+            if (*p <= MARC_SF_DELIM && *p >= MARC_REC_TERM)
+                return MARC_RET_RAW_SUBFLD;
+        if (p < endp && *p != MARC_SF_DELIM)
+            return MARC_RET_RAW_SUBFLD;
+    }
+
+    /* No reserved chars in the rest except delimiters before a good
+     *   subfield code.  In a fixed field, no delimiters at all.
+     */
+    sf_count = 2;
+    for (; (p = marc_xscan_resv (p, endp)) < endp; p++) {
+        if (*p != MARC_SF_DELIM || dp->tag < MARC_FIRST_VARFIELD)
+            return MARC_RET_RAW_SUBFLD;
+        if (p + 1 >= endp || marc_ok_subfield (*(p + 1)) != 0)
+            return MARC_RET_RAW_SUBFLD;
+        if (sf_count++ > MARC_MAX_SFDIRSIZE)
+            return MARC_RET_RAW_SUBFLD;
+        ++p;
+    }
+
+    return 0;
+
+} /* marc_xraw_field */
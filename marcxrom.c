@@ -0,0 +1,207 @@
+/************************************************************************
+* marc_xroom ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make room in the raw buffer for a field to grow.                *
+*                                                                       *
+*       Each field owns FLDDIR.room bytes at its offset, at least its   *
+*       length.  Fields don't have to be in the raw buffer in any       *
+*       order, or next to each other, so a field that needs more room   *
+*       than it has is moved to the end of the buffer, with spare room  *
+*       as big as itself, leaving a hole where it was.  Nothing else    *
+*       moves, so adding to a field costs about what's added, no        *
+*       matter where the field is in the record.                        *
+*                                                                       *
+*       The field that ends the buffer just grows in place.  Records    *
+*       built a field at a time are laid out just as they always were.  *
+*                                                                       *
+*       When holes would take up half the buffer, all fields are        *
+*       packed together again instead, with this one last.              *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*       Ptr to directory entry for field.                               *
+*       Number of bytes to be added to it.                              *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.  Field may have moved, get its offset again.       *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <string.h>
+#include "marcdefs.h"
+
+#ifdef DEBUG
+void *marc_alloc(int, int);
+void marc_dealloc(void *, int);
+#endif
+
+static int xroom_buf  (MARCP, size_t);
+static int xroom_pack (MARCP, FLDDIR *);
+
+int marc_xroom (
+    MARCP   mp,             /* Pointer to structure     */
+    FLDDIR  *dp,            /* Field to grow            */
+    size_t  add_len         /* By this many bytes       */
+) {
+    size_t  need,           /* Room it must have        */
+            newroom;        /* Room if moved            */
+    int     stat;           /* Return code              */
+
+
+    need = dp->len + add_len;
+    if (need <= dp->room)
+        return 0;
+
+    /* Anywhere but the end of the buffer, move it there */
+    if (dp->offset + dp->room != mp->raw_datalen) {
+
+        newroom = need + ((need > MARC_DFT_FLDSLACK) ?
+                          need : MARC_DFT_FLDSLACK);
+
+        /* Pack instead if holes pile up, or we're near the limit */
+        if (mp->raw_holes + dp->room > mp->raw_datalen / 2
+                || mp->raw_datalen + newroom + 1 > (size_t) MARC_MAX_MARCDATA) {
+            if ((stat = xroom_pack (mp, dp)) != 0)
+                return stat;
+        }
+
+        else {
+            if ((stat = xroom_buf (mp, mp->raw_datalen + newroom)) != 0)
+                return stat;
+            memcpy (mp->rawbufp + mp->raw_datalen, mp->rawbufp + dp->offset,
+                    dp->len);
+            mp->raw_holes   += dp->room;
+            dp->offset       = mp->raw_datalen;
+            dp->room         = newroom;
+            mp->raw_datalen += newroom;
+
+            /* Subfield directory points at the old copy */
+            mp->cur_sf_field = MARC_NO_FIELD;
+
+            return 0;
+        }
+    }
+
+    /* Last field in the buffer, grow it in place */
+    if (dp->offset + need + 1 > (size_t) MARC_MAX_MARCDATA)
+        return MARC_ERR_RECLEN;
+    if ((stat = xroom_buf (mp, dp->offset + need)) != 0)
+        return stat;
+    dp->room        = need;
+    mp->raw_datalen = dp->offset + need;
+
+    return 0;
+
+} /* marc_xroom */
+
+
+/************************************************************************
+* xroom_buf ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make the raw buffer big enough for a given amount of data,      *
+*       plus the one byte marc_add_subfield() has always left after     *
+*       it.  The buffer is at least doubled each time it grows.         *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*       Bytes of data it must hold.                                     *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int xroom_buf (
+    MARCP   mp,             /* Pointer to structure     */
+    size_t  datalen         /* Data it must hold        */
+) {
+    size_t  newlen;         /* New buffer size          */
+
+
+    if (datalen < mp->raw_buflen)
+        return 0;
+
+    newlen = mp->raw_buflen * 2;
+    if (newlen < datalen + 1 || newlen > (size_t) MARC_MAX_MARCDATA)
+        newlen = datalen + 1;
+
+    if (marc_xallocate ((void **) &mp->rawbufp, (void **) &mp->endrawp,
+                        &mp->raw_buflen, newlen, sizeof(unsigned char)) != 0)
+        return MARC_ERR_RAWALLOC;
+
+    return 0;
+
+} /* xroom_buf */
+
+
+/************************************************************************
+* xroom_pack ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Pack all fields together in a new raw buffer, in directory      *
+*       order except for one, which goes last so it can grow in place.  *
+*       Holes, spare room, and any terminators left from marc_old()     *
+*       are all squeezed out.                                           *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*       Ptr to directory entry for field to put last.                   *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int xroom_pack (
+    MARCP   mp,             /* Pointer to structure     */
+    FLDDIR  *lastdp         /* Field to put at the end  */
+) {
+    FLDDIR  *dp;            /* Ptr to each field        */
+    unsigned char *newp,    /* New raw buffer           */
+            *destp;         /* Next field goes here     */
+    int     i;              /* Loop counter             */
+
+
+#ifdef DEBUG
+    if ((newp = (unsigned char *) marc_alloc (mp->raw_buflen, 1150)) == NULL) //TAG:1150
+        return MARC_ERR_RAWALLOC;
+#else
+    if ((newp = (unsigned char *) malloc (mp->raw_buflen)) == NULL)
+        return MARC_ERR_RAWALLOC;
+#endif
+
+    destp = newp;
+    dp    = mp->fdirp;
+    for (i=0; i<=mp->field_count; i++, dp++) {
+
+        /* Save the one wanted last for last */
+        if (i == mp->field_count)
+            dp = lastdp;
+        else if (dp == lastdp)
+            continue;
+
+        memcpy (destp, mp->rawbufp + dp->offset, dp->len);
+        dp->offset = (size_t) (destp - newp);
+        dp->room   = dp->len;
+        destp     += dp->len;
+    }
+
+#ifdef DEBUG
+    marc_dealloc (mp->rawbufp, 1151);  //TAG:1151
+#else
+    free (mp->rawbufp);
+#endif
+
+    mp->rawbufp      = newp;
+    mp->endrawp      = newp + mp->raw_buflen;
+    mp->raw_datalen  = (size_t) (destp - newp);
+    mp->raw_holes    = 0;
+
+    /* Subfield directory points into the old buffer */
+    mp->cur_sf_field = MARC_NO_FIELD;
+
+    return 0;
+
+} /* xroom_pack */
@@ -0,0 +1,264 @@
+/************************************************************************
+* marcxscn.c                                                            *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Byte scanning kernels for parsing records.                      *
+*                                                                       *
+*       Finding subfield delimiters and other reserved characters in    *
+*       field data, and checking that a directory is all digits, are    *
+*       done here 16 bytes at a time with SSE2, or 32 at a time with    *
+*       AVX2 if the cpu we're running on has it, which is decided once  *
+*       when the program starts.  Runs too short to be worth it, and    *
+*       whatever is left over at the end, less than a full block, are   *
+*       done a byte at a time, as is everything on machines without     *
+*       them or when compiled with -DMARC_NO_SIMD.  All ways give the   *
+*       same result.                                                    *
+*                                                                       *
+*       This file is always compiled with optimization, see             *
+*       CMakeLists.txt.  Without it the kernels cost more than they     *
+*       save.                                                           *
+*                                                                       *
+*       We never read past the end of what we're given.  Records from   *
+*       marc_old_map() may end right at the end of a mapped file.       *
+************************************************************************/
+
+#include "marcdefs.h"
+
+#if !defined(MARC_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__) \
+        && (defined(__x86_64__) || defined(__i386__))
+#define MARC_SIMD
+#include <immintrin.h>
+#endif
+
+/* True if a byte is one of MARC_REC_TERM, MARC_FIELD_TERM, MARC_SF_DELIM */
+#define IS_RESV(c)  ((unsigned char) ((c) - MARC_REC_TERM) <= \
+                        MARC_SF_DELIM - MARC_REC_TERM)
+
+/* True if a byte is an ascii digit */
+#define IS_DIGIT(c) ((unsigned char) ((c) - '0') <= 9)
+
+#ifdef MARC_SIMD
+
+/* Bytes done at once by each kernel */
+#define SSE_BLOCK   16
+#define AVX_BLOCK   32
+
+/* Runs shorter than this go a byte at a time */
+#define SIMD_MIN    (4 * SSE_BLOCK)
+
+/* Kernels in use, see pick_kernels() */
+static unsigned char *sse2_resv     (unsigned char *, unsigned char *);
+static unsigned char *sse2_digits   (unsigned char *, unsigned char *);
+static unsigned char *(*S_resv)     (unsigned char *, unsigned char *)
+                                        = sse2_resv;
+static unsigned char *(*S_digits)   (unsigned char *, unsigned char *)
+                                        = sse2_digits;
+
+/************************************************************************
+* SSE2 and AVX2 kernels                                                 *
+*                                                                       *
+*   Each byte has the low end of its range subtracted, then is in the   *
+*   range if unsigned min(byte, span) leaves it alone.  The comparison  *
+*   gives a bit per byte, the first one set (or clear) is our answer.   *
+*                                                                       *
+*   The AVX2 ones finish with SSE2 on what's left.                      *
+************************************************************************/
+
+static unsigned char *sse2_resv (
+    unsigned char *p,       /* Start of scan            */
+    unsigned char *endp     /* Ptr after end            */
+) {
+    __m128i       low,      /* MARC_REC_TERM in each    */
+                  span,     /* Width of range in each   */
+                  v;        /* Block being tested       */
+    unsigned int  mask;     /* Bit per reserved byte    */
+
+
+    low  = _mm_set1_epi8 (MARC_REC_TERM);
+    span = _mm_set1_epi8 (MARC_SF_DELIM - MARC_REC_TERM);
+    while (endp - p >= SSE_BLOCK) {
+        v    = _mm_sub_epi8 (_mm_loadu_si128 ((__m128i *) p), low);
+        mask = (unsigned int) _mm_movemask_epi8 (
+                    _mm_cmpeq_epi8 (_mm_min_epu8 (v, span), v));
+        if (mask)
+            return p + __builtin_ctz (mask);
+        p += SSE_BLOCK;
+    }
+
+    return p;
+
+} /* sse2_resv */
+
+
+static unsigned char *sse2_digits (
+    unsigned char *p,       /* Start of scan            */
+    unsigned char *endp     /* Ptr after end            */
+) {
+    __m128i       low,      /* '0' in each              */
+                  span,     /* 9 in each                */
+                  v;        /* Block being tested       */
+    unsigned int  mask;     /* Bit per digit            */
+
+
+    low  = _mm_set1_epi8 ('0');
+    span = _mm_set1_epi8 (9);
+    while (endp - p >= SSE_BLOCK) {
+        v    = _mm_sub_epi8 (_mm_loadu_si128 ((__m128i *) p), low);
+        mask = (unsigned int) _mm_movemask_epi8 (
+                    _mm_cmpeq_epi8 (_mm_min_epu8 (v, span), v));
+        if (mask != 0xffff)
+            return p + __builtin_ctz (~mask);
+        p += SSE_BLOCK;
+    }
+
+    return p;
+
+} /* sse2_digits */
+
+
+__attribute__((target("avx2")))
+static unsigned char *avx2_resv (
+    unsigned char *p,       /* Start of scan            */
+    unsigned char *endp     /* Ptr after end            */
+) {
+    __m256i       low,      /* MARC_REC_TERM in each    */
+                  span,     /* Width of range in each   */
+                  v;        /* Block being tested       */
+    unsigned int  mask;     /* Bit per reserved byte    */
+
+
+    low  = _mm256_set1_epi8 (MARC_REC_TERM);
+    span = _mm256_set1_epi8 (MARC_SF_DELIM - MARC_REC_TERM);
+    while (endp - p >= AVX_BLOCK) {
+        v    = _mm256_sub_epi8 (_mm256_loadu_si256 ((__m256i *) p), low);
+        mask = (unsigned int) _mm256_movemask_epi8 (
+                    _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, span), v));
+        if (mask)
+            return p + __builtin_ctz (mask);
+        p += AVX_BLOCK;
+    }
+
+    return sse2_resv (p, endp);
+
+} /* avx2_resv */
+
+
+__attribute__((target("avx2")))
+static unsigned char *avx2_digits (
+    unsigned char *p,       /* Start of scan            */
+    unsigned char *endp     /* Ptr after end            */
+) {
+    __m256i       low,      /* '0' in each              */
+                  span,     /* 9 in each                */
+                  v;        /* Block being tested       */
+    unsigned int  mask;     /* Bit per digit            */
+
+
+    low  = _mm256_set1_epi8 ('0');
+    span = _mm256_set1_epi8 (9);
+    while (endp - p >= AVX_BLOCK) {
+        v    = _mm256_sub_epi8 (_mm256_loadu_si256 ((__m256i *) p), low);
+        mask = (unsigned int) _mm256_movemask_epi8 (
+                    _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, span), v));
+        if (mask != 0xffffffff)
+            return p + __builtin_ctz (~mask);
+        p += AVX_BLOCK;
+    }
+
+    return sse2_digits (p, endp);
+
+} /* avx2_digits */
+
+
+/************************************************************************
+* pick_kernels ()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Use the AVX2 kernels if the cpu has AVX2.  Run once, before     *
+*       main(), so scans don't ask again and threads never race here.   *
+************************************************************************/
+
+__attribute__((constructor))
+static void pick_kernels (void)
+{
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+        S_resv   = avx2_resv;
+        S_digits = avx2_digits;
+    }
+
+} /* pick_kernels */
+
+#endif /* MARC_SIMD */
+
+
+/************************************************************************
+* marc_xscan_resv ()                                                    *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find the first reserved character, i.e., a record terminator,   *
+*       field terminator, or subfield delimiter, in a run of bytes.     *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to first byte to look at.                                   *
+*       Ptr after last.                                                 *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to first reserved char, or endp if none.                    *
+************************************************************************/
+
+unsigned char *marc_xscan_resv (
+    unsigned char *p,       /* Start of scan            */
+    unsigned char *endp     /* Ptr after end            */
+) {
+#ifdef MARC_SIMD
+    if (endp - p >= SIMD_MIN) {
+        p = (*S_resv) (p, endp);
+        if (p < endp && IS_RESV(*p))
+            return p;
+    }
+#endif
+
+    for (; p < endp; p++)
+        if (IS_RESV(*p))
+            break;
+
+    return p;
+
+} /* marc_xscan_resv */
+
+
+/************************************************************************
+* marc_xscan_digits ()                                                  *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find the first byte that isn't an ascii digit in a run of       *
+*       bytes, e.g., to check a record directory.                       *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to first byte to look at.                                   *
+*       Ptr after last.                                                 *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to first non-digit, or endp if they're all digits.          *
+************************************************************************/
+
+unsigned char *marc_xscan_digits (
+    unsigned char *p,       /* Start of scan            */
+    unsigned char *endp     /* Ptr after end            */
+) {
+#ifdef MARC_SIMD
+    if (endp - p >= SIMD_MIN) {
+        p = (*S_digits) (p, endp);
+        if (p < endp && !IS_DIGIT(*p))
+            return p;
+    }
+#endif
+
+    for (; p < endp; p++)
+        if (!IS_DIGIT(*p))
+            break;
+
+    return p;
+
+} /* marc_xscan_digits */
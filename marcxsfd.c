@@ -9,6 +9,11 @@
 *       multiple times, and is also used in sorting subfields within    *
 *       a field.                                                        *
 *                                                                       *
+*       The directory grows as needed, see marc_xsfd_room().  It may    *
+*       be shared with other marcctls, see marc_share_sfdir(), and if   *
+*       one of them has parsed into it since we did, our field is       *
+*       parsed again, keeping the current subfield.                     *
+*                                                                       *
 *   PASS                                                                *
 *       Pointer to marcctl.                                             *
 *                                                                       *
@@ -33,7 +38,10 @@ int marc_xsfdir (
                   *datap;       /* Ptr to subfield data     */
     FLDDIR        *fdp;         /* Ptr to current field dir */
     SFDIR         *sdp;         /* Ptr to sf directory entry*/
+    SFIXENT       *ixp;         /* Ptr to sf index entry    */
+    MARCSFDIR     *sfdp;        /* Directory we parse into  */
     int           sf_count,     /* Count of subfields       */
+                  cur_sf,       /* Current sf after parse   */
                   retcode;      /* Return code              */
 
 
@@ -50,21 +58,63 @@ int marc_xsfdir (
      *   they have changed something which can affect this.
      *   See marc_add_field() and marc_add_sub_field().
      */
-    if (mp->cur_sf_field != mp->cur_field) {
+    if (mp->cur_sf_field != mp->cur_field || mp->sfinp->gen != mp->sf_gen) {
+
+        /* Same field parsed again, because someone else parsed into
+         *   the directory, stays on the same subfield
+         */
+        cur_sf = (mp->cur_sf_field == mp->cur_field) ? mp->cur_sf : -1;
 
         /* Point to field directory */
         fdp = mp->fdirp + mp->cur_field;
         mp->cur_sf_field = mp->cur_field;
 
-        /* Control fields have no subfields */
+        /* Parse into our own directory.  A marc_cursor() may have been
+         *   borrowing the record's until now.
+         */
+        sfdp = mp->sfdp;
+        mp->sfinp = sfdp;
+
+        /* Control fields have no subfields, nothing goes in it */
         if (fdp->tag < MARC_FIRST_VARFIELD) {
+            mp->sf_gen   = sfdp->gen;
             mp->sf_count = 0;
             return MARC_ERR_CTLFIELD;
         }
 
-        /* Initialize pointers and counter */
+        /* Anyone else's parse in it is gone */
+        mp->sf_gen = ++sfdp->gen;
+
+        /* Copy it from the whole record index if we can */
+        if (mp->sf_index && marc_xsfix (mp, fdp) == 0) {
+            if ((retcode = marc_xsfd_room (sfdp, fdp->sfix_cnt)) != 0) {
+                mp->cur_sf_field = MARC_NO_FIELD;
+                return retcode;
+            }
+            mp->sdirp = sfdp->sdirp;
+            ixp  = mp->sfixp->entp + fdp->sfix_first;
+            sdp  = mp->sdirp;
+            for (sf_count=0; sf_count<fdp->sfix_cnt; sf_count++) {
+                sdp->startp = mp->rawbufp + fdp->offset + ixp->offset;
+                sdp->id     = ixp->id;
+                sdp->len    = ixp->len;
+                sdp->order  = (unsigned char) sf_count;
+                if (sf_count > 1)
+                    sdp->coll = mp->sf_collate[sdp->id];
+                ++sdp;
+                ++ixp;
+            }
+            mp->sf_count = sf_count;
+            mp->cur_sf   = cur_sf;
+            return 0;
+        }
+
+        /* Initialize pointers and counter.
+         * Any directory has room for the indicators.
+         */
         datap = mp->rawbufp + fdp->offset;
         endp  = datap + fdp->len;
+        mp->sdirp = sfdp->sdirp;
         sdp   = mp->sdirp;
 
         /* Install 2 indicator "subfields".
@@ -81,16 +131,22 @@ int marc_xsfdir (
         }
 
         /* Scan field, looking for subfield delimiters */
-        while (datap < endp) {
+        while ((datap = marc_xscan_resv (datap, endp)) < endp) {
 
             /* If on subfield delimiter */
             if (*datap == MARC_SF_DELIM) {
 
-                /* Don't exceed directory size */
-                if (sf_count > mp->sf_max) {
+                /* Don't exceed directory size, growing it if we can */
+                if (sf_count > MARC_MAX_SFDIRSIZE) {
                     retcode = MARC_ERR_MAX_SFS;
                     break;
                 }
+                if ((size_t) sf_count >= sfdp->sf_max) {
+                    if ((retcode = marc_xsfd_room (sfdp, sf_count + 1)) != 0)
+                        break;
+                    mp->sdirp = sfdp->sdirp;
+                    sdp = mp->sdirp + sf_count;
+                }
 
                 /* Set length of previous var subfield, if there is one */
                 if (sf_count > 2)
@@ -118,8 +174,10 @@ int marc_xsfdir (
         /* Set final count into marcctl */
         mp->sf_count = sf_count;
 
-        /* We haven't positioned to any subfields in this field yet */
-        mp->cur_sf = -1;
+        /* We haven't positioned to any subfields in this field yet,
+         *   unless it's the same field again
+         */
+        mp->cur_sf = cur_sf;
 
         /* If no subfields found, caller built field and put nothing in it */
         if (sf_count == 0)
@@ -0,0 +1,176 @@
+/************************************************************************
+* marc_xtag_reset ()                                                    *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Empty the tag index, for a record with no fields yet.           *
+*                                                                       *
+*       Slots are emptied by moving to a new generation, not by         *
+*       clearing them, so this is cheap enough to do for every record.  *
+*                                                                       *
+*       The tag index (see marctagix in marcdefs.h) lets               *
+*       marc_get_field() go straight to the fields with a tag instead   *
+*       of searching the whole field directory for them.                *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+#include <string.h>
+#include "marcdefs.h"
+
+void marc_xtag_reset (
+    MARCP         mp        /* Control for marc record  */
+) {
+    MARCTAGIX     *ixp;     /* Tag index                */
+
+
+    if ((ixp = mp->tagixp) == NULL)
+        return;
+
+    /* On wraparound, old slots could look current again */
+    if (++ixp->gen == 0) {
+        memset (ixp->slot, 0, sizeof(ixp->slot));
+        ixp->gen = 1;
+    }
+
+    ixp->valid    = 1;
+    ixp->last_tag = -1;
+
+} /* marc_xtag_reset */
+
+
+/************************************************************************
+* marc_xtag_add ()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Add a field directory entry to the tag index.                   *
+*                                                                       *
+*       The entry must be the last one in the directory, as it always   *
+*       is when a field is added or a record is parsed.  Nothing is     *
+*       done if the index is already out of date.                       *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.                                             *
+*       Position of entry in the field directory.                       *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+void marc_xtag_add (
+    MARCP         mp,       /* Control for marc record  */
+    int           pos       /* New directory entry      */
+) {
+    MARCTAGIX     *ixp;     /* Tag index                */
+    MARCTAGSLOT   *sp;      /* Slot for entry's tag     */
+    FLDDIR        *dp;      /* The entry                */
+
+
+    if ((ixp = mp->tagixp) == NULL || !ixp->valid)
+        return;
+
+    dp = mp->fdirp + pos;
+    sp = ixp->slot + dp->tag;
+
+    /* First of its tag, or chain it after the last one */
+    if (sp->gen != ixp->gen) {
+        sp->gen   = ixp->gen;
+        sp->first = pos;
+        sp->count = 0;
+    }
+    else
+        mp->fdirp[sp->last].next_occ = pos;
+
+    sp->last     = pos;
+    dp->occ      = sp->count++;
+    dp->next_occ = MARC_NO_FIELD;
+
+} /* marc_xtag_add */
+
+
+/************************************************************************
+* marc_xtag_find ()                                                     *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find an occurrence of a field through the tag index,            *
+*       rebuilding the index first if it's out of date.                 *
+*                                                                       *
+*       Starts from the last field found, when that was an earlier      *
+*       occurrence of the same tag, so callers looping up through       *
+*       the occurrences don't walk the chain from the start each time.  *
+*                                                                       *
+*   PASS                                                                *
+*       Pointer to marcctl.  Must have a tag index.                     *
+*       Field tag.                                                      *
+*       Occurrence, origin 0.  Negative numbers count from the end,     *
+*           -1 is the last occurrence.                                  *
+*       Ptr to place to put position in the field directory.            *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Found.                                                      *
+*       MARC_RET_NO_FIELD  = No field with this tag.                    *
+*       MARC_RET_NO_FLDOCC = Field found but not this occurrence.       *
+************************************************************************/
+
+int marc_xtag_find (
+    MARCP         mp,       /* Control for marc record  */
+    int           field_id, /* Tag to find              */
+    int           field_occ,/* Occurrence of it         */
+    int           *posp     /* Put position here        */
+) {
+    MARCTAGIX     *ixp;     /* Tag index                */
+    MARCTAGSLOT   *sp;      /* Slot for the tag         */
+    int           i,        /* Loop counter             */
+                  pos,      /* Current entry            */
+                  occ;      /* Its occurrence           */
+
+
+    ixp = mp->tagixp;
+
+    /* Out of date, start over from the directory */
+    if (!ixp->valid) {
+        marc_xtag_reset (mp);
+        for (i=0; i<mp->field_count; i++)
+            marc_xtag_add (mp, i);
+    }
+
+    if (field_id < 0 || field_id > MARC_MAX_FIELDID)
+        return MARC_RET_NO_FIELD;
+    sp = ixp->slot + field_id;
+    if (sp->gen != ixp->gen)
+        return MARC_RET_NO_FIELD;
+
+    /* Count from the end the same way as from the start */
+    if (field_occ < 0)
+        field_occ += sp->count;
+    if (field_occ < 0 || field_occ >= sp->count)
+        return MARC_RET_NO_FLDOCC;
+
+    /* Pick the nearest place to start walking from */
+    if (field_occ == sp->count - 1) {
+        pos = sp->last;
+        occ = field_occ;
+    }
+    else if (ixp->last_tag == field_id && ixp->last_occ <= field_occ) {
+        pos = ixp->last_pos;
+        occ = ixp->last_occ;
+    }
+    else {
+        pos = sp->first;
+        occ = 0;
+    }
+    for (; occ<field_occ; occ++)
+        pos = mp->fdirp[pos].next_occ;
+
+    ixp->last_tag = field_id;
+    ixp->last_occ = field_occ;
+    ixp->last_pos = pos;
+
+    *posp = pos;
+
+    return 0;
+
+} /* marc_xtag_find */
@@ -0,0 +1,75 @@
+/************************************************************************
+* mkidx.c                                                               *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Build a sidecar record offset index for a sequential file of    *
+*       marc records.  See marc_idx_build().                            *
+*                                                                       *
+*       marcconv -x builds the same index itself when it needs one.     *
+*       Run this ahead of time, e.g., when a file is delivered, so      *
+*       the first run needn't wait for it, or to include the 001        *
+*       control numbers for other tools.                                *
+*                                                                       *
+*   COMMAND LINE ARGUMENTS                                              *
+*       -c to include 001 control numbers.                              *
+*       Name of input file.                                             *
+*       Optional name of index file, default = input file + ".idx".     *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "marc.h"
+
+int main (int argc, char *argv[])
+{
+    char   idxname[FILENAME_MAX]; /* Index file name    */
+    int    argn,            /* Next arg to look at  */
+           with_cn,         /* True=include 001s    */
+           stat;            /* Return code          */
+    long   count;           /* Records indexed      */
+    MARCIDXP ixp;           /* To check result      */
+
+
+    argn    = 1;
+    with_cn = 0;
+    if (argn < argc && strcmp (argv[argn], "-c") == 0) {
+        with_cn = 1;
+        ++argn;
+    }
+
+    /* usage */
+    if (argn >= argc || argc - argn > 2) {
+        fprintf (stderr, "usage: mkidx {-c} inputmarcfile {indexfile}\n");
+        fprintf (stderr, "Builds record offset index for a marc file\n");
+        fprintf (stderr, "  -c            = Include 001 control numbers\n");
+        fprintf (stderr, "  inputmarcfile = Sequential file of marc recs\n");
+        fprintf (stderr, "  indexfile     = Default inputmarcfile.idx\n");
+        exit (1);
+    }
+
+    if (argn + 1 < argc)
+        snprintf (idxname, sizeof(idxname), "%s", argv[argn + 1]);
+    else
+        snprintf (idxname, sizeof(idxname), "%s.idx", argv[argn]);
+
+    if ((stat = marc_idx_build (argv[argn], idxname, with_cn)) != 0) {
+        fprintf (stderr, "Error %d indexing %s\n", stat, argv[argn]);
+        exit (1);
+    }
+
+    if ((stat = marc_idx_open (idxname, argv[argn], &ixp)) != 0) {
+        fprintf (stderr, "Error %d opening new index %s\n", stat, idxname);
+        exit (1);
+    }
+    marc_idx_count (ixp, &count);
+    marc_idx_close (ixp);
+
+    printf ("Indexed %ld records in %s\n", count, idxname);
+
+    return 0;
+
+} /* main */
@@ -17,6 +17,8 @@ MATCHING_PAREN_STRUCT inmost_parens;
 void *marc_alloc(int, int);
 void marc_dealloc(void *, int);
 
+static char *normalize_into(char *dest, char *srcp, size_t src_len);
+
 /************************************************************************
 * add_ending_punc                                                       *
 *                                                                       *
@@ -169,6 +171,102 @@ int allocate_n_ncopy(char **dest, size_t tsrc_len, int extraspace,
 
 
 
+/************************************************************************
+* arena_n_copy()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Like allocate_n_copy(), but the copy comes from cmp_alloc()     *
+*       and lasts until the record is done.  Don't free it.             *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to proc parms                                               *
+*       Ptr to dest                                                     *
+*       Ptr to src                                                      *
+*                                                                       *
+*   RETURN                                                              *
+*       0 success (running out of memory is fatal)                      *
+************************************************************************/
+
+int arena_n_copy(CM_PROC_PARMS *pp, char **dest, char *src)
+{
+  size_t src_len = strlen(src);
+
+  *dest = (char *) cmp_alloc(pp, src_len+1);
+  memcpy(*dest, src, src_len+1);
+
+  return 0;
+
+} /* arena_n_copy */
+
+
+
+/************************************************************************
+* arena_n_ncopy()                                                       *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Like allocate_n_ncopy(), but the copy comes from cmp_alloc()    *
+*       and lasts until the record is done.  Don't free it.             *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to proc parms                                               *
+*       Ptr to dest                                                     *
+*       Number of bytes to copy, or CALC_LENGTH                         *
+*       Extra bytes to allocate after them                              *
+*       Ptr to src                                                      *
+*       COLLAPSE_SPACES or NO_COLLAPSE_SPACES                           *
+*                                                                       *
+*   RETURN                                                              *
+*       0 success (running out of memory is fatal)                      *
+************************************************************************/
+
+int arena_n_ncopy(CM_PROC_PARMS *pp, char **dest, size_t tsrc_len,
+		  int extraspace, char *src, int compress_spaces)
+{
+  size_t src_len;
+
+  if(tsrc_len==CALC_LENGTH)
+    src_len = strlen(src);
+  else
+    src_len = tsrc_len;
+
+  *dest = (char *) cmp_alloc(pp, src_len+extraspace+1);
+  memset(*dest, '\0', src_len+extraspace+1);
+
+  if(compress_spaces == NO_COLLAPSE_SPACES)
+    strncpy(*dest, src, src_len);
+  else
+    collapse_spaces(dest, src, src_len);
+
+  return 0;
+
+} /* arena_n_ncopy */
+
+
+
+/************************************************************************
+* arena_normalized()                                                    *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Like normalized(), but the copy comes from cmp_alloc() and      *
+*       lasts until the record is done.  Don't free it.                 *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to proc parms                                               *
+*       Ptr to src                                                      *
+*       Length of src                                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       ptr to normalized data (running out of memory is fatal)         *
+************************************************************************/
+
+char *arena_normalized(CM_PROC_PARMS *pp, char *srcp, size_t src_len)
+{
+  return normalize_into((char *) cmp_alloc(pp, src_len+1), srcp, src_len);
+
+} /* arena_normalized */
+
+
+
 /************************************************************************
 * collapse_spaces()                                                     *
 *                                                                       *
@@ -1612,9 +1710,7 @@ void print_paren_array(char *array_desc, MATCHING_PAREN_STRUCT paren_struct)
 
 char *normalized(char *srcp, size_t src_len)
 {
-  char          *tmpp;          /* Ptr to temp data                    */
   char          *dest;          /* returned Ptr                        */
-  int           numspaces;
 
   /*=========================================================================*/
   /* Allocate memory based on size of src...                                 */
@@ -1632,6 +1728,33 @@ char *normalized(char *srcp, size_t src_len)
   }
 #endif
 
+  return normalize_into(dest, srcp, src_len);
+
+} /* normalized */
+
+
+
+/************************************************************************
+* normalize_into()                                                      *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Does the work of normalized() and arena_normalized(), given     *
+*       memory for the result                                           *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to dest, at least src_len+1 bytes                           *
+*       Ptr to src                                                      *
+*       Length of src                                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       ptr to dest                                                     *
+************************************************************************/
+
+static char *normalize_into(char *dest, char *srcp, size_t src_len)
+{
+  char          *tmpp;          /* Ptr to temp data                    */
+  int           numspaces;
+
   /*=========================================================================*/
   /* Initialize the destination buffer...                                    */
   /*=========================================================================*/
@@ -1676,7 +1799,7 @@ char *normalized(char *srcp, size_t src_len)
 
   return dest;
 
-} /* normalized */
+} /* normalize_into */
 
 
 
@@ -95,6 +95,19 @@ int     allocate_n_ncopy(char **dest,
 			 int compress_spaces,
 			 char *fname);
 
+int     arena_n_copy(CM_PROC_PARMS *pp,
+		     char **dest,
+		     char *src);
+
+int     arena_n_ncopy(CM_PROC_PARMS *pp,
+		      char **dest,
+		      size_t tsrc_len,
+		      int extraspace,
+		      char *src,
+		      int compress_spaces);
+
+char   *arena_normalized(CM_PROC_PARMS *pp, char *srcp, size_t src_len);
+
 void    collapse_spaces(char **outp, char *srcp, size_t src_len);
 
 void    collapse_spaces_in_place(char **srcp, int trim_instructions);
@@ -0,0 +1,437 @@
+/************************************************************************
+* mtgetr.c                                                              *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Stress test for building records in several threads at once.    *
+*                                                                       *
+*       A set of records is made up from a fixed seed, with field and   *
+*       subfield sorting, protected ranges, and empty fields varying    *
+*       from record to record.  Each is built once with                 *
+*       marc_get_record() in this thread, then again in every worker    *
+*       thread, each with its own marcctl, all at the same time, and    *
+*       what the workers build must be byte for byte the same.          *
+*                                                                       *
+*       Each built record is also parsed with marc_old() and rebuilt    *
+*       in reverse field order with sorting off, and that must be the   *
+*       same in every thread too.                                       *
+*                                                                       *
+*   COMMAND LINE ARGUMENTS                                              *
+*       Optional number of threads, default 4.                          *
+*       Optional number of passes over the records, default 5.          *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Every record matched.                                       *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "marc.h"
+
+#define MT_RECS       2000  /* Records made up                  */
+#define MT_MAX_FIELDS  150  /* Most fields in one               */
+#define MT_MAX_THREADS  64  /* Most worker threads              */
+
+/* One record, built serially */
+typedef struct mt_rec {
+    unsigned char *recp;    /* Record as built                  */
+    size_t        reclen;   /* Its length                       */
+    unsigned char *revp;    /* Parsed and rebuilt in reverse    */
+    size_t        revlen;   /* Its length                       */
+} MT_REC;
+
+/* One worker thread */
+typedef struct mt_thread {
+    pthread_t     tid;      /* Thread id                        */
+    int           num;      /* Worker number, where to start    */
+    int           passes;   /* Times through the records        */
+    long          errs;     /* Records that didn't match        */
+} MT_THREAD;
+
+static MT_REC S_recs[MT_RECS];
+
+static int  make_rec        (MARCP, int);
+static int  build_rec       (MARCP, MARCP, int, unsigned char **, size_t *,
+                             unsigned char **, size_t *);
+static int  reverse_rec     (MARCP, MARCP, unsigned char *);
+static void *worker         (void *);
+static unsigned long next_rand (unsigned long *);
+
+
+int main (int argc, char *argv[])
+{
+    MT_THREAD thr[MT_MAX_THREADS]; /* Workers           */
+    MARCP  mp,              /* Built serially here      */
+           revmp;           /*   and rebuilt here       */
+    unsigned char *recp,    /* Built record             */
+           *revp;           /* Rebuilt record           */
+    size_t reclen,          /* Length of recp           */
+           revlen;          /* Length of revp           */
+    int    threads,         /* Number of workers        */
+           passes,          /* Times through records    */
+           i,               /* Loop counter             */
+           stat;            /* Return code              */
+    long   errs;            /* Records not matching     */
+
+
+    threads = argc > 1 ? atoi (argv[1]) : 4;
+    passes  = argc > 2 ? atoi (argv[2]) : 5;
+    if (argc > 3 || threads < 1 || threads > MT_MAX_THREADS || passes < 1) {
+        fprintf (stderr, "usage: mtgetr {threads {passes}}\n");
+        fprintf (stderr, "Builds marc records in threads, compares to "
+                         "serial\n");
+        fprintf (stderr, "  threads = 1..%d, default 4\n", MT_MAX_THREADS);
+        fprintf (stderr, "  passes  = Times through %d records, "
+                         "default 5\n", MT_RECS);
+        exit (1);
+    }
+
+    /* Everything built once, one at a time */
+    if ((stat = marc_init (&mp)) != 0 || (stat = marc_init (&revmp)) != 0) {
+        fprintf (stderr, "Error %d from marc_init\n", stat);
+        exit (1);
+    }
+    for (i=0; i<MT_RECS; i++) {
+        if ((stat = build_rec (mp, revmp, i, &recp, &reclen,
+                               &revp, &revlen)) != 0) {
+            fprintf (stderr, "Error %d building record %d\n", stat, i);
+            exit (1);
+        }
+        S_recs[i].recp   = (unsigned char *) malloc (reclen);
+        S_recs[i].revp   = (unsigned char *) malloc (revlen);
+        if (!S_recs[i].recp || !S_recs[i].revp) {
+            fprintf (stderr, "Out of memory\n");
+            exit (1);
+        }
+        memcpy (S_recs[i].recp, recp, reclen);
+        memcpy (S_recs[i].revp, revp, revlen);
+        S_recs[i].reclen = reclen;
+        S_recs[i].revlen = revlen;
+    }
+    marc_free (mp);
+    marc_free (revmp);
+
+    /* And again in every thread at once */
+    for (i=0; i<threads; i++) {
+        thr[i].num    = i;
+        thr[i].passes = passes;
+        thr[i].errs   = 0;
+        if (pthread_create (&thr[i].tid, NULL, worker, &thr[i]) != 0) {
+            fprintf (stderr, "Unable to start thread %d\n", i);
+            exit (1);
+        }
+    }
+    errs = 0;
+    for (i=0; i<threads; i++) {
+        pthread_join (thr[i].tid, NULL);
+        errs += thr[i].errs;
+    }
+
+    if (errs) {
+        fprintf (stderr, "%ld records differ from serial build\n", errs);
+        return 1;
+    }
+    printf ("%d records built %d times in %d threads, all the same\n",
+            MT_RECS, passes, threads);
+
+    return 0;
+
+} /* main */
+
+
+/************************************************************************
+* worker ()                                                             *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Thread that builds every record and compares it with the        *
+*       serial build.  Workers start at different records so they're    *
+*       building different ones at the same time.                       *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to MT_THREAD.                                               *
+*                                                                       *
+*   RETURN                                                              *
+*       NULL, mismatches are counted in the MT_THREAD.                  *
+************************************************************************/
+
+static void *worker (
+    void          *argp     /* Ptr to MT_THREAD         */
+) {
+    MT_THREAD     *tp;      /* Our thread               */
+    MT_REC        *rp;      /* Serial build of record   */
+    MARCP         mp,       /* Build here               */
+                  revmp;    /*   and rebuild here       */
+    unsigned char *recp,    /* Built record             */
+                  *revp;    /* Rebuilt record           */
+    size_t        reclen,   /* Length of recp           */
+                  revlen;   /* Length of revp           */
+    int           pass,     /* Times through            */
+                  i, n,     /* Loop counter, record     */
+                  stat;     /* Return code              */
+
+
+    tp = (MT_THREAD *) argp;
+    if (marc_init (&mp) != 0 || marc_init (&revmp) != 0) {
+        tp->errs = MT_RECS;
+        return NULL;
+    }
+
+    for (pass=0; pass<tp->passes; pass++) {
+        for (i=0; i<MT_RECS; i++) {
+            n  = (i + tp->num * (MT_RECS / 7)) % MT_RECS;
+            rp = &S_recs[n];
+            stat = build_rec (mp, revmp, n, &recp, &reclen, &revp, &revlen);
+            if (stat != 0 || reclen != rp->reclen || revlen != rp->revlen
+                          || memcmp (recp, rp->recp, reclen)
+                          || memcmp (revp, rp->revp, revlen)) {
+                if (!tp->errs)
+                    fprintf (stderr, "Thread %d record %d differs, "
+                             "stat=%d\n", tp->num, n, stat);
+                ++tp->errs;
+            }
+        }
+    }
+
+    marc_free (mp);
+    marc_free (revmp);
+
+    return NULL;
+
+} /* worker */
+
+
+/************************************************************************
+* build_rec ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Make up a record, build it, then parse it and build it again    *
+*       in reverse field order.                                         *
+*                                                                       *
+*   PASS                                                                *
+*       Marcctl to build in.                                            *
+*       Marcctl to rebuild in.                                          *
+*       Record number, which decides what's in it.                      *
+*       Ptrs to place to put ptr to built record, and its length.       *
+*       Ptrs to place to put ptr to rebuilt record, and its length.     *
+*           Both are in the marcctls, good till they're used again.     *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int build_rec (
+    MARCP         mp,       /* Build here               */
+    MARCP         revmp,    /* Rebuild here             */
+    int           recnum,   /* Which record             */
+    unsigned char **recpp,  /* Put built record here    */
+    size_t        *reclenp, /*   and its length         */
+    unsigned char **revpp,  /* Put rebuilt record here  */
+    size_t        *revlenp  /*   and its length         */
+) {
+    int           stat;     /* Return code              */
+
+
+    if ((stat = make_rec (mp, recnum)) != 0)
+        return stat;
+    if ((stat = marc_get_record (mp, recpp, reclenp)) != 0)
+        return stat;
+    if ((stat = reverse_rec (mp, revmp, *recpp)) != 0)
+        return stat;
+
+    return marc_get_record (revmp, revpp, revlenp);
+
+} /* build_rec */
+
+
+/************************************************************************
+* make_rec ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Fill a marcctl with a made up record.  The same record number   *
+*       always makes the same record.                                   *
+*                                                                       *
+*       Some records have an empty field first, or elsewhere, which     *
+*       marc_get_record() drops.  Sorting is on or off, with or         *
+*       without a protected range, so each thread's builds go through   *
+*       every compare routine.                                          *
+*                                                                       *
+*   PASS                                                                *
+*       Marcctl.                                                        *
+*       Record number.                                                  *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int make_rec (
+    MARCP         mp,       /* Marcctl to fill          */
+    int           recnum    /* Which record             */
+) {
+    unsigned char data[64]; /* Subfield data            */
+    unsigned long seed;     /* Random number state      */
+    int           nfields,  /* Fields in record         */
+                  nsfs,     /* Subfields in a field     */
+                  tag,      /* Field tag                */
+                  sf,       /* Subfield code            */
+                  len,      /* Data length              */
+                  i, j, k,  /* Loop counters            */
+                  stat;     /* Return code              */
+
+
+    seed = (unsigned long) recnum * 2654435761UL + 1;
+
+    /* Sorting choices are kept in the marcctl, set them every time */
+    marc_field_sort (mp, recnum % 3 != 0);
+    if (recnum % 5 == 0)
+        marc_field_order (mp, 500, 599);
+    else
+        marc_field_order (mp, MARC_NO_ORDER, MARC_NO_ORDER);
+    marc_subfield_sort (mp, recnum % 4 != 0);
+    if (recnum % 7 == 0)
+        marc_subfield_order (mp, 'x', 'z');
+    else
+        marc_subfield_order (mp, MARC_NO_ORDER, MARC_NO_ORDER);
+
+    if ((stat = marc_new (mp)) != 0)
+        return stat;
+
+    /* Empty field just after the leader */
+    if (recnum % 11 == 0 && (stat = marc_add_field (mp, 500)) != 0)
+        return stat;
+
+    if ((stat = marc_add_field (mp, 1)) != 0)
+        return stat;
+    len = sprintf ((char *) data, "mt%06d", recnum);
+    if ((stat = marc_add_subfield (mp, 0, data, len)) != 0)
+        return stat;
+
+    nfields = 1 + (int) (next_rand (&seed) % MT_MAX_FIELDS);
+    for (i=0; i<nfields; i++) {
+        tag = 10 + (int) (next_rand (&seed) % 990);
+        if ((stat = marc_add_field (mp, tag)) != 0)
+            return stat;
+
+        /* Now and then leave one empty */
+        if (next_rand (&seed) % 17 == 0)
+            continue;
+
+        data[0] = (unsigned char) ('0' + next_rand (&seed) % 10);
+        if ((stat = marc_add_subfield (mp, MARC_INDIC1, data, 1)) != 0)
+            return stat;
+        data[0] = ' ';
+        if ((stat = marc_add_subfield (mp, MARC_INDIC2, data, 1)) != 0)
+            return stat;
+
+        nsfs = 1 + (int) (next_rand (&seed) % 6);
+        for (j=0; j<nsfs; j++) {
+            sf  = 'a' + (int) (next_rand (&seed) % 26);
+            len = 1 + (int) (next_rand (&seed) % (sizeof(data) - 1));
+            for (k=0; k<len; k++)
+                data[k] = (unsigned char) ('A' + next_rand (&seed) % 58);
+            if ((stat = marc_add_subfield (mp, sf, data, len)) != 0)
+                return stat;
+        }
+    }
+
+    return 0;
+
+} /* make_rec */
+
+
+/************************************************************************
+* reverse_rec ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Parse a built record and copy its fields to another marcctl     *
+*       in reverse order, with sorting off.                             *
+*                                                                       *
+*   PASS                                                                *
+*       Marcctl to parse with.                                          *
+*       Marcctl to copy to.                                             *
+*       Ptr to built record.                                            *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int reverse_rec (
+    MARCP         mp,       /* Parse here               */
+    MARCP         revmp,    /* Copy to here             */
+    unsigned char *recp     /* Record to parse          */
+) {
+    unsigned char *datap;   /* Field or subfield data   */
+    size_t        datalen;  /* Its length               */
+    int           fcount,   /* Fields in record         */
+                  scount,   /* Subfields in field       */
+                  id,       /* Field or subfield id     */
+                  tag,      /* Field id                 */
+                  i, j,     /* Loop counters            */
+                  stat;     /* Return code              */
+
+
+    if ((stat = marc_old (mp, recp)) != 0)
+        return stat;
+
+    marc_field_sort (revmp, 0);
+    marc_subfield_sort (revmp, 0);
+    if ((stat = marc_new (revmp)) != 0)
+        return stat;
+
+    if ((stat = marc_cur_field_count (mp, &fcount)) != 0)
+        return stat;
+    for (i=fcount-1; i>0; i--) {
+        if ((stat = marc_pos_field (mp, i, &tag, &datap, &datalen)) != 0)
+            return stat;
+        if ((stat = marc_add_field (revmp, tag)) != 0)
+            return stat;
+
+        if (tag < 10) {
+            if ((stat = marc_add_subfield (revmp, 0, datap, datalen)) != 0)
+                return stat;
+            continue;
+        }
+
+        /* Indicators come first, like subfields */
+        if ((stat = marc_cur_subfield_count (mp, &scount)) != 0)
+            return stat;
+        for (j=0; j<scount; j++) {
+            if ((stat = marc_pos_subfield (mp, j, &id, &datap,
+                                           &datalen)) != 0)
+                return stat;
+            if ((stat = marc_add_subfield (revmp, id, datap, datalen)) != 0)
+                return stat;
+        }
+    }
+
+    return 0;
+
+} /* reverse_rec */
+
+
+/************************************************************************
+* next_rand ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Simple random numbers, the same on every system, with the       *
+*       state in the caller so threads don't share it.                  *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to state.                                                   *
+*                                                                       *
+*   RETURN                                                              *
+*       Next number.                                                    *
+************************************************************************/
+
+static unsigned long next_rand (
+    unsigned long *seedp    /* Ptr to state             */
+) {
+    *seedp = (*seedp * 1103515245UL + 12345UL) & 0x7fffffffUL;
+
+    return *seedp >> 8;
+
+} /* next_rand */
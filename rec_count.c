@@ -1,13 +1,27 @@
 /************************************************************************
-* marcprn.c                                                             *
+* rec_count.c                                                           *
 *                                                                       *
 *   DEFINITION                                                          *
-*       Test program for marc package.                                  *
+*       Count the records in a sequential file of marc records.         *
 *                                                                       *
-*       Reads records from a sequential input file of marc records,     *
-*       and dumps the records.                                          *
+*       Only the leaders are looked at.  The file is mapped and we      *
+*       hop from each leader to the next by its logical record          *
+*       length, checking that each hop lands just after a record        *
+*       terminator.                                                     *
+*                                                                       *
+*       With -t, the file is split into that many partitions, counted   *
+*       by separate threads.  Each partition after the first starts at  *
+*       the first record boundary we can find in it.  A thread must     *
+*       end exactly where the next one started, proving the boundary    *
+*       was real.  If any of them don't, or there's a bad record, we    *
+*       count again from the start in one thread, which reports the     *
+*       error at the right record.                                      *
+*                                                                       *
+*       If the file has an up to date index (see mkidx) the count is    *
+*       just taken from it.                                             *
 *                                                                       *
 *   COMMAND LINE ARGUMENTS                                              *
+*       -t<num> for number of threads, default 1.                       *
 *       Name of input file.                                             *
 *                                                                       *
 *   RETURN                                                              *
@@ -19,100 +33,338 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
 #include "marcdefs.h"
 
-#ifdef MARC16
-#define IBSIZE  0x2000      /* Input buffer size    */
-#else
-#define IBSIZE  100000
-#endif
+#define MAX_THREADS  64     /* Most partitions      */
+#define SYNC_RECS     2     /* Valid recs to trust a boundary */
 
-#define REC_TERM    29      /* marc rec terminator  */
-#define OUT_RECLEN   75
-#define DLEN(x) (x > OUT_RECLEN ? OUT_RECLEN : x)
+/* One partition of the file, counted by one thread */
+typedef struct part {
+    unsigned char *startp;  /* First record         */
+    unsigned char *endp;    /* Next partition start */
+    unsigned char *stopp;   /* Where we really ended*/
+    long   count;           /* Records counted      */
+    int    stat;            /* 0 or error           */
+} PART;
 
 static long S_in_count;
+static unsigned char *S_basep;  /* Start of mapped file */
+static unsigned char *S_endp;   /* End of mapped file   */
 
 
-static void copy_rec (MARCP, MARCP, int);
-static long compare  (char *, unsigned char *, unsigned char *);
+static long hop_count  (MARCMAPP, int *);
+static long part_count (int, int *);
+static int  hop_rec    (unsigned char *, size_t *);
+static unsigned char *find_start (unsigned char *);
+static void *part_thread (void *);
 static void fatal    (char *, ...);
 
 int main (int argc, char *argv[])
 {
-    FILE   *infp;           /* Input file           */
-    unsigned char *inbuf,   /* Input buffer         */
-           *datap, *datam;  /* Ptr to data          */
-    MARCP  m_org;           /* Original input record*/
-    int    i,               /* Loop counter         */
-           count,
-           fd,
+    MARCMAPP map;           /* Mapped input file    */
+    MARCIDXP ixp;           /* Index, if there is one*/
+    char   idxname[FILENAME_MAX]; /* Its name       */
+    char   *fname;          /* Input file name      */
+    int    argn,            /* Next arg to look at  */
+           threads,         /* Number of partitions */
            stat;            /* Return code          */
-    long   first_dump,      /* First to dump, org 0 */
-           count_dump,      /* Num to dump          */
-           out_count;       /* Num recs dumped      */
-    size_t datalen;         /* Returned data length */
+    long   count;           /* Records in file      */
+
+    /* Options */
+    threads = 1;
+    for (argn=1; argn<argc && argv[argn][0] == '-'; argn++) {
+        if (argv[argn][1] == 't' && argv[argn][2])
+            threads = atoi (argv[argn] + 2);
+        else
+            break;
+    }
 
     /* usage */
-    if (argc < 2) {
-        fprintf (stderr, "usage: marcprn inputmarcfile {count {start}}\n");
-        fprintf (stderr, "Dumps marc records human readable to stdout\n");
+    if (argn != argc - 1 || threads < 1 || threads > MAX_THREADS) {
+        fprintf (stderr, "usage: rec_count {-t<num>} inputmarcfile\n");
+        fprintf (stderr, "Counts records in a marc file\n");
+        fprintf (stderr, "  -t<num>       = Count with num threads, "
+                         "max %d\n", MAX_THREADS);
         fprintf (stderr, "  inputmarcfile = Sequential file of marc recs\n");
-        fprintf (stderr, "  count         = Optional num records to dump\n");
-        fprintf (stderr, "  start         = Optional first rec, org 0\n");
         exit (1);
     }
+    fname = argv[argn];
 
-#ifdef MCK
-    /* Init memory checker */
-    mc_startcheck(erf_logfile);
-    atexit ((void (*)()) mc_endcheck);
-#endif
-
-    /* Open files */
-    if ((infp = fopen (argv[1], "rb")) == NULL) {
-        perror (argv[1]);
-        fatal ("Unable to open input file");
+    /* An up to date index already knows the answer */
+    sprintf (idxname, "%.*s.idx", (int) sizeof(idxname) - 5, fname);
+    if (marc_idx_open (idxname, fname, &ixp) == 0) {
+        marc_idx_count (ixp, &count);
+        marc_idx_close (ixp);
+        printf("\n\nNumber of records: %ld\n\n\n", count);
+        return 0;
     }
 
-    /* Starting number and count */
-    S_in_count =
-    out_count  =
-    first_dump =
-    count_dump = 0L;
-    if (argc > 2) {
-        count_dump = atol (argv[2]);
-        if (argc > 3)
-            first_dump = atol (argv[3]);
+    if ((stat = marc_map_open (fname, &map)) != 0) {
+        perror (fname);
+        fatal ("Error %d mapping input file", stat);
     }
+    S_basep = map->basep;
+    S_endp  = map->endp;
 
-    /* Create buffer */
-    if ((inbuf = malloc (IBSIZE)) == NULL)
-        fatal ("Memory\n");
+    /* Try partitions first, if asked, then fall back to one pass */
+    stat = -1;
+    if (threads > 1)
+        count = part_count (threads, &stat);
+    if (stat != 0)
+        count = hop_count (map, &stat);
 
-    /* Create marc control structures */
-    if ((stat = marc_init (&m_org)) != 0)
-        fatal ("Error %d initializing m_org", stat);
+    marc_map_close (map);
 
-    /* Turn off sorting in original record */
-    if ((stat = marc_field_sort (m_org, 0)) != 0)
-        fatal ("Error %d turning off sort for m_org", stat);
-    if ((stat = marc_subfield_sort (m_org, 0)) != 0)
-        fatal ("Error %d turning off subfield sort for m_org", stat);
+    S_in_count = count;
+    if (stat != 0)
+        fatal ("Error %d reading record after %ld good ones", stat, count);
 
-    /* While we successfully read records from input file */
-    count = 0;
-    while (marc_read_rec (infp, inbuf, IBSIZE) != EOF) {
+    printf("\n\nNumber of records: %ld\n\n\n", count);
+
+    return 0;
+
+}
+
+
+/************************************************************************
+* hop_count ()                                                          *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Count all records in one pass, using marc_map_read(), which     *
+*       only touches the leader and record terminator of each.          *
+*                                                                       *
+*   PASS                                                                *
+*       Mapped input file.                                              *
+*       Ptr to place to put 0 or error code.                            *
+*                                                                       *
+*   RETURN                                                              *
+*       Number of good records before end or error.                     *
+************************************************************************/
 
+static long hop_count (
+    MARCMAPP      map,      /* Input file               */
+    int           *statp    /* Put status here          */
+) {
+    unsigned char *recp;    /* Ptr to record            */
+    size_t        reclen;   /* Its length               */
+    long          count;    /* Records so far           */
+    int           stat;     /* From marc_map_read()     */
+
+
+    marc_map_seek (map, 0);
+
+    count = 0;
+    while ((stat = marc_map_read (map, &recp, &reclen)) == 0)
         ++count;
+
+    *statp = (stat == EOF) ? 0 : stat;
+
+    return count;
+
+} /* hop_count */
+
+
+/************************************************************************
+* part_count ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Count records by partitions, one thread per partition.          *
+*                                                                       *
+*   PASS                                                                *
+*       Number of partitions.                                           *
+*       Ptr to place to put 0 or error code.                            *
+*           Any error means the count is no good and the caller         *
+*           should count again in one pass.                             *
+*                                                                       *
+*   RETURN                                                              *
+*       Number of records.                                              *
+************************************************************************/
+
+static long part_count (
+    int           threads,  /* Number of partitions     */
+    int           *statp    /* Put status here          */
+) {
+    PART          parts[MAX_THREADS];   /* Partitions   */
+    pthread_t     tids[MAX_THREADS];    /* Their threads*/
+    size_t        size;     /* Bytes per partition      */
+    long          count;    /* Total records            */
+    int           i,        /* Loop counter             */
+                  started;  /* Threads running          */
+
+
+    /* Find the first record boundary in each partition.
+     * A partition with none is merged into the one before.
+     */
+    size = (size_t) (S_endp - S_basep) / threads;
+    parts[0].startp = S_basep;
+    for (i=1; i<threads; i++) {
+        parts[i].startp = find_start (S_basep + size * i);
+        if (parts[i].startp < parts[i-1].startp)
+            parts[i].startp = parts[i-1].startp;
     }
+    for (i=0; i<threads; i++)
+        parts[i].endp = (i < threads - 1) ? parts[i+1].startp : S_endp;
 
-    printf("\n\nNumber of records: %d\n\n\n", count);
+    started = 0;
+    for (i=0; i<threads; i++) {
+        if (pthread_create (&tids[i], NULL, part_thread, &parts[i]) != 0)
+            break;
+        ++started;
+    }
+
+    count  = 0;
+    *statp = (started == threads) ? 0 : -1;
+    for (i=0; i<started; i++) {
+        pthread_join (tids[i], NULL);
+        count += parts[i].count;
+
+        /* Must have ended right at the next boundary */
+        if (parts[i].stat != 0 || parts[i].stopp != parts[i].endp)
+            *statp = -1;
+    }
 
+    return count;
+
+} /* part_count */
+
+
+/************************************************************************
+* part_thread ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Count the records in one partition.                             *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr to partition.                                               *
+*                                                                       *
+*   RETURN                                                              *
+*       NULL.  Results are in the partition.                            *
+************************************************************************/
+
+static void *part_thread (
+    void          *argp     /* Partition                */
+) {
+    PART          *pp;      /* Partition                */
+    unsigned char *recp;    /* Current record           */
+    size_t        lrecl;    /* Its length               */
+
+
+    pp    = (PART *) argp;
+    recp  = pp->startp;
+    pp->count = 0;
+    pp->stat  = 0;
+
+    while (recp < pp->endp) {
+
+        /* Partial leader at end of file is end of file */
+        if ((size_t) (S_endp - recp) < MARC_LEADER_LEN) {
+            recp = S_endp;
+            break;
+        }
+        if ((pp->stat = hop_rec (recp, &lrecl)) != 0)
+            break;
+        ++pp->count;
+        recp += lrecl;
+    }
+    pp->stopp = recp;
+
+    return NULL;
+
+} /* part_thread */
+
+
+/************************************************************************
+* hop_rec ()                                                            *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Check that a record starts here, get its length.                *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr into mapped file, with at least a leader after it.          *
+*       Ptr to place to put logical record length.                      *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error, same codes as marc_map_read().                      *
+************************************************************************/
+
+static int hop_rec (
+    unsigned char *recp,    /* Possible record          */
+    size_t        *lreclp   /* Put its length here      */
+) {
+    size_t        lrecl;    /* Logical record length    */
+    int           i;        /* Loop counter             */
+
+
+    for (i=0; i<MARC_RECLEN_LEN; i++)
+        if (recp[i] < '0' || recp[i] > '9')
+            return MARC_ERR_READ_LDR;
+    lrecl = marc_xnum (recp, MARC_RECLEN_LEN);
+    if (lrecl <= MARC_LEADER_LEN)
+        return MARC_ERR_READ_LDR;
+    if (lrecl > (size_t) (S_endp - recp))
+        return MARC_ERR_READ_INC;
+    if (recp[lrecl - 1] != MARC_REC_TERM)
+        return MARC_ERR_READ_TERM;
+
+    *lreclp = lrecl;
 
     return 0;
 
-}
+} /* hop_rec */
+
+
+/************************************************************************
+* find_start ()                                                         *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Find the first record boundary at or after a point in the       *
+*       file.  That's the byte after a record terminator, if it also    *
+*       starts SYNC_RECS good records in a row, or good records up to   *
+*       end of file.                                                    *
+*                                                                       *
+*       Data could fool us, but then the thread counting the partition  *
+*       before won't end exactly here, and we'll know.                  *
+*                                                                       *
+*   PASS                                                                *
+*       Ptr into mapped file.                                           *
+*                                                                       *
+*   RETURN                                                              *
+*       Ptr to record start, or end of file if none found.              *
+************************************************************************/
+
+static unsigned char *find_start (
+    unsigned char *p        /* Look here and after      */
+) {
+    unsigned char *recp;    /* Candidate record         */
+    size_t        lrecl;    /* Its length               */
+    int           i;        /* Records checked          */
+
+
+    /* Back up one, the record may start right here */
+    if (p > S_basep)
+        --p;
+
+    for (; p < S_endp; p++) {
+        if (*p != MARC_REC_TERM)
+            continue;
+
+        recp = p + 1;
+        for (i=0; i<SYNC_RECS; i++) {
+            if ((size_t) (S_endp - recp) < MARC_LEADER_LEN
+                    || hop_rec (recp, &lrecl) != 0)
+                break;
+            recp += lrecl;
+        }
+        if (i == SYNC_RECS || recp == S_endp)
+            return p + 1;
+    }
+
+    return S_endp;
+
+} /* find_start */
 
 
 /************************************************************************
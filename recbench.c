@@ -0,0 +1,318 @@
+/************************************************************************
+* recbench.c                                                            *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Microbenchmark of the per field cost of building a record with  *
+*       marc_get_record() and parsing it with marc_old().               *
+*                                                                       *
+*       One record of N fields, each with one subfield, is built and    *
+*       parsed over and over, and the time for each is reported in      *
+*       nanoseconds per field.  Most of it is the directory: tags,      *
+*       lengths and offsets written by marc_xputnum() and read back     *
+*       by marc_xnum().                                                 *
+*                                                                       *
+*       For comparison the directory and leader numbers of the same     *
+*       record are also written on their own, both with sprintf() as    *
+*       marc_get_record() used to and with marc_xputnum() as it does    *
+*       now.                                                            *
+*                                                                       *
+*   COMMAND LINE ARGUMENTS                                              *
+*       Optional number of fields, default 20.                          *
+*       Optional number of times, default 20000.                        *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "marcdefs.h"
+
+static int    make_rec      (MARCP, int);
+static void   dir_sprintf   (unsigned char *, unsigned char *, int);
+static void   dir_xputnum   (unsigned char *, unsigned char *, int);
+static double now_ns        (void);
+
+
+int main (int argc, char *argv[])
+{
+    MARCP  mp,              /* Build here               */
+           inmp;            /* Parse here               */
+    unsigned char *recp,    /* Built record             */
+           *copyp,          /* Copy of it to parse      */
+           *outp;           /* Rewrite copy of it here  */
+    size_t reclen;          /* Its length               */
+    double start,           /* Start time, ns           */
+           get_ns,          /* Time building            */
+           old_ns,          /* Time parsing             */
+           spr_ns,          /* Time sprintf directory   */
+           put_ns;          /* Time xputnum directory   */
+    int    fields,          /* Fields per record        */
+           reps,            /* Times to do each         */
+           i,               /* Loop counter             */
+           stat;            /* Return code              */
+
+
+    fields = argc > 1 ? atoi (argv[1]) : 20;
+    reps   = argc > 2 ? atoi (argv[2]) : 20000;
+    if (argc > 3 || fields < 1 || fields > 999 || reps < 1) {
+        fprintf (stderr, "usage: recbench {fields {times}}\n");
+        fprintf (stderr, "Times marc_get_record() and marc_old() per "
+                         "field\n");
+        fprintf (stderr, "  fields = Fields in the record, 1..999, "
+                         "default 20\n");
+        fprintf (stderr, "  times  = Times to build and parse it, "
+                         "default 20000\n");
+        exit (1);
+    }
+
+    if ((stat = marc_init (&mp)) != 0 || (stat = marc_init (&inmp)) != 0) {
+        fprintf (stderr, "Error %d from marc_init\n", stat);
+        exit (1);
+    }
+
+    /* Build the record again and again, from the same fields */
+    if ((stat = make_rec (mp, fields)) != 0) {
+        fprintf (stderr, "Error %d adding fields\n", stat);
+        exit (1);
+    }
+    start = now_ns ();
+    for (i=0; i<reps; i++) {
+        if ((stat = marc_get_record (mp, &recp, &reclen)) != 0) {
+            fprintf (stderr, "Error %d building record\n", stat);
+            exit (1);
+        }
+    }
+    get_ns = now_ns () - start;
+
+    /* marc_old() wants a record it can keep */
+    if ((copyp = (unsigned char *) malloc (reclen + 1)) == NULL
+            || (outp = (unsigned char *) malloc (reclen + 1)) == NULL) {
+        fprintf (stderr, "Out of memory\n");
+        exit (1);
+    }
+    memcpy (copyp, recp, reclen + 1);
+    memcpy (outp, recp, reclen + 1);
+
+    /* Its directory and leader numbers, the old way and the new */
+    start = now_ns ();
+    for (i=0; i<reps; i++)
+        dir_sprintf (outp, recp, fields);
+    spr_ns = now_ns () - start;
+    if (memcmp (outp, recp, reclen) != 0) {
+        fprintf (stderr, "sprintf directory differs\n");
+        exit (1);
+    }
+
+    start = now_ns ();
+    for (i=0; i<reps; i++)
+        dir_xputnum (outp, recp, fields);
+    put_ns = now_ns () - start;
+    if (memcmp (outp, recp, reclen) != 0) {
+        fprintf (stderr, "marc_xputnum directory differs\n");
+        exit (1);
+    }
+
+    /* And parse it again and again */
+    start = now_ns ();
+    for (i=0; i<reps; i++) {
+        if ((stat = marc_old (inmp, copyp)) != 0) {
+            fprintf (stderr, "Error %d parsing record\n", stat);
+            exit (1);
+        }
+    }
+    old_ns = now_ns () - start;
+
+    printf ("%d fields, %d times, record length %lu\n",
+            fields, reps, (unsigned long) reclen);
+    printf ("  marc_get_record         %8.1f ns/field\n",
+            get_ns / ((double) reps * fields));
+    printf ("  marc_old                %8.1f ns/field\n",
+            old_ns / ((double) reps * fields));
+    printf ("  directory, sprintf      %8.1f ns/field\n",
+            spr_ns / ((double) reps * fields));
+    printf ("  directory, marc_xputnum %8.1f ns/field\n",
+            put_ns / ((double) reps * fields));
+
+    free (outp);
+    free (copyp);
+    marc_free (mp);
+    marc_free (inmp);
+
+    return 0;
+
+} /* main */
+
+
+/************************************************************************
+* make_rec ()                                                           *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Fill a marcctl with a record of one subfield fields, tags       *
+*       counting up from 100.                                           *
+*                                                                       *
+*   PASS                                                                *
+*       Marcctl.                                                        *
+*       Number of fields.                                               *
+*                                                                       *
+*   RETURN                                                              *
+*       0 = Success.                                                    *
+*       Else error.                                                     *
+************************************************************************/
+
+static int make_rec (
+    MARCP  mp,              /* Marcctl to fill          */
+    int    fields           /* Number of fields         */
+) {
+    int    i,               /* Loop counter             */
+           stat;            /* Return code              */
+
+
+    if ((stat = marc_new (mp)) != 0)
+        return stat;
+
+    for (i=0; i<fields; i++) {
+        if ((stat = marc_add_field (mp, 100 + i % 900)) != 0)
+            return stat;
+        if ((stat = marc_add_subfield (mp, MARC_INDIC1,
+                                       (unsigned char *) "0", 1)) != 0
+                || (stat = marc_add_subfield (mp, MARC_INDIC2,
+                                       (unsigned char *) " ", 1)) != 0
+                || (stat = marc_add_subfield (mp, 'a',
+                          (unsigned char *) "Some subfield data", 18)) != 0)
+            return stat;
+    }
+
+    return 0;
+
+} /* make_rec */
+
+
+/************************************************************************
+* dir_sprintf ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Write the directory entries and leader numbers of a record      *
+*       with sprintf(), the way marc_get_record() used to.              *
+*                                                                       *
+*   PASS                                                                *
+*       Record to write them into.                                      *
+*       Record to take the numbers from, built by marc_get_record().    *
+*       Number of fields.                                               *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void dir_sprintf (
+    unsigned char *outp,    /* Write numbers here       */
+    unsigned char *recp,    /* Take them from here      */
+    int    fields           /* Number of fields         */
+) {
+    unsigned char *dirp,    /* Directory entry out      */
+                  *srcp;    /* Directory entry in       */
+    char   numbuf[15];      /* Construct numbers here   */
+    int    i;               /* Loop counter             */
+
+
+    dirp = outp + MARC_LEADER_LEN;
+    srcp = recp + MARC_LEADER_LEN;
+    for (i=0; i<fields; i++) {
+        /* sprintf plants a 0 after the entry, put back what was there */
+        sprintf ((char *) dirp, "%03d%04u%05u",
+                 (int) marc_xnum (srcp, MARC_TAG_LEN),
+                 marc_xnum (srcp + MARC_TAG_LEN, MARC_FIELDLEN_LEN),
+                 marc_xnum (srcp + (MARC_TAG_LEN + MARC_FIELDLEN_LEN),
+                            MARC_OFFSET_LEN));
+        dirp[MARC_DIR_SIZE] = srcp[MARC_DIR_SIZE];
+        dirp += MARC_DIR_SIZE;
+        srcp += MARC_DIR_SIZE;
+    }
+
+    sprintf (numbuf, "%0*u", MARC_RECLEN_LEN,
+             marc_xnum (recp + MARC_RECLEN_OFF, MARC_RECLEN_LEN));
+    memcpy (outp + MARC_RECLEN_OFF, numbuf, MARC_RECLEN_LEN);
+    sprintf (numbuf, "%0*u", MARC_BASEADDR_LEN,
+             marc_xnum (recp + MARC_BASEADDR_OFF, MARC_BASEADDR_LEN));
+    memcpy (outp + MARC_BASEADDR_OFF, numbuf, MARC_BASEADDR_LEN);
+
+} /* dir_sprintf */
+
+
+/************************************************************************
+* dir_xputnum ()                                                        *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Same as dir_sprintf(), with marc_xputnum() as marc_get_record() *
+*       does now.                                                       *
+*                                                                       *
+*   PASS                                                                *
+*       Record to write them into.                                      *
+*       Record to take the numbers from, built by marc_get_record().    *
+*       Number of fields.                                               *
+*                                                                       *
+*   RETURN                                                              *
+*       Void.                                                           *
+************************************************************************/
+
+static void dir_xputnum (
+    unsigned char *outp,    /* Write numbers here       */
+    unsigned char *recp,    /* Take them from here      */
+    int    fields           /* Number of fields         */
+) {
+    unsigned char *dirp,    /* Directory entry out      */
+                  *srcp;    /* Directory entry in       */
+    int    i;               /* Loop counter             */
+
+
+    dirp = outp + MARC_LEADER_LEN;
+    srcp = recp + MARC_LEADER_LEN;
+    for (i=0; i<fields; i++) {
+        marc_xputnum (dirp, marc_xnum (srcp, MARC_TAG_LEN), MARC_TAG_LEN);
+        marc_xputnum (dirp + MARC_TAG_LEN,
+                      marc_xnum (srcp + MARC_TAG_LEN, MARC_FIELDLEN_LEN),
+                      MARC_FIELDLEN_LEN);
+        marc_xputnum (dirp + (MARC_TAG_LEN + MARC_FIELDLEN_LEN),
+                      marc_xnum (srcp + (MARC_TAG_LEN + MARC_FIELDLEN_LEN),
+                                 MARC_OFFSET_LEN),
+                      MARC_OFFSET_LEN);
+        dirp += MARC_DIR_SIZE;
+        srcp += MARC_DIR_SIZE;
+    }
+
+    marc_xputnum (outp + MARC_RECLEN_OFF,
+                  marc_xnum (recp + MARC_RECLEN_OFF, MARC_RECLEN_LEN),
+                  MARC_RECLEN_LEN);
+    marc_xputnum (outp + MARC_BASEADDR_OFF,
+                  marc_xnum (recp + MARC_BASEADDR_OFF, MARC_BASEADDR_LEN),
+                  MARC_BASEADDR_LEN);
+
+} /* dir_xputnum */
+
+
+/************************************************************************
+* now_ns ()                                                             *
+*                                                                       *
+*   DEFINITION                                                          *
+*       Read the monotonic clock.                                       *
+*                                                                       *
+*   PASS                                                                *
+*       Nothing.                                                        *
+*                                                                       *
+*   RETURN                                                              *
+*       Time in nanoseconds.                                            *
+************************************************************************/
+
+static double now_ns (void)
+{
+    struct timespec ts;     /* Clock reading            */
+
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+
+} /* now_ns */
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Session post-procs must see the same named buffers with -j or -f
+#   as without.  Tables whose records set buffers the session
+#   post-procs read must be converted serially.
+#
+# usage: sesspost.sh marcconv srcdir workdir -j|-f n
+#
+
+conv=$1; src=$2; work=$3; opt=$4; n=$5
+mkdir -p "$work" || exit 1
+
+rc=0
+for t in sessbuf sessttl; do
+    for run in serial par; do
+        log="$work/$t.$run.log"
+        rm -f "$log"
+        if [ $run = serial ]; then
+            "$conv" -l "$log" "$src/test/sess.mrc" "$work/$t.$run.out" \
+                    "$src/test/$t.tbl" >/dev/null 2>&1
+        else
+            "$conv" $opt $n -l "$log" "$src/test/sess.mrc" \
+                    "$work/$t.$run.out" "$src/test/$t.tbl" >/dev/null 2>&1
+        fi
+        grep -E "seen: |title: " "$log" > "$work/$t.$run.msgs"
+    done
+    if ! cmp -s "$work/$t.serial.msgs" "$work/$t.par.msgs" \
+            || ! cmp -s "$work/$t.serial.out" "$work/$t.par.out"; then
+        echo "$t.tbl: $opt $n differs from serial" >&2
+        diff "$work/$t.serial.msgs" "$work/$t.par.msgs" >&2
+        rc=1
+    fi
+    if ! grep -q "may carry data" "$work/$t.par.log"; then
+        echo "$t.tbl: no warning converting with $opt $n" >&2
+        rc=1
+    fi
+done
+
+exit $rc
@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# marcconv -x must not trust an index built before records were
+#   appended to its marc file.  It should see the index is stale
+#   and rebuild it, with or without -f.
+#
+# usage: staleidx.sh marcconv mkidx rec_count srcdir workdir
+#
+
+conv=$1; mkidx=$2; count=$3; src=$4; work=$5
+mkdir -p "$work" || exit 1
+
+# Records in a file, as rec_count reports them
+nrecs () {
+    "$count" "$1" | sed -n 's/^Number of records: //p'
+}
+
+in="$work/in.mrc"
+rm -f "$in" "$in.idx" "$work/old.idx" "$work/new.idx"
+cp "$src/test/sess.mrc" "$in" || exit 1
+if ! "$mkidx" "$in" "$work/old.idx" >/dev/null; then
+    echo "mkidx failed" >&2
+    exit 1
+fi
+
+rc=0
+
+# Index is good to start with
+cp "$work/old.idx" "$in.idx"
+"$conv" -x -s 6 -l "$work/fresh.log" "$in" "$work/fresh.out" >/dev/null 2>&1
+if [ "$(nrecs "$work/fresh.out")" != 6 ] \
+        || ! cmp -s "$in.idx" "$work/old.idx"; then
+    echo "-x -s 6 with a fresh index: wrong records out or index changed" >&2
+    rc=1
+fi
+
+# Append the records again, the index now ends half way
+cat "$src/test/sess.mrc" >> "$in"
+"$mkidx" "$in" "$work/new.idx" >/dev/null
+
+for opt in "" "-f 2"; do
+    cp "$work/old.idx" "$in.idx"
+    rm -f "$work/stale.log"
+    "$conv" $opt -x -s 18 -l "$work/stale.log" "$in" "$work/stale.out" \
+            >/dev/null 2>&1
+    if [ "$(nrecs "$work/stale.out")" != 6 ]; then
+        echo "-x -s 18${opt:+ $opt} with a stale index: wrong records out" >&2
+        rc=1
+    fi
+    if ! cmp -s "$in.idx" "$work/new.idx"; then
+        echo "-x -s 18${opt:+ $opt}: stale index not rebuilt" >&2
+        rc=1
+    fi
+done
+
+if [ "$(nrecs "$in")" != 24 ]; then
+    echo "rec_count after rebuild: wrong count" >&2
+    rc=1
+fi
+
+exit $rc
@@ -940,8 +940,8 @@ CM_STAT cmp_proc_440 (
 	    *tmpp=toupper(*tmpp);
 	  }
 
-	  if(allocate_n_ncopy(&srca,src_len,1,(char *)tmpp,
-			      NO_COLLAPSE_SPACES,"440$a")!=0)
+	  if(arena_n_ncopy(pp,&srca,src_len,1,(char *)tmpp,
+			      NO_COLLAPSE_SPACES)!=0)
 	    return CM_STAT_KILL_RECORD;
 	  break;
 	  
@@ -950,29 +950,29 @@ CM_STAT cmp_proc_440 (
 	  /*=================================================================*/
 	case 'n':
 	  strcat(sf_order,"n");
-	  if(allocate_n_ncopy(&srcn,src_len,1,(char *)tsrcp,
-			      NO_COLLAPSE_SPACES,"440$n")!=0)
+	  if(arena_n_ncopy(pp,&srcn,src_len,1,(char *)tsrcp,
+			      NO_COLLAPSE_SPACES)!=0)
 	    return CM_STAT_KILL_RECORD;
 	  break;
 	  
 	case 'p':
 	  strcat(sf_order,"p");
-	  if(allocate_n_ncopy(&srcp,src_len,1,(char *)tsrcp,
-			      NO_COLLAPSE_SPACES,"440$p")!=0)
+	  if(arena_n_ncopy(pp,&srcp,src_len,1,(char *)tsrcp,
+			      NO_COLLAPSE_SPACES)!=0)
 	    return CM_STAT_KILL_RECORD;
 	  break;
 	  
 	case 'v':
 	  strcat(sf_order,"v");
-	  if(allocate_n_ncopy(&srcv,src_len,1,(char *)tsrcp,
-			      NO_COLLAPSE_SPACES,"440$v")!=0)
+	  if(arena_n_ncopy(pp,&srcv,src_len,1,(char *)tsrcp,
+			      NO_COLLAPSE_SPACES)!=0)
 	    return CM_STAT_KILL_RECORD;
 	  break;
 	  
 	case 'x':
 	  strcat(sf_order,"x");
-	  if(allocate_n_ncopy(&srcx,src_len,1,(char *)tsrcp,
-			      NO_COLLAPSE_SPACES,"440$x")!=0)
+	  if(arena_n_ncopy(pp,&srcx,src_len,1,(char *)tsrcp,
+			      NO_COLLAPSE_SPACES)!=0)
 	    return CM_STAT_KILL_RECORD;
 	  break;
 	  
@@ -1295,8 +1295,8 @@ CM_STAT cmp_proc_650 (
     /*=======================================================================*/
     /* We want to look at the $a data...                                     */
     /*=======================================================================*/
-    if(allocate_n_ncopy(&srca,tsrc_len,1,(char *)tsrcp,
-			NO_COLLAPSE_SPACES,pp->args[0])!=0)
+    if(arena_n_ncopy(pp,&srca,tsrc_len,1,(char *)tsrcp,
+			NO_COLLAPSE_SPACES)!=0)
       return CM_STAT_KILL_RECORD;
 
     srcp = srca+tsrc_len-1;
@@ -1320,8 +1320,8 @@ CM_STAT cmp_proc_650 (
     /*=======================================================================*/
     if(tmp1len>0) {
       
-      if(allocate_n_ncopy(&srcx,tmp1len,1,(char *)tmp1,
-			  NO_COLLAPSE_SPACES,pp->args[0])!=0)
+      if(arena_n_ncopy(pp,&srcx,tmp1len,1,(char *)tmp1,
+			  NO_COLLAPSE_SPACES)!=0)
 	return CM_STAT_KILL_RECORD;
       
       srcp = srcx+tmp1len-1;
@@ -1332,13 +1332,12 @@ CM_STAT cmp_proc_650 (
 	sfxlen=strlen(srcx);
       }
       
-     if(allocate_n_ncopy(&src2,sfalen,sfxlen+1,(char *)srca,
-			  NO_COLLAPSE_SPACES,pp->args[0])!=0)
+     if(arena_n_ncopy(pp,&src2,sfalen,sfxlen+1,(char *)srca,
+			  NO_COLLAPSE_SPACES)!=0)
 	return CM_STAT_KILL_RECORD;
       
       strcat(src2,"!");
       strncat(src2,srcx,sfxlen);
-      free(srcx);
 
       srcp=src2;
       src_len=sfalen+sfxlen+1;
@@ -1370,7 +1369,6 @@ CM_STAT cmp_proc_650 (
 	/* If not, copy field over as-is...                                    */  
 	/*=====================================================================*/
 	marc_put_field(pp,tagno,-1);
-	free(src2);
 	continue;
       }
       else {
@@ -1919,9 +1917,8 @@ char *concat_sfs (
     if(*tmpp=='@') {
       tmpp++;
       if(marc_get_indic(pp->inmp,*tmpp,&ind)==0) {
-	if(allocate_n_ncopy(&tmp2, outlen, 5, outp,
-			    NO_COLLAPSE_SPACES,"concat_sfs")==0) {
-	  free(outp);
+	if(arena_n_ncopy(pp,&tmp2, outlen, 5, outp,
+			    NO_COLLAPSE_SPACES)==0) {
 	  outp=tmp2;
 	  printf(delim,"@%c",31+tmpp-sfs);
 	  strcat(outp,delim);
@@ -1937,10 +1934,9 @@ char *concat_sfs (
     else {
       if(marc_get_item(pp->inmp,tag,occ,*tmpp,0,&tsrc1,&src1len)==0) {
 	
-	if(allocate_n_ncopy(&tmp2,outlen,src1len+4,outp,
-			    NO_COLLAPSE_SPACES,"concat_sfs")==0) {
+	if(arena_n_ncopy(pp,&tmp2,outlen,src1len+4,outp,
+			    NO_COLLAPSE_SPACES)==0) {
 	  
-	  free(outp);
 	  outp=tmp2;
 	  printf(delim,"\\%c",31+tmpp-sfs);
 	  strcat(outp,delim);
@@ -2385,8 +2381,8 @@ CM_STAT cmp_reorder_650_1 (
       srtsfa = (char *) tsrcp;
     
     if(marc_get_item(pp->inmp,tag,occ,'x',0,&tsrc2,&tsrclen)==0) {
-      if(allocate_n_ncopy(&src2,srtalen,tsrclen+1,(char *)tsrcp,
-			  NO_COLLAPSE_SPACES,"650")!=0)
+      if(arena_n_ncopy(pp,&src2,srtalen,tsrclen+1,(char *)tsrcp,
+			  NO_COLLAPSE_SPACES)!=0)
 	return CM_STAT_KILL_RECORD;
       
       strcat(src2,"!");
@@ -2426,24 +2422,6 @@ CM_STAT cmp_reorder_650_1 (
     /*=======================================================================*/
     marc_put_field(pp,tag,-1);
 
-    /*=======================================================================*/
-    /* Release memory for sort fields...                                     */
-    /*=======================================================================*/
-    if(sort_650_array[occ].srtind1)
-      free(sort_650_array[occ].srtind1);
-
-    if(sort_650_array[occ].srtind2)
-      free(sort_650_array[occ].srtind2);
-
-    if(sort_650_array[occ].srtsf8)
-      free(sort_650_array[occ].srtsf8);
-
-    if(sort_650_array[occ].srtsf2e)
-      free(sort_650_array[occ].srtsf2e);
-
-    if(sort_650_array[occ].srtsfa)
-      free(sort_650_array[occ].srtsfa);
-
   }
 
   return CM_STAT_OK;
@@ -2492,7 +2470,7 @@ void add_to_650_array(CM_PROC_PARMS *pp,
   /* Allocate and copy each sort field over to a separate area of memory...  */
   /*=========================================================================*/
   if(ind1) {
-    if(allocate_n_ncopy(&tmp1,len1,1,ind1,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp1,len1,1,ind1,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp1;*tmpp;tmpp++)
@@ -2500,7 +2478,7 @@ void add_to_650_array(CM_PROC_PARMS *pp,
   }
   
   if(ind2) {
-    if(allocate_n_ncopy(&tmp2,len2,1,ind2,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp2,len2,1,ind2,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp2;*tmpp;tmpp++)
@@ -2508,7 +2486,7 @@ void add_to_650_array(CM_PROC_PARMS *pp,
   }
 
   if(sf8) {
-    if(allocate_n_ncopy(&tmp3,lensf8,1,sf8,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp3,lensf8,1,sf8,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp3;*tmpp;tmpp++)
@@ -2516,7 +2494,7 @@ void add_to_650_array(CM_PROC_PARMS *pp,
   }
 
   if(sfe) {
-    if(allocate_n_ncopy(&tmp4,lensfe,1,sfe,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp4,lensfe,1,sfe,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp4;*tmpp;tmpp++)
@@ -2524,7 +2502,7 @@ void add_to_650_array(CM_PROC_PARMS *pp,
   }
 
   if(sfa) {
-    if(allocate_n_ncopy(&tmp5,lensfa,1,sfa,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp5,lensfa,1,sfa,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp5;*tmpp;tmpp++)
@@ -3139,12 +3117,6 @@ CM_STAT cmp_dedupe_655_9 (
 	}
       }
     }
-    
-    if(src1)
-      free(src1);
-    
-    if(src2)
-      free(src2);
   }
   
   return CM_STAT_OK;
@@ -3281,24 +3253,6 @@ CM_STAT cmp_reorder_655_9 (
     /*=======================================================================*/
     marc_put_field(pp,tag,-1);
 
-    /*=======================================================================*/
-    /* Release memory for sort fields...                                     */
-    /*=======================================================================*/
-    if(sort_655_array[occ].srtind1)
-      free(sort_655_array[occ].srtind1);
-
-    if(sort_655_array[occ].srtind2)
-      free(sort_655_array[occ].srtind2);
-
-    if(sort_655_array[occ].srtsf8)
-      free(sort_655_array[occ].srtsf8);
-
-    if(sort_655_array[occ].srtsf2e)
-      free(sort_655_array[occ].srtsf2e);
-
-    if(sort_655_array[occ].srtsfa)
-      free(sort_655_array[occ].srtsfa);
-
   }
 
   return CM_STAT_OK;
@@ -3347,7 +3301,7 @@ void add_to_655_array(CM_PROC_PARMS *pp,
   /* Allocate and copy each sort field over to a separate area of memory...  */
   /*=========================================================================*/
   if(ind1) {
-    if(allocate_n_ncopy(&tmp1,len1,1,ind1,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp1,len1,1,ind1,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp1;*tmpp;tmpp++)
@@ -3355,7 +3309,7 @@ void add_to_655_array(CM_PROC_PARMS *pp,
   }
   
   if(ind2) {
-    if(allocate_n_ncopy(&tmp2,len2,1,ind2,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp2,len2,1,ind2,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp2;*tmpp;tmpp++)
@@ -3363,7 +3317,7 @@ void add_to_655_array(CM_PROC_PARMS *pp,
   }
 
   if(sf8) {
-    if(allocate_n_ncopy(&tmp3,lensf8,1,sf8,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp3,lensf8,1,sf8,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp3;*tmpp;tmpp++)
@@ -3371,7 +3325,7 @@ void add_to_655_array(CM_PROC_PARMS *pp,
   }
 
   if(sf2) {
-    if(allocate_n_ncopy(&tmp4,lensf2,1,sf2,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp4,lensf2,1,sf2,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp4;*tmpp;tmpp++)
@@ -3379,7 +3333,7 @@ void add_to_655_array(CM_PROC_PARMS *pp,
   }
 
   if(sfa) {
-    if(allocate_n_ncopy(&tmp5,lensfa,1,sfa,NO_COLLAPSE_SPACES,"6XX")!=0)
+    if(arena_n_ncopy(pp,&tmp5,lensfa,1,sfa,NO_COLLAPSE_SPACES)!=0)
       cm_error(CM_FATAL,"Error allocating memory in sort 6xx");
 
     for(tmpp=tmp5;*tmpp;tmpp++)